@@ -282,10 +282,14 @@ kevent_hook(int kq, const struct kevent *changelist, int nchanges,
   write(g_main_thread_pipe_fd, "~", 1);
 
   // Run the event loop (blocking on the mach port for window messages).
-  NSEvent* event = [NSApp nextEventMatchingMask:NSAnyEventMask
-                          untilDate:[NSDate dateWithTimeIntervalSinceNow:ts]
-                          inMode:NSDefaultRunLoopMode // kCFRunLoopDefaultMode
-                          dequeue:YES];
+  NSEvent* event;
+  {
+    PLASK_TRACE_EVENT("loop", "wait");
+    event = [NSApp nextEventMatchingMask:NSAnyEventMask
+                   untilDate:[NSDate dateWithTimeIntervalSinceNow:ts]
+                   inMode:NSDefaultRunLoopMode // kCFRunLoopDefaultMode
+                   dequeue:YES];
+  }
 
   // Stop the helper thread if it hasn't already woken up (in which case it
   // would have already stopped itself).
@@ -306,6 +310,7 @@ kevent_hook(int kq, const struct kevent *changelist, int nchanges,
       // A wakeup after the kqueue callback.
       EVENTLOOP_DEBUG_C((printf("* Wakeup event.\n")));
     } else {
+      PLASK_TRACE_EVENT("loop", "sendEvent");
       [event retain];
       [NSApp sendEvent:event];
       [event release];
@@ -327,7 +332,9 @@ kevent_hook(int kq, const struct kevent *changelist, int nchanges,
 }
 
 int main(int argc, char** argv) {
+  plask_startup_mark("main");
   NSAutoreleasePool* pool = [NSAutoreleasePool new];
+  plask_trace_set_thread_name("Main");
   [NSApplication sharedApplication];  // Make sure NSApp is initialized.
 
   InitMenuBar();
@@ -376,6 +383,7 @@ int main(int argc, char** argv) {
   {
     v8::Isolate::Scope isolate_scope(isolate);
     v8::V8::Initialize();
+    plask_startup_mark("v8");
 
     v8::Locker locker(isolate);
     v8::HandleScope handle_scope(isolate);
@@ -387,9 +395,11 @@ int main(int argc, char** argv) {
     plask_setup_bindings(isolate, plask_raw);
     context->Global()->Set(v8::String::NewFromUtf8(isolate, "PlaskRawMac"),
                            plask_raw->NewInstance());
+    plask_startup_mark("bindings");
 
     node::Environment* env = node::CreateEnvironment(
         isolate, context, argc, argv, exec_argc, exec_argv);
+    plask_startup_mark("script");  // The main script has been run.
 
     {
 
@@ -423,7 +433,10 @@ int main(int argc, char** argv) {
       while (!g_should_quit && more) {
         NSAutoreleasePool* looppool = [NSAutoreleasePool new];
         EVENTLOOP_DEBUG_C((printf("-> uv_run_once\n")));
-        more = uv_run(uvloop, UV_RUN_ONCE);
+        {
+          PLASK_TRACE_EVENT("loop", "uv_run");
+          more = uv_run(uvloop, UV_RUN_ONCE);
+        }
         EVENTLOOP_DEBUG_C((printf("<- uv_run_once\n")));
         EVENTLOOP_DEBUG_C((printf(" - handles: %d\n", uvloop->active_handles)));
         if (more == false) {
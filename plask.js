@@ -57,6 +57,323 @@ exports.SkCanvas.create = function(width, height) {
   return new exports.SkCanvas(width, height);
 };
 
+// static SkCanvas createCopyOnWrite(SkCanvas canvas)
+//
+// Create a copy of a bitmap `canvas` that shares its pixels until either of
+// them is drawn to (or has its matrix, clip or save stack changed), rather
+// than copying them up front like `new SkCanvas(canvas)`.  Writes through
+// pixel indexing (`canvas[i] = v` or `copy[i] = v`) don't unshare, so they
+// are seen by the source and every copy still sharing with it.  Draw to a
+// canvas before writing its pixels directly (`c.save(); c.restore();` is
+// enough), or use a plain copy.
+exports.SkCanvas.createCopyOnWrite = function(canvas) {
+  return new exports.SkCanvas('^COW', canvas);
+};
+
+// static SkCanvas createFromPack(pack, name)
+//
+// Create a bitmap SkCanvas over the image `name` in an asset pack (see
+// AssetPack).  Nothing is decoded or copied, the canvas uses the pack's mapped
+// pixels, which are read in from disk as they are touched.  `pack` is an
+// AssetPack or a filename, which opens the pack for just this canvas, so open
+// it once with AssetPack.open when loading several.  Like a copy-on-write
+// copy, the canvas moves to pixels of its own when first drawn to, so write
+// its pixels directly (`canvas[i] = v`) only after drawing to it.
+exports.SkCanvas.createFromPack = function(pack, name) {
+  if (typeof pack === 'string') pack = exports.AssetPack.open(pack);
+  return new exports.SkCanvas('^PAK', pack, name);
+};
+
+// AssetPack
+//
+// A single file of pre-decoded images (premultiplied BGRA, as a canvas holds
+// them), and optionally compressed texture data, for loading many assets with
+// no decoding.  Build one with AssetPack.write or tools/pack_assets.js, then
+// load images with SkCanvas.createFromPack, and compressed textures with
+// pack.data(name).  Methods: names(), entry(name), data(name), prefetch(name).
+exports.AssetPack = PlaskRawMac.PlaskAssetPack;
+
+var kAssetPackAlignment = 16384;  // A multiple of both 4k and 16k pages.
+
+// static AssetPack open(filename)
+//
+// Open and map the pack `filename`.  Each call maps it again, keep the pack
+// around rather than opening it per load.  The mapping goes once the pack and
+// every canvas over it are collected.
+exports.AssetPack.open = function(filename) {
+  return new exports.AssetPack(filename);
+};
+
+function writeUInt64LE(buf, value, offset) {
+  buf.writeUInt32LE(value % 4294967296, offset);
+  buf.writeUInt32LE(Math.floor(value / 4294967296), offset + 4);
+}
+
+// static object write(filename, assets)
+//
+// Write the asset pack `filename`.  `assets` is an array of entries, either
+// {name, canvas} for a bitmap SkCanvas, {name, path} for an image file, or
+// {name, data, format, width, height} for compressed texture data, where
+// `data` is a Uint8Array and `format` its GL internal format.  Returns
+// {count, byteLength}.  See plask_bindings.mm for the file format.
+exports.AssetPack.write = function(filename, assets) {
+  var seen = { };
+  var index = [ ];
+  var offset = kAssetPackAlignment;  // After the header's page.
+  var index_bytes = 0;
+
+  var fd = fs.openSync(filename, 'w');
+  try {
+    for (var i = 0, il = assets.length; i < il; ++i) {
+      var asset = assets[i];
+      var name = String(asset.name);
+      if (seen.hasOwnProperty(name))
+        throw new Error('Asset name used twice: ' + name);
+      seen[name] = true;
+
+      var entry = {name: new Buffer(name, 'utf8'), offset: offset};
+      var bytes;
+      var canvas = asset.path !== undefined ?
+          exports.SkCanvas.createFromImage(asset.path) : asset.canvas;
+      if (canvas !== undefined) {
+        entry.format = exports.AssetPack.FORMAT_BGRA;
+        entry.width = canvas.width;
+        entry.height = canvas.height;
+        bytes = new Buffer(canvas.width * canvas.height * 4);
+        for (var j = 0, jl = bytes.length; j < jl; ++j) bytes[j] = canvas[j];
+        if (asset.path !== undefined) canvas.dispose();
+      } else {
+        entry.format = asset.format;
+        entry.width = asset.width | 0;
+        entry.height = asset.height | 0;
+        bytes = new Buffer(asset.data);
+      }
+      entry.bytes = bytes.length;
+
+      fs.writeSync(fd, bytes, 0, bytes.length, offset);
+      offset += Math.ceil(bytes.length / kAssetPackAlignment) * kAssetPackAlignment;
+      index_bytes += 4 + ((entry.name.length + 3) & ~3) + 28;
+      index.push(entry);
+    }
+
+    var buf = new Buffer(index_bytes);
+    buf.fill(0);
+    for (var i = 0, pos = 0, il = index.length; i < il; ++i) {
+      var entry = index[i];
+      buf.writeUInt32LE(entry.name.length, pos);
+      entry.name.copy(buf, pos + 4);
+      pos += 4 + ((entry.name.length + 3) & ~3);
+      buf.writeUInt32LE(entry.format, pos);
+      buf.writeUInt32LE(entry.width, pos + 4);
+      buf.writeUInt32LE(entry.height, pos + 8);
+      writeUInt64LE(buf, entry.offset, pos + 12);
+      writeUInt64LE(buf, entry.bytes, pos + 20);
+      pos += 28;
+    }
+    fs.writeSync(fd, buf, 0, buf.length, offset);
+
+    var header = new Buffer(40);
+    header.fill(0);
+    header.write('PLASKPAK', 0, 'ascii');
+    header.writeUInt32LE(1, 8);  // Version.
+    header.writeUInt32LE(index.length, 12);
+    header.writeUInt32LE(kAssetPackAlignment, 16);
+    writeUInt64LE(header, offset, 24);
+    writeUInt64LE(header, index_bytes, 32);
+    fs.writeSync(fd, header, 0, header.length, 0);
+  } finally {
+    fs.closeSync(fd);
+  }
+  return {count: index.length, byteLength: offset + index_bytes};
+};
+
+// FrameSequencePlayer
+//
+// Plays a sequence of image files, ex. the frames of a render, decoding ahead
+// of the playhead on background threads into a bounded cache, so showing a
+// frame is a copy rather than a decode.  There is no clock, move the playhead
+// with seek(frame), step(delta) or setFrame(frame) from whatever drives the
+// sketch (a timer, MIDI clock, ...), then deliver the current frame with
+// copyToCanvas(canvas, wait) or texImage2D(target, level, wait).  Without
+// `wait` a frame that isn't decoded yet isn't delivered, and counts as a miss.
+// stats() reports cache hits and misses and dropped frames.  Also frame(),
+// isReady(), frameSize(wait), resetStats() and close().
+exports.FrameSequencePlayer = PlaskRawMac.PlaskFrameSequencePlayer;
+
+// Expand a printf style frame pattern, ex. 'out/frame_%05d.png'.
+function frameSequenceFilenames(pattern, first, count) {
+  var match = /%(0?)(\d*)d/.exec(pattern);
+  if (match === null) throw 'Expected a %d in the frame pattern.';
+  var width = match[2] === '' ? 0 : parseInt(match[2], 10);
+  var fill = match[1] === '0' ? '0' : ' ';
+  var filenames = [ ];
+  for (var i = first; count === undefined || i < first + count; ++i) {
+    var num = '' + i;
+    while (num.length < width) num = fill + num;
+    var filename = pattern.replace(match[0], num);
+    if (count === undefined && !fs.existsSync(filename)) break;
+    filenames.push(filename);
+  }
+  return filenames;
+}
+
+// static FrameSequencePlayer create(frames, opts)
+//
+// `frames` is an array of filenames, or a pattern like 'out/frame_%05d.png'
+// numbered from `opts.first` (default 0) for `opts.count` frames (default up
+// to the first missing file).  Options:
+//   window   Frames kept decoded ahead of the playhead (default 8).
+//   threads  Decode threads (default one less than the CPUs, at most window).
+//   loop     Whether the sequence wraps around at the ends (default false).
+exports.FrameSequencePlayer.create = function(frames, opts) {
+  opts = opts || { };
+  if (typeof frames === 'string')
+    frames = frameSequenceFilenames(frames, opts.first || 0, opts.count);
+  return new exports.FrameSequencePlayer(frames, opts.window, opts.threads,
+                                         opts.loop === true);
+};
+
+// SkCanvas toCanvas(wait)
+//
+// The current frame as a new bitmap SkCanvas, or null if it isn't decoded
+// yet and `wait` isn't true.
+exports.FrameSequencePlayer.prototype.toCanvas = function(wait) {
+  var size = this.frameSize(wait === true);
+  if (size === null) return null;
+  var canvas = exports.SkCanvas.create(size.width, size.height);
+  this.copyToCanvas(canvas, true);  // Already decoded.
+  return canvas;
+};
+
+// Noise
+//
+// Simplex and Perlin noise in 2, 3 and 4 dimensions, with fBm (summed
+// octaves) and turbulence, computed natively for flow fields, terrain and
+// textures where sampling noise per point in JavaScript is too slow.  Fill a
+// Float32Array with a grid (fill) or at a list of points (fillPoints), or
+// draw a grid straight into a bitmap SkCanvas (draw), optionally split over
+// threads.  noise(x, y, z, w) samples a single point.  Simplex noise is
+// about -1 to 1, Perlin a bit less, and turbulence 0 to 1.
+exports.Noise = PlaskRawMac.PlaskNoise;
+
+// static Noise create(opts)
+//
+// Options:
+//   type        'simplex' (default) or 'perlin'.
+//   seed        Integer that shuffles the gradients (default 0).
+//   octaves     Octaves summed for fBm (default 1, just the noise).
+//   lacunarity  Frequency multiplier from one octave to the next (default 2).
+//   gain        Amplitude multiplier from one octave to the next (default 0.5).
+//   turbulence  Sum the octaves' absolute values instead (default false).
+exports.Noise.create = function(opts) {
+  opts = opts || { };
+  var Noise = exports.Noise;
+  var type = opts.type === 'perlin' ? Noise.PERLIN : Noise.SIMPLEX;
+  if (opts.type !== undefined && opts.type !== 'perlin' && opts.type !== 'simplex')
+    throw new Error('Unknown noise type: ' + opts.type);
+  return new Noise(type, opts.seed | 0, opts.octaves, opts.lacunarity,
+                   opts.gain, opts.turbulence === true);
+};
+
+// The fillGrid / drawGrid arguments after the output, for grid `opts`.
+function noiseGridArgs(opts, width) {
+  var scale = opts.scale !== undefined ? opts.scale : 1 / width;
+  return [opts.dims || 2, opts.x || 0, opts.y || 0, opts.z || 0, opts.w || 0,
+          opts.dx !== undefined ? opts.dx : scale,
+          opts.dy !== undefined ? opts.dy : scale];
+}
+
+// Float32Array fill(out, width, height, opts)
+//
+// Fill `out` (a Float32Array of at least `width` x `height`, or null for a new
+// one, which is returned) with a grid of noise, row by row.  Options:
+//   dims        Dimensions, 2 (default), 3 or 4.
+//   x, y, z, w  Position of the first sample (default 0).  Animate with z (or
+//               w for 3D) for noise that evolves over time.
+//   scale       Distance between samples (default 1 / width, so the grid
+//               spans one unit across), or dx and dy separately.
+//   threads     Threads to split the rows over (default 1, 0 for one per CPU).
+exports.Noise.prototype.fill = function(out, width, height, opts) {
+  opts = opts || { };
+  if (out === null) out = new Float32Array(width * height);
+  var args = noiseGridArgs(opts, width);
+  this.fillGrid(out, args[0], width, height, args[1], args[2], args[3],
+                args[4], args[5], args[6], opts.threads);
+  return out;
+};
+
+// void draw(canvas, opts)
+//
+// Draw a grid of noise the size of the bitmap SkCanvas `canvas` into its
+// pixels, as opaque gray.  Takes the fill options, and `min` and `max`, the
+// noise drawn black and white (default -1 and 1, 0 and 1 for turbulence).
+exports.Noise.prototype.draw = function(canvas, opts) {
+  opts = opts || { };
+  var args = noiseGridArgs(opts, canvas.width);
+  var min = opts.min !== undefined ? opts.min : (this.turbulence ? 0 : -1);
+  var max = opts.max !== undefined ? opts.max : 1;
+  this.drawGrid(canvas, args[0], args[1], args[2], args[3], args[4],
+                args[5], args[6], min, max, opts.threads);
+};
+
+// static object packAtlas(canvases, opts)
+//
+// Pack many small SkCanvas images into a single atlas canvas, for drawing
+// with drawAtlas.  Returns {canvas, rects}, where `rects` is a Float32Array
+// holding [left, top, right, bottom] of where each of `canvases` was placed,
+// in the same order, ready to be copied into drawAtlas `srcRects`.
+//
+// Images are packed onto shelves, tallest first.  `opts.width` sets the atlas
+// width (default about square), and `opts.padding` the transparent space
+// left around each image (default 1), which avoids neighbors bleeding in when
+// sprites are drawn with filtering.
+exports.SkCanvas.packAtlas = function(canvases, opts) {
+  var padding = (opts && opts.padding !== undefined) ? opts.padding : 1;
+  var num = canvases.length;
+  var area = 0, max_width = 0;
+  var order = [ ];
+  for (var i = 0; i < num; ++i) {
+    var c = canvases[i];
+    var w = c.width + padding * 2, h = c.height + padding * 2;
+    area += w * h;
+    if (w > max_width) max_width = w;
+    order.push(i);
+  }
+
+  var width = (opts && opts.width) ||
+      Math.max(max_width, Math.ceil(Math.sqrt(area) * 1.1));
+  if (max_width > width) throw 'packAtlas: image wider than the atlas.';
+
+  order.sort(function(a, b) {
+    return canvases[b].height - canvases[a].height || a - b;
+  });
+
+  var rects = new Float32Array(num * 4);
+  var x = 0, y = 0, shelf_height = 0;
+  for (var i = 0; i < num; ++i) {
+    var idx = order[i], c = canvases[idx];
+    var w = c.width + padding * 2, h = c.height + padding * 2;
+    if (x + w > width) {  // Start a new shelf.
+      y += shelf_height;
+      x = 0;
+      shelf_height = 0;
+    }
+    rects[idx * 4 + 0] = x + padding;
+    rects[idx * 4 + 1] = y + padding;
+    rects[idx * 4 + 2] = x + padding + c.width;
+    rects[idx * 4 + 3] = y + padding + c.height;
+    x += w;
+    if (h > shelf_height) shelf_height = h;
+  }
+
+  var atlas = exports.SkCanvas.create(width, Math.max(1, y + shelf_height));
+  atlas.clear(0, 0, 0, 0);
+  for (var i = 0; i < num; ++i)
+    atlas.drawCanvas(null, canvases[i], rects[i * 4], rects[i * 4 + 1]);
+
+  return {canvas: atlas, rects: rects};
+};
+
 // Sizes are in points, at 72 points per inch, letter would be 612x792.
 // That makes A4 about 595x842.
 // TODO(deanm): The sizes are integer, check the right size to use for A4.
@@ -64,6 +381,8 @@ exports.SkCanvas.create = function(width, height) {
 // static SkCanvas createForPDF(filename, page_width, page_height, content_width, content_height)
 //
 // Create a new vector-mode SkCanvas that can be written to a PDF with `writePDF`.
+// The canvas draws to the first page of the document, `nextPage` starts the
+// next page.
 exports.SkCanvas.createForPDF = function(filename, page_width, page_height,
                                          content_width, content_height) {
   return new exports.SkCanvas(
@@ -73,6 +392,281 @@ exports.SkCanvas.createForPDF = function(filename, page_width, page_height,
       content_height === undefined ? page_height : content_height);
 };
 
+// Tracing.
+//
+// Records timed events from the event loop, GL calls, image coding, garbage
+// collection and your own begin() / end() pairs, and exports them in the
+// format understood by chrome://tracing.  For example:
+//
+//   plask.trace.start();
+//   ...
+//   plask.trace.writeFile('/tmp/trace.json');  // Load in chrome://tracing.
+//
+// While tracing is stopped begin() and end() are only a function call and a
+// branch, so they can be left in place.
+var PlaskTrace = PlaskRawMac.PlaskTrace;
+var trace_enabled = false;
+var trace_depth = 0;  // Events opened with begin() and not yet end()ed.
+
+exports.trace = {
+  // void start()
+  start: function() {
+    PlaskTrace.enable();
+    trace_enabled = true;
+  },
+
+  // void stop()
+  //
+  // Stop recording, the events recorded so far are kept until clear().
+  stop: function() {
+    PlaskTrace.disable();
+    trace_enabled = false;
+  },
+
+  // bool isEnabled()
+  isEnabled: function() { return trace_enabled; },
+
+  // void clear()
+  clear: function() { PlaskTrace.clear(); },
+
+  // void begin(string name)
+  //
+  // Open a nested event `name`, closed by the next end().
+  begin: function(name) {
+    if (trace_enabled === true) {
+      PlaskTrace.begin(name);
+      ++trace_depth;
+    }
+  },
+
+  // void end()
+  end: function() {
+    // Events opened before a stop() are still closed properly.
+    if (trace_depth > 0) {
+      --trace_depth;
+      PlaskTrace.end();
+    }
+  },
+
+  // string toJSON()
+  toJSON: function() { return PlaskTrace.toJSON(); },
+
+  // void writeFile(string filename)
+  writeFile: function(filename) {
+    fs.writeFileSync(filename, PlaskTrace.toJSON());
+  }
+};
+
+// object startupTimings()
+//
+// The time in milliseconds since the process was started at which startup
+// reached each phase, in order: 'main' (entered main()), 'v8' (initialized),
+// 'bindings' (native bindings set up), 'plask.js' (loaded), 'script' (the
+// main script has run) and 'firstFrame' (the first simpleWindow frame was
+// drawn).  Phases not reached yet are missing.
+exports.startupTimings = function() {
+  var marks = PlaskTrace.startupMarks();
+  var res = { };
+  for (var i = 0, il = marks.length; i < il; ++i)
+    res[marks[i].name] = marks[i].ms;
+  return res;
+};
+
+var startup_first_frame_marked = false;
+
+// Binding stats.
+//
+// Per method call counts and latency histograms for the NSOpenGLContext,
+// SkCanvas, SkPaint and SkPath bindings.  Collection is off by default, when
+// off the bindings cost about the same as without instrumentation.
+//
+//   plask.stats.setEnabled(true);
+//   ...
+//   console.log(plask.stats());
+var PlaskStats = PlaskRawMac.PlaskStats;
+
+// Estimate the `p` quantile (0 .. 1) in nanoseconds from a log2 histogram,
+// interpolating linearly within the bucket.
+function statsHistogramQuantile(histogram, calls, p) {
+  var target = p * calls, seen = 0;
+  for (var i = 0, il = histogram.length; i < il; ++i) {
+    var count = histogram[i];
+    if (count !== 0 && seen + count >= target) {
+      var lo = i === 0 ? 0 : Math.pow(2, i);
+      return lo + (Math.pow(2, i + 1) - lo) * ((target - seen) / count);
+    }
+    seen += count;
+  }
+  return 0;
+}
+
+// object stats()
+//
+// Returns a snapshot keyed by 'Class.method', for every method called since
+// the last reset, sorted by total time spent.  Each entry has `calls`,
+// `totalMs`, `meanUs`, `maxUs`, estimated `p50Us`, `p90Us` and `p99Us`, and
+// the raw `histogram`, where histogram[i] counts calls that took from 2^i to
+// 2^(i+1) nanoseconds.
+exports.stats = function() {
+  var entries = PlaskStats.snapshot();
+  entries.sort(function(a, b) { return b.totalNs - a.totalNs; });
+  var res = { };
+  for (var i = 0, il = entries.length; i < il; ++i) {
+    var e = entries[i];
+    res[e.className + '.' + e.name] = {
+      calls: e.calls,
+      totalMs: e.totalNs / 1e6,
+      meanUs: e.totalNs / e.calls / 1e3,
+      maxUs: e.maxNs / 1e3,
+      p50Us: statsHistogramQuantile(e.histogram, e.calls, 0.5) / 1e3,
+      p90Us: statsHistogramQuantile(e.histogram, e.calls, 0.9) / 1e3,
+      p99Us: statsHistogramQuantile(e.histogram, e.calls, 0.99) / 1e3,
+      histogram: e.histogram
+    };
+  }
+  return res;
+};
+
+// void stats.reset()
+exports.stats.reset = function() { PlaskStats.reset(); };
+
+// void stats.setEnabled(bool enabled)
+exports.stats.setEnabled = function(enabled) {
+  if (enabled) PlaskStats.enable(); else PlaskStats.disable();
+};
+
+// bool stats.isEnabled()
+exports.stats.isEnabled = function() { return PlaskStats.isEnabled(); };
+
+// Workers.
+//
+// A Worker runs a script on a thread of its own, in a separate JavaScript
+// isolate, for CPU heavy work (simulation, mesh generation, image analysis)
+// that would otherwise hold up drawing.  The worker script can require('plask')
+// for the math, SkPath, SkPaint and bitmap SkCanvas, and require() relative .js
+// files, but has no windows, GL, audio, MIDI, timers or node modules.
+//
+//   // main.js
+//   var worker = new plask.Worker(__dirname + '/mesher.js');
+//   worker.on('message', function(data) { ... data.positions ... });
+//   worker.postMessage({n: 100000});
+//
+//   // mesher.js
+//   onmessage = function(e) {
+//     var positions = new Float32Array(e.data.n * 3);
+//     ...
+//     postMessage({positions: positions});
+//   };
+//
+// Messages are sent as JSON, except for ArrayBuffers and typed arrays, which
+// are transferred instead of copied: the sender's ArrayBuffer is left empty
+// (zero length) and the receiver gets the same memory.  Stats (plask.stats)
+// only cover the main thread.  A worker keeps the process running until it
+// calls close() or terminate() is called.
+var kWorkerViewTypes = {
+  Int8Array: Int8Array, Uint8Array: Uint8Array,
+  Uint8ClampedArray: Uint8ClampedArray, Int16Array: Int16Array,
+  Uint16Array: Uint16Array, Int32Array: Int32Array, Uint32Array: Uint32Array,
+  Float32Array: Float32Array, Float64Array: Float64Array, DataView: DataView
+};
+
+function workerViewType(value) {
+  for (var name in kWorkerViewTypes) {
+    if (value instanceof kWorkerViewTypes[name]) return name;
+  }
+  return null;
+}
+
+// Returns {json, buffers}, with the ArrayBuffers (and the buffers of typed
+// arrays) in `data` replaced by their index in `buffers`.
+function workerEncodeMessage(data) {
+  var buffers = [ ];
+  function bufferIndex(ab) {
+    var i = buffers.indexOf(ab);
+    return i !== -1 ? i : buffers.push(ab) - 1;
+  }
+
+  var json = JSON.stringify(data, function(key, value) {
+    if (value instanceof ArrayBuffer) return {__plask_ab: bufferIndex(value)};
+    if (value !== null && typeof value === 'object' &&
+        value.buffer instanceof ArrayBuffer) {
+      var type = workerViewType(value);
+      if (type !== null) {
+        return {__plask_view: type, ab: bufferIndex(value.buffer),
+                byteOffset: value.byteOffset,
+                length: type === 'DataView' ? value.byteLength : value.length};
+      }
+    }
+    return value;
+  });
+
+  return {json: json === undefined ? 'null' : json, buffers: buffers};
+}
+
+function workerDecodeMessage(json, buffers) {
+  return JSON.parse(json, function(key, value) {
+    if (value !== null && typeof value === 'object') {
+      if (typeof value.__plask_ab === 'number') return buffers[value.__plask_ab];
+      if (typeof value.__plask_view === 'string') {
+        var ctor = kWorkerViewTypes[value.__plask_view];
+        return new ctor(buffers[value.ab], value.byteOffset, value.length);
+      }
+    }
+    return value;
+  });
+}
+
+// new Worker(filename)
+//
+// Start a worker running the script `filename`.  Emits 'message' with the
+// data of each message from the worker, 'error' with an Error for each
+// uncaught exception in the worker (logged if there is no listener), and
+// 'exit' once the worker has finished.
+exports.Worker = function(filename) {
+  events.EventEmitter.call(this);
+  var this_ = this;
+
+  this.worker_ = new PlaskRawMac.PlaskWorker(
+      path.resolve(filename), __filename,
+      path.join(__dirname, 'plask_worker.js'), function(type, json, buffers) {
+    // Since emit is synchronous, we need to catch any exceptions that might
+    // happen during event handlers.
+    try {
+      if (type === 'message') {
+        this_.emit('message', workerDecodeMessage(json, buffers));
+      } else if (type === 'error') {
+        if (this_.listeners('error').length === 0) {
+          console.error('Uncaught exception in worker: ' + json);
+        } else {
+          this_.emit('error', new Error(json));
+        }
+      } else if (type === 'exit') {
+        this_.emit('exit');
+      }
+    } catch(ex) {
+      sys.puts(ex.stack);
+    }
+  });
+};
+inherits(exports.Worker, events.EventEmitter);
+
+// void postMessage(data)
+exports.Worker.prototype.postMessage = function(data) {
+  var encoded = workerEncodeMessage(data);
+  this.worker_.postMessage(encoded.json, encoded.buffers);
+};
+
+// void terminate()
+//
+// Stop the worker right away, even if it is busy.  Messages not yet
+// delivered are dropped.
+exports.Worker.prototype.terminate = function() {
+  this.worker_.terminate();
+};
+
+exports.Worker.encodeMessage = workerEncodeMessage;
+exports.Worker.decodeMessage = workerDecodeMessage;
+
 var kPI   = 3.14159265358979323846264338327950288;
 var kPI2  = 1.57079632679489661923132169163975144;
 var kPI4  = 0.785398163397448309615660845819875721;
@@ -184,6 +778,7 @@ PlaskRawMac.NSOpenGLContext.prototype.texImage2DSkCanvas = function(a, b, c) {
   flipped.scale(1, -1);
   flipped.drawCanvas(flipper_paint, c, 0, 0, width, height);
   var result = this.texImage2DSkCanvasB(a, b, flipped);
+  flipped.dispose();  // Back to the pixel pool for the next upload.
   return result;
 };
 
@@ -191,6 +786,188 @@ PlaskRawMac.NSOpenGLContext.prototype.texImage2DSkCanvasNoFlip = function() {
   return this.texImage2DSkCanvasB.apply(this, arguments);
 };
 
+// Compressed textures
+//
+// S3TC (DXT) textures, from the built-in encoder or from DDS and KTX files.
+// All give a compressed image, {format, width, height, levels}, where `levels`
+// is the mip chain as [{width, height, data}] and `format` the GL internal
+// format, ready for gl.compressedTexImage2DLevels.  S3TC needs the
+// WEBGL_compressed_texture_s3tc extension, which every Mac has.
+exports.CompressedTexture = { };
+
+var kS3TCFormats = {
+  COMPRESSED_RGB_S3TC_DXT1_EXT: 0x83f0,
+  COMPRESSED_RGBA_S3TC_DXT1_EXT: 0x83f1,
+  COMPRESSED_RGBA_S3TC_DXT3_EXT: 0x83f2,
+  COMPRESSED_RGBA_S3TC_DXT5_EXT: 0x83f3
+};
+for (var name in kS3TCFormats)
+  exports.CompressedTexture[name] = kS3TCFormats[name];
+
+// object encode(source, format, opts)
+//
+// Encode `source` as S3TC `format` (ex. COMPRESSED_RGBA_S3TC_DXT5_EXT) on a
+// few threads.  `source` is a bitmap SkCanvas, or {data, width, height} with
+// `data` a Uint8Array of RGBA pixels.  opts:
+//   mipmaps  Make the whole mip chain (default false).
+//   flipY    Flip vertically, so the first row is the bottom (default true for
+//            an SkCanvas, like texImage2DSkCanvas, false otherwise).
+//   threads  Threads to encode on (default one per CPU).
+// Canvas pixels are premultiplied, so they're encoded premultiplied.
+exports.CompressedTexture.encode = function(source, format, opts) {
+  opts = opts || { };
+  var S3TC = PlaskRawMac.PlaskS3TC;
+  var is_canvas = source instanceof exports.SkCanvas;
+  var flip = opts.flipY !== undefined ? opts.flipY : is_canvas;
+  var flags = (flip ? S3TC.FLIP_Y : 0) | (is_canvas ? S3TC.SOURCE_BGRA : 0);
+  var levels = S3TC.encode(is_canvas ? source : source.data,
+                           source.width, source.height, format, flags,
+                           opts.mipmaps === true ? 0 : 1, opts.threads | 0);
+  return {format: format, width: levels[0].width, height: levels[0].height,
+          levels: levels};
+};
+
+// Uint8Array decode(data, width, height, format)
+//
+// Decode S3TC data to RGBA pixels, ex. to check the encoder's quality.
+exports.CompressedTexture.decode = function(data, width, height, format) {
+  return PlaskRawMac.PlaskS3TC.decode(data, width, height, format);
+};
+
+function compressedLevels(data, offset, width, height, format, count, padded) {
+  var levels = [ ];
+  for (var i = 0; i < count; ++i) {
+    var size = PlaskRawMac.PlaskS3TC.imageBytes(format, width, height);
+    if (padded) {  // KTX has each level's size in front of it.
+      var dv = new DataView(data.buffer, data.byteOffset + offset, 4);
+      size = dv.getUint32(0, padded.littleEndian);
+      offset += 4;
+    }
+    if (offset + size > data.byteLength)
+      throw new Error('Compressed texture data is truncated.');
+    levels.push({width: width, height: height,
+                 data: new Uint8Array(data.buffer, data.byteOffset + offset, size)});
+    offset += padded ? (size + 3) & ~3 : size;
+    if (width === 1 && height === 1) break;
+    width = Math.max(1, width >> 1);
+    height = Math.max(1, height >> 1);
+  }
+  return levels;
+}
+
+function toUint8Array(data) {
+  if (data instanceof Uint8Array) return data;
+  if (data instanceof ArrayBuffer) return new Uint8Array(data);
+  return new Uint8Array(data);  // ex. a Buffer, copied.
+}
+
+// object parseDDS(data)
+//
+// Parse a DDS file holding DXT1, DXT3 or DXT5 data (a FourCC or DX10 header)
+// into a compressed image, with every mip level in the file.  `data` is a
+// Uint8Array (or a Buffer), the levels are views onto it.  Cube maps and
+// arrays aren't supported.
+exports.CompressedTexture.parseDDS = function(data) {
+  data = toUint8Array(data);
+  if (data.byteLength < 128)
+    throw new Error('Not a DDS file.');
+  var dv = new DataView(data.buffer, data.byteOffset, data.byteLength);
+  if (dv.getUint32(0, true) !== 0x20534444 || dv.getUint32(4, true) !== 124)
+    throw new Error('Not a DDS file.');
+
+  var kDDSD_MIPMAPCOUNT = 0x20000, kDDPF_ALPHAPIXELS = 0x1,
+      kDDPF_FOURCC = 0x4, kDDSCAPS2_CUBEMAP = 0x200;
+  var flags = dv.getUint32(8, true);
+  var height = dv.getUint32(12, true), width = dv.getUint32(16, true);
+  var mips = (flags & kDDSD_MIPMAPCOUNT) ? Math.max(1, dv.getUint32(28, true)) : 1;
+  var pf_flags = dv.getUint32(80, true), fourcc = dv.getUint32(84, true);
+  var caps2 = dv.getUint32(112, true);
+  if (!(pf_flags & kDDPF_FOURCC))
+    throw new Error('Only compressed DDS files are supported.');
+  if (caps2 & kDDSCAPS2_CUBEMAP)
+    throw new Error('DDS cube maps aren\'t supported.');
+
+  var offset = 128, format;
+  var cc = String.fromCharCode(fourcc & 255, (fourcc >> 8) & 255,
+                               (fourcc >> 16) & 255, fourcc >>> 24);
+  if (cc === 'DX10') {
+    if (data.byteLength < 148) throw new Error('Not a DDS file.');
+    var dxgi = dv.getUint32(128, true), array_size = dv.getUint32(140, true);
+    if (array_size > 1) throw new Error('DDS arrays aren\'t supported.');
+    offset = 148;
+    // BC1, BC2 and BC3, UNORM and UNORM_SRGB (the data is the same).
+    var dxgi_formats = {70: 0x83f1, 71: 0x83f1, 72: 0x83f1,
+                        73: 0x83f2, 74: 0x83f2, 75: 0x83f2,
+                        76: 0x83f3, 77: 0x83f3, 78: 0x83f3};
+    format = dxgi_formats[dxgi];
+  } else if (cc === 'DXT1') {
+    format = (pf_flags & kDDPF_ALPHAPIXELS) ? 0x83f1 : 0x83f0;
+  } else if (cc === 'DXT2' || cc === 'DXT3') {
+    format = 0x83f2;
+  } else if (cc === 'DXT4' || cc === 'DXT5') {
+    format = 0x83f3;
+  }
+  if (format === undefined)
+    throw new Error('Unsupported DDS format: ' + cc + (cc === 'DX10' ? ' ' + dxgi : ''));
+
+  return {format: format, width: width, height: height,
+          levels: compressedLevels(data, offset, width, height, format, mips, null)};
+};
+
+// object parseKTX(data)
+//
+// Parse a KTX (version 1) file of compressed data into a compressed image,
+// with every mip level in the file.  `data` is a Uint8Array (or a Buffer), the
+// levels are views onto it.  Cube maps and arrays aren't supported.
+exports.CompressedTexture.parseKTX = function(data) {
+  data = toUint8Array(data);
+  var kIdentifier = [0xab, 0x4b, 0x54, 0x58, 0x20, 0x31, 0x31, 0xbb,
+                     0x0d, 0x0a, 0x1a, 0x0a];
+  if (data.byteLength < 64)
+    throw new Error('Not a KTX file.');
+  for (var i = 0; i < kIdentifier.length; ++i) {
+    if (data[i] !== kIdentifier[i]) throw new Error('Not a KTX file.');
+  }
+  var dv = new DataView(data.buffer, data.byteOffset, data.byteLength);
+  var le = dv.getUint32(12, true) === 0x04030201;
+  var field = function(i) { return dv.getUint32(16 + i * 4, le); };
+  var gl_type = field(0), internal_format = field(3);
+  var width = field(5), height = Math.max(1, field(6));
+  var array_elements = field(8), faces = field(9);
+  var mips = Math.max(1, field(10)), kv_bytes = field(11);
+  if (gl_type !== 0)
+    throw new Error('Only compressed KTX files are supported.');
+  if (faces !== 1 || array_elements > 1)
+    throw new Error('KTX cube maps and arrays aren\'t supported.');
+
+  return {format: internal_format, width: width, height: height,
+          levels: compressedLevels(data, 64 + kv_bytes, width, height,
+                                   internal_format, mips, {littleEndian: le})};
+};
+
+// object load(filename)
+//
+// Read a DDS or KTX file into a compressed image.
+exports.CompressedTexture.load = function(filename) {
+  var data = toUint8Array(fs.readFileSync(filename));
+  if (data[0] === 0xab && data[1] === 0x4b)  // «KTX
+    return exports.CompressedTexture.parseKTX(data);
+  return exports.CompressedTexture.parseDDS(data);
+};
+
+// void compressedTexImage2DLevels(target, image)
+//
+// Upload every mip level of a compressed image (from CompressedTexture) to
+// the texture bound to `target`.
+PlaskRawMac.NSOpenGLContext.prototype.compressedTexImage2DLevels = function(
+    target, image) {
+  for (var i = 0, il = image.levels.length; i < il; ++i) {
+    var level = image.levels[i];
+    this.compressedTexImage2D(target, i, image.format, level.width,
+                              level.height, 0, level.data);
+  }
+};
+
 PlaskRawMac.CAMIDISource.prototype.noteOn = function(chan, note, vel, ns) {
   return this.sendData([0x90 | (chan & 0xf), note & 0x7f, vel & 0x7f], ns);
 };
@@ -215,6 +992,98 @@ PlaskRawMac.CAMIDISource.prototype.programChange = function(chan, val) {
 
 inherits(PlaskRawMac.CAMIDIDestination, events.EventEmitter);
 
+// string parseMidiMessage(msg, emitter)
+//
+// Parse the raw MIDI bytes in `msg`, which can hold several messages back to
+// back, calling `emitter.emit(type, event)` for each.  Returns null on
+// success, otherwise a string describing the problem.  Used by MidiIn, and
+// exported so the parsing can be tested and benchmarked without a device.
+function parseMidiMessage(msg, emitter) {
+  if (msg.length < 1) return 'Received zero length midi message.';
+
+  // NOTE(deanm): I would have assumed that every MIDI message should come
+  // in as its own 'packet', but for example sending a snapshot from a
+  // UC-33e sends some of the controller messages back to back in the same
+  // packet.  I'm not sure if this is the expected behavior, but we'll
+  // try to handle it...
+
+  // TODO(deanm): Use framing instead of assuming atomic writes on the pipe.
+  for (var j = 0, jl = msg.length; j < jl; ) {
+    if ((msg[j] & 0x80) !== 0x80) {
+      console.trace(msg);
+      console.trace(msg.slice(j));
+      return 'First MIDI byte not a status byte.';
+    }
+
+    var rem = jl - j;  // Number of bytes remaining.
+
+    // NOTE(deanm): We expect MIDI packets are the correct length, for
+    // example 3 bytes for note on and off.  Instead of error checking,
+    // we'll get undefined from msg[] if the message is shorter, maybe
+    // should handle this better, but loads of length checking is annoying.
+    switch (msg[j] & 0xf0) {
+      case 0x80:  // Note off.
+        if (rem < 3) return 'Short noteOff message.';
+        emitter.emit('noteOff', {type:'noteOff',
+                                chan: msg[j+0] & 0x0f,
+                                note: msg[j+1],
+                                vel: msg[j+2]});
+        j += 3; break;
+      case 0x90:  // Note on.
+        if (rem < 3) return 'Short noteOn message.';
+        emitter.emit('noteOn', {type:'noteOn',
+                                chan: msg[j+0] & 0x0f,
+                                note: msg[j+1],
+                                vel: msg[j+2]});
+        j += 3; break;
+      case 0xa0:  // Aftertouch.
+        if (rem < 3) return 'Short aftertouch message.';
+        emitter.emit('aftertouch', {type:'aftertouch',
+                                    chan: msg[j+0] & 0x0f,
+                                    note: msg[j+1],
+                                    pressure: msg[j+2]});
+        j += 3; break;
+      case 0xb0:  // Controller message.
+        if (rem < 3) return 'Short controller message.';
+        emitter.emit('controller', {type:'controller',
+                                    chan: msg[j+0] & 0x0f,
+                                    num: msg[j+1],
+                                    val: msg[j+2]});
+        j += 3; break;
+      case 0xc0:  // Program change.
+        if (rem < 2) return 'Short programChange message.';
+        emitter.emit('programChange', {type:'programChange',
+                                       chan: msg[j+0] & 0x0f,
+                                       num: msg[j+1]});
+        j += 2; break;
+      case 0xd0:  // Channel pressure.
+        if (rem < 2) return 'Short channelPressure message.';
+        emitter.emit('channelPressure', {type:'channelPressure',
+                                         chan: msg[j+0] & 0x0f,
+                                         pressure: msg[j+1]});
+        j += 2; break;
+      case 0xe0:  // Pitch wheel.
+        if (rem < 3) return 'Short pitchWheel message.';
+        emitter.emit('pitchWheel', {type:'pitchWheel',
+                                    chan: msg[j+0] & 0x0f,
+                                    val: (msg[j+2] << 7) | msg[j+1]});
+        j += 3; break;
+      case 0xf0:  // SysEx and the 0xFx messages.
+        if (msg[j] !== 0xf0)
+          return 'Unhandled MIDI status byte: 0x' + msg[j].toString(16);
+        var start = j;
+        while (j+1 < msg.length && msg[j] !== 0xf7) ++j;
+        if (msg[j++] !== 0xf7) return 'Missing expected SysEx termination.';
+        emitter.emit('sysex', {type: 'sysex', data: msg.slice(start, j)});
+        break;
+      default:
+        return 'Unhandled MIDI status byte: 0x' + msg[j].toString(16);
+    }
+  }
+
+  return null;
+}
+
 PlaskRawMac.CAMIDIDestination.prototype.on = function(evname, callback) {
   // TODO(deanm): Move initialization to constructor (need to shim it).
   if (this._sock_initialized !== true) {
@@ -222,94 +1091,8 @@ PlaskRawMac.CAMIDIDestination.prototype.on = function(evname, callback) {
     sock.writable = false;
     var this_ = this;
 
-    function processMessage(msg) {
-      if (msg.length < 1) return 'Received zero length midi message.';
-
-      // NOTE(deanm): I would have assumed that every MIDI message should come
-      // in as its own 'packet', but for example sending a snapshot from a
-      // UC-33e sends some of the controller messages back to back in the same
-      // packet.  I'm not sure if this is the expected behavior, but we'll
-      // try to handle it...
-
-      // TODO(deanm): Use framing instead of assuming atomic writes on the pipe.
-      for (var j = 0, jl = msg.length; j < jl; ) {
-        if ((msg[j] & 0x80) !== 0x80) {
-          console.trace(msg);
-          console.trace(msg.slice(j));
-          return 'First MIDI byte not a status byte.';
-        }
-
-        var rem = jl - j;  // Number of bytes remaining.
-
-        // NOTE(deanm): We expect MIDI packets are the correct length, for
-        // example 3 bytes for note on and off.  Instead of error checking,
-        // we'll get undefined from msg[] if the message is shorter, maybe
-        // should handle this better, but loads of length checking is annoying.
-        switch (msg[j] & 0xf0) {
-          case 0x80:  // Note off.
-            if (rem < 3) return 'Short noteOff message.';
-            this_.emit('noteOff', {type:'noteOff',
-                                  chan: msg[j+0] & 0x0f,
-                                  note: msg[j+1],
-                                  vel: msg[j+2]});
-            j += 3; break;
-          case 0x90:  // Note on.
-            if (rem < 3) return 'Short noteOn message.';
-            this_.emit('noteOn', {type:'noteOn',
-                                  chan: msg[j+0] & 0x0f,
-                                  note: msg[j+1],
-                                  vel: msg[j+2]});
-            j += 3; break;
-          case 0xa0:  // Aftertouch.
-            if (rem < 3) return 'Short aftertouch message.';
-            this_.emit('aftertouch', {type:'aftertouch',
-                                      chan: msg[j+0] & 0x0f,
-                                      note: msg[j+1],
-                                      pressure: msg[j+2]});
-            j += 3; break;
-          case 0xb0:  // Controller message.
-            if (rem < 3) return 'Short controller message.';
-            this_.emit('controller', {type:'controller',
-                                      chan: msg[j+0] & 0x0f,
-                                      num: msg[j+1],
-                                      val: msg[j+2]});
-            j += 3; break;
-          case 0xc0:  // Program change.
-            if (rem < 2) return 'Short programChange message.';
-            this_.emit('programChange', {type:'programChange',
-                                         chan: msg[j+0] & 0x0f,
-                                         num: msg[j+1]});
-            j += 2; break;
-          case 0xd0:  // Channel pressure.
-            if (rem < 2) return 'Short channelPressure message.';
-            this_.emit('channelPressure', {type:'channelPressure',
-                                           chan: msg[j+0] & 0x0f,
-                                           pressure: msg[j+1]});
-            j += 2; break;
-          case 0xe0:  // Pitch wheel.
-            if (rem < 3) return 'Short pitchWheel message.';
-            this_.emit('pitchWheel', {type:'pitchWheel',
-                                      chan: msg[j+0] & 0x0f,
-                                      val: (msg[j+2] << 7) | msg[j+1]});
-            j += 3; break;
-          case 0xf0:  // SysEx and the 0xFx messages.
-            if (msg[j] !== 0xf0)
-              return 'Unhandled MIDI status byte: 0x' + msg[j].toString(16);
-            var start = j;
-            while (j+1 < msg.length && msg[j] !== 0xf7) ++j;
-            if (msg[j++] !== 0xf7) return 'Missing expected SysEx termination.';
-            this_.emit('sysex', {type: 'sysex', data: msg.slice(start, j)});
-            break;
-          default:
-            return 'Unhandled MIDI status byte: 0x' + msg[j].toString(16);
-        }
-      }
-
-      return null;
-    }
-
     sock.on('data', function(msg, rinfo) {
-      var res = processMessage(msg);
+      var res = parseMidiMessage(msg, this_);
       if (res !== null) console.log(res);
     });
 
@@ -321,6 +1104,7 @@ PlaskRawMac.CAMIDIDestination.prototype.on = function(evname, callback) {
 
 exports.MidiIn = PlaskRawMac.CAMIDIDestination;
 exports.MidiOut = PlaskRawMac.CAMIDISource;
+exports.parseMidiMessage = parseMidiMessage;
 
 exports.SBApplication = function(bundleid) {
   var sbapp = new PlaskRawMac.SBApplication(bundleid);
@@ -347,6 +1131,296 @@ exports.SBApplication = function(bundleid) {
 
 exports.AppleScript = PlaskRawMac.NSAppleScript;
 
+// About mouse buttons.  One day it will be important to have consistent
+// numbering across platforms.  We name from base 1:
+//  1 left
+//  2 right
+//  3 middle
+//  ... Others (figure out wheel, etc).
+function buttonNumberToName(numBaseOne) {
+  switch (numBaseOne) {
+    case 1: return 'left';
+    case 2: return 'right';
+    case 3: return 'middle';
+    default: return 'button' + numBaseOne;
+  }
+}
+
+function nsEventNameToEmitName(nsname) {
+  switch (nsname) {
+    case PlaskRawMac.NSEvent.NSLeftMouseUp: return 'leftMouseUp';
+    case PlaskRawMac.NSEvent.NSLeftMouseDown: return 'leftMouseDown';
+    case PlaskRawMac.NSEvent.NSRightMouseUp: return 'rightMouseUp';
+    case PlaskRawMac.NSEvent.NSRightMouseDown: return 'rightMouseDown';
+    case PlaskRawMac.NSEvent.NSOtherMouseUp: return 'otherMouseUp';
+    case PlaskRawMac.NSEvent.NSOtherMouseDown: return 'otherMouseDown';
+    case PlaskRawMac.NSEvent.NSLeftMouseDragged: return 'leftMouseDragged';
+    case PlaskRawMac.NSEvent.NSRightMouseDragged: return 'rightMouseDragged';
+    case PlaskRawMac.NSEvent.NSOtherMouseDragged: return 'otherMouseDragged';
+    case PlaskRawMac.NSEvent.NSKeyUp: return 'keyUp';
+    case PlaskRawMac.NSEvent.NSKeyDown: return 'keyDown';
+    case PlaskRawMac.NSEvent.NSScrollWheel: return 'scrollWheel';
+    case PlaskRawMac.NSEvent.NSTabletPoint: return 'tabletPoint';
+    case PlaskRawMac.NSEvent.NSTabletProximity: return 'tabletProximity';
+    case PlaskRawMac.NSEvent.NSMouseMoved: return 'mouseMoved';
+    default: return '';
+  }
+}
+
+// Input event queue.
+//
+// With an EventQueue attached to a Window (the eventQueue option), mouse,
+// drag, scroll and tablet events are decoded natively into records in a ring
+// (see PlaskEventQueue in plask_bindings.mm), and only become events when the
+// queue is drained, usually once per frame.  Draining emits the same events
+// with the same fields as per event delivery, plus `timestamp` in seconds.
+// The event objects are reused from drain to drain, copy what you keep.
+//
+// With coalescing, a run of mouseMoved events, or of drag events for the same
+// button, is delivered as its last event.  dx / dy / dz are summed over the
+// run, and the run is kept at full resolution in the drained records, see
+// historyIndex / historyCount and the record accessors.
+
+var kEventRecordSize = 16;  // kEventRecordSize in plask_bindings.mm.
+var kEvType = 0, kEvTimestamp = 1, kEvX = 2, kEvY = 3, kEvDeltaX = 4,
+    kEvDeltaY = 5, kEvDeltaZ = 6, kEvPressure = 7, kEvButton = 8,
+    kEvClickCount = 9, kEvModifiers = 10, kEvScrollingDeltaX = 11,
+    kEvScrollingDeltaY = 12, kEvFlags = 13, kEvPhase = 14,
+    kEvMomentumPhase = 15;
+var kEvFlagPreciseScrollingDeltas = 1, kEvFlagEnteringProximity = 2;
+
+var kMiddleButtonEventNames = {
+  otherMouseDown: 'middleMouseDown',
+  otherMouseUp: 'middleMouseUp',
+  otherMouseDragged: 'middleMouseDragged'
+};
+
+function eventQueueSetModifiers(te, mods) {
+  var e = PlaskRawMac.NSEvent;
+  te.capslock = (mods & e.NSAlphaShiftKeyMask) !== 0;
+  te.shift = (mods & e.NSShiftKeyMask) !== 0;
+  te.ctrl = (mods & e.NSControlKeyMask) !== 0;
+  te.option = (mods & e.NSAlternateKeyMask) !== 0;
+  te.cmd = (mods & e.NSCommandKeyMask) !== 0;
+  te.function = (mods & e.NSFunctionKeyMask) !== 0;
+}
+
+function eventQueueIsCoalescable(type) {
+  var e = PlaskRawMac.NSEvent;
+  return type === e.NSMouseMoved || type === e.NSLeftMouseDragged ||
+         type === e.NSRightMouseDragged || type === e.NSOtherMouseDragged;
+}
+
+function eventQueueValue(v) { return v === undefined ? 0 : +v; }
+
+// new EventQueue(opts)
+//
+// opts.capacity is the number of records held (default 4096), when it fills
+// the oldest are dropped.  opts.coalesce turns on coalescing.  opts.height and
+// opts.dpiScale map from window points (bottom left origin) to event
+// coordinates (top left origin, pixels), a Window sets them itself.
+exports.EventQueue = function(opts) {
+  if (opts === undefined) opts = { };
+  var capacity = opts.capacity === undefined ? 4096 : opts.capacity;
+  this.native = new PlaskRawMac.PlaskEventQueue(capacity);
+  this.records = new Float64Array(capacity * kEventRecordSize);
+  this.coalesce = opts.coalesce === true;
+  this.height = opts.height === undefined ? 0 : opts.height;
+  this.dpiScale = opts.dpiScale === undefined ? 1 : opts.dpiScale;
+  this.events_ = { };  // Reused event objects, by type.
+};
+
+// void push(object e)
+//
+// Queue a synthetic event, ex. for testing without a window.  The fields of
+// `e` are those of a record, missing fields are 0: type (a PlaskRawMac.NSEvent
+// type), timestamp, x, y (window points, bottom left origin), dx, dy, dz,
+// pressure, button (from 0), clickCount, modifiers, scrollingDeltaX,
+// scrollingDeltaY, precise, entering, phase, momentumPhase.
+exports.EventQueue.prototype.push = function(e) {
+  var v = eventQueueValue;
+  var flags = (e.precise === true ? kEvFlagPreciseScrollingDeltas : 0) |
+              (e.entering === true ? kEvFlagEnteringProximity : 0);
+  this.native.push(v(e.type), v(e.timestamp), v(e.x), v(e.y),
+                   v(e.dx), v(e.dy), v(e.dz), v(e.pressure), v(e.button),
+                   v(e.clickCount), v(e.modifiers), v(e.scrollingDeltaX),
+                   v(e.scrollingDeltaY), flags, v(e.phase),
+                   v(e.momentumPhase));
+};
+
+// int size()
+exports.EventQueue.prototype.size = function() { return this.native.size(); };
+
+// int dropped()
+//
+// The number of records dropped because the queue was full.
+exports.EventQueue.prototype.dropped = function() {
+  return this.native.dropped();
+};
+
+// The accessors for the records of the last drain, by record index, ex. for
+// the coalesced history of an event:
+//   for (var i = e.historyIndex; i < e.historyIndex + e.historyCount; ++i)
+//     line.push(queue.recordX(i), queue.recordY(i));
+
+// float recordX(int index)
+exports.EventQueue.prototype.recordX = function(index) {
+  return this.records[index * kEventRecordSize + kEvX] * this.dpiScale;
+};
+
+// float recordY(int index)
+exports.EventQueue.prototype.recordY = function(index) {
+  return this.height -
+         this.records[index * kEventRecordSize + kEvY] * this.dpiScale;
+};
+
+// float recordPressure(int index)
+exports.EventQueue.prototype.recordPressure = function(index) {
+  return this.records[index * kEventRecordSize + kEvPressure];
+};
+
+// float recordTimestamp(int index)
+exports.EventQueue.prototype.recordTimestamp = function(index) {
+  return this.records[index * kEventRecordSize + kEvTimestamp];
+};
+
+exports.EventQueue.prototype.event_ = function(type_name) {
+  var te = this.events_[type_name];
+  if (te === undefined)
+    te = this.events_[type_name] = {type: type_name};
+  return te;
+};
+
+// Emit the event for the records |first| to |last|, a coalesced run when they
+// differ.
+exports.EventQueue.prototype.emitRecords_ = function(emitter, first, last) {
+  var r = this.records, o = last * kEventRecordSize;
+  var e = PlaskRawMac.NSEvent, scale = this.dpiScale;
+  var type = r[o + kEvType];
+  var type_name = nsEventNameToEmitName(type);
+  var te, button;
+
+  switch (type) {
+    case e.NSLeftMouseDown:
+    case e.NSLeftMouseUp:
+    case e.NSRightMouseDown:
+    case e.NSRightMouseUp:
+    case e.NSOtherMouseDown:
+    case e.NSOtherMouseUp:
+      button = r[o + kEvButton] + 1;  // We work starting from 1.
+      if (button === 3) type_name = kMiddleButtonEventNames[type_name];
+      te = this.event_(type_name);
+      te.x = r[o + kEvX] * scale;
+      te.y = this.height - r[o + kEvY] * scale;
+      te.buttonNumber = button;
+      te.buttonName = buttonNumberToName(button);
+      te.clickCount = r[o + kEvClickCount];
+      eventQueueSetModifiers(te, r[o + kEvModifiers]);
+      te.timestamp = r[o + kEvTimestamp];
+      // Filter out clicks on the title bar.
+      if (te.y < 0) break;
+      emitter.emit(type_name, te);
+      emitter.emit(type === e.NSLeftMouseUp || type === e.NSRightMouseUp ||
+                   type === e.NSOtherMouseUp ? 'mouseUp' : 'mouseDown', te);
+      break;
+    case e.NSLeftMouseDragged:
+    case e.NSRightMouseDragged:
+    case e.NSOtherMouseDragged:
+    case e.NSMouseMoved:
+      var dx = 0, dy = 0, dz = 0;
+      for (var i = first; i <= last; ++i) {
+        var io = i * kEventRecordSize;
+        dx += r[io + kEvDeltaX]; dy += r[io + kEvDeltaY]; dz += r[io + kEvDeltaZ];
+      }
+      var dragged = type !== e.NSMouseMoved;
+      if (dragged === true) {
+        button = r[o + kEvButton] + 1;
+        if (button === 3) type_name = kMiddleButtonEventNames[type_name];
+      }
+      te = this.event_(type_name);
+      te.x = r[o + kEvX] * scale;
+      te.y = this.height - r[o + kEvY] * scale;
+      te.dx = dx * scale;
+      te.dy = dy * scale;  // Doesn't need flip, in device space.
+      te.dz = dz;
+      if (dragged === true) {
+        te.pressure = r[o + kEvPressure];
+        te.buttonNumber = button;
+        te.buttonName = buttonNumberToName(button);
+      }
+      eventQueueSetModifiers(te, r[o + kEvModifiers]);
+      te.timestamp = r[o + kEvTimestamp];
+      te.historyIndex = first;
+      te.historyCount = last - first + 1;
+      if (dragged === false) {
+        emitter.emit(type_name, te);
+        break;
+      }
+      // TODO(deanm): This is wrong if the drag started in the content view.
+      if (te.y < 0) break;
+      emitter.emit(type_name, te);
+      emitter.emit('mouseDragged', te);
+      break;
+    case e.NSTabletPoint:
+      te = this.event_(type_name);
+      te.x = r[o + kEvX] * scale;
+      te.y = this.height - r[o + kEvY] * scale;
+      te.pressure = r[o + kEvPressure];
+      eventQueueSetModifiers(te, r[o + kEvModifiers]);
+      te.timestamp = r[o + kEvTimestamp];
+      emitter.emit(type_name, te);
+      break;
+    case e.NSTabletProximity:
+      te = this.event_(type_name);
+      te.entering = (r[o + kEvFlags] & kEvFlagEnteringProximity) !== 0;
+      te.timestamp = r[o + kEvTimestamp];
+      emitter.emit(type_name, te);
+      break;
+    case e.NSScrollWheel:
+      te = this.event_(type_name);
+      te.x = r[o + kEvX] * scale;
+      te.y = this.height - r[o + kEvY] * scale;
+      te.dx = r[o + kEvDeltaX] * scale;
+      te.dy = r[o + kEvDeltaY] * scale;  // Doesn't need flip, in device space.
+      te.dz = r[o + kEvDeltaZ];
+      te.hasPreciseScrollingDeltas =
+          (r[o + kEvFlags] & kEvFlagPreciseScrollingDeltas) !== 0;
+      te.scrollingDeltaX = r[o + kEvScrollingDeltaX];
+      te.scrollingDeltaY = r[o + kEvScrollingDeltaY];
+      te.phase = r[o + kEvPhase];
+      te.momentumPhase = r[o + kEvMomentumPhase];
+      eventQueueSetModifiers(te, r[o + kEvModifiers]);
+      te.timestamp = r[o + kEvTimestamp];
+      emitter.emit(type_name, te);
+      break;
+    default:
+      break;
+  }
+};
+
+// int drain(EventEmitter emitter)
+//
+// Emit the queued events on `emitter`, returns the number of records drained.
+// The records stay in `records` until the next drain.
+exports.EventQueue.prototype.drain = function(emitter) {
+  var r = this.records;
+  var num = this.native.drain(r);
+  for (var i = 0; i < num; ++i) {
+    var first = i;
+    var type = r[i * kEventRecordSize + kEvType];
+    if (this.coalesce === true && eventQueueIsCoalescable(type) === true) {
+      var button = r[i * kEventRecordSize + kEvButton];
+      while (i + 1 < num &&
+             r[(i + 1) * kEventRecordSize + kEvType] === type &&
+             r[(i + 1) * kEventRecordSize + kEvButton] === button) {
+        ++i;
+      }
+    }
+    this.emitRecords_(emitter, first, i);
+  }
+  return num;
+};
+
 exports.Window = function(width, height, opts) {
   setInterval(function() { }, 999999999);  // Hack to prevent empty event loop.
   var nswindow_ = new PlaskRawMac.NSWindow(
@@ -361,52 +1435,44 @@ exports.Window = function(width, height, opts) {
 
   var dpi_scale = opts.highdpi === 2 ? 2 : 1;  // For scaling mouse events.
 
+  // With an event queue, mouse, scroll and tablet events are queued natively
+  // and emitted by drainEvents(), see EventQueue.  The queue becoming non
+  // empty drains it on the next turn of the event loop, unless something is
+  // already draining it every frame (drainEventsPerFrame).
+  var event_queue = null;
+  var event_drain_handle = null;
+  if (opts.eventQueue !== undefined && opts.eventQueue !== false) {
+    event_queue = new exports.EventQueue(
+        opts.eventQueue === true ? { } : opts.eventQueue);
+    event_queue.height = height;
+    event_queue.dpiScale = dpi_scale;
+    nswindow_.setEventQueue(event_queue.native);
+  }
+  this.eventQueue = event_queue;
+  this.drainEventsPerFrame = false;
+
+  // void drainEvents()
+  this.drainEvents = function() {
+    if (event_queue === null) return;
+    // Since emit is synchronous, we need to catch any exceptions that might
+    // happen during event handlers.
+    try {
+      event_queue.drain(this_);
+    } catch(ex) {
+      sys.puts(ex.stack);
+    }
+  };
+
   this.context = nswindow_.context;  // Export the 3d context (if it exists).
 
   this.width = width; this.height = height;
 
-  // About mouse buttons.  One day it will be important to have consistent
-  // numbering across platforms.  We name from base 1:
-  //  1 left
-  //  2 right
-  //  3 middle
-  //  ... Others (figure out wheel, etc).
-  function buttonNumberToName(numBaseOne) {
-    switch (numBaseOne) {
-      case 1: return 'left';
-      case 2: return 'right';
-      case 3: return 'middle';
-      default: return 'button' + numBaseOne;
-    }
-  }
-
   this.setTitle = function(title) { return nswindow_.setTitle(title); };
   this.setFullscreen = function(fs) { return nswindow_.setFullscreen(fs); };
 
   // This is quite noisy on the event loop if you don't need it.
   //nswindow_.setAcceptsMouseMovedEvents(true);
 
-  function nsEventNameToEmitName(nsname) {
-    switch (nsname) {
-      case PlaskRawMac.NSEvent.NSLeftMouseUp: return 'leftMouseUp';
-      case PlaskRawMac.NSEvent.NSLeftMouseDown: return 'leftMouseDown';
-      case PlaskRawMac.NSEvent.NSRightMouseUp: return 'rightMouseUp';
-      case PlaskRawMac.NSEvent.NSRightMouseDown: return 'rightMouseDown';
-      case PlaskRawMac.NSEvent.NSOtherMouseUp: return 'otherMouseUp';
-      case PlaskRawMac.NSEvent.NSOtherMouseDown: return 'otherMouseDown';
-      case PlaskRawMac.NSEvent.NSLeftMouseDragged: return 'leftMouseDragged';
-      case PlaskRawMac.NSEvent.NSRightMouseDragged: return 'rightMouseDragged';
-      case PlaskRawMac.NSEvent.NSOtherMouseDragged: return 'otherMouseDragged';
-      case PlaskRawMac.NSEvent.NSKeyUp: return 'keyUp';
-      case PlaskRawMac.NSEvent.NSKeyDown: return 'keyDown';
-      case PlaskRawMac.NSEvent.NSScrollWheel: return 'scrollWheel';
-      case PlaskRawMac.NSEvent.NSTabletPoint: return 'tabletPoint';
-      case PlaskRawMac.NSEvent.NSTabletProximity: return 'tabletProximity';
-      case PlaskRawMac.NSEvent.NSMouseMoved: return 'mouseMoved';
-      default: return '';
-    }
-  }
-
   this.setMouseMovedEnabled = function(enabled) {
     return nswindow_.setAcceptsMouseMovedEvents(enabled);
   };
@@ -663,6 +1729,13 @@ exports.Window = function(width, height, opts) {
                                     paths: msgdata.paths,
                                     x: msgdata.x,
                                     y: height - msgdata.y});
+      } else if (msgtype === 2) {  // The event queue stopped being empty.
+        if (this_.drainEventsPerFrame !== true && event_drain_handle === null) {
+          event_drain_handle = setTimeout(function() {
+            event_drain_handle = null;
+            this_.drainEvents();
+          }, 0);
+        }
       }
     } catch(ex) {
       sys.puts(ex.stack);
@@ -703,7 +1776,8 @@ exports.simpleWindow = function(obj) {
                       borderless: settings.borderless === undefined ?
                           settings.fullscreen : settings.borderless,
                       fullscreen: settings.fullscreen,
-                      highdpi: settings.highdpi});
+                      highdpi: settings.highdpi,
+                      eventQueue: settings.eventQueue});
 
   if (settings.position !== undefined) {
     var position_x = settings.position.x;
@@ -774,6 +1848,8 @@ exports.simpleWindow = function(obj) {
   obj.framerate = function(fps) {
     if (framerate_handle !== null)
       clearInterval(framerate_handle);
+    // Queued events are drained at the start of every frame.
+    window_.drainEventsPerFrame = fps !== 0;
     if (fps === 0) return;
     framerate_handle = setInterval(function() {
       obj.redraw();
@@ -820,22 +1896,35 @@ exports.simpleWindow = function(obj) {
     draw = obj.draw;
 
   obj.redraw = function() {
+    var trace = exports.trace;
+    trace.begin('frame');
+    if (window_.eventQueue !== null) {
+      trace.begin('events');
+      window_.drainEvents();
+      trace.end();
+    }
     if (gl_ !== undefined)
       gl_.makeCurrentContext();
     if (draw !== null) {
       obj.framenum = framenum;
       obj.frametime = (Date.now() - frame_start_time) / 1000;  // Secs.
+      trace.begin('draw');
       try {
         obj.draw();
       } catch (ex) {
         sys.error('Exception caught in simpleWindow draw:\n' +
                   ex + '\n' + ex.stack);
       }
+      trace.end();
       framenum++;
     }
 
     // TODO(deanm): For bitmap_canvas too?
-    if (gpu_canvas !== null) gpu_canvas.flush();
+    if (gpu_canvas !== null) {
+      trace.begin('flush');
+      gpu_canvas.flush();
+      trace.end();
+    }
 
     if (bitmap_canvas !== null) {  // 3d2d
       // Blit to Syphon.
@@ -852,6 +1941,7 @@ exports.simpleWindow = function(obj) {
     }
 
     gl_.blit();  // Update the screen automatically.
+    trace.end();
   };
 
   // Sort of a debouncing version of redraw, which is convenient for use in
@@ -870,6 +1960,10 @@ exports.simpleWindow = function(obj) {
   };
 
   obj.redraw();  // Draw the first frame.
+  if (startup_first_frame_marked === false) {
+    PlaskTrace.startupMark('firstFrame');
+    startup_first_frame_marked = true;
+  }
 
   return obj;
 };
@@ -2244,6 +3338,331 @@ MagicProgram.createFromBasename = function(gl, directory, base, opts) {
       opts);
 };
 
+// BatchRenderer
+//
+// Collects draws of many objects and issues them grouped, as one instanced
+// draw per group, instead of a use(), uniform calls and a draw per object.
+// Draws are grouped by program, geometry, textures and the names of their
+// per-instance values.  The per-instance values (ex. each object's model
+// matrix and color) are vertex attributes in the shader, rather than
+// uniforms, and are packed together into an instance buffer:
+//
+//     attribute vec2 a_pos;      // From the geometry.
+//     attribute mat4 i_model;    // Per instance.
+//     attribute vec4 i_color;    // Per instance.
+//     uniform mat4 u_viewproj;   // Shared, set on the program as usual.
+//
+//     var batch = new plask.gl.BatchRenderer(gl);
+//     var quad = {mode: gl.TRIANGLES, count: 6,
+//             attribs: {a_pos: {buffer: quad_buffer, size: 2}}};
+//     for (var i = 0; i < objects.length; ++i)
+//       batch.submit(mp, quad, {i_model: objects[i].model, i_color: objects[i].color});
+//     batch.flush();
+//
+// Uniforms are program state, so a uniform set on a program holds for all of
+// its draws in the batch, values that differ per object have to be instance
+// values.  Groups are drawn in the order of their first submission, so draws
+// are reordered, which is fine for opaque objects with depth testing but not
+// for blended ones that depend on order.  Without instancing (PLASK_WEBGL2)
+// each object is a draw, but still without the binding in between.
+//
+// stats() returns {submitted, issued, groups, flushes}, the objects submitted
+// and the GL draws issued for them since the last resetStats().
+
+var batch_next_id = 1;
+
+// A number identifying |obj| (a program, geometry or texture) in group keys.
+function batchObjectId(obj) {
+  if (!obj.hasOwnProperty('_batch_id'))
+    Object.defineProperty(obj, '_batch_id', {value: batch_next_id++});
+  return obj._batch_id;
+}
+
+// The number of floats per instance for the instance value `value`: a number,
+// Vec2, Vec3, Vec4, Mat3, Mat4, or an array of up to 4 numbers.
+function batchValueSize(value) {
+  if (typeof value === 'number') return 1;
+  if (value instanceof Mat4) return 16;
+  if (value instanceof Mat3) return 9;
+  if (value instanceof Vec4) return 4;
+  if (value instanceof Vec3) return 3;
+  if (value instanceof Vec2) return 2;
+  if (value.length >= 1 && value.length <= 4) return value.length;
+  throw 'BatchRenderer: unsupported instance value.';
+}
+
+// Write the instance value `value` of `size` floats into `data` at `offset`.
+// Matrices are written column major, a column per attribute location.
+function batchPackValue(data, offset, value, size) {
+  switch (size) {
+    case 16:
+      data[offset]      = value.a11; data[offset + 1]  = value.a21;
+      data[offset + 2]  = value.a31; data[offset + 3]  = value.a41;
+      data[offset + 4]  = value.a12; data[offset + 5]  = value.a22;
+      data[offset + 6]  = value.a32; data[offset + 7]  = value.a42;
+      data[offset + 8]  = value.a13; data[offset + 9]  = value.a23;
+      data[offset + 10] = value.a33; data[offset + 11] = value.a43;
+      data[offset + 12] = value.a14; data[offset + 13] = value.a24;
+      data[offset + 14] = value.a34; data[offset + 15] = value.a44;
+      return;
+    case 9:
+      data[offset]     = value.a11; data[offset + 1] = value.a21;
+      data[offset + 2] = value.a31; data[offset + 3] = value.a12;
+      data[offset + 4] = value.a22; data[offset + 5] = value.a32;
+      data[offset + 6] = value.a13; data[offset + 7] = value.a23;
+      data[offset + 8] = value.a33;
+      return;
+  }
+  if (typeof value === 'number') {
+    data[offset] = value;
+  } else if (value instanceof Vec2 || value instanceof Vec3 ||
+             value instanceof Vec4) {
+    data[offset] = value.x; data[offset + 1] = value.y;
+    if (size > 2) data[offset + 2] = value.z;
+    if (size > 3) data[offset + 3] = value.w;
+  } else {
+    for (var i = 0; i < size; ++i) data[offset + i] = value[i];
+  }
+}
+
+// new BatchRenderer(gl, opts)
+//
+// `opts.instanced` false draws each object separately even when instancing
+// is available, ex. to compare.
+function BatchRenderer(gl, opts) {
+  this.gl = gl;
+  this.instanced = typeof gl.drawArraysInstanced === 'function' &&
+                   !(opts && opts.instanced === false);
+  this.buffer = gl.createBuffer();
+  this.data = new Float32Array(4096);
+  this.groups = [ ];  // The groups with draws in this batch, in order.
+  // The groups of the last flush, kept to reuse their arrays.  Groups not
+  // drawn in a flush are dropped, so objects come and go without a leak.
+  this.groups_by_key = { };
+  this.resetStats();
+}
+
+// void submit(program, geometry, instance, textures)
+//
+// Add a draw of `geometry` with the MagicProgram `program`.  `geometry` is
+// {mode, count, first, attribs, indices, indexType}, where `attribs` maps
+// attribute names to {buffer, size, type, normalized, stride, offset}
+// (type defaults to FLOAT), and with `indices` (an ELEMENT_ARRAY_BUFFER) the
+// draw is indexed, `first` then being the byte offset into it.  `instance`
+// maps attribute names to this object's values (see batchValueSize).
+// `textures` is an optional array of textures bound to units 0, 1, ..., as
+// WebGLTextures for TEXTURE_2D or {target, texture}.
+BatchRenderer.prototype.submit = function(program, geometry, instance,
+                                          textures) {
+  var names = Object.keys(instance);
+  // The sizes are in the key too, a value changing size (ex. from a Vec3 to a
+  // Vec4) needs a group with its own layout.
+  var sizes = names.map(function(name) {
+    return batchValueSize(instance[name]);
+  });
+  var key = batchObjectId(program) + ':' + batchObjectId(geometry) + ':' +
+            names.join(',') + ':' + sizes.join(',');
+  if (textures) {
+    for (var i = 0, il = textures.length; i < il; ++i) {
+      var t = textures[i];
+      key += ':' + batchObjectId(t.texture !== undefined ? t.texture : t);
+    }
+  }
+
+  var group = this.groups_by_key[key];
+  if (group === undefined) {
+    names.forEach(function(name) {
+      var loc = program['location_' + name];
+      if (loc === undefined || loc < 0)
+        throw 'BatchRenderer: no attribute ' + name + ' in the program.';
+    });
+    var stride = sizes.reduce(function(a, b) { return a + b; }, 0);
+    group = {key: key, program: program, geometry: geometry,
+             textures: textures, names: names, sizes: sizes, stride: stride,
+             data: new Float32Array(stride * 16), count: 0};
+    this.groups_by_key[key] = group;
+  }
+  if (group.count === 0) this.groups.push(group);
+
+  var offset = group.count * group.stride;
+  if (offset + group.stride > group.data.length) {
+    var data = new Float32Array(group.data.length * 2);
+    data.set(group.data);
+    group.data = data;
+  }
+  for (var i = 0, il = names.length; i < il; ++i) {
+    var size = group.sizes[i];
+    batchPackValue(group.data, offset, instance[names[i]], size);
+    offset += size;
+  }
+  ++group.count;
+  ++this.submitted;
+};
+
+// Bind `geometry`'s attributes for `program`, returns the enabled locations.
+BatchRenderer.prototype.bindGeometry_ = function(program, geometry) {
+  var gl = this.gl;
+  var enabled = [ ];
+  var attribs = geometry.attribs;
+  for (var name in attribs) {
+    var loc = program['location_' + name];
+    if (loc === undefined || loc < 0) continue;
+    var a = attribs[name];
+    gl.bindBuffer(gl.ARRAY_BUFFER, a.buffer);
+    gl.enableVertexAttribArray(loc);
+    gl.vertexAttribPointer(loc, a.size, a.type || gl.FLOAT,
+                           a.normalized === true, a.stride || 0, a.offset || 0);
+    enabled.push(loc);
+  }
+  if (geometry.indices)
+    gl.bindBuffer(gl.ELEMENT_ARRAY_BUFFER, geometry.indices);
+  return enabled;
+};
+
+// Set the constant (non-array) attributes for instance `i` of `group`.
+BatchRenderer.prototype.setInstanceAttribs_ = function(group, i) {
+  var gl = this.gl, data = group.data;
+  var offset = i * group.stride;
+  for (var j = 0, jl = group.names.length; j < jl; ++j) {
+    var loc = group.program['location_' + group.names[j]];
+    var size = group.sizes[j];
+    var columns = size === 16 ? 4 : size === 9 ? 3 : 1;
+    var rows = size / columns;
+    for (var c = 0; c < columns; ++c, offset += rows) {
+      gl.vertexAttrib4f(loc + c, data[offset],
+                        rows > 1 ? data[offset + 1] : 0,
+                        rows > 2 ? data[offset + 2] : 0,
+                        rows > 3 ? data[offset + 3] : 1);
+    }
+  }
+};
+
+// void flush()
+//
+// Issue the draws for everything submitted since the last flush, and start
+// a new batch.  Leaves the last group's program in use, and ARRAY_BUFFER and
+// ELEMENT_ARRAY_BUFFER bound to the last buffers used.
+BatchRenderer.prototype.flush = function() {
+  var gl = this.gl;
+  var groups = this.groups;
+  var groups_by_key = { };
+  for (var i = 0, il = groups.length; i < il; ++i)
+    groups_by_key[groups[i].key] = groups[i];
+  this.groups_by_key = groups_by_key;
+  if (groups.length === 0) return;
+
+  // All of the groups' instance data goes up in one upload.
+  if (this.instanced) {
+    var total = 0;
+    for (var i = 0, il = groups.length; i < il; ++i)
+      total += groups[i].count * groups[i].stride;
+    if (total > this.data.length) {
+      var length = this.data.length;
+      while (length < total) length *= 2;
+      this.data = new Float32Array(length);
+    }
+    var offset = 0;
+    for (var i = 0, il = groups.length; i < il; ++i) {
+      var group = groups[i];
+      var floats = group.count * group.stride;
+      this.data.set(group.data.subarray(0, floats), offset);
+      group.offset = offset * 4;
+      offset += floats;
+    }
+    gl.bindBuffer(gl.ARRAY_BUFFER, this.buffer);
+    gl.bufferData(gl.ARRAY_BUFFER, this.data.subarray(0, total), gl.STREAM_DRAW);
+  }
+
+  for (var i = 0, il = groups.length; i < il; ++i) {
+    var group = groups[i];
+    var program = group.program, geometry = group.geometry;
+    program.use();
+
+    var textures = group.textures;
+    if (textures) {
+      for (var t = 0, tl = textures.length; t < tl; ++t) {
+        var tex = textures[t];
+        gl.activeTexture(gl.TEXTURE0 + t);
+        if (tex.texture !== undefined)
+          gl.bindTexture(tex.target, tex.texture);
+        else
+          gl.bindTexture(gl.TEXTURE_2D, tex);
+      }
+    }
+
+    var enabled = this.bindGeometry_(program, geometry);
+    var mode = geometry.mode, count = geometry.count, first = geometry.first || 0;
+    var index_type = geometry.indexType || gl.UNSIGNED_SHORT;
+
+    if (this.instanced) {
+      gl.bindBuffer(gl.ARRAY_BUFFER, this.buffer);
+      var stride_bytes = group.stride * 4;
+      var offset = group.offset;
+      var divisors = [ ];
+      for (var j = 0, jl = group.names.length; j < jl; ++j) {
+        var loc = program['location_' + group.names[j]];
+        var size = group.sizes[j];
+        var columns = size === 16 ? 4 : size === 9 ? 3 : 1;
+        var rows = size / columns;
+        for (var c = 0; c < columns; ++c, offset += rows * 4) {
+          gl.enableVertexAttribArray(loc + c);
+          gl.vertexAttribPointer(loc + c, rows, gl.FLOAT, false, stride_bytes, offset);
+          gl.vertexAttribDivisor(loc + c, 1);
+          divisors.push(loc + c);
+        }
+      }
+      if (geometry.indices)
+        gl.drawElementsInstanced(mode, count, index_type, first, group.count);
+      else
+        gl.drawArraysInstanced(mode, first, count, group.count);
+      ++this.issued;
+      for (var j = 0, jl = divisors.length; j < jl; ++j) {
+        gl.vertexAttribDivisor(divisors[j], 0);
+        gl.disableVertexAttribArray(divisors[j]);
+      }
+    } else {
+      for (var n = 0; n < group.count; ++n) {
+        this.setInstanceAttribs_(group, n);
+        if (geometry.indices)
+          gl.drawElements(mode, count, index_type, first);
+        else
+          gl.drawArrays(mode, first, count);
+      }
+      this.issued += group.count;
+    }
+
+    for (var j = 0, jl = enabled.length; j < jl; ++j)
+      gl.disableVertexAttribArray(enabled[j]);
+    group.count = 0;
+  }
+
+  this.groups_count += groups.length;
+  ++this.flushes;
+  this.groups = [ ];
+};
+
+// object stats()
+BatchRenderer.prototype.stats = function() {
+  return {submitted: this.submitted, issued: this.issued,
+          groups: this.groups_count, flushes: this.flushes};
+};
+
+// void resetStats()
+BatchRenderer.prototype.resetStats = function() {
+  this.submitted = 0;
+  this.issued = 0;
+  this.groups_count = 0;
+  this.flushes = 0;
+};
+
+// void destroy()
+//
+// Delete the instance buffer.  The renderer can't be used after.
+BatchRenderer.prototype.destroy = function() {
+  this.gl.deleteBuffer(this.buffer);
+  this.buffer = null;
+};
+
 exports.kPI  = kPI;
 exports.kPI2 = kPI2;
 exports.kPI4 = kPI4;
@@ -2270,4 +3689,6 @@ exports.Vec4 = Vec4;
 exports.Mat3 = Mat3;
 exports.Mat4 = Mat4;
 
-exports.gl = {MagicProgram: MagicProgram};
+exports.gl = {MagicProgram: MagicProgram, BatchRenderer: BatchRenderer};
+
+PlaskTrace.startupMark('plask.js');
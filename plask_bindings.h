@@ -19,9 +19,56 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include <stdint.h>
+
 #include "v8.h"
+#include "uv.h"
 
 // Create and install bindings on |obj|.
 void plask_setup_bindings(v8::Isolate* isolate,
                           v8::Handle<v8::ObjectTemplate> obj);
 void plask_teardown_bindings();
+
+// Tracing.
+//
+// A low overhead per-thread ring buffer of timed events, exported on demand
+// as Chrome about:tracing JSON (see PlaskTrace in plask_bindings.mm).  When
+// tracing is disabled a PLASK_TRACE_EVENT costs a single load and branch.
+//
+// The category and name must be string literals, or otherwise live for the
+// lifetime of the process, only the pointers are stored.
+
+extern bool g_plask_trace_enabled;
+
+void plask_trace_set_thread_name(const char* name);
+void plask_trace_add_complete_event(const char* category, const char* name,
+                                    uint64_t start_ns, uint64_t end_ns);
+
+class PlaskScopedTraceEvent {
+ public:
+  PlaskScopedTraceEvent(const char* category, const char* name)
+      : category_(category), name_(name),
+        start_ns_(g_plask_trace_enabled ? uv_hrtime() : 0) { }
+
+  ~PlaskScopedTraceEvent() {
+    if (start_ns_ != 0)
+      plask_trace_add_complete_event(category_, name_, start_ns_, uv_hrtime());
+  }
+
+ private:
+  const char* category_;
+  const char* name_;
+  uint64_t start_ns_;
+};
+
+#define PLASK_TRACE_CONCAT_(a, b) a##b
+#define PLASK_TRACE_CONCAT(a, b) PLASK_TRACE_CONCAT_(a, b)
+
+// Trace the remainder of the current scope.
+#define PLASK_TRACE_EVENT(category, name) \
+  PlaskScopedTraceEvent PLASK_TRACE_CONCAT(plask_trace_event_, __LINE__)( \
+      category, name)
+
+// Record that startup reached phase |name|, see PlaskTrace.startupMarks().
+// Main thread only, |name| must live for the lifetime of the process.
+void plask_startup_mark(const char* name);
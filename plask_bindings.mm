@@ -24,9 +24,15 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>  // mmap
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <unistd.h>  // getpid
+#include <sys/time.h>  // gettimeofday
+#include <sys/sysctl.h>  // Process start time.
 
 #include "v8_utils.h"
 
@@ -34,6 +40,15 @@
 
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
+#include <deque>
+#include <list>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>  // Noise.
+#endif
 
 #if PLASK_OSX
 #include <CoreFoundation/CoreFoundation.h>
@@ -54,6 +69,8 @@
 #include "SkCanvas.h"
 #include "SkColorPriv.h"  // For color ordering.
 #include "SkDevice.h"
+#include "SkImage.h"
+#include "SkRSXform.h"
 #include "SkString.h"
 #include "SkTypeface.h"
 #include "SkUnPreMultiply.h"
@@ -232,11 +249,18 @@ T Clamp(T v, T a, T b) {
 
 @end
 
+namespace {
+class EventQueue;
+}  // namespace
+
 @interface WrappedNSWindow: NSWindow {
   v8::Persistent<v8::Function> event_callback_;
+  v8::Persistent<v8::Object> event_queue_handle_;  // Keeps |event_queue_| alive.
+  EventQueue* event_queue_;
 }
 
 -(void)setEventCallbackWithHandle:(v8::Handle<v8::Function>)func;
+-(void)setEventQueueWithHandle:(v8::Handle<v8::Value>)queue;
 
 @end
 
@@ -247,13 +271,391 @@ T Clamp(T v, T a, T b) {
 
 #endif  // PLASK_OSX
 
+// Tracing.
+//
+// Every thread that records an event gets its own fixed size ring buffer, so
+// recording never takes a lock.  The rings are kept on a global list (under a
+// lock) so they can be found at export time.  When a thread exits its ring is
+// shrunk to just the events it holds, so they can still be exported, and those
+// are freed by clear().  Short lived threads (decoders, noise, ...) don't each
+// leave a whole ring behind.  When a ring fills up the oldest events are
+// overwritten.  Exporting while another thread is recording is best effort,
+// the event being written at that moment might be exported half written.
+
+bool g_plask_trace_enabled = false;
+
+static const uint64_t kTraceRingCapacity = 1 << 16;  // Must be a power of 2.
+static const int kTraceMaxOpenEvents = 64;  // Nesting depth of begin()/end().
+
+struct TraceEvent {
+  const char* category;
+  const char* name;
+  uint64_t start_ns;
+  uint64_t dur_ns;
+};
+
+struct TraceRing {
+  int tid;
+  const char* thread_name;
+  uint64_t num_written;  // Total number of events ever written.
+  bool exited;  // The thread is gone, |events| is just what it had left.
+  uint64_t capacity;
+  TraceRing* next;
+  TraceEvent* events;
+};
+
+struct TraceOpenEvent {
+  const char* name;
+  uint64_t start_ns;
+};
+
+static uv_once_t g_trace_once = UV_ONCE_INIT;
+static uv_mutex_t g_trace_lock;
+static TraceRing* g_trace_rings = NULL;
+static int g_trace_next_tid = 1;
+static uint64_t g_trace_epoch_ns = 0;  // Exported timestamps are relative.
+static std::set<std::string>* g_trace_interned_names = NULL;
+static pthread_key_t g_trace_ring_key;  // Only to be told of thread exit.
+
+static __thread TraceRing* t_trace_ring = NULL;
+static __thread const char* t_trace_thread_name = NULL;
+static __thread uint64_t t_trace_gc_start_ns = 0;
+static __thread int t_trace_num_open = 0;
+static __thread TraceOpenEvent t_trace_open[kTraceMaxOpenEvents];
+
+static void TraceFreeRing(TraceRing* ring) {
+  delete[] ring->events;
+  delete ring;
+}
+
+// Unlink |ring| from g_trace_rings, under g_trace_lock.
+static void TraceUnlinkRing(TraceRing* ring) {
+  TraceRing** link = &g_trace_rings;
+  while (*link != ring)
+    link = &(*link)->next;
+  *link = ring->next;
+}
+
+// A thread with a ring is exiting, after its last event.  The thread's
+// __thread variables might already be gone, so only |arg| is touched.
+static void TraceThreadExit(void* arg) {
+  TraceRing* ring = reinterpret_cast<TraceRing*>(arg);
+
+  uint64_t num_kept = std::min(ring->num_written, kTraceRingCapacity);
+  TraceEvent* kept = num_kept == 0 ? NULL : new TraceEvent[num_kept];
+  uv_mutex_lock(&g_trace_lock);
+  for (uint64_t i = 0; i < num_kept; ++i) {
+    uint64_t index = ring->num_written - num_kept + i;
+    kept[i] = ring->events[index & (kTraceRingCapacity - 1)];
+  }
+  TraceEvent* events = ring->events;
+  ring->events = kept;
+  ring->capacity = num_kept;
+  ring->num_written = num_kept;
+  ring->exited = true;
+  if (num_kept == 0)
+    TraceUnlinkRing(ring);
+  uv_mutex_unlock(&g_trace_lock);
+
+  delete[] events;
+  if (num_kept == 0)
+    TraceFreeRing(ring);
+}
+
+static void TraceInitOnce() {
+  uv_mutex_init(&g_trace_lock);
+  g_trace_interned_names = new std::set<std::string>;
+  pthread_key_create(&g_trace_ring_key, &TraceThreadExit);
+}
+
+static TraceRing* TraceGetThreadRing() {
+  if (t_trace_ring != NULL)
+    return t_trace_ring;
+
+  uv_once(&g_trace_once, &TraceInitOnce);
+  TraceRing* ring = new TraceRing;
+  ring->thread_name = t_trace_thread_name;
+  ring->num_written = 0;
+  ring->exited = false;
+  ring->capacity = kTraceRingCapacity;
+  ring->events = new TraceEvent[kTraceRingCapacity];
+  uv_mutex_lock(&g_trace_lock);
+  ring->tid = g_trace_next_tid++;
+  ring->next = g_trace_rings;
+  g_trace_rings = ring;
+  uv_mutex_unlock(&g_trace_lock);
+  t_trace_ring = ring;
+  pthread_setspecific(g_trace_ring_key, ring);
+  return ring;
+}
+
+void plask_trace_set_thread_name(const char* name) {
+  // The ring is allocated lazily on the first event, don't allocate a ring
+  // for a thread that might never record anything.
+  t_trace_thread_name = name;
+  if (t_trace_ring != NULL)
+    t_trace_ring->thread_name = name;
+}
+
+void plask_trace_add_complete_event(const char* category, const char* name,
+                                    uint64_t start_ns, uint64_t end_ns) {
+  TraceRing* ring = TraceGetThreadRing();
+  TraceEvent* event =
+      &ring->events[ring->num_written & (kTraceRingCapacity - 1)];
+  event->category = category;
+  event->name = name;
+  event->start_ns = start_ns;
+  event->dur_ns = end_ns - start_ns;
+  ++ring->num_written;
+}
+
+// Names coming from JavaScript need to outlive the string they came from.
+// The nodes of a std::set are never moved, so the c_str() stays valid.
+static const char* TraceInternName(const std::string& name) {
+  uv_once(&g_trace_once, &TraceInitOnce);
+  uv_mutex_lock(&g_trace_lock);
+  const char* interned = g_trace_interned_names->insert(name).first->c_str();
+  uv_mutex_unlock(&g_trace_lock);
+  return interned;
+}
+
+static void TraceGCPrologue(v8::Isolate* isolate,
+                            v8::GCType type,
+                            v8::GCCallbackFlags flags) {
+  t_trace_gc_start_ns = uv_hrtime();
+}
+
+static void TraceGCEpilogue(v8::Isolate* isolate,
+                            v8::GCType type,
+                            v8::GCCallbackFlags flags) {
+  if (!g_plask_trace_enabled || t_trace_gc_start_ns == 0)
+    return;
+  plask_trace_add_complete_event(
+      "v8", type == v8::kGCTypeScavenge ? "GC.Scavenge" : "GC.MarkSweepCompact",
+      t_trace_gc_start_ns, uv_hrtime());
+  t_trace_gc_start_ns = 0;
+}
+
+static void TraceEnable(v8::Isolate* isolate) {
+  if (g_plask_trace_enabled)
+    return;
+  if (g_trace_epoch_ns == 0)
+    g_trace_epoch_ns = uv_hrtime();
+  isolate->AddGCPrologueCallback(&TraceGCPrologue);
+  isolate->AddGCEpilogueCallback(&TraceGCEpilogue);
+  g_plask_trace_enabled = true;
+}
+
+static void TraceDisable(v8::Isolate* isolate) {
+  if (!g_plask_trace_enabled)
+    return;
+  g_plask_trace_enabled = false;
+  isolate->RemoveGCPrologueCallback(&TraceGCPrologue);
+  isolate->RemoveGCEpilogueCallback(&TraceGCEpilogue);
+  t_trace_gc_start_ns = 0;
+}
+
+static void TraceClear() {
+  uv_once(&g_trace_once, &TraceInitOnce);
+  uv_mutex_lock(&g_trace_lock);
+  TraceRing* ring = g_trace_rings;
+  while (ring) {
+    TraceRing* next = ring->next;
+    if (ring->exited) {
+      TraceUnlinkRing(ring);
+      TraceFreeRing(ring);
+    } else {
+      ring->num_written = 0;
+    }
+    ring = next;
+  }
+  uv_mutex_unlock(&g_trace_lock);
+}
+
+static void TraceAppendJSONString(std::string* out, const char* str) {
+  out->push_back('"');
+  for (const char* p = str; *p; ++p) {
+    unsigned char c = *p;
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out->append(buf);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+// Export everything recorded so far in the Trace Event Format understood by
+// chrome://tracing, with a complete ("X") event per recorded event.
+static std::string TraceExportJSON() {
+  uv_once(&g_trace_once, &TraceInitOnce);
+  std::string out("{\"traceEvents\":[");
+  int pid = getpid();
+  char buf[128];
+  bool first = true;
+
+  uv_mutex_lock(&g_trace_lock);
+  for (TraceRing* ring = g_trace_rings; ring; ring = ring->next) {
+    if (ring->thread_name != NULL) {
+      snprintf(buf, sizeof(buf),
+               "%s{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\","
+               "\"args\":{\"name\":", first ? "" : ",", pid, ring->tid);
+      out.append(buf);
+      TraceAppendJSONString(&out, ring->thread_name);
+      out.append("}}");
+      first = false;
+    }
+
+    uint64_t num_written = ring->num_written;
+    uint64_t begin = num_written > ring->capacity ?
+        num_written - ring->capacity : 0;
+    for (uint64_t i = begin; i < num_written; ++i) {
+      // A power of 2 while the thread is alive, then just what it kept.
+      const TraceEvent& event = ring->events[i % ring->capacity];
+      // Events recorded before tracing was ever enabled (a scope that was
+      // entered right as tracing was turned on) would have a negative time.
+      if (event.start_ns < g_trace_epoch_ns)
+        continue;
+      out.append(first ? "{\"ph\":\"X\",\"cat\":" : ",{\"ph\":\"X\",\"cat\":");
+      TraceAppendJSONString(&out, event.category);
+      out.append(",\"name\":");
+      TraceAppendJSONString(&out, event.name);
+      snprintf(buf, sizeof(buf),
+               ",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+               pid, ring->tid, (event.start_ns - g_trace_epoch_ns) / 1000.0,
+               event.dur_ns / 1000.0);
+      out.append(buf);
+      first = false;
+    }
+  }
+  uv_mutex_unlock(&g_trace_lock);
+
+  out.append("],\"displayTimeUnit\":\"ms\"}");
+  return out;
+}
+
+// Startup marks.
+//
+// Timestamps of the startup phases, from main() through loading the script to
+// the first frame, relative to when the process was started (before dyld and
+// static initializers run), so launches can be compared.  Main thread only.
+
+struct StartupMark {
+  const char* name;
+  uint64_t ns;
+};
+
+static const int kMaxStartupMarks = 32;
+static StartupMark g_startup_marks[kMaxStartupMarks];
+static int g_num_startup_marks = 0;
+static uint64_t g_process_start_ns = 0;  // In uv_hrtime() time.
+
+// Map the process start time, which the kernel keeps as wall clock time, to
+// uv_hrtime() time.  Without it, times are relative to the first mark.
+static uint64_t StartupProcessStartNs(uint64_t now_ns) {
+#if PLASK_OSX
+  struct kinfo_proc info;
+  size_t size = sizeof(info);
+  int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid() };
+  struct timeval now;
+  if (sysctl(mib, 4, &info, &size, NULL, 0) == 0 &&
+      gettimeofday(&now, NULL) == 0) {
+    const struct timeval& start = info.kp_proc.p_starttime;
+    int64_t since_start_ns =
+        (static_cast<int64_t>(now.tv_sec) - start.tv_sec) * 1000000000LL +
+        (static_cast<int64_t>(now.tv_usec) - start.tv_usec) * 1000LL;
+    if (since_start_ns >= 0 && static_cast<uint64_t>(since_start_ns) < now_ns)
+      return now_ns - since_start_ns;
+  }
+#endif
+  return now_ns;
+}
+
+void plask_startup_mark(const char* name) {
+  uint64_t now_ns = uv_hrtime();
+  if (g_process_start_ns == 0)
+    g_process_start_ns = StartupProcessStartNs(now_ns);
+  if (g_num_startup_marks == kMaxStartupMarks)
+    return;
+  g_startup_marks[g_num_startup_marks].name = name;
+  g_startup_marks[g_num_startup_marks].ns = now_ns;
+  ++g_num_startup_marks;
+}
+
 namespace {
 
 // hack...
-v8::Isolate* isolate;
+// Per thread, since each thread running JavaScript (the main thread and any
+// workers, see PlaskWorkerWrapper) has an isolate of its own.
+__thread v8::Isolate* isolate;
 
 void SetInternalIsolate(v8::Isolate* iso) { isolate = iso; }
 
+// True on worker threads, see PlaskWorkerWrapper.
+__thread bool t_is_worker = false;
+
+// State which would otherwise be static, but belongs to an isolate, namely
+// the cached FunctionTemplates, which can't be shared between isolates.  An
+// isolate is only ever run on the thread that created it, so the data hangs
+// off a thread local.
+class PerIsolateData {
+ public:
+  // The data for this thread's isolate, created on first use.
+  static PerIsolateData* Current() {
+    if (!current_)
+      current_ = new PerIsolateData;
+    return current_;
+  }
+
+  // Release this thread's data, the isolate must still be entered.
+  static void DisposeCurrent() {
+    delete current_;
+    current_ = NULL;
+  }
+
+  // Each GetTemplate() allocates a slot once, the same in every isolate.
+  static int NewTemplateSlot() {
+    return __sync_fetch_and_add(&num_template_slots_, 1);
+  }
+
+  v8::Persistent<v8::FunctionTemplate>& TemplateCache(int slot) {
+    if (slot >= static_cast<int>(templates_.size()))
+      templates_.resize(slot + 1, NULL);
+    if (!templates_[slot])
+      templates_[slot] = new v8::Persistent<v8::FunctionTemplate>;
+    return *templates_[slot];
+  }
+
+ private:
+  ~PerIsolateData() {
+    for (size_t i = 0; i < templates_.size(); ++i) {
+      if (!templates_[i]) continue;
+      templates_[i]->Reset();
+      delete templates_[i];
+    }
+  }
+
+  static __thread PerIsolateData* current_;
+  static int num_template_slots_;
+
+  std::vector<v8::Persistent<v8::FunctionTemplate>*> templates_;
+};
+
+__thread PerIsolateData* PerIsolateData::current_ = NULL;
+int PerIsolateData::num_template_slots_ = 0;
+
+// Declares |var|, a reference to this isolate's cached template for the
+// enclosing GetTemplate().
+#define PER_ISOLATE_TEMPLATE_CACHE(var) \
+  static const int var##_slot = PerIsolateData::NewTemplateSlot(); \
+  v8::Persistent<v8::FunctionTemplate>& var = \
+      PerIsolateData::Current()->TemplateCache(var##_slot)
+
 template <class TypeName>
 inline v8::Local<TypeName> StrongPersistentToLocal(
     const v8::PersistentBase<TypeName>& persistent) {
@@ -357,6 +759,8 @@ void writeImageHelper(const v8::FunctionCallbackInfo<v8::Value>& args,
   if (args.Length() < 2)
     return v8_utils::ThrowError(isolate, "Wrong number of arguments.");
 
+  PLASK_TRACE_EVENT("image", "encode");
+
   FREE_IMAGE_FORMAT format;
 
   v8::String::Utf8Value type(args[0]);
@@ -466,11 +870,89 @@ struct BatchedMethods {
   v8::FunctionCallback func;
 };
 
+// Binding stats.
+//
+// Methods registered with NewInstrumentedMethod are called through a
+// trampoline, which while stats are enabled counts the calls and records a
+// latency histogram for each method.  While disabled it only costs a branch
+// and an extra indirect call.
+
+const int kBindingStatsBuckets = 32;  // Bucket i is [2^i, 2^(i+1)) ns.
+
+struct BindingStats {
+  const char* class_name;
+  const char* name;
+  v8::FunctionCallback func;
+  uint64_t calls;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t histogram[kBindingStatsBuckets];
+};
+
+bool g_binding_stats_enabled = false;
+std::vector<BindingStats*> g_binding_stats;
+
+void InstrumentedMethodTrampoline(
+    const v8::FunctionCallbackInfo<v8::Value>& args) {
+  BindingStats* stats = reinterpret_cast<BindingStats*>(
+      v8::Handle<v8::External>::Cast(args.Data())->Value());
+  if (!g_binding_stats_enabled)
+    return stats->func(args);
+
+  uint64_t start_ns = uv_hrtime();
+  stats->func(args);
+  uint64_t ns = uv_hrtime() - start_ns;
+
+  int bucket = 63 - __builtin_clzll(ns | 1);
+  if (bucket >= kBindingStatsBuckets)
+    bucket = kBindingStatsBuckets - 1;
+  ++stats->calls;
+  stats->total_ns += ns;
+  if (ns > stats->max_ns)
+    stats->max_ns = ns;
+  ++stats->histogram[bucket];
+}
+
+void ResetBindingStats() {
+  for (size_t i = 0; i < g_binding_stats.size(); ++i) {
+    BindingStats* stats = g_binding_stats[i];
+    stats->calls = 0;
+    stats->total_ns = 0;
+    stats->max_ns = 0;
+    memset(stats->histogram, 0, sizeof(stats->histogram));
+  }
+}
+
+// Use in place of v8::FunctionTemplate::New when registering |method|.
+v8::Local<v8::FunctionTemplate> NewInstrumentedMethod(
+    v8::Isolate* isolate, const char* class_name, const BatchedMethods& method,
+    v8::Handle<v8::Signature> signature) {
+  // Stats are only collected for the main thread's isolate, the registry
+  // isn't locked, workers get plain methods.
+  if (t_is_worker) {
+    return v8::FunctionTemplate::New(isolate, method.func,
+                                     v8::Handle<v8::Value>(), signature);
+  }
+
+  BindingStats* stats = new BindingStats;  // Lives as long as the template.
+  stats->class_name = class_name;
+  stats->name = method.name;
+  stats->func = method.func;
+  stats->calls = 0;
+  stats->total_ns = 0;
+  stats->max_ns = 0;
+  memset(stats->histogram, 0, sizeof(stats->histogram));
+  g_binding_stats.push_back(stats);
+  return v8::FunctionTemplate::New(isolate, &InstrumentedMethodTrampoline,
+                                   v8::External::New(isolate, stats),
+                                   signature);
+}
+
 
 class WebGLActiveInfo {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -514,7 +996,7 @@ template <const char* TClassName>
 class WebGLNameMappedObject {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -624,7 +1106,7 @@ class NSOpenGLContextWrapper;
 class WebGLUniformLocation {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -668,6 +1150,310 @@ class WebGLUniformLocation {
 };
 
 
+#if PLASK_WEBGL2
+// A buffer for streaming dynamic data (vertices, etc) to the GPU every frame,
+// without the implicit synchronization of bufferData / bufferSubData.
+//
+// The buffer is divided into segments used as a ring, one segment per frame.
+// Our contexts are legacy GL 2.1, so rather than GL3's glMapBufferRange this
+// uses GL_APPLE_flush_buffer_range: with serialized modify off mapping never
+// waits on the GPU, and with flushing unmap off only the written bytes of the
+// segment are flushed.  A GL_APPLE_fence is set at the end of each frame, and
+// only waited on before the segment is reused, num_segments frames later, by
+// which time the GPU has normally long finished with it.  With a single
+// segment the buffer is orphaned every frame instead.
+class WebGLStreamBuffer {
+ public:
+  static const int kMaxSegments = 16;
+
+  struct State {
+    GLuint name;
+    GLenum target;
+    GLsizeiptr segment_size;
+    int num_segments;
+    int current;
+    GLuint fences[kMaxSegments];  // 0 when not set.
+    v8::Persistent<v8::ArrayBuffer> mapped;  // Empty while unmapped.
+    double bytes_flushed;
+    double num_waits;
+    uint64_t wait_ns;
+  };
+
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft =
+        v8::FunctionTemplate::New(isolate, &WebGLStreamBuffer::V8New);
+
+    ft->SetClassName(v8::String::NewFromUtf8(isolate, "WebGLStreamBuffer"));
+    v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
+    instance->SetInternalFieldCount(1);  // State*.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
+
+    v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
+
+    static BatchedMethods methods[] = {
+      METHOD_ENTRY( map ),
+      METHOD_ENTRY( unmap ),
+      METHOD_ENTRY( offset ),
+      METHOD_ENTRY( endFrame ),
+      METHOD_ENTRY( stats ),
+      METHOD_ENTRY( destroy ),
+    };
+
+    for (size_t i = 0; i < arraysize(methods); ++i) {
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
+    }
+
+    ft_cache.Reset(isolate, ft);
+    return ft_cache;
+  }
+
+  // Create the buffer, the GL context must be current.  Returns an empty
+  // handle with an exception scheduled on bad arguments.
+  static v8::Handle<v8::Value> NewStreamBuffer(
+      GLenum target, GLsizeiptr segment_size, int num_segments) {
+    if (segment_size <= 0 || (segment_size & 3) != 0) {
+      v8_utils::ThrowError(isolate, "Segment size must be a multiple of 4.");
+      return v8::Handle<v8::Value>();
+    }
+    if (num_segments < 1 || num_segments > kMaxSegments) {
+      v8_utils::ThrowError(isolate, "Number of segments must be 1 to 16.");
+      return v8::Handle<v8::Value>();
+    }
+
+    State* state = new State;
+    state->target = target;
+    // Keep every segment 256 byte aligned, as drivers prefer.
+    state->segment_size = (segment_size + 255) & ~255;
+    state->num_segments = num_segments;
+    state->current = 0;
+    memset(state->fences, 0, sizeof(state->fences));
+    state->bytes_flushed = 0;
+    state->num_waits = 0;
+    state->wait_ns = 0;
+
+    glGenBuffers(1, &state->name);
+    glBindBuffer(target, state->name);
+    glBufferData(target, state->segment_size * num_segments, NULL,
+                 GL_STREAM_DRAW);
+    glBufferParameteriAPPLE(target, GL_BUFFER_SERIALIZED_MODIFY_APPLE, GL_FALSE);
+    glBufferParameteriAPPLE(target, GL_BUFFER_FLUSHING_UNMAP_APPLE, GL_FALSE);
+
+    v8::Local<v8::FunctionTemplate> ft = v8::Local<v8::FunctionTemplate>::New(
+        isolate, GetTemplate(isolate));
+    v8::Local<v8::Object> obj = ft->InstanceTemplate()->NewInstance();
+    obj->SetAlignedPointerInInternalField(0, state);
+    obj->Set(v8::String::NewFromUtf8(isolate, "buffer"),
+             WebGLBuffer::NewFromName(state->name), v8::ReadOnly);
+    obj->Set(v8::String::NewFromUtf8(isolate, "segmentSize"),
+             v8::Integer::New(isolate, state->segment_size), v8::ReadOnly);
+
+    v8::Persistent<v8::Object>* persistent = new v8::Persistent<v8::Object>;
+    persistent->Reset(isolate, obj);
+    persistent->SetWeak(persistent, &WebGLStreamBuffer::WeakCallback);
+    return obj;
+  }
+
+ private:
+  static State* ExtractPointer(v8::Handle<v8::Object> obj) {
+    return reinterpret_cast<State*>(obj->GetAlignedPointerFromInternalField(0));
+  }
+
+  // The mapped memory belongs to GL, so once unmapped any views on it have
+  // to be detached before JavaScript can touch it again.
+  static void NeuterMapped(State* state) {
+    if (state->mapped.IsEmpty())
+      return;
+    PersistentToLocal(isolate, state->mapped)->Neuter();
+    state->mapped.Reset();
+  }
+
+  static void WeakCallback(
+      const v8::WeakCallbackData<v8::Object, v8::Persistent<v8::Object> >& data) {
+    State* state = ExtractPointer(data.GetValue());
+
+    v8::Persistent<v8::Object>* persistent = data.GetParameter();
+    persistent->ClearWeak();
+    persistent->Reset();
+    delete persistent;
+
+    // Like the other WebGL objects, the GL buffer itself is only deleted
+    // explicitly (with destroy()), there might not be a current context now.
+    if (state) {
+      NeuterMapped(state);
+      delete state;
+    }
+  }
+
+  static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (!args.IsConstructCall())
+      return v8_utils::ThrowTypeError(isolate, kMsgNonConstructCall);
+    args.This()->SetAlignedPointerInInternalField(0, NULL);
+  }
+
+  // Float32Array map()
+  //
+  // Map the segment for the current frame, and return a Float32Array over it
+  // to write into.  The buffer is left bound to its target.  If the GPU might
+  // still be reading the segment (from num_segments frames ago) this waits
+  // until it's done.
+  static void map(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    State* state = ExtractPointer(args.Holder());
+    if (!state || state->name == 0)
+      return v8_utils::ThrowError(isolate, "Stream buffer destroyed.");
+    if (!state->mapped.IsEmpty())
+      return v8_utils::ThrowError(isolate, "Stream buffer already mapped.");
+
+    PLASK_TRACE_EVENT("gl", "WebGLStreamBuffer::map");
+    glBindBuffer(state->target, state->name);
+
+    GLintptr offset = 0;
+    if (state->num_segments == 1) {
+      // Orphan, the driver hands us fresh storage if the old is in use.
+      glBufferData(state->target, state->segment_size, NULL, GL_STREAM_DRAW);
+    } else {
+      GLuint fence = state->fences[state->current];
+      if (fence != 0) {
+        // Test without flushing first, normally the fence has long passed.
+        if (!glTestFenceAPPLE(fence)) {
+          uint64_t start_ns = uv_hrtime();
+          glFinishFenceAPPLE(fence);
+          state->wait_ns += uv_hrtime() - start_ns;
+          ++state->num_waits;
+        }
+        glDeleteFencesAPPLE(1, &fence);
+        state->fences[state->current] = 0;
+      }
+      offset = state->segment_size * state->current;
+    }
+
+    // The whole buffer is mapped, but only this segment is written.
+    void* ptr = glMapBuffer(state->target, GL_WRITE_ONLY);
+    if (!ptr)
+      return v8_utils::ThrowError(isolate, "Couldn't map stream buffer.");
+
+    // An externalized ArrayBuffer, V8 won't try to free GL's memory.
+    v8::Local<v8::ArrayBuffer> ab = v8::ArrayBuffer::New(
+        isolate, reinterpret_cast<char*>(ptr) + offset, state->segment_size);
+    state->mapped.Reset(isolate, ab);
+    return args.GetReturnValue().Set(
+        v8::Float32Array::New(ab, 0, state->segment_size / 4));
+  }
+
+  // int unmap(int bytes_written)
+  //
+  // Unmap the current segment, making the first `bytes_written` bytes
+  // (default the whole segment) available to draws.  The Float32Array from
+  // map() is detached.  Returns the byte offset of the segment within the
+  // buffer, for vertexAttribPointer and friends.
+  static void unmap(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    State* state = ExtractPointer(args.Holder());
+    if (!state || state->mapped.IsEmpty())
+      return v8_utils::ThrowError(isolate, "Stream buffer not mapped.");
+
+    GLsizeiptr bytes = Clamp<GLsizeiptr>(
+        v8_utils::ToInt32WithDefault(args[0], state->segment_size),
+        0, state->segment_size);
+
+    int offset = state->num_segments == 1 ? 0 :
+        state->segment_size * state->current;
+
+    NeuterMapped(state);
+    glBindBuffer(state->target, state->name);
+    // The APPLE flush offset is from the start of the buffer, not the map.
+    if (bytes > 0)
+      glFlushMappedBufferRangeAPPLE(state->target, offset, bytes);
+    glUnmapBuffer(state->target);
+    state->bytes_flushed += bytes;
+
+    return args.GetReturnValue().Set(v8::Integer::New(isolate, offset));
+  }
+
+  // int offset()
+  //
+  // The byte offset of the current segment within the buffer.
+  static void offset(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    State* state = ExtractPointer(args.Holder());
+    if (!state)
+      return v8_utils::ThrowError(isolate, "Stream buffer destroyed.");
+    int offset = state->num_segments == 1 ? 0 :
+        state->segment_size * state->current;
+    return args.GetReturnValue().Set(v8::Integer::New(isolate, offset));
+  }
+
+  // void endFrame()
+  //
+  // Call after the draws using the current segment have been issued.  Fences
+  // the segment and moves on to the next one.
+  static void endFrame(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    State* state = ExtractPointer(args.Holder());
+    if (!state || state->name == 0)
+      return v8_utils::ThrowError(isolate, "Stream buffer destroyed.");
+    if (!state->mapped.IsEmpty())
+      return v8_utils::ThrowError(isolate, "Stream buffer still mapped.");
+    if (state->num_segments == 1)
+      return args.GetReturnValue().SetUndefined();
+
+    GLuint fence;
+    glGenFencesAPPLE(1, &fence);
+    glSetFenceAPPLE(fence);
+    state->fences[state->current] = fence;
+    state->current = (state->current + 1) % state->num_segments;
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // object stats()
+  //
+  // Returns {bytesFlushed, waits, waitMs}, where waits counts the times map()
+  // had to wait on the GPU, which means more segments are needed.
+  static void stats(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    State* state = ExtractPointer(args.Holder());
+    if (!state)
+      return v8_utils::ThrowError(isolate, "Stream buffer destroyed.");
+    v8::Local<v8::Object> res = v8::Object::New(isolate);
+    res->Set(v8::String::NewFromUtf8(isolate, "bytesFlushed"),
+             v8::Number::New(isolate, state->bytes_flushed));
+    res->Set(v8::String::NewFromUtf8(isolate, "waits"),
+             v8::Number::New(isolate, state->num_waits));
+    res->Set(v8::String::NewFromUtf8(isolate, "waitMs"),
+             v8::Number::New(isolate, state->wait_ns / 1e6));
+    return args.GetReturnValue().Set(res);
+  }
+
+  // void destroy()
+  //
+  // Delete the GL buffer and fences.  The GL context must be current.
+  static void destroy(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    State* state = ExtractPointer(args.Holder());
+    if (!state || state->name == 0)
+      return args.GetReturnValue().SetUndefined();
+
+    if (!state->mapped.IsEmpty()) {
+      NeuterMapped(state);
+      glBindBuffer(state->target, state->name);
+      glUnmapBuffer(state->target);
+    }
+    for (int i = 0; i < state->num_segments; ++i) {
+      if (state->fences[i] != 0)
+        glDeleteFencesAPPLE(1, &state->fences[i]);
+      state->fences[i] = 0;
+    }
+    WebGLBuffer::ClearName(
+        args.Holder()->Get(v8::String::NewFromUtf8(isolate, "buffer")));
+    glDeleteBuffers(1, &state->name);
+    state->name = 0;
+    return args.GetReturnValue().SetUndefined();
+  }
+};
+#endif  // PLASK_WEBGL2
+
+
 // TODO
 // 5.12 WebGLShaderPrecisionFormat
 
@@ -676,7 +1462,7 @@ class WebGLUniformLocation {
 class SyphonServerWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -686,6 +1472,7 @@ class SyphonServerWrapper {
     ft->SetClassName(v8::String::NewFromUtf8(isolate, "SyphonServer"));
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
     instance->SetInternalFieldCount(1);  // SyphonServer
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
@@ -704,15 +1491,15 @@ class SyphonServerWrapper {
     for (size_t i = 0; i < arraysize(constants); ++i) {
       ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
               v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -776,7 +1563,7 @@ class SyphonServerWrapper {
 class SyphonClientWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -786,6 +1573,7 @@ class SyphonClientWrapper {
     ft->SetClassName(v8::String::NewFromUtf8(isolate, "SyphonClient"));
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
     instance->SetInternalFieldCount(2);  // SyphonClient, CGLContextObj
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
@@ -803,15 +1591,15 @@ class SyphonClientWrapper {
     for (size_t i = 0; i < arraysize(constants); ++i) {
       ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
               v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -895,6 +1683,9 @@ static const char* const kWebGLExtensions[] = {
   "OES_standard_derivatives",
   // https://www.khronos.org/registry/webgl/extensions/EXT_shader_texture_lod/
   "EXT_shader_texture_lod",
+  // https://www.khronos.org/registry/webgl/extensions/WEBGL_compressed_texture_s3tc/
+  // Every Mac GPU has GL_EXT_texture_compression_s3tc.
+  "WEBGL_compressed_texture_s3tc",
 };
 
 // 10.33 Should Extension Macros be Globally Defined?
@@ -1000,39 +1791,1194 @@ static void RewriteWebGLSLtoGLSL(char* p, int len) {
   }
 }
 
-class NSOpenGLContextWrapper {
- public:
-  enum WebGLType {
-    WebGLTypeInvalid = 0,
-    WebGLTypeDOMString,
-    WebGLTypeFloat32Arrayx2,
-    WebGLTypeFloat32Arrayx4,
-    WebGLTypeGLboolean,
-    WebGLTypeGLbooleanx4,
-    WebGLTypeGLenum,
-    WebGLTypeGLfloat,
-    WebGLTypeGLint,
-    WebGLTypeGLuint,
-    WebGLTypeInt32Arrayx2,
-    WebGLTypeInt32Arrayx4,
-    WebGLTypeUint32Array,
-    WebGLTypeWebGLBuffer,
-    WebGLTypeWebGLFramebuffer,
-    WebGLTypeWebGLProgram,
-    WebGLTypeWebGLRenderbuffer,
-    WebGLTypeWebGLTexture,
-    WebGLTypeWebGLVertexArrayObject,
-    WebGLTypeWebGLTransformFeedback,
+// S3TC texture compression.
+//
+// Encodes RGBA pixels as DXT1 (BC1), DXT3 (BC2) or DXT5 (BC3) data for
+// compressedTexImage2D.  A block's color endpoints are the extremes of its
+// pixels along their principal axis, then refined once by least squares on
+// the chosen indices, in the spirit of stb_dxt.  DXT5 alpha uses whichever of
+// the two alpha modes fits the block better.  The rows of blocks are split
+// over a few threads.  The decoder is for checking the encoder's quality.
+
+const int kS3TCFlipY = 1;  // Read the source rows bottom up, like GL.
+const int kS3TCSourceBGRA = 2;  // The source is BGRA, ex. an SkCanvas.
+
+static int S3TCBlockBytes(GLenum format) {
+  switch (format) {
+    case WEBGL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case WEBGL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+      return 8;
+    case WEBGL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case WEBGL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+      return 16;
+  }
+  return 0;  // Not S3TC.
+}
+
+// The bytes of S3TC |format| data for a |width| x |height| image.
+static size_t S3TCImageBytes(GLenum format, int width, int height) {
+  return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) *
+         S3TCBlockBytes(format);
+}
+
+static inline int S3TCDistance(const uint8_t* a, const int* b) {
+  int dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2];
+  return dr * dr + dg * dg + db * db;
+}
+
+static inline int S3TCQuantize(float v, int max) {
+  int i = static_cast<int>(v * max / 255.0f + 0.5f);
+  return i < 0 ? 0 : i > max ? max : i;
+}
+
+static inline uint16_t S3TCPack565(const float* rgb) {
+  return static_cast<uint16_t>((S3TCQuantize(rgb[0], 31) << 11) |
+                               (S3TCQuantize(rgb[1], 63) << 5) |
+                               S3TCQuantize(rgb[2], 31));
+}
+
+static inline void S3TCUnpack565(uint16_t c, int* rgb) {
+  int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+// The colors of a color block.  With |four| the block is in four color mode
+// whatever the endpoint order (DXT3 and DXT5 blocks always are), otherwise
+// c0 <= c1 selects three colors and transparent black.
+static bool S3TCPalette(uint16_t c0, uint16_t c1, bool four, int palette[4][3]) {
+  four = four || c0 > c1;
+  S3TCUnpack565(c0, palette[0]);
+  S3TCUnpack565(c1, palette[1]);
+  for (int i = 0; i < 3; ++i) {
+    if (four) {
+      palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+      palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+    } else {
+      palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+      palette[3][i] = 0;
+    }
+  }
+  return four;
+}
+
+// Choose the nearest color for each pixel into |indices|, returns the total
+// squared error.  Pixels with |transparent| set take index 3 (three color
+// mode only).
+static int S3TCSelectIndices(const uint8_t* block, const bool* transparent,
+                             uint16_t c0, uint16_t c1, uint32_t* indices) {
+  int palette[4][3];
+  int colors = S3TCPalette(c0, c1, false, palette) ? 4 : 3;
+  int total = 0;
+  *indices = 0;
+  for (int i = 0; i < 16; ++i) {
+    int best = 3, best_dist = 0;
+    if (!transparent || !transparent[i]) {
+      best_dist = 1 << 30;
+      for (int j = 0; j < colors; ++j) {
+        int dist = S3TCDistance(block + i * 4, palette[j]);
+        if (dist < best_dist) {
+          best = j;
+          best_dist = dist;
+        }
+      }
+    }
+    total += best_dist;
+    *indices |= static_cast<uint32_t>(best) << (i * 2);
+  }
+  return total;
+}
+
+// Endpoints at the extremes of the pixels (those without |skip| set) along
+// their principal axis.  Returns false if every pixel is skipped.
+static bool S3TCPrincipalEndpoints(const uint8_t* block, const bool* skip,
+                                   float* lo, float* hi) {
+  float mean[3] = { 0, 0, 0 };
+  int count = 0;
+  for (int i = 0; i < 16; ++i) {
+    if (skip && skip[i]) continue;
+    for (int c = 0; c < 3; ++c) mean[c] += block[i * 4 + c];
+    ++count;
+  }
+  if (count == 0)
+    return false;
+  for (int c = 0; c < 3; ++c) mean[c] /= count;
+
+  float cov[6] = { 0, 0, 0, 0, 0, 0 };  // rr rg rb gg gb bb
+  for (int i = 0; i < 16; ++i) {
+    if (skip && skip[i]) continue;
+    float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1];
+    float b = block[i * 4 + 2] - mean[2];
+    cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+    cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+  }
+
+  // Power iteration for the axis of most variance.
+  float axis[3] = { 0.6f, 0.8f, 0.4f };
+  for (int iter = 0; iter < 8; ++iter) {
+    float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    float len = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+    if (len < 1e-6f) break;  // A flat block, any axis will do.
+    axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+  }
+  float norm = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+  float min_t = 0, max_t = 0;
+  for (int i = 0; i < 16; ++i) {
+    if (skip && skip[i]) continue;
+    float t = ((block[i * 4] - mean[0]) * axis[0] +
+               (block[i * 4 + 1] - mean[1]) * axis[1] +
+               (block[i * 4 + 2] - mean[2]) * axis[2]) / norm;
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+  // Inset a little, the extremes rarely need to be hit exactly.
+  float inset = (max_t - min_t) / 16.0f;
+  for (int c = 0; c < 3; ++c) {
+    lo[c] = mean[c] + axis[c] * (min_t + inset);
+    hi[c] = mean[c] + axis[c] * (max_t - inset);
+  }
+  return true;
+}
+
+// Least squares endpoints for the four color mode |indices|, false if they
+// can't be solved for (ex. all pixels on one index).
+static bool S3TCRefineEndpoints(const uint8_t* block, uint32_t indices,
+                                float* c0, float* c1) {
+  static const float kWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+  float aa = 0, bb = 0, ab = 0;
+  float ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+  for (int i = 0; i < 16; ++i) {
+    float a = kWeights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+    aa += a * a; bb += b * b; ab += a * b;
+    for (int c = 0; c < 3; ++c) {
+      ax[c] += a * block[i * 4 + c];
+      bx[c] += b * block[i * 4 + c];
+    }
+  }
+  float det = aa * bb - ab * ab;
+  if (fabsf(det) < 1e-3f)
+    return false;
+  for (int c = 0; c < 3; ++c) {
+    c0[c] = (ax[c] * bb - bx[c] * ab) / det;
+    c1[c] = (bx[c] * aa - ax[c] * ab) / det;
+  }
+  return true;
+}
+
+// Four color mode endpoints (c0 > c1) and indices, returns the error.
+static int S3TCFourColor(const uint8_t* block, const float* e0, const float* e1,
+                         uint16_t* c0, uint16_t* c1, uint32_t* indices) {
+  *c0 = S3TCPack565(e0);
+  *c1 = S3TCPack565(e1);
+  if (*c0 < *c1)
+    std::swap(*c0, *c1);
+  if (*c0 == *c1) {
+    // One color, index 0 is it in either mode.
+    int palette[4][3];
+    S3TCPalette(*c0, *c1, true, palette);
+    *indices = 0;
+    int error = 0;
+    for (int i = 0; i < 16; ++i) error += S3TCDistance(block + i * 4, palette[0]);
+    return error;
+  }
+  return S3TCSelectIndices(block, NULL, *c0, *c1, indices);
+}
+
+static inline void S3TCWrite16(uint8_t* out, uint32_t v) {
+  out[0] = v & 0xff;
+  out[1] = (v >> 8) & 0xff;
+}
+
+static inline void S3TCWrite32(uint8_t* out, uint32_t v) {
+  S3TCWrite16(out, v);
+  S3TCWrite16(out + 2, v >> 16);
+}
+
+// Encode the color of a block of 16 RGBA pixels into 8 bytes.  With
+// |punch_through| (DXT1 with alpha), pixels with alpha under 128 are encoded
+// as transparent, using three color mode.
+static void S3TCEncodeColorBlock(const uint8_t* block, bool punch_through,
+                                 uint8_t* out) {
+  bool transparent[16];
+  bool any_transparent = false;
+  for (int i = 0; i < 16; ++i) {
+    transparent[i] = punch_through && block[i * 4 + 3] < 128;
+    any_transparent = any_transparent || transparent[i];
+  }
+
+  float lo[3], hi[3];
+  uint16_t c0, c1;
+  uint32_t indices;
+  if (any_transparent) {
+    // Three color mode, c0 <= c1.
+    if (!S3TCPrincipalEndpoints(block, transparent, lo, hi)) {
+      c0 = c1 = 0;  // All transparent.
+    } else {
+      c0 = S3TCPack565(lo);
+      c1 = S3TCPack565(hi);
+      if (c0 > c1)
+        std::swap(c0, c1);
+    }
+    S3TCSelectIndices(block, transparent, c0, c1, &indices);
+  } else {
+    S3TCPrincipalEndpoints(block, NULL, lo, hi);
+    int error = S3TCFourColor(block, hi, lo, &c0, &c1, &indices);
+    float r0[3], r1[3];
+    if (error > 0 && c0 != c1 && S3TCRefineEndpoints(block, indices, r0, r1)) {
+      uint16_t rc0, rc1;
+      uint32_t rindices;
+      if (S3TCFourColor(block, r0, r1, &rc0, &rc1, &rindices) < error) {
+        c0 = rc0;
+        c1 = rc1;
+        indices = rindices;
+      }
+    }
+  }
+
+  S3TCWrite16(out, c0);
+  S3TCWrite16(out + 2, c1);
+  S3TCWrite32(out + 4, indices);
+}
+
+// The eight alphas of a DXT5 alpha block.
+static void S3TCAlphaPalette(int a0, int a1, int palette[8]) {
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    for (int i = 1; i < 7; ++i)
+      palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+  } else {
+    for (int i = 1; i < 5; ++i)
+      palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+// Nearest alpha indices for the endpoints, returns the squared error.
+static int S3TCSelectAlpha(const uint8_t* block, int a0, int a1,
+                           uint64_t* indices) {
+  int palette[8];
+  S3TCAlphaPalette(a0, a1, palette);
+  int total = 0;
+  *indices = 0;
+  for (int i = 0; i < 16; ++i) {
+    int a = block[i * 4 + 3], best = 0, best_dist = 1 << 30;
+    for (int j = 0; j < 8; ++j) {
+      int dist = (a - palette[j]) * (a - palette[j]);
+      if (dist < best_dist) {
+        best = j;
+        best_dist = dist;
+      }
+    }
+    total += best_dist;
+    *indices |= static_cast<uint64_t>(best) << (i * 3);
+  }
+  return total;
+}
+
+// Encode the alpha of a block of 16 RGBA pixels into 8 bytes of DXT5 alpha.
+static void S3TCEncodeAlphaBlock(const uint8_t* block, uint8_t* out) {
+  // Eight alphas between the extremes, or six between the extremes other than
+  // 0 and 255 which are then exact.
+  int min8 = 255, max8 = 0, min6 = 255, max6 = 0;
+  for (int i = 0; i < 16; ++i) {
+    int a = block[i * 4 + 3];
+    min8 = std::min(min8, a);
+    max8 = std::max(max8, a);
+    if (a != 0 && a != 255) {
+      min6 = std::min(min6, a);
+      max6 = std::max(max6, a);
+    }
+  }
+  if (min6 > max6)  // Only 0 and 255.
+    min6 = max6 = 0;
+
+  int a0 = max8, a1 = min8;
+  uint64_t indices;
+  int error = S3TCSelectAlpha(block, a0, a1, &indices);
+  if (error > 0) {
+    uint64_t indices6;
+    if (S3TCSelectAlpha(block, min6, max6, &indices6) < error) {
+      a0 = min6;
+      a1 = max6;
+      indices = indices6;
+    }
+  }
+
+  out[0] = a0;
+  out[1] = a1;
+  for (int i = 0; i < 6; ++i)
+    out[2 + i] = (indices >> (i * 8)) & 0xff;
+}
+
+// Encode the alpha of a block into 8 bytes of DXT3 explicit alpha.
+static void S3TCEncodeExplicitAlphaBlock(const uint8_t* block, uint8_t* out) {
+  for (int i = 0; i < 8; ++i) {
+    int lo = (block[i * 8 + 3] * 15 + 127) / 255;
+    int hi = (block[i * 8 + 7] * 15 + 127) / 255;
+    out[i] = lo | (hi << 4);
+  }
+}
+
+// Read the 4x4 block at block coordinates (|bx|, |by|) of the tightly packed
+// RGBA |pixels|, repeating the last row / column past the edges.
+static void S3TCLoadBlock(const uint8_t* pixels, int width, int height,
+                          int bx, int by, uint8_t* block) {
+  for (int y = 0; y < 4; ++y) {
+    int sy = std::min(by * 4 + y, height - 1);
+    for (int x = 0; x < 4; ++x) {
+      int sx = std::min(bx * 4 + x, width - 1);
+      memcpy(block + (y * 4 + x) * 4,
+             pixels + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+    }
+  }
+}
+
+struct S3TCJob {
+  const uint8_t* pixels;  // Tightly packed RGBA.
+  int width, height;
+  GLenum format;
+  uint8_t* out;
+  int first_row, last_row;  // Rows of blocks, [first, last).
+};
+
+static void S3TCEncodeRows(void* arg) {
+  S3TCJob* job = reinterpret_cast<S3TCJob*>(arg);
+  int block_bytes = S3TCBlockBytes(job->format);
+  int blocks_wide = (job->width + 3) / 4;
+  uint8_t block[64];
+  for (int by = job->first_row; by < job->last_row; ++by) {
+    uint8_t* out = job->out + static_cast<size_t>(by) * blocks_wide * block_bytes;
+    for (int bx = 0; bx < blocks_wide; ++bx, out += block_bytes) {
+      S3TCLoadBlock(job->pixels, job->width, job->height, bx, by, block);
+      switch (job->format) {
+        case WEBGL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+          S3TCEncodeColorBlock(block, false, out);
+          break;
+        case WEBGL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+          S3TCEncodeColorBlock(block, true, out);
+          break;
+        case WEBGL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+          S3TCEncodeExplicitAlphaBlock(block, out);
+          S3TCEncodeColorBlock(block, false, out + 8);
+          break;
+        case WEBGL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+          S3TCEncodeAlphaBlock(block, out);
+          S3TCEncodeColorBlock(block, false, out + 8);
+          break;
+      }
+    }
+  }
+}
+
+// Encode the tightly packed RGBA |pixels| into |out| (S3TCImageBytes big),
+// on up to |threads| threads.
+static void S3TCEncode(const uint8_t* pixels, int width, int height,
+                       GLenum format, uint8_t* out, int threads) {
+  const int kMinRowsPerThread = 16;
+  int rows = (height + 3) / 4;
+  threads = std::max(1, std::min(threads, rows / kMinRowsPerThread));
+
+  std::vector<S3TCJob> jobs(threads);
+  std::vector<uv_thread_t> thread_ids(threads);
+  for (int i = 0; i < threads; ++i) {
+    S3TCJob& job = jobs[i];
+    job.pixels = pixels;
+    job.width = width;
+    job.height = height;
+    job.format = format;
+    job.out = out;
+    job.first_row = rows * i / threads;
+    job.last_row = rows * (i + 1) / threads;
+  }
+  // The calling thread does the first share.
+  int started = 1;
+  for (; started < threads; ++started) {
+    if (uv_thread_create(&thread_ids[started], &S3TCEncodeRows,
+                         &jobs[started]) != 0) {
+      break;
+    }
+  }
+  for (int i = started; i < threads; ++i)  // Couldn't start them, do them here.
+    S3TCEncodeRows(&jobs[i]);
+  S3TCEncodeRows(&jobs[0]);
+  for (int i = 1; i < started; ++i)
+    uv_thread_join(&thread_ids[i]);
+}
+
+// Decode S3TC |data| to tightly packed RGBA |pixels|.
+static void S3TCDecode(const uint8_t* data, int width, int height,
+                       GLenum format, uint8_t* pixels) {
+  int block_bytes = S3TCBlockBytes(format);
+  int blocks_wide = (width + 3) / 4, blocks_high = (height + 3) / 4;
+  for (int by = 0; by < blocks_high; ++by) {
+    for (int bx = 0; bx < blocks_wide; ++bx, data += block_bytes) {
+      const uint8_t* color = block_bytes == 16 ? data + 8 : data;
+      uint16_t c0 = color[0] | (color[1] << 8), c1 = color[2] | (color[3] << 8);
+      uint32_t indices = color[4] | (color[5] << 8) | (color[6] << 16) |
+                         (static_cast<uint32_t>(color[7]) << 24);
+      int palette[4][3];
+      bool four = S3TCPalette(c0, c1, block_bytes == 16, palette);
+
+      int alphas[8];
+      uint64_t alpha_indices = 0;
+      if (format == WEBGL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+        S3TCAlphaPalette(data[0], data[1], alphas);
+        for (int i = 0; i < 6; ++i)
+          alpha_indices |= static_cast<uint64_t>(data[2 + i]) << (i * 8);
+      }
+
+      for (int i = 0; i < 16; ++i) {
+        int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+        if (x >= width || y >= height) continue;
+        uint8_t* p = pixels + (static_cast<size_t>(y) * width + x) * 4;
+        int index = (indices >> (i * 2)) & 3;
+        p[0] = palette[index][0];
+        p[1] = palette[index][1];
+        p[2] = palette[index][2];
+        switch (format) {
+          case WEBGL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+            p[3] = !four && index == 3 ? 0 : 255;
+            break;
+          case WEBGL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+            p[3] = ((data[i / 2] >> ((i & 1) * 4)) & 15) * 17;
+            break;
+          case WEBGL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            p[3] = alphas[(alpha_indices >> (i * 3)) & 7];
+            break;
+          default:
+            p[3] = 255;
+        }
+      }
+    }
+  }
+}
+
+// Copy |width| x |height| pixels, rows |stride| bytes apart, to tightly packed
+// RGBA, per the kS3TC |flags|.
+static void S3TCLoadSource(const uint8_t* src, int width, int height,
+                           size_t stride, int flags, uint8_t* rgba) {
+  for (int y = 0; y < height; ++y) {
+    const uint8_t* row =
+        src + stride * ((flags & kS3TCFlipY) ? height - 1 - y : y);
+    uint8_t* out = rgba + static_cast<size_t>(y) * width * 4;
+    if (!(flags & kS3TCSourceBGRA)) {
+      memcpy(out, row, static_cast<size_t>(width) * 4);
+      continue;
+    }
+    for (int x = 0; x < width; ++x, row += 4, out += 4) {
+      out[0] = row[2];
+      out[1] = row[1];
+      out[2] = row[0];
+      out[3] = row[3];
+    }
+  }
+}
+
+// Box filter tightly packed RGBA |src| to the next mip level down.
+static void S3TCHalve(const uint8_t* src, int width, int height, uint8_t* dst) {
+  int dw = std::max(1, width / 2), dh = std::max(1, height / 2);
+  for (int y = 0; y < dh; ++y) {
+    int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+    for (int x = 0; x < dw; ++x) {
+      int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+      const uint8_t* p00 = src + (static_cast<size_t>(y0) * width + x0) * 4;
+      const uint8_t* p01 = src + (static_cast<size_t>(y0) * width + x1) * 4;
+      const uint8_t* p10 = src + (static_cast<size_t>(y1) * width + x0) * 4;
+      const uint8_t* p11 = src + (static_cast<size_t>(y1) * width + x1) * 4;
+      uint8_t* out = dst + (static_cast<size_t>(y) * dw + x) * 4;
+      for (int c = 0; c < 4; ++c)
+        out[c] = (p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4;
+    }
+  }
+}
+
+// Noise.
+//
+// Simplex and Perlin ("improved", with a quintic fade) gradient noise in 2, 3
+// and 4 dimensions, after Stefan Gustavson's simplexnoise1234/noise1234, over
+// a permutation table shuffled from a seed.  Octaves are summed for fBm, or
+// their absolute values for turbulence, normalized by the total amplitude so
+// the result stays in about -1 to 1 (0 to 1 for turbulence).  Points are
+// sampled in chunks laid out as separate x, y, z and w arrays, 2D and 3D
+// simplex evaluate four points at a time with SSE2 when it's there.  Grids
+// and point lists are split over a few threads by rows / ranges.
+
+enum NoiseKind {
+  kSimplexNoise,
+  kPerlinNoise,
+};
+
+struct NoiseGenerator {
+  int kind;
+  int octaves;
+  float lacunarity;
+  float gain;
+  bool turbulence;
+  uint8_t perm[512];
+  uint8_t perm_mod12[512];
+};
+
+// Shuffle the permutation table with a small xorshift generator.
+static void SeedNoise(NoiseGenerator* noise, uint32_t seed) {
+  uint32_t state = seed * 2654435761U + 0x9e3779b9U;
+  if (state == 0) state = 1;
+  for (int i = 0; i < 256; ++i)
+    noise->perm[i] = i;
+  for (int i = 255; i > 0; --i) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    int j = state % (i + 1);
+    std::swap(noise->perm[i], noise->perm[j]);
+  }
+  for (int i = 0; i < 512; ++i) {
+    noise->perm[i] = noise->perm[i & 255];
+    noise->perm_mod12[i] = noise->perm[i] % 12;
+  }
+}
+
+static const float kNoiseGrad3[12][3] = {
+  {1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0},
+  {1, 0, 1}, {-1, 0, 1}, {1, 0, -1}, {-1, 0, -1},
+  {0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1},
+};
+
+static const float kNoiseGrad4[32][4] = {
+  {0, 1, 1, 1}, {0, 1, 1, -1}, {0, 1, -1, 1}, {0, 1, -1, -1},
+  {0, -1, 1, 1}, {0, -1, 1, -1}, {0, -1, -1, 1}, {0, -1, -1, -1},
+  {1, 0, 1, 1}, {1, 0, 1, -1}, {1, 0, -1, 1}, {1, 0, -1, -1},
+  {-1, 0, 1, 1}, {-1, 0, 1, -1}, {-1, 0, -1, 1}, {-1, 0, -1, -1},
+  {1, 1, 0, 1}, {1, 1, 0, -1}, {1, -1, 0, 1}, {1, -1, 0, -1},
+  {-1, 1, 0, 1}, {-1, 1, 0, -1}, {-1, -1, 0, 1}, {-1, -1, 0, -1},
+  {1, 1, 1, 0}, {1, 1, -1, 0}, {1, -1, 1, 0}, {1, -1, -1, 0},
+  {-1, 1, 1, 0}, {-1, 1, -1, 0}, {-1, -1, 1, 0}, {-1, -1, -1, 0},
+};
+
+static const float kNoiseF2 = 0.36602540378f;  // (sqrt(3) - 1) / 2
+static const float kNoiseG2 = 0.21132486540f;  // (3 - sqrt(3)) / 6
+static const float kNoiseF3 = 1.0f / 3.0f;
+static const float kNoiseG3 = 1.0f / 6.0f;
+static const float kNoiseF4 = 0.30901699437f;  // (sqrt(5) - 1) / 4
+static const float kNoiseG4 = 0.13819660112f;  // (5 - sqrt(5)) / 20
+
+static inline int NoiseFloor(float x) {
+  int i = static_cast<int>(x);
+  return x < i ? i - 1 : i;
+}
+
+// The contribution of a simplex corner, |t| is 0.5 (or 0.6) less the squared
+// distance.  Written the same as the SSE2 version, so they agree exactly.
+static inline float NoiseCorner(float t, float dot) {
+  t = std::max(t, 0.0f);
+  t *= t;
+  return t * t * dot;
+}
+
+static float Simplex2(const NoiseGenerator* noise, float x, float y) {
+  float s = (x + y) * kNoiseF2;
+  int i = NoiseFloor(x + s), j = NoiseFloor(y + s);
+  float t = static_cast<float>(i + j) * kNoiseG2;
+  float x0 = x - (static_cast<float>(i) - t);
+  float y0 = y - (static_cast<float>(j) - t);
+  int i1 = x0 > y0 ? 1 : 0, j1 = 1 - i1;
+  float x1 = x0 - i1 + kNoiseG2, y1 = y0 - j1 + kNoiseG2;
+  float x2 = x0 + (-1.0f + 2.0f * kNoiseG2), y2 = y0 + (-1.0f + 2.0f * kNoiseG2);
+
+  const uint8_t* perm = noise->perm;
+  int ii = i & 255, jj = j & 255;
+  const float* g0 = kNoiseGrad3[noise->perm_mod12[ii + perm[jj]]];
+  const float* g1 = kNoiseGrad3[noise->perm_mod12[ii + i1 + perm[jj + j1]]];
+  const float* g2 = kNoiseGrad3[noise->perm_mod12[ii + 1 + perm[jj + 1]]];
+
+  float n0 = NoiseCorner(0.5f - x0 * x0 - y0 * y0, g0[0] * x0 + g0[1] * y0);
+  float n1 = NoiseCorner(0.5f - x1 * x1 - y1 * y1, g1[0] * x1 + g1[1] * y1);
+  float n2 = NoiseCorner(0.5f - x2 * x2 - y2 * y2, g2[0] * x2 + g2[1] * y2);
+  return 70.0f * (n0 + n1 + n2);
+}
+
+static float Simplex3(const NoiseGenerator* noise, float x, float y, float z) {
+  float s = (x + y + z) * kNoiseF3;
+  int i = NoiseFloor(x + s), j = NoiseFloor(y + s), k = NoiseFloor(z + s);
+  float t = static_cast<float>(i + j + k) * kNoiseG3;
+  float x0 = x - (static_cast<float>(i) - t);
+  float y0 = y - (static_cast<float>(j) - t);
+  float z0 = z - (static_cast<float>(k) - t);
+
+  // Which simplex of the cube, by the order of x0, y0 and z0.
+  bool xy = x0 >= y0, yz = y0 >= z0, xz = x0 >= z0;
+  int i1 = xy && xz, j1 = !xy && yz, k1 = !xz && !yz;
+  int i2 = xy || xz, j2 = !xy || yz, k2 = !xz || !yz;
+
+  float x1 = x0 - i1 + kNoiseG3, y1 = y0 - j1 + kNoiseG3, z1 = z0 - k1 + kNoiseG3;
+  float x2 = x0 - i2 + 2.0f * kNoiseG3, y2 = y0 - j2 + 2.0f * kNoiseG3,
+        z2 = z0 - k2 + 2.0f * kNoiseG3;
+  float x3 = x0 + (-1.0f + 3.0f * kNoiseG3), y3 = y0 + (-1.0f + 3.0f * kNoiseG3),
+        z3 = z0 + (-1.0f + 3.0f * kNoiseG3);
+
+  const uint8_t* perm = noise->perm;
+  const uint8_t* mod12 = noise->perm_mod12;
+  int ii = i & 255, jj = j & 255, kk = k & 255;
+  const float* g0 = kNoiseGrad3[mod12[ii + perm[jj + perm[kk]]]];
+  const float* g1 = kNoiseGrad3[mod12[ii + i1 + perm[jj + j1 + perm[kk + k1]]]];
+  const float* g2 = kNoiseGrad3[mod12[ii + i2 + perm[jj + j2 + perm[kk + k2]]]];
+  const float* g3 = kNoiseGrad3[mod12[ii + 1 + perm[jj + 1 + perm[kk + 1]]]];
+
+  float n0 = NoiseCorner(0.6f - x0 * x0 - y0 * y0 - z0 * z0,
+                         g0[0] * x0 + g0[1] * y0 + g0[2] * z0);
+  float n1 = NoiseCorner(0.6f - x1 * x1 - y1 * y1 - z1 * z1,
+                         g1[0] * x1 + g1[1] * y1 + g1[2] * z1);
+  float n2 = NoiseCorner(0.6f - x2 * x2 - y2 * y2 - z2 * z2,
+                         g2[0] * x2 + g2[1] * y2 + g2[2] * z2);
+  float n3 = NoiseCorner(0.6f - x3 * x3 - y3 * y3 - z3 * z3,
+                         g3[0] * x3 + g3[1] * y3 + g3[2] * z3);
+  return 32.0f * (n0 + n1 + n2 + n3);
+}
+
+static float Simplex4(const NoiseGenerator* noise,
+                      float x, float y, float z, float w) {
+  float s = (x + y + z + w) * kNoiseF4;
+  int i = NoiseFloor(x + s), j = NoiseFloor(y + s),
+      k = NoiseFloor(z + s), l = NoiseFloor(w + s);
+  float t = static_cast<float>(i + j + k + l) * kNoiseG4;
+  float p0[4] = {x - (static_cast<float>(i) - t), y - (static_cast<float>(j) - t),
+                 z - (static_cast<float>(k) - t), w - (static_cast<float>(l) - t)};
+
+  // Rank the coordinates, the simplex's corners step the largest first.
+  int rank[4] = {0, 0, 0, 0};
+  for (int a = 0; a < 4; ++a) {
+    for (int b = a + 1; b < 4; ++b) {
+      if (p0[a] > p0[b]) ++rank[a]; else ++rank[b];
+    }
+  }
+
+  const uint8_t* perm = noise->perm;
+  int ii = i & 255, jj = j & 255, kk = k & 255, ll = l & 255;
+  float total = 0;
+  for (int c = 0; c < 5; ++c) {
+    // Corner c steps the c coordinates ranked highest.
+    int o[4];
+    float p[4];
+    for (int a = 0; a < 4; ++a) {
+      o[a] = rank[a] >= 4 - c;
+      p[a] = p0[a] - o[a] + c * kNoiseG4;
+    }
+    const float* g = kNoiseGrad4[
+        perm[ii + o[0] + perm[jj + o[1] + perm[kk + o[2] + perm[ll + o[3]]]]] & 31];
+    total += NoiseCorner(0.6f - p[0] * p[0] - p[1] * p[1] - p[2] * p[2] - p[3] * p[3],
+                         g[0] * p[0] + g[1] * p[1] + g[2] * p[2] + g[3] * p[3]);
+  }
+  return 27.0f * total;
+}
+
+static inline float NoiseFade(float t) {
+  return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+static inline float NoiseLerp(float t, float a, float b) {
+  return a + t * (b - a);
+}
+
+static inline float PerlinGrad2(int hash, float x, float y) {
+  int h = hash & 7;
+  float u = h < 4 ? x : y, v = h < 4 ? y : x;
+  return ((h & 1) ? -u : u) + ((h & 2) ? -2.0f * v : 2.0f * v);
+}
+
+static inline float PerlinGrad3(int hash, float x, float y, float z) {
+  int h = hash & 15;
+  float u = h < 8 ? x : y;
+  float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+  return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+static inline float PerlinGrad4(int hash, float x, float y, float z, float w) {
+  int h = hash & 31;
+  float u = h < 24 ? x : y, v = h < 16 ? y : z, s = h < 8 ? z : w;
+  return ((h & 1) ? -u : u) + ((h & 2) ? -v : v) + ((h & 4) ? -s : s);
+}
+
+static float Perlin2(const NoiseGenerator* noise, float x, float y) {
+  const uint8_t* perm = noise->perm;
+  int ix = NoiseFloor(x), iy = NoiseFloor(y);
+  float fx = x - ix, fy = y - iy;
+  int x0 = ix & 255, y0 = iy & 255, x1 = (x0 + 1) & 255, y1 = (y0 + 1) & 255;
+  float u = NoiseFade(fx), v = NoiseFade(fy);
+  float a = NoiseLerp(u, PerlinGrad2(perm[x0 + perm[y0]], fx, fy),
+                         PerlinGrad2(perm[x1 + perm[y0]], fx - 1, fy));
+  float b = NoiseLerp(u, PerlinGrad2(perm[x0 + perm[y1]], fx, fy - 1),
+                         PerlinGrad2(perm[x1 + perm[y1]], fx - 1, fy - 1));
+  return 0.507f * NoiseLerp(v, a, b);
+}
+
+static float Perlin3(const NoiseGenerator* noise, float x, float y, float z) {
+  const uint8_t* perm = noise->perm;
+  int ix = NoiseFloor(x), iy = NoiseFloor(y), iz = NoiseFloor(z);
+  float fx = x - ix, fy = y - iy, fz = z - iz;
+  int x0 = ix & 255, y0 = iy & 255, z0 = iz & 255;
+  int x1 = (x0 + 1) & 255, y1 = (y0 + 1) & 255, z1 = (z0 + 1) & 255;
+  float u = NoiseFade(fx), v = NoiseFade(fy), r = NoiseFade(fz);
+
+  float n[2];
+  for (int c = 0; c < 2; ++c) {
+    int zc = c ? z1 : z0;
+    float gz = c ? fz - 1 : fz;
+    float a = NoiseLerp(u, PerlinGrad3(perm[x0 + perm[y0 + perm[zc]]], fx, fy, gz),
+                           PerlinGrad3(perm[x1 + perm[y0 + perm[zc]]], fx - 1, fy, gz));
+    float b = NoiseLerp(u, PerlinGrad3(perm[x0 + perm[y1 + perm[zc]]], fx, fy - 1, gz),
+                           PerlinGrad3(perm[x1 + perm[y1 + perm[zc]]], fx - 1, fy - 1, gz));
+    n[c] = NoiseLerp(v, a, b);
+  }
+  return 0.936f * NoiseLerp(r, n[0], n[1]);
+}
+
+static float Perlin4(const NoiseGenerator* noise,
+                     float x, float y, float z, float w) {
+  const uint8_t* perm = noise->perm;
+  int ix = NoiseFloor(x), iy = NoiseFloor(y), iz = NoiseFloor(z), iw = NoiseFloor(w);
+  float fx = x - ix, fy = y - iy, fz = z - iz, fw = w - iw;
+  int x0 = ix & 255, y0 = iy & 255, z0 = iz & 255, w0 = iw & 255;
+  int x1 = (x0 + 1) & 255, y1 = (y0 + 1) & 255;
+  int z1 = (z0 + 1) & 255, w1 = (w0 + 1) & 255;
+  float u = NoiseFade(fx), v = NoiseFade(fy), r = NoiseFade(fz), q = NoiseFade(fw);
+
+  float n[2];
+  for (int d = 0; d < 2; ++d) {
+    int wd = d ? w1 : w0;
+    float gw = d ? fw - 1 : fw;
+    float m[2];
+    for (int c = 0; c < 2; ++c) {
+      int zc = c ? z1 : z0;
+      float gz = c ? fz - 1 : fz;
+      float a = NoiseLerp(u,
+          PerlinGrad4(perm[x0 + perm[y0 + perm[zc + perm[wd]]]], fx, fy, gz, gw),
+          PerlinGrad4(perm[x1 + perm[y0 + perm[zc + perm[wd]]]], fx - 1, fy, gz, gw));
+      float b = NoiseLerp(u,
+          PerlinGrad4(perm[x0 + perm[y1 + perm[zc + perm[wd]]]], fx, fy - 1, gz, gw),
+          PerlinGrad4(perm[x1 + perm[y1 + perm[zc + perm[wd]]]], fx - 1, fy - 1, gz, gw));
+      m[c] = NoiseLerp(v, a, b);
+    }
+    n[d] = NoiseLerp(r, m[0], m[1]);
+  }
+  return 0.87f * NoiseLerp(q, n[0], n[1]);
+}
+
+// One octave of noise at |count| points, coords[d] holding dimension d.
+typedef void (*NoiseBatchFunc)(const NoiseGenerator* noise, int count,
+                               const float* const* coords, float* out);
+
+#if defined(__SSE2__)
+static inline __m128 NoiseFloor4(__m128 x, __m128i* i) {
+  __m128i t = _mm_cvttps_epi32(x);
+  __m128 f = _mm_cvtepi32_ps(t);
+  __m128i below = _mm_castps_si128(_mm_cmplt_ps(x, f));
+  *i = _mm_add_epi32(t, below);  // -1 where truncation rounded up.
+  return _mm_cvtepi32_ps(*i);
+}
+
+static inline __m128 NoiseCorner4(__m128 t, __m128 dot) {
+  t = _mm_max_ps(t, _mm_setzero_ps());
+  t = _mm_mul_ps(t, t);
+  return _mm_mul_ps(_mm_mul_ps(t, t), dot);
+}
+
+// The gradient of each lane's |index| (into kNoiseGrad3), as 3 vectors.
+static inline void NoiseGather3(const int* index, __m128* gx, __m128* gy,
+                                __m128* gz) {
+  const float* g0 = kNoiseGrad3[index[0]];
+  const float* g1 = kNoiseGrad3[index[1]];
+  const float* g2 = kNoiseGrad3[index[2]];
+  const float* g3 = kNoiseGrad3[index[3]];
+  *gx = _mm_setr_ps(g0[0], g1[0], g2[0], g3[0]);
+  *gy = _mm_setr_ps(g0[1], g1[1], g2[1], g3[1]);
+  *gz = _mm_setr_ps(g0[2], g1[2], g2[2], g3[2]);
+}
+
+static void Simplex2Batch4(const NoiseGenerator* noise,
+                           const float* xs, const float* ys, float* out) {
+  const __m128 f2 = _mm_set1_ps(kNoiseF2), g2 = _mm_set1_ps(kNoiseG2);
+  const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+  __m128 x = _mm_loadu_ps(xs), y = _mm_loadu_ps(ys);
+  __m128 s = _mm_mul_ps(_mm_add_ps(x, y), f2);
+  __m128i i, j;
+  __m128 fi = NoiseFloor4(_mm_add_ps(x, s), &i);
+  __m128 fj = NoiseFloor4(_mm_add_ps(y, s), &j);
+  __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(i, j)), g2);
+  __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(fi, t));
+  __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(fj, t));
+  __m128 i1 = _mm_and_ps(_mm_cmpgt_ps(x0, y0), one);
+  __m128 j1 = _mm_sub_ps(one, i1);
+  __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), g2);
+  __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), g2);
+  __m128 c2 = _mm_set1_ps(-1.0f + 2.0f * kNoiseG2);
+  __m128 x2 = _mm_add_ps(x0, c2), y2 = _mm_add_ps(y0, c2);
+
+  int ia[4], ja[4], i1a[4], g0[4], g1[4], g2i[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(ia), i);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(ja), j);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(i1a), _mm_cvtps_epi32(i1));
+  const uint8_t* perm = noise->perm;
+  const uint8_t* mod12 = noise->perm_mod12;
+  for (int l = 0; l < 4; ++l) {
+    int ii = ia[l] & 255, jj = ja[l] & 255, di = i1a[l], dj = 1 - di;
+    g0[l] = mod12[ii + perm[jj]];
+    g1[l] = mod12[ii + di + perm[jj + dj]];
+    g2i[l] = mod12[ii + 1 + perm[jj + 1]];
+  }
+
+  __m128 gx, gy, gz;
+  NoiseGather3(g0, &gx, &gy, &gz);
+  __m128 n = NoiseCorner4(
+      _mm_sub_ps(_mm_sub_ps(half, _mm_mul_ps(x0, x0)), _mm_mul_ps(y0, y0)),
+      _mm_add_ps(_mm_mul_ps(gx, x0), _mm_mul_ps(gy, y0)));
+  NoiseGather3(g1, &gx, &gy, &gz);
+  n = _mm_add_ps(n, NoiseCorner4(
+      _mm_sub_ps(_mm_sub_ps(half, _mm_mul_ps(x1, x1)), _mm_mul_ps(y1, y1)),
+      _mm_add_ps(_mm_mul_ps(gx, x1), _mm_mul_ps(gy, y1))));
+  NoiseGather3(g2i, &gx, &gy, &gz);
+  n = _mm_add_ps(n, NoiseCorner4(
+      _mm_sub_ps(_mm_sub_ps(half, _mm_mul_ps(x2, x2)), _mm_mul_ps(y2, y2)),
+      _mm_add_ps(_mm_mul_ps(gx, x2), _mm_mul_ps(gy, y2))));
+  _mm_storeu_ps(out, _mm_mul_ps(_mm_set1_ps(70.0f), n));
+}
+
+static inline __m128 NoiseDot3(__m128 gx, __m128 gy, __m128 gz,
+                               __m128 x, __m128 y, __m128 z) {
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gy, y)),
+                    _mm_mul_ps(gz, z));
+}
+
+static inline __m128 NoiseFalloff3(__m128 x, __m128 y, __m128 z) {
+  return _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.6f), _mm_mul_ps(x, x)),
+                               _mm_mul_ps(y, y)),
+                    _mm_mul_ps(z, z));
+}
+
+static void Simplex3Batch4(const NoiseGenerator* noise, const float* xs,
+                           const float* ys, const float* zs, float* out) {
+  const __m128 f3 = _mm_set1_ps(kNoiseF3), g3 = _mm_set1_ps(kNoiseG3);
+  const __m128 one = _mm_set1_ps(1.0f);
+  __m128 x = _mm_loadu_ps(xs), y = _mm_loadu_ps(ys), z = _mm_loadu_ps(zs);
+  __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(x, y), z), f3);
+  __m128i i, j, k;
+  __m128 fi = NoiseFloor4(_mm_add_ps(x, s), &i);
+  __m128 fj = NoiseFloor4(_mm_add_ps(y, s), &j);
+  __m128 fk = NoiseFloor4(_mm_add_ps(z, s), &k);
+  __m128 t = _mm_mul_ps(
+      _mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(i, j), k)), g3);
+  __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(fi, t));
+  __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(fj, t));
+  __m128 z0 = _mm_sub_ps(z, _mm_sub_ps(fk, t));
+
+  __m128 xy = _mm_cmpge_ps(x0, y0), yz = _mm_cmpge_ps(y0, z0);
+  __m128 xz = _mm_cmpge_ps(x0, z0);
+  __m128 i1 = _mm_and_ps(_mm_and_ps(xy, xz), one);
+  __m128 j1 = _mm_and_ps(_mm_andnot_ps(xy, yz), one);
+  __m128 k1 = _mm_andnot_ps(_mm_or_ps(xz, yz), one);
+  __m128 i2 = _mm_and_ps(_mm_or_ps(xy, xz), one);
+  __m128 j2 = _mm_sub_ps(one, _mm_and_ps(_mm_andnot_ps(yz, xy), one));
+  __m128 k2 = _mm_sub_ps(one, _mm_and_ps(_mm_and_ps(xz, yz), one));
+
+  __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), g3);
+  __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), g3);
+  __m128 z1 = _mm_add_ps(_mm_sub_ps(z0, k1), g3);
+  __m128 g3x2 = _mm_set1_ps(2.0f * kNoiseG3);
+  __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, i2), g3x2);
+  __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, j2), g3x2);
+  __m128 z2 = _mm_add_ps(_mm_sub_ps(z0, k2), g3x2);
+  __m128 c3 = _mm_set1_ps(-1.0f + 3.0f * kNoiseG3);
+  __m128 x3 = _mm_add_ps(x0, c3), y3 = _mm_add_ps(y0, c3), z3 = _mm_add_ps(z0, c3);
+
+  int ia[4], ja[4], ka[4], o1[3][4], o2[3][4];
+  int gi[4][4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(ia), i);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(ja), j);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(ka), k);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(o1[0]), _mm_cvtps_epi32(i1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(o1[1]), _mm_cvtps_epi32(j1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(o1[2]), _mm_cvtps_epi32(k1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(o2[0]), _mm_cvtps_epi32(i2));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(o2[1]), _mm_cvtps_epi32(j2));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(o2[2]), _mm_cvtps_epi32(k2));
+  const uint8_t* perm = noise->perm;
+  const uint8_t* mod12 = noise->perm_mod12;
+  for (int l = 0; l < 4; ++l) {
+    int ii = ia[l] & 255, jj = ja[l] & 255, kk = ka[l] & 255;
+    gi[0][l] = mod12[ii + perm[jj + perm[kk]]];
+    gi[1][l] = mod12[ii + o1[0][l] + perm[jj + o1[1][l] + perm[kk + o1[2][l]]]];
+    gi[2][l] = mod12[ii + o2[0][l] + perm[jj + o2[1][l] + perm[kk + o2[2][l]]]];
+    gi[3][l] = mod12[ii + 1 + perm[jj + 1 + perm[kk + 1]]];
+  }
+
+  __m128 gx, gy, gz;
+  NoiseGather3(gi[0], &gx, &gy, &gz);
+  __m128 n = NoiseCorner4(NoiseFalloff3(x0, y0, z0),
+                          NoiseDot3(gx, gy, gz, x0, y0, z0));
+  NoiseGather3(gi[1], &gx, &gy, &gz);
+  n = _mm_add_ps(n, NoiseCorner4(NoiseFalloff3(x1, y1, z1),
+                                 NoiseDot3(gx, gy, gz, x1, y1, z1)));
+  NoiseGather3(gi[2], &gx, &gy, &gz);
+  n = _mm_add_ps(n, NoiseCorner4(NoiseFalloff3(x2, y2, z2),
+                                 NoiseDot3(gx, gy, gz, x2, y2, z2)));
+  NoiseGather3(gi[3], &gx, &gy, &gz);
+  n = _mm_add_ps(n, NoiseCorner4(NoiseFalloff3(x3, y3, z3),
+                                 NoiseDot3(gx, gy, gz, x3, y3, z3)));
+  _mm_storeu_ps(out, _mm_mul_ps(_mm_set1_ps(32.0f), n));
+}
+#endif  // defined(__SSE2__)
+
+static void Simplex2Batch(const NoiseGenerator* noise, int count,
+                          const float* const* coords, float* out) {
+  int i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4)
+    Simplex2Batch4(noise, coords[0] + i, coords[1] + i, out + i);
+#endif
+  for (; i < count; ++i)
+    out[i] = Simplex2(noise, coords[0][i], coords[1][i]);
+}
+
+static void Simplex3Batch(const NoiseGenerator* noise, int count,
+                          const float* const* coords, float* out) {
+  int i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4)
+    Simplex3Batch4(noise, coords[0] + i, coords[1] + i, coords[2] + i, out + i);
+#endif
+  for (; i < count; ++i)
+    out[i] = Simplex3(noise, coords[0][i], coords[1][i], coords[2][i]);
+}
+
+static void Simplex4Batch(const NoiseGenerator* noise, int count,
+                          const float* const* coords, float* out) {
+  for (int i = 0; i < count; ++i) {
+    out[i] = Simplex4(noise, coords[0][i], coords[1][i],
+                      coords[2][i], coords[3][i]);
+  }
+}
+
+static void Perlin2Batch(const NoiseGenerator* noise, int count,
+                         const float* const* coords, float* out) {
+  for (int i = 0; i < count; ++i)
+    out[i] = Perlin2(noise, coords[0][i], coords[1][i]);
+}
+
+static void Perlin3Batch(const NoiseGenerator* noise, int count,
+                         const float* const* coords, float* out) {
+  for (int i = 0; i < count; ++i)
+    out[i] = Perlin3(noise, coords[0][i], coords[1][i], coords[2][i]);
+}
+
+static void Perlin4Batch(const NoiseGenerator* noise, int count,
+                         const float* const* coords, float* out) {
+  for (int i = 0; i < count; ++i) {
+    out[i] = Perlin4(noise, coords[0][i], coords[1][i],
+                     coords[2][i], coords[3][i]);
+  }
+}
+
+static NoiseBatchFunc NoiseBatchFor(int kind, int dims) {
+  static const NoiseBatchFunc simplex[3] = {
+    &Simplex2Batch, &Simplex3Batch, &Simplex4Batch};
+  static const NoiseBatchFunc perlin[3] = {
+    &Perlin2Batch, &Perlin3Batch, &Perlin4Batch};
+  return (kind == kPerlinNoise ? perlin : simplex)[dims - 2];
+}
+
+// The points sampled at a time, small enough to stay on the stack.
+const int kNoiseChunk = 64;
+
+// Fractal noise at |count| (up to kNoiseChunk) points of |dims| dimensions.
+static void NoiseChunk(const NoiseGenerator* noise, int dims, int count,
+                       const float* const* coords, float* out) {
+  NoiseBatchFunc batch = NoiseBatchFor(noise->kind, dims);
+  if (noise->octaves <= 1 && !noise->turbulence) {
+    batch(noise, count, coords, out);
+    return;
+  }
+
+  float scaled[4][kNoiseChunk];
+  const float* scaled_coords[4] = {scaled[0], scaled[1], scaled[2], scaled[3]};
+  float octave[kNoiseChunk];
+  for (int i = 0; i < count; ++i)
+    out[i] = 0;
+  float frequency = 1.0f, amplitude = 1.0f, total = 0.0f;
+  for (int o = 0; o < std::max(1, noise->octaves); ++o) {
+    for (int d = 0; d < dims; ++d) {
+      for (int i = 0; i < count; ++i)
+        scaled[d][i] = coords[d][i] * frequency;
+    }
+    batch(noise, count, scaled_coords, octave);
+    if (noise->turbulence) {
+      for (int i = 0; i < count; ++i)
+        out[i] += amplitude * fabsf(octave[i]);
+    } else {
+      for (int i = 0; i < count; ++i)
+        out[i] += amplitude * octave[i];
+    }
+    total += amplitude;
+    frequency *= noise->lacunarity;
+    amplitude *= noise->gain;
+  }
+  if (total > 0) {
+    float scale = 1.0f / total;
+    for (int i = 0; i < count; ++i)
+      out[i] *= scale;
+  }
+}
+
+// Fractal noise at one point.
+static float NoiseAt(const NoiseGenerator* noise, int dims, const float* p) {
+  const float* coords[4] = {&p[0], &p[1], &p[2], &p[3]};
+  float out;
+  NoiseChunk(noise, dims, 1, coords, &out);
+  return out;
+}
+
+// A grid of samples, (x, y, z, w) + (column * dx, row * dy, 0, 0).
+struct NoiseGrid {
+  float origin[4];
+  float dx, dy;
+  int width, height;
+};
+
+// Where a NoiseJob's samples go.
+enum NoiseOutput {
+  kNoiseToFloats,  // |out| floats, a sample each.
+  kNoiseToPixels,  // |pixels| opaque gray BGRA, |lo| to |hi| as 0 to 255.
+};
+
+struct NoiseJob {
+  const NoiseGenerator* noise;
+  int dims;
+  const NoiseGrid* grid;  // Rows [first, last) of the grid, or...
+  const float* points;  // ...points [first, last), |dims| floats each.
+  int first, last;
+  int output;
+  float* out;
+  uint8_t* pixels;
+  size_t stride;  // Bytes between rows of |pixels|.
+  float lo, hi;
+};
+
+static void NoiseWrite(const NoiseJob* job, size_t index, int row, int column,
+                       int count, const float* values) {
+  if (job->output == kNoiseToFloats) {
+    memcpy(job->out + index, values, count * sizeof(float));
+    return;
+  }
+  float scale = job->hi != job->lo ? 255.0f / (job->hi - job->lo) : 0.0f;
+  uint32_t* pixel = reinterpret_cast<uint32_t*>(
+      job->pixels + job->stride * row) + column;
+  for (int i = 0; i < count; ++i) {
+    float v = (values[i] - job->lo) * scale + 0.5f;
+    uint32_t gray = v <= 0.0f ? 0 : (v >= 255.0f ? 255 : static_cast<uint32_t>(v));
+    pixel[i] = SkPackARGB32(255, gray, gray, gray);
+  }
+}
+
+static void NoiseRun(void* arg) {
+  const NoiseJob* job = reinterpret_cast<const NoiseJob*>(arg);
+  int dims = job->dims;
+  float coords[4][kNoiseChunk];
+  const float* coord_ptrs[4] = {coords[0], coords[1], coords[2], coords[3]};
+  float values[kNoiseChunk];
+
+  if (job->grid) {
+    const NoiseGrid* grid = job->grid;
+    for (int row = job->first; row < job->last; ++row) {
+      float y = grid->origin[1] + row * grid->dy;
+      for (int column = 0; column < grid->width; column += kNoiseChunk) {
+        int count = std::min(kNoiseChunk, grid->width - column);
+        for (int i = 0; i < count; ++i) {
+          coords[0][i] = grid->origin[0] + (column + i) * grid->dx;
+          coords[1][i] = y;
+          coords[2][i] = grid->origin[2];
+          coords[3][i] = grid->origin[3];
+        }
+        NoiseChunk(job->noise, dims, count, coord_ptrs, values);
+        NoiseWrite(job, static_cast<size_t>(row) * grid->width + column,
+                   row, column, count, values);
+      }
+    }
+    return;
+  }
+
+  for (int first = job->first; first < job->last; first += kNoiseChunk) {
+    int count = std::min(kNoiseChunk, job->last - first);
+    const float* p = job->points + static_cast<size_t>(first) * dims;
+    for (int i = 0; i < count; ++i, p += dims) {
+      for (int d = 0; d < dims; ++d)
+        coords[d][i] = p[d];
+    }
+    NoiseChunk(job->noise, dims, count, coord_ptrs, values);
+    NoiseWrite(job, first, 0, 0, count, values);
+  }
+}
+
+// Run |job| over [0, |total|) rows or points, split on up to |threads|
+// threads.  The calling thread does the first share.
+static void RunNoiseJobs(const NoiseJob& job, int total, int threads) {
+  const int kMinPerThread = job.grid ? 8 : 4096;
+  threads = std::max(1, std::min(threads, total / kMinPerThread));
+
+  std::vector<NoiseJob> jobs(threads, job);
+  std::vector<uv_thread_t> thread_ids(threads);
+  for (int i = 0; i < threads; ++i) {
+    jobs[i].first = static_cast<int>(static_cast<int64_t>(total) * i / threads);
+    jobs[i].last = static_cast<int>(static_cast<int64_t>(total) * (i + 1) / threads);
+  }
+  int started = 1;
+  for (; started < threads; ++started) {
+    if (uv_thread_create(&thread_ids[started], &NoiseRun, &jobs[started]) != 0)
+      break;
+  }
+  for (int i = started; i < threads; ++i)  // Couldn't start them, do them here.
+    NoiseRun(&jobs[i]);
+  NoiseRun(&jobs[0]);
+  for (int i = 1; i < started; ++i)
+    uv_thread_join(&thread_ids[i]);
+}
+
+class NSOpenGLContextWrapper {
+ public:
+  enum WebGLType {
+    WebGLTypeInvalid = 0,
+    WebGLTypeDOMString,
+    WebGLTypeFloat32Arrayx2,
+    WebGLTypeFloat32Arrayx4,
+    WebGLTypeGLboolean,
+    WebGLTypeGLbooleanx4,
+    WebGLTypeGLenum,
+    WebGLTypeGLfloat,
+    WebGLTypeGLint,
+    WebGLTypeGLuint,
+    WebGLTypeInt32Arrayx2,
+    WebGLTypeInt32Arrayx4,
+    WebGLTypeUint32Array,
+    WebGLTypeWebGLBuffer,
+    WebGLTypeWebGLFramebuffer,
+    WebGLTypeWebGLProgram,
+    WebGLTypeWebGLRenderbuffer,
+    WebGLTypeWebGLTexture,
+    WebGLTypeWebGLVertexArrayObject,
+    WebGLTypeWebGLTransformFeedback,
   };
 
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
     v8::Local<v8::FunctionTemplate> ft =
         v8::FunctionTemplate::New(isolate, &NSOpenGLContextWrapper::V8New);
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 #if PLASK_GPUSKIA
     instance->SetInternalFieldCount(3);  // gl context, SkSurface, and GrContext.
 #else
@@ -1181,6 +3127,7 @@ class NSOpenGLContextWrapper {
       METHOD_ENTRY( bindBufferBase ),
       METHOD_ENTRY( bindBufferRange ),
       METHOD_ENTRY( getBufferSubData ),
+      METHOD_ENTRY( createStreamBuffer ),
 #endif
       METHOD_ENTRY( stencilFunc ),
       METHOD_ENTRY( stencilFuncSeparate ),
@@ -1191,6 +3138,7 @@ class NSOpenGLContextWrapper {
       METHOD_ENTRY( texImage2D ),
       METHOD_ENTRY( texImage2DSkCanvasB ),
       METHOD_ENTRY( compressedTexImage2D ),
+      METHOD_ENTRY( compressedTexSubImage2D ),
       METHOD_ENTRY( texParameterf ),
       METHOD_ENTRY( texParameteri ),
       METHOD_ENTRY( texSubImage2D ),
@@ -1243,15 +3191,14 @@ class NSOpenGLContextWrapper {
     for (size_t i = 0; i < arraysize(constants); ++i) {
       ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
               v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 NewInstrumentedMethod(isolate, "NSOpenGLContext", methods[i],
+                                       default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -1282,6 +3229,9 @@ class NSOpenGLContextWrapper {
       return v8_utils::ThrowTypeError(isolate, kMsgNonConstructCall);
 
     unsigned int multisample = args[0]->Uint32Value();
+    // Apple's software renderer is slow, but is available without a GPU and
+    // renders the same everywhere, which is what tests and benchmarks want.
+    bool software = args.Length() > 1 && args[1]->BooleanValue();
 
     NSOpenGLContext* context = NULL;
 
@@ -1303,6 +3253,18 @@ class NSOpenGLContextWrapper {
     if (!multisample)
       attrs[8] = 0;
 
+    if (software) {
+      NSOpenGLPixelFormatAttribute software_attrs[] = {
+          NSOpenGLPFAColorSize, 24,
+          NSOpenGLPFADepthSize, 16,
+          NSOpenGLPFADoubleBuffer,
+          NSOpenGLPFARendererID, kCGLRendererGenericFloatID,
+          NSOpenGLPFAStencilSize, 8,
+          0
+      };
+      memcpy(attrs, software_attrs, sizeof(software_attrs));
+    }
+
     NSOpenGLPixelFormat* format = [[NSOpenGLPixelFormat alloc] initWithAttributes:attrs];
     context = [[NSOpenGLContext alloc] initWithFormat:format shareContext:nil];
     [format release];
@@ -1392,6 +3354,7 @@ class NSOpenGLContextWrapper {
 #endif
 
   static void blit(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    PLASK_TRACE_EVENT("gl", "blit");
     NSOpenGLContext* context = ExtractContextPointer(args.Holder());
 #if PLASK_OSX
     [context flushBuffer];
@@ -1581,6 +3544,7 @@ class NSOpenGLContextWrapper {
   // void bufferData(GLenum target, ArrayBufferView data, GLenum usage)
   // void bufferData(GLenum target, ArrayBuffer data, GLenum usage)
   DEFINE_METHOD(bufferData, 3)
+    PLASK_TRACE_EVENT("gl", "bufferData");
     GLsizeiptr size = 0;
     GLvoid* data = NULL;
 
@@ -1598,6 +3562,7 @@ class NSOpenGLContextWrapper {
   // void bufferSubData(GLenum target, GLsizeiptr offset, ArrayBufferView data)
   // void bufferSubData(GLenum target, GLsizeiptr offset, ArrayBuffer data)
   DEFINE_METHOD(bufferSubData, 3)
+    PLASK_TRACE_EVENT("gl", "bufferSubData");
     GLsizeiptr size = 0;
     GLintptr offset = args[1]->Int32Value();
     GLvoid* data = NULL;
@@ -1906,6 +3871,7 @@ class NSOpenGLContextWrapper {
 
   // void drawArrays(GLenum mode, GLint first, GLsizei count)
   DEFINE_METHOD(drawArrays, 3)
+    PLASK_TRACE_EVENT("gl", "drawArrays");
     glDrawArrays(args[0]->Uint32Value(),
                  args[1]->Int32Value(), args[2]->Int32Value());
     return args.GetReturnValue().SetUndefined();
@@ -1914,6 +3880,7 @@ class NSOpenGLContextWrapper {
   // void drawElements(GLenum mode, GLsizei count,
   //                   GLenum type, GLsizeiptr offset)
   DEFINE_METHOD(drawElements, 4)
+    PLASK_TRACE_EVENT("gl", "drawElements");
     glDrawElements(args[0]->Uint32Value(),
                    args[1]->Int32Value(),
                    args[2]->Uint32Value(),
@@ -1931,6 +3898,7 @@ class NSOpenGLContextWrapper {
 
   // void drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount)
   DEFINE_METHOD(drawArraysInstanced, 4)
+    PLASK_TRACE_EVENT("gl", "drawArraysInstanced");
     glDrawArraysInstancedARB(args[0]->Uint32Value(),
                              args[1]->Int32Value(),
                              args[2]->Int32Value(),
@@ -1942,6 +3910,7 @@ class NSOpenGLContextWrapper {
   //                            GLenum type, GLintptr offset,
   //                            GLsizei instanceCount)
   DEFINE_METHOD(drawElementsInstanced, 5)
+    PLASK_TRACE_EVENT("gl", "drawElementsInstanced");
     glDrawElementsInstancedARB(args[0]->Uint32Value(),
                                args[1]->Int32Value(),
                                args[2]->Uint32Value(),
@@ -1954,6 +3923,7 @@ class NSOpenGLContextWrapper {
   //                        GLuint start, GLuint end,
   //                        GLsizei count, GLenum type, GLintptr offset)
   DEFINE_METHOD(drawRangeElements, 6)
+    PLASK_TRACE_EVENT("gl", "drawRangeElements");
     glDrawRangeElementsEXT(args[0]->Uint32Value(),
                            args[1]->Uint32Value(),
                            args[2]->Uint32Value(),
@@ -2644,6 +4614,7 @@ class NSOpenGLContextWrapper {
   // void readPixels(GLint x, GLint y, GLsizei width, GLsizei height,
   //                 GLenum format, GLenum type, ArrayBufferView pixels)
   DEFINE_METHOD(readPixels, 7)
+    PLASK_TRACE_EVENT("gl", "readPixels");
     GLint x = args[0]->Int32Value();
     GLint y = args[1]->Int32Value();
     GLsizei width = args[2]->Int32Value();
@@ -2846,32 +4817,47 @@ class NSOpenGLContextWrapper {
     GLenum target = args[0]->Uint32Value();
     GLintptr offset = args[1]->IntegerValue();
 
-    GLboolean was_okay = false;
-
-    while (!was_okay) {  // This loop seems like a horrible idea...
-      //void* map = glMapBufferRange(target, offset, size, GL_MAP_READ_BIT);  // GL3
-      void* map = glMapBuffer(target, GL_READ_ONLY);  // GL2
-      if (!map) return args.GetReturnValue().SetUndefined();
+    if (size == 0)
+      return args.GetReturnValue().SetUndefined();
 
-      //memcpy(data, map, size);
-      memcpy(data, reinterpret_cast<char*>(map) + offset, size);
+    PLASK_TRACE_EVENT("gl", "getBufferSubData");
 
-      // "When a data store is unmapped, the pointer to its data store becomes
-      //  invalid. glUnmapBuffer returns GL_TRUE unless the data store contents
-      //  have become corrupt during the time the data store was mapped. This
-      //  can occur for system-specific reasons that affect the availability of
-      //  graphics memory, such as screen mode changes. In such situations,
-      //  GL_FALSE is returned and the data store contents are undefined. An
-      //  application must detect this rare condition and reinitialize the data
-      //  store."
-      was_okay = glUnmapBuffer(target);
-    }
+    // Only the range asked for is read back, rather than mapping the whole
+    // buffer.  Check it's in the buffer first.
+    GLint buffer_size = 0;
+    glGetBufferParameteriv(target, GL_BUFFER_SIZE, &buffer_size);
+    if (offset < 0 || offset > buffer_size || size > buffer_size - offset)
+      return v8_utils::ThrowError(isolate, "Read outside of the buffer.");
 
+    glGetBufferSubData(target, offset, size, data);
     return args.GetReturnValue().SetUndefined();
   }
-#endif  // PLASK_WEBGL2
 
-  // void stencilFunc(GLenum func, GLint ref, GLuint mask)
+  // WebGLStreamBuffer createStreamBuffer(GLenum target, int segment_size,
+  //                                      int num_segments)
+  //
+  // Plask-specific, not in WebGL.  Create a buffer for streaming dynamic data
+  // to the GPU each frame, a ring of `num_segments` (1 to 16, typically 3)
+  // segments of `segment_size` bytes.  Each frame:
+  //
+  //   var f32 = stream.map();  // Float32Array over this frame's segment.
+  //   ... write vertices into f32 ...
+  //   var offset = stream.unmap(num_bytes_written);
+  //   gl.vertexAttribPointer(loc, 2, gl.FLOAT, false, 0, offset);
+  //   gl.drawArrays(...);
+  //   stream.endFrame();
+  //
+  // The `buffer` property is the WebGLBuffer, for binding it elsewhere.
+  DEFINE_METHOD(createStreamBuffer, 3)
+    v8::Handle<v8::Value> res = WebGLStreamBuffer::NewStreamBuffer(
+        args[0]->Uint32Value(), args[1]->Int32Value(), args[2]->Int32Value());
+    if (res.IsEmpty())
+      return;  // Exception already thrown.
+    return args.GetReturnValue().Set(res);
+  }
+#endif  // PLASK_WEBGL2
+
+  // void stencilFunc(GLenum func, GLint ref, GLuint mask)
   DEFINE_METHOD(stencilFunc, 3)
     glStencilFunc(args[0]->Uint32Value(),
                   args[1]->Int32Value(),
@@ -2930,6 +4916,7 @@ class NSOpenGLContextWrapper {
   // void texImage2D(GLenum target, GLint level, GLenum internalformat,
   //                 GLenum format, GLenum type, HTMLVideoElement video)
   DEFINE_METHOD(texImage2D, 9)
+    PLASK_TRACE_EVENT("gl", "texImage2D");
     GLvoid* data = NULL;
     GLsizeiptr size = 0;  // FIXME use size
 
@@ -2960,27 +4947,64 @@ class NSOpenGLContextWrapper {
   //                           GLsizei width, GLsizei height, GLint border,
   //                           ArrayBufferView data)
   DEFINE_METHOD(compressedTexImage2D, 7)
+    PLASK_TRACE_EVENT("gl", "compressedTexImage2D");
     GLvoid* data = NULL;
-    GLsizeiptr size = 0;  // FIXME use size
+    intptr_t size = 0;
+    GLenum internalformat = args[2]->Uint32Value();
+    GLsizei width = args[3]->Int32Value(), height = args[4]->Int32Value();
 
     if (!args[6]->IsNull()) {
-      // TODO(deanm): Check size / format.  For now just use it correctly.
       if (!GetTypedArrayBytes(args[6], &data, &size))
         return v8_utils::ThrowError(isolate, "Data must be a TypedArray.");
     }
+    // As in WebGL, the data must be exactly the size of the image.
+    if (data && S3TCBlockBytes(internalformat) != 0 && width >= 0 && height >= 0 &&
+        static_cast<size_t>(size) != S3TCImageBytes(internalformat, width, height)) {
+      return v8_utils::ThrowError(isolate,
+          "Compressed data is the wrong size for its format and dimensions.");
+    }
 
-    // TODO(deanm): Support more than just the zero initialization case.
     glCompressedTexImage2D(args[0]->Uint32Value(),  // target
                            args[1]->Int32Value(),   // level
-                           args[2]->Int32Value(),   // internalFormat
-                           args[3]->Int32Value(),   // width
-                           args[4]->Int32Value(),   // height
+                           internalformat,          // internalFormat
+                           width,                   // width
+                           height,                  // height
                            args[5]->Int32Value(),   // border
                            size,                    // size
                            data);                   // data
     return args.GetReturnValue().SetUndefined();
   }
 
+  // void compressedTexSubImage2D(GLenum target, GLint level,
+  //                              GLint xoffset, GLint yoffset,
+  //                              GLsizei width, GLsizei height, GLenum format,
+  //                              ArrayBufferView data)
+  DEFINE_METHOD(compressedTexSubImage2D, 8)
+    PLASK_TRACE_EVENT("gl", "compressedTexSubImage2D");
+    void* data;
+    intptr_t size;
+    if (!GetTypedArrayBytes(args[7], &data, &size))
+      return v8_utils::ThrowError(isolate, "Data must be a TypedArray.");
+    GLsizei width = args[4]->Int32Value(), height = args[5]->Int32Value();
+    GLenum format = args[6]->Uint32Value();
+    if (S3TCBlockBytes(format) != 0 && width >= 0 && height >= 0 &&
+        static_cast<size_t>(size) != S3TCImageBytes(format, width, height)) {
+      return v8_utils::ThrowError(isolate,
+          "Compressed data is the wrong size for its format and dimensions.");
+    }
+
+    glCompressedTexSubImage2D(args[0]->Uint32Value(),  // target
+                              args[1]->Int32Value(),   // level
+                              args[2]->Int32Value(),   // xoffset
+                              args[3]->Int32Value(),   // yoffset
+                              width,                   // width
+                              height,                  // height
+                              format,                  // format
+                              size,                    // size
+                              data);                   // data
+    return args.GetReturnValue().SetUndefined();
+  }
+
   // void texParameterf(GLenum target, GLenum pname, GLfloat param)
   DEFINE_METHOD(texParameterf, 3)
     glTexParameterf(args[0]->Uint32Value(),
@@ -3015,6 +5039,7 @@ class NSOpenGLContextWrapper {
   //                    GLenum format, GLenum type, HTMLVideoElement video)
 
   DEFINE_METHOD(texSubImage2D, 9)
+    PLASK_TRACE_EVENT("gl", "texSubImage2D");
     GLvoid* data = NULL;
     GLsizeiptr size = 0;  // FIXME use size
 
@@ -3517,10 +5542,235 @@ class NSOpenGLContextWrapper {
 };
 
 
+// Input event queue.
+//
+// High rate input (mouse, drag, scroll and tablet) is decoded as it arrives
+// into fixed size records of doubles in a ring, rather than each event being
+// wrapped in an NSEvent object and passed to JavaScript on its own.  JS drains
+// the ring, usually once per frame, into a Float64Array that it reuses, see
+// EventQueue in plask.js for the decoding.  A full ring overwrites its oldest
+// records, the number overwritten is kept in dropped().
+
+const int kEventRecordSize = 16;  // Doubles per record.
+
+enum EventRecordField {
+  kEventFieldType = 0,        // The NSEventType.
+  kEventFieldTimestamp,       // Seconds since system startup.
+  kEventFieldX,               // locationInWindow, bottom left origin, points.
+  kEventFieldY,
+  kEventFieldDeltaX,
+  kEventFieldDeltaY,
+  kEventFieldDeltaZ,
+  kEventFieldPressure,
+  kEventFieldButton,          // buttonNumber, from 0.
+  kEventFieldClickCount,
+  kEventFieldModifiers,       // modifierFlags.
+  kEventFieldScrollingDeltaX,
+  kEventFieldScrollingDeltaY,
+  kEventFieldFlags,           // kEventFlag* bits.
+  kEventFieldPhase,
+  kEventFieldMomentumPhase,
+};
+
+enum EventRecordFlags {
+  kEventFlagPreciseScrollingDeltas = 1,
+  kEventFlagEnteringProximity = 2,
+};
+
+class EventQueue {
+ public:
+  explicit EventQueue(int capacity)
+      : records_(capacity * kEventRecordSize), capacity_(capacity),
+        head_(0), size_(0), dropped_(0) { }
+
+  bool empty() const { return size_ == 0; }
+  int size() const { return size_; }
+  int capacity() const { return capacity_; }
+  double dropped() const { return dropped_; }
+
+  // Returns a zeroed record at the end of the queue, for the caller to fill.
+  double* Push() {
+    if (size_ == capacity_) {  // Overwrite the oldest.
+      head_ = (head_ + 1) % capacity_;
+      --size_;
+      ++dropped_;
+    }
+    double* record =
+        &records_[((head_ + size_) % capacity_) * kEventRecordSize];
+    ++size_;
+    memset(record, 0, sizeof(double) * kEventRecordSize);
+    return record;
+  }
+
+  // Moves up to |max_records| records, oldest first, to |out|.  Returns the
+  // number of records moved.
+  int Drain(double* out, int max_records) {
+    int num = std::min(size_, max_records);
+    for (int i = 0; i < num; ) {
+      // The records up to the end of the ring are contiguous.
+      int run = std::min(num - i, capacity_ - head_);
+      memcpy(out + i * kEventRecordSize, &records_[head_ * kEventRecordSize],
+             sizeof(double) * kEventRecordSize * run);
+      head_ = (head_ + run) % capacity_;
+      size_ -= run;
+      i += run;
+    }
+    return num;
+  }
+
+ private:
+  std::vector<double> records_;
+  int capacity_;
+  int head_;  // Index of the oldest record.
+  int size_;
+  double dropped_;
+};
+
+class PlaskEventQueueWrapper {
+ public:
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft =
+        v8::FunctionTemplate::New(isolate, &PlaskEventQueueWrapper::V8New);
+    v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
+    instance->SetInternalFieldCount(1);  // EventQueue pointer.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
+
+    v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
+
+    static BatchedConstants constants[] = {
+      { "RECORD_SIZE", kEventRecordSize },
+      { "FLAG_PRECISE_SCROLLING_DELTAS", kEventFlagPreciseScrollingDeltas },
+      { "FLAG_ENTERING_PROXIMITY", kEventFlagEnteringProximity },
+    };
+
+    static BatchedMethods methods[] = {
+      METHOD_ENTRY( push ),
+      METHOD_ENTRY( drain ),
+      METHOD_ENTRY( size ),
+      METHOD_ENTRY( capacity ),
+      METHOD_ENTRY( dropped ),
+    };
+
+    for (size_t i = 0; i < arraysize(constants); ++i) {
+      ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+              v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+    }
+
+    for (size_t i = 0; i < arraysize(methods); ++i) {
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
+    }
+
+    ft_cache.Reset(isolate, ft);
+    return ft_cache;
+  }
+
+  static bool HasInstance(v8::Isolate* isolate, v8::Handle<v8::Value> value) {
+    return PersistentToLocal(isolate, GetTemplate(isolate))->HasInstance(value);
+  }
+
+  static EventQueue* ExtractPointer(v8::Handle<v8::Object> obj) {
+    return reinterpret_cast<EventQueue*>(obj->GetAlignedPointerFromInternalField(0));
+  }
+
+ private:
+  static void WeakCallback(
+      const v8::WeakCallbackData<v8::Object, v8::Persistent<v8::Object> >& data) {
+    EventQueue* queue = ExtractPointer(data.GetValue());
+
+    v8::Persistent<v8::Object>* persistent = data.GetParameter();
+    persistent->ClearWeak();
+    persistent->Reset();
+    delete persistent;
+
+    delete queue;
+  }
+
+  // new PlaskEventQueue(int capacity)
+  //
+  // Create a queue holding up to `capacity` event records.  Attach it to a
+  // window with NSWindow setEventQueue.
+  static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (!args.IsConstructCall())
+      return v8_utils::ThrowTypeError(isolate, kMsgNonConstructCall);
+
+    int capacity = args[0]->Int32Value();
+    if (capacity <= 0 || capacity > (1 << 20))
+      return v8_utils::ThrowError(isolate, "Invalid event queue capacity.");
+
+    args.This()->SetAlignedPointerInInternalField(0, new EventQueue(capacity));
+
+    v8::Persistent<v8::Object>* persistent = new v8::Persistent<v8::Object>;
+    persistent->Reset(isolate, args.This());
+    persistent->SetWeak(persistent, &PlaskEventQueueWrapper::WeakCallback);
+
+    args.GetReturnValue().Set(args.This());
+  }
+
+  // void push(type, timestamp, x, y, dx, dy, dz, pressure, button, clickCount,
+  //           modifiers, scrollingDeltaX, scrollingDeltaY, flags, phase,
+  //           momentumPhase)
+  //
+  // Queue a record, with the fields in record order.  Used for synthetic
+  // events, native events are queued without calling into JavaScript.
+  DEFINE_METHOD(push, kEventRecordSize)
+    EventQueue* queue = ExtractPointer(args.This());
+    double* record = queue->Push();
+    for (int i = 0; i < kEventRecordSize; ++i)
+      record[i] = args[i]->NumberValue();
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // int drain(Float64Array records)
+  //
+  // Move as many queued records as fit into `records`, oldest first, and
+  // return the number moved.
+  DEFINE_METHOD(drain, 1)
+    EventQueue* queue = ExtractPointer(args.This());
+    if (!args[0]->IsFloat64Array())
+      return v8_utils::ThrowTypeError(isolate, "drain expects a Float64Array.");
+    void* data;
+    intptr_t size;
+    if (!GetTypedArrayBytes(args[0], &data, &size))
+      return v8_utils::ThrowError(isolate, "Unable to access the Float64Array.");
+    int num = queue->Drain(reinterpret_cast<double*>(data),
+                           size / (sizeof(double) * kEventRecordSize));
+    return args.GetReturnValue().Set(num);
+  }
+
+  // int size()
+  //
+  // The number of records queued.
+  DEFINE_METHOD(size, 0)
+    return args.GetReturnValue().Set(ExtractPointer(args.This())->size());
+  }
+
+  // int capacity()
+  DEFINE_METHOD(capacity, 0)
+    return args.GetReturnValue().Set(ExtractPointer(args.This())->capacity());
+  }
+
+  // int dropped()
+  //
+  // The number of records overwritten because the queue was full.
+  DEFINE_METHOD(dropped, 0)
+    return args.GetReturnValue().Set(ExtractPointer(args.This())->dropped());
+  }
+};
+
+
 class NSWindowWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -3534,6 +5784,7 @@ class NSWindowWrapper {
 
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
     instance->SetInternalFieldCount(1);  // NSWindow
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     // Configure the template...
     static BatchedConstants constants[] = {
@@ -3545,6 +5796,7 @@ class NSWindowWrapper {
       METHOD_ENTRY( setAcceptsMouseMovedEvents ),
       METHOD_ENTRY( setAcceptsFileDrag ),
       METHOD_ENTRY( setEventCallback ),
+      METHOD_ENTRY( setEventQueue ),
       METHOD_ENTRY( setTitle ),
       METHOD_ENTRY( setFrameTopLeftPoint ),
       METHOD_ENTRY( center ),
@@ -3565,15 +5817,15 @@ class NSWindowWrapper {
     for (size_t i = 0; i < arraysize(constants); ++i) {
       ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
               v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -3829,6 +6081,23 @@ class NSWindowWrapper {
     return args.GetReturnValue().SetUndefined();
   }
 
+  // void setEventQueue(PlaskEventQueue? queue)
+  //
+  // While a queue is set, mouse, drag, scroll and tablet events are written to
+  // it instead of going to the event callback one by one.  The callback is
+  // called with message type 2 when the queue stops being empty.  Pass null to
+  // go back to per event delivery.
+  static void setEventQueue(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (args.Length() != 1 ||
+        !(args[0]->IsNull() || PlaskEventQueueWrapper::HasInstance(isolate, args[0])))
+      return v8_utils::ThrowError(isolate, "Expected PlaskEventQueue or null.");
+    WrappedNSWindow* window = ExtractWindowPointer(args.Holder());
+#if PLASK_OSX
+    [window setEventQueueWithHandle:args[0]];
+#endif  // PLASK_OSX
+    return args.GetReturnValue().SetUndefined();
+  }
+
   // void setTitle(string title)
   //
   // Sets the title shown in the frame at the top of the window.
@@ -4031,7 +6300,7 @@ class NSWindowWrapper {
 class NSEventWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -4039,6 +6308,7 @@ class NSEventWrapper {
         v8::FunctionTemplate::New(isolate, &NSEventWrapper::V8New);
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
     instance->SetInternalFieldCount(1);  // NSEvent pointer.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
@@ -4117,8 +6387,8 @@ class NSEventWrapper {
     for (size_t i = 0; i < arraysize(constants); ++i) {
       ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
               v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(class_methods); ++i) {
@@ -4128,10 +6398,10 @@ class NSEventWrapper {
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -4391,14 +6661,15 @@ class NSEventWrapper {
 class SkPathWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
     v8::Local<v8::FunctionTemplate> ft =
         v8::FunctionTemplate::New(isolate, &SkPathWrapper::V8New);
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
-    instance->SetInternalFieldCount(1);  // SkPath pointer.
+    instance->SetInternalFieldCount(2);  // SkPath pointer, and frozen flag.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
@@ -4423,42 +6694,46 @@ class SkPathWrapper {
       { "kDoneVerb",  SkPath::kDone_Verb },   //!< iter.next returns 0 points
     };
 
+    // The methods that change the path, which throw once it's frozen.
+#define MUTATING_METHOD_ENTRY(name) { #name, &Mutating<&name> }
     static BatchedMethods methods[] = {
-      METHOD_ENTRY( reset ),
-      METHOD_ENTRY( rewind ),
-      METHOD_ENTRY( moveTo ),
-      METHOD_ENTRY( lineTo ),
-      METHOD_ENTRY( rLineTo ),
-      METHOD_ENTRY( quadTo ),
-      METHOD_ENTRY( cubicTo ),
-      METHOD_ENTRY( arcTo ),
-      METHOD_ENTRY( arct ),
-      METHOD_ENTRY( addRect ),
-      METHOD_ENTRY( addOval ),
-      METHOD_ENTRY( addCircle ),
-      METHOD_ENTRY( close ),
-      METHOD_ENTRY( offset ),
+      MUTATING_METHOD_ENTRY( reset ),
+      MUTATING_METHOD_ENTRY( rewind ),
+      MUTATING_METHOD_ENTRY( moveTo ),
+      MUTATING_METHOD_ENTRY( lineTo ),
+      MUTATING_METHOD_ENTRY( rLineTo ),
+      MUTATING_METHOD_ENTRY( quadTo ),
+      MUTATING_METHOD_ENTRY( cubicTo ),
+      MUTATING_METHOD_ENTRY( arcTo ),
+      MUTATING_METHOD_ENTRY( arct ),
+      MUTATING_METHOD_ENTRY( addRect ),
+      MUTATING_METHOD_ENTRY( addOval ),
+      MUTATING_METHOD_ENTRY( addCircle ),
+      MUTATING_METHOD_ENTRY( close ),
+      MUTATING_METHOD_ENTRY( offset ),
       METHOD_ENTRY( getBounds ),
-      METHOD_ENTRY( transform ),
+      MUTATING_METHOD_ENTRY( transform ),
       METHOD_ENTRY( toSVGString ),
-      METHOD_ENTRY( fromSVGString ),
-      METHOD_ENTRY( op ),
+      MUTATING_METHOD_ENTRY( fromSVGString ),
+      MUTATING_METHOD_ENTRY( op ),
       METHOD_ENTRY( getPoints ),
       METHOD_ENTRY( getVerbs ),
+      METHOD_ENTRY( freeze ),
+      METHOD_ENTRY( isFrozen ),
     };
+#undef MUTATING_METHOD_ENTRY
 
     for (size_t i = 0; i < arraysize(constants); ++i) {
       ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
               v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 NewInstrumentedMethod(isolate, "SkPath", methods[i],
+                                       default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -4473,7 +6748,42 @@ class SkPathWrapper {
     return PersistentToLocal(isolate, GetTemplate(isolate))->HasInstance(value);
   }
 
+  static bool IsFrozen(v8::Handle<v8::Object> obj) {
+    return obj->GetAlignedPointerFromInternalField(1) != NULL;
+  }
+
+  // Throws and returns false if |obj| is frozen.
+  static bool CheckNotFrozen(v8::Handle<v8::Object> obj) {
+    if (!IsFrozen(obj))
+      return true;
+    v8_utils::ThrowError(isolate, "SkPath is frozen.");
+    return false;
+  }
+
  private:
+  template <v8::FunctionCallback Method>
+  static void Mutating(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (CheckNotFrozen(args.Holder()))
+      Method(args);
+  }
+
+  // void freeze()
+  //
+  // Mark the path as immutable, the methods that would change it throw from
+  // now on.  Frozen paths drawn to bitmap canvases have their rasterization
+  // cached, so that drawing them again, with a paint of the same geometry and
+  // at the same scale and rotation, is a blit.  See SkCanvas pathCacheStats.
+  static void freeze(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    // Any non-NULL pointer will do as the flag.
+    args.Holder()->SetAlignedPointerInInternalField(1, ExtractPointer(args.Holder()));
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // bool isFrozen()
+  static void isFrozen(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return args.GetReturnValue().Set(IsFrozen(args.Holder()));
+  }
+
   // void reset()
   //
   // Reset the path to an empty path.
@@ -4749,6 +7059,7 @@ class SkPathWrapper {
   // void SkPath(SkPath? path_to_copy)
   //
   // Construct a new path object, optionally based off of an existing path.
+  // A copy of a frozen path isn't frozen.
   static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
     if (!args.IsConstructCall())
       return v8_utils::ThrowTypeError(isolate, kMsgNonConstructCall);
@@ -4761,14 +7072,155 @@ class SkPathWrapper {
 
     SkPath* path = prev_path ? new SkPath(*prev_path) : new SkPath;
     args.This()->SetAlignedPointerInInternalField(0, path);
+    args.This()->SetAlignedPointerInInternalField(1, NULL);  // Not frozen.
   }
 };
 
 
+// Gradient shader cache.
+//
+// Setting a gradient on a paint every frame would create a new SkShader each
+// time, building its color table again when it's first drawn.  Gradient
+// shaders are kept by their contents instead (type, geometry, tile mode and
+// stops, hashed), so setting the same gradient again reuses the SkShader.
+// The least recently used are dropped past a number of entries.  Shared by
+// all threads, under a lock, SkShaders are immutable.
+
+enum GradientType {
+  kLinearGradient,
+  kRadialGradient,
+  kSweepGradient,
+  kTwoPointConicalGradient,
+};
+
+// A gradient's key words: type, tile mode, 6 geometry floats, the number of
+// stops, their positions (floats), then their colors (SkColor).
+static const size_t kGradientKeyHeader = 9;
+
+struct GradientEntry {
+  std::vector<uint32_t> key;
+  SkShader* shader;  // A reference.
+  std::list<uint64_t>::iterator lru;
+};
+
+typedef std::map<uint64_t, GradientEntry> GradientMap;
+
+static uv_once_t g_gradient_once = UV_ONCE_INIT;
+static uv_mutex_t g_gradient_lock;
+// Guarded by g_gradient_lock.
+static GradientMap* g_gradients = NULL;
+static std::list<uint64_t>* g_gradient_lru = NULL;  // Most recent first.
+static size_t g_gradient_capacity = 256;
+static uint64_t g_gradient_hits = 0;
+static uint64_t g_gradient_misses = 0;
+static uint64_t g_gradient_evictions = 0;
+
+static void GradientInitOnce() {
+  uv_mutex_init(&g_gradient_lock);
+  g_gradients = new GradientMap;
+  g_gradient_lru = new std::list<uint64_t>;
+}
+
+// Drop least recently used shaders until at most |capacity| are cached.
+// Called with g_gradient_lock held.
+static void GradientTrimLocked(size_t capacity) {
+  while (g_gradients->size() > capacity) {
+    GradientMap::iterator it = g_gradients->find(g_gradient_lru->back());
+    it->second.shader->unref();
+    g_gradients->erase(it);
+    g_gradient_lru->pop_back();
+    ++g_gradient_evictions;
+  }
+}
+
+static uint64_t HashGradientKey(const std::vector<uint32_t>& key) {
+  uint64_t hash = 14695981039346656037ULL;  // FNV-1a.
+  for (size_t i = 0; i < key.size(); ++i)
+    hash = (hash ^ key[i]) * 1099511628211ULL;
+  return hash;
+}
+
+static uint32_t GradientFloatBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static SkShader* CreateGradientShader(const std::vector<uint32_t>& key) {
+  int count = key[8];
+  if (count < 1)
+    return NULL;
+  std::vector<SkScalar> positions(count);
+  std::vector<SkColor> colors(count);
+  memcpy(&positions[0], &key[kGradientKeyHeader], count * sizeof(SkScalar));
+  memcpy(&colors[0], &key[kGradientKeyHeader + count], count * sizeof(SkColor));
+  SkScalar g[6];
+  memcpy(g, &key[2], sizeof(g));
+  SkShader::TileMode tile = static_cast<SkShader::TileMode>(key[1]);
+
+  switch (key[0]) {
+    case kLinearGradient: {
+      SkPoint points[2] = {{g[0], g[1]}, {g[2], g[3]}};
+      return SkGradientShader::CreateLinear(
+          points, &colors[0], &positions[0], count, tile);
+    }
+    case kRadialGradient:
+      return SkGradientShader::CreateRadial(
+          SkPoint::Make(g[0], g[1]), g[2],
+          &colors[0], &positions[0], count, tile);
+    case kSweepGradient:
+      return SkGradientShader::CreateSweep(
+          g[0], g[1], &colors[0], &positions[0], count);
+    case kTwoPointConicalGradient:
+      return SkGradientShader::CreateTwoPointConical(
+          SkPoint::Make(g[0], g[1]), g[2], SkPoint::Make(g[3], g[4]), g[5],
+          &colors[0], &positions[0], count, tile);
+  }
+  return NULL;
+}
+
+// Set the gradient shader for |key| on |paint|, from the cache if it's there.
+static void SetGradientShader(SkPaint* paint, const std::vector<uint32_t>& key) {
+  uv_once(&g_gradient_once, &GradientInitOnce);
+  uint64_t hash = HashGradientKey(key);
+
+  uv_mutex_lock(&g_gradient_lock);
+  GradientMap::iterator it = g_gradients->find(hash);
+  if (it != g_gradients->end() && it->second.key == key) {
+    ++g_gradient_hits;
+    g_gradient_lru->splice(g_gradient_lru->begin(), *g_gradient_lru,
+                           it->second.lru);
+    paint->setShader(it->second.shader);
+    uv_mutex_unlock(&g_gradient_lock);
+    return;
+  }
+  ++g_gradient_misses;
+  uv_mutex_unlock(&g_gradient_lock);
+
+  SkShader* shader = CreateGradientShader(key);
+  paint->setShader(shader);
+  if (!shader)
+    return;
+
+  uv_mutex_lock(&g_gradient_lock);
+  if (g_gradient_capacity > 0 && g_gradients->find(hash) == g_gradients->end()) {
+    g_gradient_lru->push_front(hash);
+    GradientEntry& entry = (*g_gradients)[hash];
+    entry.key = key;
+    entry.shader = shader;  // Takes the creation reference.
+    entry.lru = g_gradient_lru->begin();
+    GradientTrimLocked(g_gradient_capacity);
+    shader = NULL;
+  }
+  uv_mutex_unlock(&g_gradient_lock);
+  if (shader)  // Not cached (or a collision), the paint has its reference.
+    shader->unref();
+}
+
 class SkPaintWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -4776,6 +7228,7 @@ class SkPaintWrapper {
         v8::FunctionTemplate::New(isolate, &SkPaintWrapper::V8New);
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
     instance->SetInternalFieldCount(1);  // SkPaint pointer.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
@@ -4835,6 +7288,15 @@ class SkPaintWrapper {
       { "kRoundJoin", SkPaint::kRound_Join },
       { "kBevelJoin", SkPaint::kBevel_Join },
       { "kDefaultJoin", SkPaint::kDefault_Join },
+      // Gradient SkShader::TileMode.
+      { "kClampTileMode", SkShader::kClamp_TileMode },
+      { "kRepeatTileMode", SkShader::kRepeat_TileMode },
+      { "kMirrorTileMode", SkShader::kMirror_TileMode },
+    };
+
+    static BatchedMethods class_methods[] = {
+      { "shaderCacheStats", &SkPaintWrapper::class_shaderCacheStats },
+      { "setShaderCacheSize", &SkPaintWrapper::class_setShaderCacheSize },
     };
 
     static BatchedMethods methods[] = {
@@ -4872,6 +7334,8 @@ class SkPaintWrapper {
       METHOD_ENTRY( setFontFamilyPostScript ),
       METHOD_ENTRY( setLinearGradientShader ),
       METHOD_ENTRY( setRadialGradientShader ),
+      METHOD_ENTRY( setSweepGradientShader ),
+      METHOD_ENTRY( setTwoPointConicalGradientShader ),
       METHOD_ENTRY( clearShader ),
       METHOD_ENTRY( setDashPathEffect ),
       METHOD_ENTRY( setDiscretePathEffect ),
@@ -4887,15 +7351,20 @@ class SkPaintWrapper {
     for (size_t i = 0; i < arraysize(constants); ++i) {
       ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
               v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+    }
+
+    for (size_t i = 0; i < arraysize(class_methods); ++i) {
+      ft->Set(v8::String::NewFromUtf8(isolate, class_methods[i].name),
+              v8::FunctionTemplate::New(isolate, class_methods[i].func,
+                                        v8::Handle<v8::Value>()));
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 NewInstrumentedMethod(isolate, "SkPaint", methods[i],
+                                       default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -5171,6 +7640,9 @@ class SkPaintWrapper {
     if (!SkPathWrapper::HasInstance(isolate, args[1]))
       return args.GetReturnValue().SetUndefined();
 
+    if (!SkPathWrapper::CheckNotFrozen(v8::Handle<v8::Object>::Cast(args[1])))
+      return;
+
     SkPath* src = SkPathWrapper::ExtractPointer(
         v8::Handle<v8::Object>::Cast(args[0]));
     SkPath* dst = SkPathWrapper::ExtractPointer(
@@ -5308,85 +7780,175 @@ class SkPaintWrapper {
     return args.GetReturnValue().SetUndefined();
   }
 
-  // void setLinearGradientShader(x0, y0, x1, y1, float[ ] colorpositions)
-  DEFINE_METHOD(setLinearGradientShader, 5)
-    SkPaint* paint = ExtractPointer(args.Holder());
-
-    SkPoint points[2] = {{SkDoubleToScalar(args[0]->NumberValue()),
-                          SkDoubleToScalar(args[1]->NumberValue())},
-                         {SkDoubleToScalar(args[2]->NumberValue()),
-                          SkDoubleToScalar(args[3]->NumberValue())}};
-
-    SkColor* colors = NULL;
-    SkScalar* positions = NULL;
-    uint32_t num = 0;
-
-    if (args[4]->IsArray()) {
-      v8::Handle<v8::Array> data = v8::Handle<v8::Array>::Cast(args[4]);
-      uint32_t data_len = data->Length();
-      num = data_len / 5;
-
-      colors = new SkColor[num];
-      positions = new SkScalar[num];
-
-      for (uint32_t i = 0, j = 0; i < data_len; i += 5, ++j) {
-        positions[j] = SkDoubleToScalar(data->Get(i)->NumberValue());
-        colors[j] = SkColorSetARGB(data->Get(i+4)->Uint32Value() & 0xff,
-                                   data->Get(i+1)->Uint32Value() & 0xff,
-                                   data->Get(i+2)->Uint32Value() & 0xff,
-                                   data->Get(i+3)->Uint32Value() & 0xff);
+  // Read the tile mode argument at |index|, kClampTileMode when not given.
+  static bool GetTileModeArg(const v8::FunctionCallbackInfo<v8::Value>& args,
+                             int index, SkShader::TileMode* mode) {
+    *mode = SkShader::kClamp_TileMode;
+    if (args.Length() <= index || args[index]->IsUndefined())
+      return true;
+    uint32_t value = args[index]->Uint32Value();
+    if (value >= SkShader::kTileModeCount) {
+      v8_utils::ThrowError(isolate, "Invalid tile mode.");
+      return false;
+    }
+    *mode = static_cast<SkShader::TileMode>(value);
+    return true;
+  }
+
+  static uint32_t GradientColorByte(double value) {
+    return value == value ? static_cast<int64_t>(value) & 0xff : 0;
+  }
+
+  // Append the stops, an Array or a Float32Array of [pos, r, g, b, a, ...]
+  // with the color components 0-255, to the gradient |key| (the count, the
+  // positions, then the colors).  Anything else is no stops.
+  static void AppendGradientStops(v8::Handle<v8::Value> stops,
+                                  std::vector<uint32_t>* key) {
+    if (stops->IsFloat32Array()) {
+      // Read in place, without a property lookup per component.
+      void* data;
+      intptr_t size;
+      GetTypedArrayBytes(stops, &data, &size);
+      const float* values = reinterpret_cast<const float*>(data);
+      uint32_t num = size / sizeof(float) / 5;
+      key->push_back(num);
+      for (uint32_t i = 0; i < num; ++i)
+        key->push_back(GradientFloatBits(values[i * 5]));
+      for (uint32_t i = 0; i < num; ++i) {
+        const float* c = values + i * 5 + 1;
+        key->push_back(SkColorSetARGB(GradientColorByte(c[3]),
+                                      GradientColorByte(c[0]),
+                                      GradientColorByte(c[1]),
+                                      GradientColorByte(c[2])));
       }
+    } else if (stops->IsArray()) {
+      v8::Handle<v8::Array> data = v8::Handle<v8::Array>::Cast(stops);
+      uint32_t num = data->Length() / 5;
+      key->push_back(num);
+      for (uint32_t i = 0; i < num; ++i) {
+        key->push_back(GradientFloatBits(
+            SkDoubleToScalar(data->Get(i * 5)->NumberValue())));
+      }
+      for (uint32_t i = 0; i < num; ++i) {
+        uint32_t j = i * 5;
+        key->push_back(SkColorSetARGB(data->Get(j+4)->Uint32Value() & 0xff,
+                                      data->Get(j+1)->Uint32Value() & 0xff,
+                                      data->Get(j+2)->Uint32Value() & 0xff,
+                                      data->Get(j+3)->Uint32Value() & 0xff));
+      }
+    } else {
+      key->push_back(0);
     }
+  }
 
-    // TODO(deanm): Tile mode.
-    SkShader* s = SkGradientShader::CreateLinear(points, colors, positions, num,
-                                                 SkShader::kClamp_TileMode);
-    paint->setShader(s);
+  // Set a |type| gradient, from the |num_geometry| numbers at the start of
+  // |args|, followed by the stops, and the tile mode when |tiled|.
+  static void SetGradientShaderFromArgs(
+      const v8::FunctionCallbackInfo<v8::Value>& args,
+      GradientType type, int num_geometry, bool tiled) {
+    if (args.Length() < num_geometry + 1 ||
+        args.Length() > num_geometry + (tiled ? 2 : 1))
+      return v8_utils::ThrowError(isolate, "Wrong number of arguments.");
 
-    delete[] colors;
-    delete[] positions;
+    SkShader::TileMode tile = SkShader::kClamp_TileMode;
+    if (tiled && !GetTileModeArg(args, num_geometry + 1, &tile))
+      return;
+
+    std::vector<uint32_t> key;
+    key.reserve(kGradientKeyHeader + 16 * 2);
+    key.push_back(type);
+    key.push_back(tile);
+    for (int i = 0; i < 6; ++i) {
+      key.push_back(GradientFloatBits(i < num_geometry ?
+          SkDoubleToScalar(args[i]->NumberValue()) : 0));
+    }
+    AppendGradientStops(args[num_geometry], &key);
 
+    SkPaint* paint = ExtractPointer(args.Holder());
+    SetGradientShader(paint, key);
     return args.GetReturnValue().SetUndefined();
   }
 
-  // void setRadialGradientShader(x, y, radius, float[ ] colorpositions)
-  DEFINE_METHOD(setRadialGradientShader, 4)
-    SkPaint* paint = ExtractPointer(args.Holder());
-
-    SkPoint center = {SkDoubleToScalar(args[0]->NumberValue()),
-                      SkDoubleToScalar(args[1]->NumberValue())};
-    SkScalar radius = SkDoubleToScalar(args[2]->NumberValue());
-
-    SkColor* colors = NULL;
-    SkScalar* positions = NULL;
-    uint32_t num = 0;
+  // void setLinearGradientShader(x0, y0, x1, y1, float[ ] colorpositions, tile)
+  //
+  // The color positions are [pos, r, g, b, a, ...] with the colors 0-255, as
+  // an Array or a Float32Array.  The tile mode is one of kClampTileMode (the
+  // default), kRepeatTileMode or kMirrorTileMode.  Gradient shaders are
+  // cached by their contents (see SkPaint.shaderCacheStats), setting the
+  // same gradient again reuses its shader.
+  static void setLinearGradientShader(
+      const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return SetGradientShaderFromArgs(args, kLinearGradient, 4, true);
+  }
 
-    if (args[3]->IsArray()) {
-      v8::Handle<v8::Array> data = v8::Handle<v8::Array>::Cast(args[3]);
-      uint32_t data_len = data->Length();
-      num = data_len / 5;
+  // void setRadialGradientShader(x, y, radius, float[ ] colorpositions, tile)
+  static void setRadialGradientShader(
+      const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return SetGradientShaderFromArgs(args, kRadialGradient, 3, true);
+  }
 
-      colors = new SkColor[num];
-      positions = new SkScalar[num];
+  // void setSweepGradientShader(cx, cy, float[ ] colorpositions)
+  //
+  // A gradient around (cx, cy), clockwise from the positive x axis.
+  static void setSweepGradientShader(
+      const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return SetGradientShaderFromArgs(args, kSweepGradient, 2, false);
+  }
 
-      for (uint32_t i = 0, j = 0; i < data_len; i += 5, ++j) {
-        positions[j] = SkDoubleToScalar(data->Get(i)->NumberValue());
-        colors[j] = SkColorSetARGB(data->Get(i+4)->Uint32Value() & 0xff,
-                                   data->Get(i+1)->Uint32Value() & 0xff,
-                                   data->Get(i+2)->Uint32Value() & 0xff,
-                                   data->Get(i+3)->Uint32Value() & 0xff);
-      }
-    }
+  // void setTwoPointConicalGradientShader(x0, y0, r0, x1, y1, r1,
+  //                                       float[ ] colorpositions, tile)
+  //
+  // A gradient between the circle (x0, y0, r0) and the circle (x1, y1, r1),
+  // like the canvas 2D createRadialGradient.
+  static void setTwoPointConicalGradientShader(
+      const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return SetGradientShaderFromArgs(args, kTwoPointConicalGradient, 6, true);
+  }
 
-    // TODO(deanm): Tile mode.
-    SkShader* s = SkGradientShader::CreateRadial(center, radius,
-                                                 colors, positions, num,
-                                                 SkShader::kClamp_TileMode);
-    paint->setShader(s);
+  // object shaderCacheStats()
+  //
+  // The gradient shader cache's counters: {hits, misses, evictions, entries,
+  // maxEntries, hitRate}.
+  static void class_shaderCacheStats(
+      const v8::FunctionCallbackInfo<v8::Value>& args) {
+    uv_once(&g_gradient_once, &GradientInitOnce);
+    uv_mutex_lock(&g_gradient_lock);
+    double hits = g_gradient_hits, misses = g_gradient_misses;
+    double evictions = g_gradient_evictions;
+    double entries = g_gradients->size(), capacity = g_gradient_capacity;
+    uv_mutex_unlock(&g_gradient_lock);
 
-    delete[] colors;
-    delete[] positions;
+    v8::Local<v8::Object> res = v8::Object::New(isolate);
+    res->Set(v8::String::NewFromUtf8(isolate, "hits"),
+             v8::Number::New(isolate, hits));
+    res->Set(v8::String::NewFromUtf8(isolate, "misses"),
+             v8::Number::New(isolate, misses));
+    res->Set(v8::String::NewFromUtf8(isolate, "evictions"),
+             v8::Number::New(isolate, evictions));
+    res->Set(v8::String::NewFromUtf8(isolate, "entries"),
+             v8::Number::New(isolate, entries));
+    res->Set(v8::String::NewFromUtf8(isolate, "maxEntries"),
+             v8::Number::New(isolate, capacity));
+    res->Set(v8::String::NewFromUtf8(isolate, "hitRate"),
+             v8::Number::New(isolate, hits + misses > 0 ?
+                                      hits / (hits + misses) : 0));
+    return args.GetReturnValue().Set(res);
+  }
 
+  // void setShaderCacheSize(entries)
+  //
+  // Keep at most `entries` gradient shaders (default 256), dropping the least
+  // recently used now if over.  0 turns the cache off.
+  static void class_setShaderCacheSize(
+      const v8::FunctionCallbackInfo<v8::Value>& args) {
+    double entries = args[0]->NumberValue();
+    if (!(entries >= 0))
+      return v8_utils::ThrowError(isolate, "Invalid shader cache size.");
+    uv_once(&g_gradient_once, &GradientInitOnce);
+    uv_mutex_lock(&g_gradient_lock);
+    g_gradient_capacity = static_cast<size_t>(entries);
+    GradientTrimLocked(g_gradient_capacity);
+    uv_mutex_unlock(&g_gradient_lock);
     return args.GetReturnValue().SetUndefined();
   }
 
@@ -5512,6 +8074,8 @@ class SkPaintWrapper {
 
     if (!SkPathWrapper::HasInstance(isolate, args[3]))
       return v8_utils::ThrowTypeError(isolate, "4th argument must be an SkPath.");
+    if (!SkPathWrapper::CheckNotFrozen(v8::Handle<v8::Object>::Cast(args[3])))
+      return;
 
     SkPath* path = SkPathWrapper::ExtractPointer(
         v8::Handle<v8::Object>::Cast(args[3]));
@@ -5546,19 +8110,837 @@ class SkPaintWrapper {
 };
 
 
-class SkCanvasWrapper {
+// Asset packs.
+//
+// An asset pack is a single file of pre-decoded images, so loading them needs
+// no decode, convert or premultiply.  Each blob starts on a
+// kAssetPackAlignment boundary (a multiple of the page size), and the index
+// is at the end.  All integers are little endian:
+//
+//   header:  char magic[8] "PLASKPAK", u32 version, u32 count, u32 alignment,
+//            u32 reserved, u64 index_offset, u64 index_bytes
+//   index:   per entry, u32 name_bytes, the UTF-8 name padded to 4 bytes,
+//            u32 format, u32 width, u32 height, u64 offset, u64 bytes
+//
+// A format of 0 is premultiplied BGRA pixels, rows packed with no padding, in
+// the layout of a bitmap canvas.  Otherwise it's the GL internal format of
+// compressed texture data.  Packs are written by AssetPack.write in plask.js.
+//
+// A pack is mapped whole, and canvases over its images point straight at the
+// mapped pages, which are only read from disk as they are touched.  The
+// mapping is unmapped when the pack object and every canvas over it are gone.
+
+const char kAssetPackMagic[8] = { 'P', 'L', 'A', 'S', 'K', 'P', 'A', 'K' };
+const uint32_t kAssetPackVersion = 1;
+const uint32_t kAssetPackHeaderBytes = 40;
+const uint32_t kAssetPackFormatBGRA = 0;
+
+struct AssetPackEntry {
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint64_t offset;
+  uint64_t bytes;
+};
+
+struct AssetPack {
+  uint8_t* base;
+  size_t length;
+  int refs;  // The pack object and the canvases over it, atomic.
+  std::map<std::string, AssetPackEntry> entries;
+  std::vector<std::string> names;  // In pack order.
+};
+
+static void RefAssetPack(AssetPack* pack) {
+  __sync_add_and_fetch(&pack->refs, 1);
+}
+
+static void UnrefAssetPack(AssetPack* pack) {
+  if (__sync_sub_and_fetch(&pack->refs, 1) != 0)
+    return;
+  munmap(pack->base, pack->length);
+  delete pack;
+}
+
+// Reads the little endian integers of an asset pack, with bounds checks.
+class AssetPackReader {
  public:
-  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
-    if (!ft_cache.IsEmpty())
-      return ft_cache;
+  AssetPackReader(const uint8_t* data, size_t length)
+      : data_(data), length_(length), pos_(0) { }
 
-    v8::Local<v8::FunctionTemplate> ft =
-        v8::FunctionTemplate::New(isolate, &SkCanvasWrapper::V8New);
-    v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
-    instance->SetInternalFieldCount(2);  // SkCanvas and SkDocument (pdf) pointers.
+  bool U32(uint32_t* out) {
+    const uint8_t* p = Bytes(4);
+    if (!p) return false;
+    *out = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    return true;
+  }
 
-    v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
+  bool U64(uint64_t* out) {
+    uint32_t lo, hi;
+    if (!U32(&lo) || !U32(&hi)) return false;
+    *out = (static_cast<uint64_t>(hi) << 32) | lo;
+    return true;
+  }
+
+  // The next |num| bytes, or NULL if there aren't that many.
+  const uint8_t* Bytes(size_t num) {
+    if (num > length_ - pos_) return NULL;
+    const uint8_t* p = data_ + pos_;
+    pos_ += num;
+    return p;
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t length_;
+  size_t pos_;
+};
+
+static bool ParseAssetPackIndex(AssetPack* pack) {
+  AssetPackReader header(pack->base, pack->length);
+  const uint8_t* magic = header.Bytes(sizeof(kAssetPackMagic));
+  uint32_t version, count, alignment, reserved;
+  uint64_t index_offset, index_bytes;
+  if (!magic || memcmp(magic, kAssetPackMagic, sizeof(kAssetPackMagic)) != 0 ||
+      !header.U32(&version) || version != kAssetPackVersion ||
+      !header.U32(&count) || !header.U32(&alignment) || alignment == 0 ||
+      alignment % getpagesize() != 0 ||  // Entries are page aligned.
+      !header.U32(&reserved) ||
+      !header.U64(&index_offset) || !header.U64(&index_bytes) ||
+      index_bytes > pack->length || index_offset > pack->length - index_bytes) {
+    return false;
+  }
+
+  AssetPackReader index(pack->base + index_offset, index_bytes);
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t name_bytes;
+    if (!index.U32(&name_bytes))
+      return false;
+    // Padded in 64 bits, a 32 bit name_bytes near 4G would wrap around.
+    const uint8_t* name =
+        index.Bytes((static_cast<uint64_t>(name_bytes) + 3) & ~UINT64_C(3));
+    AssetPackEntry entry;
+    if (!name || !index.U32(&entry.format) ||
+        !index.U32(&entry.width) || !index.U32(&entry.height) ||
+        !index.U64(&entry.offset) || !index.U64(&entry.bytes)) {
+      return false;
+    }
+    if (entry.offset % alignment != 0 || entry.bytes > pack->length ||
+        entry.offset > pack->length - entry.bytes) {
+      return false;
+    }
+    if (entry.format == kAssetPackFormatBGRA &&
+        entry.bytes != static_cast<uint64_t>(entry.width) * entry.height * 4) {
+      return false;
+    }
+    std::string key(reinterpret_cast<const char*>(name), name_bytes);
+    if (!pack->entries.insert(std::make_pair(key, entry)).second)
+      return false;  // The same name twice.
+    pack->names.push_back(key);
+  }
+  return true;
+}
+
+// Map and index the pack |filename|, with one reference, or NULL and |error|.
+static AssetPack* OpenAssetPack(const char* filename, const char** error) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    *error = "Couldn't open asset pack.";
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(kAssetPackHeaderBytes)) {
+    close(fd);
+    *error = "Not an asset pack.";
+    return NULL;
+  }
+  // Private and writable, so a stray write through pixel indexing changes
+  // this process' copy of the page rather than faulting.
+  void* base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, 0);
+  close(fd);  // The mapping keeps the file open.
+  if (base == MAP_FAILED) {
+    *error = "Couldn't map asset pack.";
+    return NULL;
+  }
+
+  AssetPack* pack = new AssetPack;
+  pack->base = reinterpret_cast<uint8_t*>(base);
+  pack->length = st.st_size;
+  pack->refs = 1;
+  if (!ParseAssetPackIndex(pack)) {
+    UnrefAssetPack(pack);
+    *error = "Not an asset pack, or a corrupt one.";
+    return NULL;
+  }
+  return pack;
+}
+
+static const AssetPackEntry* FindAssetPackEntry(AssetPack* pack,
+                                                const std::string& name) {
+  std::map<std::string, AssetPackEntry>::const_iterator it =
+      pack->entries.find(name);
+  return it == pack->entries.end() ? NULL : &it->second;
+}
+
+class PlaskAssetPackWrapper {
+ public:
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft =
+        v8::FunctionTemplate::New(isolate, &PlaskAssetPackWrapper::V8New);
+    v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
+    instance->SetInternalFieldCount(1);  // AssetPack pointer.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
+
+    v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
+
+    static BatchedConstants constants[] = {
+      { "FORMAT_BGRA", kAssetPackFormatBGRA },
+    };
+
+    static BatchedMethods methods[] = {
+      METHOD_ENTRY( names ),
+      METHOD_ENTRY( entry ),
+      METHOD_ENTRY( data ),
+      METHOD_ENTRY( prefetch ),
+    };
+
+    for (size_t i = 0; i < arraysize(constants); ++i) {
+      ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+              v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+    }
+
+    for (size_t i = 0; i < arraysize(methods); ++i) {
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
+    }
+
+    ft_cache.Reset(isolate, ft);
+    return ft_cache;
+  }
+
+  static bool HasInstance(v8::Isolate* isolate, v8::Handle<v8::Value> value) {
+    return PersistentToLocal(isolate, GetTemplate(isolate))->HasInstance(value);
+  }
+
+  static AssetPack* ExtractPointer(v8::Handle<v8::Object> obj) {
+    return reinterpret_cast<AssetPack*>(obj->GetAlignedPointerFromInternalField(0));
+  }
+
+ private:
+  static void WeakCallback(
+      const v8::WeakCallbackData<v8::Object, v8::Persistent<v8::Object> >& data) {
+    AssetPack* pack = ExtractPointer(data.GetValue());
+
+    v8::Persistent<v8::Object>* persistent = data.GetParameter();
+    persistent->ClearWeak();
+    persistent->Reset();
+    delete persistent;
+
+    UnrefAssetPack(pack);  // Canvases over the pack keep it mapped.
+  }
+
+  // new PlaskAssetPack(string filename)
+  //
+  // Open the asset pack `filename`.  Only the index is read, images are read
+  // in as they are used.  See SkCanvas.createFromPack.
+  static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (!args.IsConstructCall())
+      return v8_utils::ThrowTypeError(isolate, kMsgNonConstructCall);
+
+    v8::String::Utf8Value filename(args[0]);
+    const char* error = NULL;
+    AssetPack* pack = OpenAssetPack(*filename, &error);
+    if (!pack)
+      return v8_utils::ThrowError(isolate, error);
+
+    args.This()->SetAlignedPointerInInternalField(0, pack);
+    args.This()->Set(v8::String::NewFromUtf8(isolate, "byteLength"),
+                     v8::Number::New(isolate, pack->length));
+
+    v8::Persistent<v8::Object>* persistent = new v8::Persistent<v8::Object>;
+    persistent->Reset(isolate, args.This());
+    persistent->SetWeak(persistent, &PlaskAssetPackWrapper::WeakCallback);
+
+    args.GetReturnValue().Set(args.This());
+  }
+
+  // string[ ] names()
+  //
+  // The names of the pack's entries, in the order they were written.
+  DEFINE_METHOD(names, 0)
+    AssetPack* pack = ExtractPointer(args.This());
+    v8::Local<v8::Array> res = v8::Array::New(isolate, pack->names.size());
+    for (size_t i = 0; i < pack->names.size(); ++i) {
+      res->Set(i, v8::String::NewFromUtf8(isolate, pack->names[i].data(),
+                                          v8::String::kNormalString,
+                                          pack->names[i].size()));
+    }
+    return args.GetReturnValue().Set(res);
+  }
+
+  // object entry(string name)
+  //
+  // {format, width, height, byteLength} of the entry `name`, or null if there
+  // is none.  `format` is FORMAT_BGRA for images, otherwise the GL internal
+  // format of compressed texture data.
+  DEFINE_METHOD(entry, 1)
+    AssetPack* pack = ExtractPointer(args.This());
+    v8::String::Utf8Value name(args[0]);
+    const AssetPackEntry* entry =
+        FindAssetPackEntry(pack, std::string(*name, name.length()));
+    if (!entry)
+      return args.GetReturnValue().SetNull();
+
+    v8::Local<v8::Object> res = v8::Object::New(isolate);
+    res->Set(v8::String::NewFromUtf8(isolate, "format"),
+             v8::Integer::NewFromUnsigned(isolate, entry->format));
+    res->Set(v8::String::NewFromUtf8(isolate, "width"),
+             v8::Integer::NewFromUnsigned(isolate, entry->width));
+    res->Set(v8::String::NewFromUtf8(isolate, "height"),
+             v8::Integer::NewFromUnsigned(isolate, entry->height));
+    res->Set(v8::String::NewFromUtf8(isolate, "byteLength"),
+             v8::Number::New(isolate, entry->bytes));
+    return args.GetReturnValue().Set(res);
+  }
+
+  // Uint8Array data(string name)
+  //
+  // The bytes of the entry `name`, ex. compressed texture data for
+  // compressedTexImage2D, as a view straight onto the mapped file.  The view
+  // keeps the pack mapped, and can't be transferred to a worker.
+  DEFINE_METHOD(data, 1)
+    AssetPack* pack = ExtractPointer(args.This());
+    v8::String::Utf8Value name(args[0]);
+    const AssetPackEntry* entry =
+        FindAssetPackEntry(pack, std::string(*name, name.length()));
+    if (!entry)
+      return v8_utils::ThrowError(isolate, "No such entry in the asset pack.");
+
+    v8::Local<v8::ArrayBuffer> ab = v8::ArrayBuffer::New(
+        isolate, pack->base + entry->offset, entry->bytes);
+    ab->SetHiddenValue(v8::String::NewFromUtf8(isolate, "plask::assetPack"),
+                       args.This());
+    return args.GetReturnValue().Set(
+        v8::Uint8Array::New(ab, 0, entry->bytes));
+  }
+
+  // void prefetch(string name)
+  //
+  // Ask for the entry `name` (or with no name, the whole pack) to be read in
+  // from disk in the background, ahead of its first use.
+  static void prefetch(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    AssetPack* pack = ExtractPointer(args.This());
+    uint8_t* start = pack->base;
+    size_t length = pack->length;
+    if (args.Length() > 0) {
+      v8::String::Utf8Value name(args[0]);
+      const AssetPackEntry* entry =
+          FindAssetPackEntry(pack, std::string(*name, name.length()));
+      if (!entry)
+        return v8_utils::ThrowError(isolate, "No such entry in the asset pack.");
+      start += entry->offset;  // Page aligned.
+      length = entry->bytes;
+    }
+    if (length != 0)
+      madvise(start, length, MADV_WILLNEED);
+    return args.GetReturnValue().SetUndefined();
+  }
+};
+
+// Pixel pool.
+//
+// Bitmap canvases take their pixels from a pool of free blocks bucketed by
+// size class, powers of two with three steps in between so a block is at most
+// a quarter bigger than asked for.  A block returns to the pool when the last
+// SkPixelRef over it goes, so when its canvas is disposed or collected, and is
+// reused by the next canvas of the same size class.  At most
+// g_pixel_pool_limit bytes of free blocks are kept.  Workers have canvases
+// too, so the pool is under a lock.  Canvases over asset pack images use the
+// same blocks, over the mapped pixels instead of pooled ones.
+
+const size_t kPixelPoolMinBlock = 4096;
+
+struct PooledCanvas;
+
+struct PixelBlock {
+  void* pixels;
+  size_t bytes;  // The size class.
+  int refs;  // SkPixelRefs over the block, guarded by g_pixel_pool_lock.
+  AssetPack* pack;  // The pack |pixels| are mapped from, or NULL if pooled.
+  // The canvases drawing with the block, more than one is copy-on-write
+  // sharing.  Only touched by the thread owning the canvases.
+  std::vector<PooledCanvas*> sharers;
+};
+
+// A bitmap canvas with pooled pixels, in the canvas' third internal field.
+struct PooledCanvas {
+  PixelBlock* block;  // NULL once disposed.
+  v8::Persistent<v8::Object>* handle;  // The canvas' weak handle.
+  int64_t reported_bytes;  // Given to AdjustAmountOfExternalAllocatedMemory.
+  // A copy-on-write copy that hasn't been drawn to or had its matrix, clip or
+  // save stack changed, so it can be moved to other pixels without losing any
+  // state.  Of the canvases sharing a block, all but one are pristine.
+  bool pristine;
+};
+
+static uv_once_t g_pixel_pool_once = UV_ONCE_INIT;
+static uv_mutex_t g_pixel_pool_lock;
+// Guarded by g_pixel_pool_lock.
+static std::map<size_t, std::vector<void*> >* g_pixel_pool_free = NULL;
+static size_t g_pixel_pool_limit = 256 << 20;
+static size_t g_pixel_pool_live_bytes = 0;
+static size_t g_pixel_pool_pooled_bytes = 0;
+static uint64_t g_pixel_pool_hits = 0;
+static uint64_t g_pixel_pool_misses = 0;
+
+static void PixelPoolInitOnce() {
+  uv_mutex_init(&g_pixel_pool_lock);
+  g_pixel_pool_free = new std::map<size_t, std::vector<void*> >;
+}
+
+static size_t PixelPoolSizeClass(size_t bytes) {
+  if (bytes <= kPixelPoolMinBlock)
+    return kPixelPoolMinBlock;
+  size_t base = kPixelPoolMinBlock;
+  while (base * 2 < bytes) base *= 2;
+  size_t step = base / 4;
+  return base + (bytes - base + step - 1) / step * step;
+}
+
+// Free pooled blocks, largest first, until at most |limit| bytes are pooled.
+// Called with g_pixel_pool_lock held.
+static void PixelPoolTrimLocked(size_t limit) {
+  while (g_pixel_pool_pooled_bytes > limit && !g_pixel_pool_free->empty()) {
+    std::map<size_t, std::vector<void*> >::iterator it =
+        --g_pixel_pool_free->end();
+    free(it->second.back());
+    it->second.pop_back();
+    g_pixel_pool_pooled_bytes -= it->first;
+    if (it->second.empty())
+      g_pixel_pool_free->erase(it);
+  }
+}
+
+// A block of at least |bytes|, with no references yet, or NULL.
+static PixelBlock* AcquirePixelBlock(size_t bytes) {
+  uv_once(&g_pixel_pool_once, &PixelPoolInitOnce);
+  size_t size_class = PixelPoolSizeClass(bytes);
+  void* pixels = NULL;
+  uv_mutex_lock(&g_pixel_pool_lock);
+  std::map<size_t, std::vector<void*> >::iterator it =
+      g_pixel_pool_free->find(size_class);
+  if (it != g_pixel_pool_free->end()) {
+    pixels = it->second.back();
+    it->second.pop_back();
+    if (it->second.empty())
+      g_pixel_pool_free->erase(it);
+    g_pixel_pool_pooled_bytes -= size_class;
+    ++g_pixel_pool_hits;
+  } else {
+    ++g_pixel_pool_misses;
+  }
+  if (!pixels)
+    pixels = malloc(size_class);
+  if (pixels)
+    g_pixel_pool_live_bytes += size_class;
+  uv_mutex_unlock(&g_pixel_pool_lock);
+
+  if (!pixels)
+    return NULL;
+  PixelBlock* block = new PixelBlock;
+  block->pixels = pixels;
+  block->bytes = size_class;
+  block->refs = 0;
+  block->pack = NULL;
+  return block;
+}
+
+// SkPixelRef release proc.
+static void ReleasePixelBlock(void* addr, void* context) {
+  PixelBlock* block = reinterpret_cast<PixelBlock*>(context);
+  uv_mutex_lock(&g_pixel_pool_lock);
+  if (--block->refs > 0) {
+    uv_mutex_unlock(&g_pixel_pool_lock);
+    return;
+  }
+  if (block->pack) {  // Mapped, not pooled.
+    uv_mutex_unlock(&g_pixel_pool_lock);
+    UnrefAssetPack(block->pack);
+    delete block;
+    return;
+  }
+  g_pixel_pool_live_bytes -= block->bytes;
+  (*g_pixel_pool_free)[block->bytes].push_back(block->pixels);
+  g_pixel_pool_pooled_bytes += block->bytes;
+  PixelPoolTrimLocked(g_pixel_pool_limit);
+  uv_mutex_unlock(&g_pixel_pool_lock);
+  delete block;
+}
+
+// Point |bitmap| at |block|'s pixels, taking a reference on the block.
+static bool InstallPixelBlock(SkBitmap* bitmap, const SkImageInfo& info,
+                              PixelBlock* block) {
+  uv_mutex_lock(&g_pixel_pool_lock);
+  ++block->refs;
+  uv_mutex_unlock(&g_pixel_pool_lock);
+  // On failure installPixels calls the release proc itself.
+  return bitmap->installPixels(info, block->pixels, info.minRowBytes(), NULL,
+                               &ReleasePixelBlock, block);
+}
+
+// Replace the SkCanvas of the pristine |pooled| canvas with one over a copy
+// of its pixels in a block of its own.
+static bool DetachPooledCanvas(v8::Isolate* isolate, PooledCanvas* pooled) {
+  PixelBlock* old_block = pooled->block;
+  v8::Local<v8::Object> obj = PersistentToLocal(isolate, *pooled->handle);
+  SkCanvas* old_canvas =
+      reinterpret_cast<SkCanvas*>(obj->GetAlignedPointerFromInternalField(0));
+  SkImageInfo info = old_canvas->imageInfo();
+
+  PixelBlock* block = AcquirePixelBlock(info.getSafeSize(info.minRowBytes()));
+  if (!block)
+    return false;
+  SkBitmap bitmap;
+  if (!InstallPixelBlock(&bitmap, info, block))
+    return false;
+  memcpy(block->pixels, old_block->pixels, bitmap.getSize());
+
+  std::vector<PooledCanvas*>& sharers = old_block->sharers;
+  sharers.erase(std::find(sharers.begin(), sharers.end(), pooled));
+  block->sharers.push_back(pooled);
+  pooled->block = block;
+
+  SkCanvas* canvas = new SkCanvas(bitmap);
+  obj->SetAlignedPointerInInternalField(0, canvas);
+  obj->SetIndexedPropertiesToPixelData(
+      reinterpret_cast<uint8_t*>(bitmap.getPixels()), bitmap.getSize());
+  delete old_canvas;  // Drops its reference on |old_block|.
+
+  // The copy has memory of its own now.
+  isolate->AdjustAmountOfExternalAllocatedMemory(bitmap.getSize());
+  pooled->reported_bytes += bitmap.getSize();
+  return true;
+}
+
+// Before |pooled| is drawn to or changes state, make sure it doesn't share
+// pixels.  A pristine canvas moves to pixels of its own, otherwise the
+// (pristine) canvases sharing with it move.  Asset pack pixels are shared with
+// later loads of the same image, so canvases over them are always pristine.
+// Writes through pixel indexing can't be seen here, they go straight to the
+// shared block and so to every sharer.
+static bool UnsharePooledCanvas(v8::Isolate* isolate, PooledCanvas* pooled) {
+  if (pooled->block->sharers.size() > 1 || pooled->block->pack) {
+    if (pooled->pristine) {
+      if (!DetachPooledCanvas(isolate, pooled))
+        return false;
+    } else {
+      std::vector<PooledCanvas*> others(pooled->block->sharers);
+      for (size_t i = 0; i < others.size(); ++i) {
+        if (others[i] != pooled && !DetachPooledCanvas(isolate, others[i]))
+          return false;
+      }
+    }
+  }
+  pooled->pristine = false;
+  return true;
+}
+
+// Path mask cache.
+//
+// Drawing a frozen SkPath (see SkPath freeze) to a bitmap canvas keeps its
+// coverage as an A8 mask, keyed by the path's generation ID and fill type, the
+// paint's geometry (style, stroke, antialiasing) and the matrix less its
+// integer translation.  Drawing with the same key again, ex. a static logo on
+// the next frame, at the same or an integer translated position, blits the
+// mask with the paint's color instead of rasterizing the path again.  Only
+// paints that just contribute a color (no shader, path effect, mask filter,
+// ...) are cached.  The least recently used masks are dropped to stay in a
+// byte budget.  Shared by all threads, under a lock.
+
+struct PathMaskKey {
+  uint32_t gen_id;
+  uint32_t fill_type;
+  uint32_t style;
+  uint32_t cap;
+  uint32_t join;
+  uint32_t antialias;
+  float stroke_width;
+  float stroke_miter;
+  float matrix[6];  // Scale and skew, and the translation's fractional part.
+};
+
+struct PathMaskKeyLess {
+  bool operator()(const PathMaskKey& a, const PathMaskKey& b) const {
+    return memcmp(&a, &b, sizeof(PathMaskKey)) < 0;
+  }
+};
+
+struct PathMaskEntry {
+  SkBitmap mask;  // kAlpha_8.
+  int left, top;  // Device position of the mask at integer translation 0.
+  size_t bytes;
+  std::list<PathMaskKey>::iterator lru;
+};
+
+typedef std::map<PathMaskKey, PathMaskEntry, PathMaskKeyLess> PathMaskMap;
+
+static uv_once_t g_path_mask_once = UV_ONCE_INIT;
+static uv_mutex_t g_path_mask_lock;
+// Guarded by g_path_mask_lock.
+static PathMaskMap* g_path_masks = NULL;
+static std::list<PathMaskKey>* g_path_mask_lru = NULL;  // Most recent first.
+static size_t g_path_mask_budget = 32 << 20;
+static size_t g_path_mask_bytes = 0;
+static uint64_t g_path_mask_hits = 0;
+static uint64_t g_path_mask_misses = 0;
+static uint64_t g_path_mask_bypassed = 0;  // Drawn directly, not cacheable.
+static uint64_t g_path_mask_evictions = 0;
+
+static void PathMaskInitOnce() {
+  uv_mutex_init(&g_path_mask_lock);
+  g_path_masks = new PathMaskMap;
+  g_path_mask_lru = new std::list<PathMaskKey>;
+}
+
+// Drop least recently used masks until at most |budget| bytes are cached.
+// Called with g_path_mask_lock held.
+static void PathMaskTrimLocked(size_t budget) {
+  while (g_path_mask_bytes > budget && !g_path_mask_lru->empty()) {
+    PathMaskMap::iterator it = g_path_masks->find(g_path_mask_lru->back());
+    g_path_mask_bytes -= it->second.bytes;
+    g_path_masks->erase(it);
+    g_path_mask_lru->pop_back();
+    ++g_path_mask_evictions;
+  }
+}
+
+static bool PathMaskCacheable(const SkPath& path, const SkPaint& paint,
+                              const SkMatrix& matrix) {
+  return !path.isInverseFillType() && !matrix.hasPerspective() &&
+         !paint.getShader() && !paint.getPathEffect() &&
+         !paint.getMaskFilter() && !paint.getRasterizer() &&
+         !paint.getLooper() && !paint.getImageFilter();
+}
+
+// Draw |path| with |paint| on the bitmap |canvas| through the mask cache.
+// Returns false when it wasn't, and should be drawn directly.
+static bool DrawPathWithMaskCache(SkCanvas* canvas, const SkPath& path,
+                                  const SkPaint& paint) {
+  uv_once(&g_path_mask_once, &PathMaskInitOnce);
+
+  const SkMatrix& total = canvas->getTotalMatrix();
+  if (!PathMaskCacheable(path, paint, total)) {
+    uv_mutex_lock(&g_path_mask_lock);
+    ++g_path_mask_bypassed;
+    uv_mutex_unlock(&g_path_mask_lock);
+    return false;
+  }
+
+  // Rasterize at the fractional part of the translation, and blit at the
+  // integer part.
+  SkScalar ix = SkScalarFloorToScalar(total.getTranslateX());
+  SkScalar iy = SkScalarFloorToScalar(total.getTranslateY());
+  SkMatrix local(total);
+  local.setTranslateX(total.getTranslateX() - ix);
+  local.setTranslateY(total.getTranslateY() - iy);
+
+  PathMaskKey key;
+  memset(&key, 0, sizeof(key));  // No stray bytes for the memcmp.
+  key.gen_id = path.getGenerationID();
+  key.fill_type = path.getFillType();
+  key.style = paint.getStyle();
+  key.cap = paint.getStrokeCap();
+  key.join = paint.getStrokeJoin();
+  key.antialias = paint.isAntiAlias();
+  key.stroke_width = paint.getStrokeWidth();
+  key.stroke_miter = paint.getStrokeMiter();
+  key.matrix[0] = local.getScaleX();
+  key.matrix[1] = local.getSkewX();
+  key.matrix[2] = local.getTranslateX();
+  key.matrix[3] = local.getSkewY();
+  key.matrix[4] = local.getScaleY();
+  key.matrix[5] = local.getTranslateY();
+
+  SkBitmap mask;
+  int left = 0, top = 0;
+  bool found = false;
+
+  uv_mutex_lock(&g_path_mask_lock);
+  PathMaskMap::iterator it = g_path_masks->find(key);
+  if (it != g_path_masks->end()) {
+    g_path_mask_lru->splice(g_path_mask_lru->begin(), *g_path_mask_lru,
+                            it->second.lru);
+    mask = it->second.mask;  // Shares the pixels.
+    left = it->second.left;
+    top = it->second.top;
+    found = true;
+    ++g_path_mask_hits;
+  }
+  size_t max_bytes = g_path_mask_budget / 4;
+  uv_mutex_unlock(&g_path_mask_lock);
+
+  if (!found) {
+    // Conservative device bounds, with a pixel for antialiasing and hairlines.
+    SkRect bounds = path.getBounds();
+    SkRect storage;
+    if (paint.canComputeFastBounds())
+      bounds = paint.computeFastBounds(bounds, &storage);
+    local.mapRect(&bounds);
+    SkIRect ibounds;
+    bounds.roundOut(&ibounds);
+    ibounds.outset(1, 1);
+    if (ibounds.isEmpty() ||
+        static_cast<uint64_t>(ibounds.width()) * ibounds.height() > max_bytes) {
+      uv_mutex_lock(&g_path_mask_lock);
+      ++g_path_mask_bypassed;
+      uv_mutex_unlock(&g_path_mask_lock);
+      return false;
+    }
+
+    if (!mask.tryAllocPixels(SkImageInfo::MakeA8(ibounds.width(),
+                                                 ibounds.height()))) {
+      return false;
+    }
+    mask.eraseColor(0);
+    SkCanvas mask_canvas(mask);
+    mask_canvas.translate(-ibounds.left(), -ibounds.top());
+    mask_canvas.concat(local);
+    SkPaint mask_paint(paint);
+    mask_paint.setColor(SK_ColorBLACK);
+    mask_paint.setXfermode(NULL);
+    mask_paint.setColorFilter(NULL);
+    mask_canvas.drawPath(path, mask_paint);
+    mask.setImmutable();
+    left = ibounds.left();
+    top = ibounds.top();
+
+    uv_mutex_lock(&g_path_mask_lock);
+    ++g_path_mask_misses;
+    if (g_path_masks->find(key) == g_path_masks->end()) {
+      g_path_mask_lru->push_front(key);
+      PathMaskEntry& entry = (*g_path_masks)[key];
+      entry.mask = mask;
+      entry.left = left;
+      entry.top = top;
+      entry.bytes = mask.getSize();
+      entry.lru = g_path_mask_lru->begin();
+      g_path_mask_bytes += entry.bytes;
+      PathMaskTrimLocked(g_path_mask_budget);
+    }
+    uv_mutex_unlock(&g_path_mask_lock);
+  }
+
+  // An A8 bitmap is drawn as a mask of the paint's color.
+  SkPaint blit_paint(paint);
+  blit_paint.setStyle(SkPaint::kFill_Style);
+  canvas->save();
+  canvas->resetMatrix();
+  canvas->drawBitmap(mask, left + ix, top + iy, &blit_paint);
+  canvas->restore();
+  return true;
+}
+
+// PDF documents.
+//
+// A PDF canvas has one page of its document open at a time, nextPage ends it
+// and begins the next on a new SkCanvas.  Skia's PDF backend embeds an image
+// once per document however many pages draw it, but it knows images by their
+// pixels' generation ID, so the same image decoded again (ex. a catalog page
+// loading the same product shot as the page before) would be embedded again.
+// Images drawn to a PDF canvas are kept by a hash of their pixels, and an
+// image with the same pixels as one drawn before is drawn from that one's
+// SkBitmap instead.
+
+struct PDFDocument {
+  SkDocument* doc;
+  SkScalar width, height;  // The open page's size,
+  SkScalar content_width, content_height;  // and its content's.
+  int pages;
+  std::map<uint64_t, SkBitmap> images;  // By HashPDFImage of their pixels.
+  std::map<uint32_t, uint64_t> image_hashes;  // By generation ID.
+};
+
+uint64_t HashPDFImage(const SkBitmap& bitmap) {
+  uint64_t hash = 14695981039346656037ULL;  // FNV-1a, a word at a time.
+  hash = (hash ^ (static_cast<uint64_t>(bitmap.width()) << 32 |
+                  static_cast<uint32_t>(bitmap.height()))) * 1099511628211ULL;
+  size_t row_bytes = bitmap.width() * bitmap.bytesPerPixel();
+  for (int y = 0; y < bitmap.height(); ++y) {
+    const uint8_t* row = reinterpret_cast<const uint8_t*>(bitmap.getAddr(0, y));
+    size_t i = 0;
+    for (; i + 8 <= row_bytes; i += 8) {
+      uint64_t word;
+      memcpy(&word, row + i, 8);
+      hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < row_bytes; ++i)
+      hash = (hash ^ row[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool SamePDFImagePixels(const SkBitmap& a, const SkBitmap& b) {
+  if (a.width() != b.width() || a.height() != b.height() ||
+      a.colorType() != b.colorType())
+    return false;
+  size_t row_bytes = a.width() * a.bytesPerPixel();
+  for (int y = 0; y < a.height(); ++y) {
+    if (memcmp(a.getAddr(0, y), b.getAddr(0, y), row_bytes) != 0)
+      return false;
+  }
+  return true;
+}
+
+// The bitmap to draw to |pdf| for |bitmap|, the first bitmap drawn with the
+// same pixels.
+const SkBitmap& CanonicalPDFImage(PDFDocument* pdf, const SkBitmap& bitmap) {
+  std::map<uint32_t, uint64_t>::iterator known =
+      pdf->image_hashes.find(bitmap.getGenerationID());
+  if (known != pdf->image_hashes.end())
+    return pdf->images[known->second];
+
+  SkAutoLockPixels lock(bitmap);
+  if (!bitmap.getPixels())  // Ex. a PDF canvas, there is nothing to share.
+    return bitmap;
+
+  uint64_t hash = HashPDFImage(bitmap);
+  std::map<uint64_t, SkBitmap>::iterator it = pdf->images.find(hash);
+  if (it == pdf->images.end()) {
+    pdf->images[hash] = bitmap;
+  } else {
+    SkAutoLockPixels canonical_lock(it->second);
+    if (!SamePDFImagePixels(bitmap, it->second))
+      return bitmap;  // A collision, draw it as it is.
+  }
+  pdf->image_hashes[bitmap.getGenerationID()] = hash;
+  return pdf->images[hash];
+}
+
+
+class SkCanvasWrapper {
+ public:
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft =
+        v8::FunctionTemplate::New(isolate, &SkCanvasWrapper::V8New);
+    v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
+    // SkCanvas, PDFDocument (pdf) and PooledCanvas pointers.
+    instance->SetInternalFieldCount(3);
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
+
+    v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
     // Configure the template...
     static BatchedConstants constants[] = {
@@ -5568,48 +8950,66 @@ class SkCanvasWrapper {
       { "kPolygonPointMode", SkCanvas::kPolygon_PointMode },
     };
 
+    static BatchedMethods class_methods[] = {
+      { "poolStats", &SkCanvasWrapper::class_poolStats },
+      { "setPoolLimit", &SkCanvasWrapper::class_setPoolLimit },
+      { "pathCacheStats", &SkCanvasWrapper::class_pathCacheStats },
+      { "setPathCacheBudget", &SkCanvasWrapper::class_setPathCacheBudget },
+    };
+
+    // The methods that draw, or change the matrix, clip or save stack.
+#define WRITING_METHOD_ENTRY(name) { #name, &Writing<&name> }
     static BatchedMethods methods[] = {
-      METHOD_ENTRY( clipRect ),
-      METHOD_ENTRY( clipPath ),
-      METHOD_ENTRY( drawCircle ),
-      METHOD_ENTRY( drawLine ),
-      METHOD_ENTRY( drawPaint ),
-      METHOD_ENTRY( drawCanvas ),
-      METHOD_ENTRY( drawColor ),
-      METHOD_ENTRY( clear ),
-      METHOD_ENTRY( drawPath ),
-      METHOD_ENTRY( drawPoints ),
-      METHOD_ENTRY( drawRect ),
-      METHOD_ENTRY( drawRoundRect ),
-      METHOD_ENTRY( drawText ),
-      METHOD_ENTRY( drawTextOnPathHV ),
-      METHOD_ENTRY( concatMatrix ),
-      METHOD_ENTRY( setMatrix ),
-      METHOD_ENTRY( resetMatrix ),
-      METHOD_ENTRY( translate ),
-      METHOD_ENTRY( scale ),
-      METHOD_ENTRY( rotate ),
-      METHOD_ENTRY( skew ),
-      METHOD_ENTRY( save ),
-      METHOD_ENTRY( saveLayer ),
-      METHOD_ENTRY( restore ),
+      WRITING_METHOD_ENTRY( clipRect ),
+      WRITING_METHOD_ENTRY( clipPath ),
+      WRITING_METHOD_ENTRY( drawCircle ),
+      WRITING_METHOD_ENTRY( drawLine ),
+      WRITING_METHOD_ENTRY( drawPaint ),
+      WRITING_METHOD_ENTRY( drawCanvas ),
+      WRITING_METHOD_ENTRY( drawAtlas ),
+      WRITING_METHOD_ENTRY( drawColor ),
+      WRITING_METHOD_ENTRY( clear ),
+      WRITING_METHOD_ENTRY( drawPath ),
+      WRITING_METHOD_ENTRY( drawPoints ),
+      WRITING_METHOD_ENTRY( drawRect ),
+      WRITING_METHOD_ENTRY( drawRoundRect ),
+      WRITING_METHOD_ENTRY( drawText ),
+      WRITING_METHOD_ENTRY( drawTextOnPathHV ),
+      WRITING_METHOD_ENTRY( concatMatrix ),
+      WRITING_METHOD_ENTRY( setMatrix ),
+      WRITING_METHOD_ENTRY( resetMatrix ),
+      WRITING_METHOD_ENTRY( translate ),
+      WRITING_METHOD_ENTRY( scale ),
+      WRITING_METHOD_ENTRY( rotate ),
+      WRITING_METHOD_ENTRY( skew ),
+      WRITING_METHOD_ENTRY( save ),
+      WRITING_METHOD_ENTRY( saveLayer ),
+      WRITING_METHOD_ENTRY( restore ),
       METHOD_ENTRY( writeImage ),
       METHOD_ENTRY( writePDF ),
+      METHOD_ENTRY( nextPage ),
       METHOD_ENTRY( flush ),
+      METHOD_ENTRY( dispose ),
     };
+#undef WRITING_METHOD_ENTRY
 
     for (size_t i = 0; i < arraysize(constants); ++i) {
       ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
               v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+    }
+
+    for (size_t i = 0; i < arraysize(class_methods); ++i) {
+      ft->Set(v8::String::NewFromUtf8(isolate, class_methods[i].name),
+              v8::FunctionTemplate::New(isolate, class_methods[i].func,
+                                              v8::Handle<v8::Value>()));
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 NewInstrumentedMethod(isolate, "SkCanvas", methods[i],
+                                       default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -5620,8 +9020,14 @@ class SkCanvasWrapper {
     return reinterpret_cast<SkCanvas*>(obj->GetAlignedPointerFromInternalField(0));
   }
 
-  static SkDocument* ExtractDocumentPointer(v8::Handle<v8::Object> obj) {
-    return reinterpret_cast<SkDocument*>(obj->GetAlignedPointerFromInternalField(1));
+  // NULL for canvases that aren't pdf.
+  static PDFDocument* ExtractDocumentPointer(v8::Handle<v8::Object> obj) {
+    return reinterpret_cast<PDFDocument*>(obj->GetAlignedPointerFromInternalField(1));
+  }
+
+  // NULL for canvases without pooled pixels (pdf and gpu).
+  static PooledCanvas* ExtractPooledCanvas(v8::Handle<v8::Object> obj) {
+    return reinterpret_cast<PooledCanvas*>(obj->GetAlignedPointerFromInternalField(2));
   }
 
   static bool HasInstance(v8::Isolate* isolate, v8::Handle<v8::Value> value) {
@@ -5633,7 +9039,8 @@ class SkCanvasWrapper {
       const v8::WeakCallbackData<v8::Object, v8::Persistent<v8::Object> >& data) {
     v8::Isolate* isolate = data.GetIsolate();
     SkCanvas* canvas = ExtractPointer(data.GetValue());
-    SkDocument* doc = ExtractDocumentPointer(data.GetValue());
+    PDFDocument* pdf = ExtractDocumentPointer(data.GetValue());
+    PooledCanvas* pooled = ExtractPooledCanvas(data.GetValue());
 
     v8::Persistent<v8::Object>* persistent = data.GetParameter();
     persistent->ClearWeak();
@@ -5642,8 +9049,15 @@ class SkCanvasWrapper {
 
     // Delete the backing SkCanvas object.  Skia reference counting should
     // handle cleaning up deeper resources (for example the backing pixels).
-    if (doc) {
-      doc->unref();  // Owns the canvas, right?
+    if (pdf) {
+      pdf->doc->unref();  // Owns the canvas, right?
+      delete pdf;
+    } else if (pooled) {
+      if (pooled->block)  // Not disposed.
+        ReleasePooledCanvas(isolate, pooled, canvas);
+      else
+        delete canvas;
+      delete pooled;
     } else {
       SkImageInfo info = canvas->imageInfo();
       int size_bytes = info.width() * info.height() * info.bytesPerPixel();
@@ -5652,6 +9066,56 @@ class SkCanvasWrapper {
     }
   }
 
+  // Runs |Method| after making sure the canvas doesn't share its pixels with
+  // a copy-on-write copy.
+  template <v8::FunctionCallback Method>
+  static void Writing(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    PooledCanvas* pooled = ExtractPooledCanvas(args.Holder());
+    if (pooled && pooled->block &&
+        (pooled->pristine || pooled->block->sharers.size() > 1) &&
+        !UnsharePooledCanvas(isolate, pooled)) {
+      return v8_utils::ThrowError(isolate, "Unable to allocate canvas pixels.");
+    }
+    Method(args);
+  }
+
+  // Stop |pooled| using its pixels, and delete its |canvas|.
+  static void ReleasePooledCanvas(v8::Isolate* isolate, PooledCanvas* pooled,
+                                  SkCanvas* canvas) {
+    std::vector<PooledCanvas*>& sharers = pooled->block->sharers;
+    sharers.erase(std::find(sharers.begin(), sharers.end(), pooled));
+    pooled->block = NULL;
+    isolate->AdjustAmountOfExternalAllocatedMemory(-pooled->reported_bytes);
+    pooled->reported_bytes = 0;
+    delete canvas;  // Drops its reference on the pixels.
+  }
+
+  // Point |bitmap| at pooled pixels for |info|, returns NULL on failure.
+  static PixelBlock* AllocPooledPixels(SkBitmap* bitmap, const SkImageInfo& info) {
+    PixelBlock* block = AcquirePixelBlock(info.getSafeSize(info.minRowBytes()));
+    if (!block || !InstallPixelBlock(bitmap, info, block))
+      return NULL;
+    return block;
+  }
+
+  // Point |bitmap| at the mapped pixels of the image |entry| in |pack|,
+  // returns NULL on failure.
+  static PixelBlock* MapPackPixels(SkBitmap* bitmap, AssetPack* pack,
+                                   const AssetPackEntry& entry) {
+    PixelBlock* block = new PixelBlock;
+    block->pixels = pack->base + entry.offset;
+    block->bytes = entry.bytes;
+    block->refs = 0;
+    block->pack = pack;
+    RefAssetPack(pack);  // Dropped by ReleasePixelBlock.
+    SkImageInfo info = SkImageInfo::Make(entry.width, entry.height,
+                                         kBGRA_8888_SkColorType,
+                                         kPremul_SkAlphaType);
+    if (!InstallPixelBlock(bitmap, info, block))
+      return NULL;
+    return block;
+  }
+
   static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
     if (!args.IsConstructCall())
       return v8_utils::ThrowTypeError(isolate, kMsgNonConstructCall);
@@ -5664,21 +9128,32 @@ class SkCanvasWrapper {
     SkBitmap* bitmap = &tbitmap;
 
     SkCanvas* canvas = NULL;
-    SkDocument* doc = NULL;
+    PDFDocument* pdf = NULL;
+    PixelBlock* block = NULL;  // For bitmap canvases.
+    bool shared = false;  // A copy-on-write copy sharing |block|.
+    bool mapped = false;  // Over the pixels of an asset pack.
 
     if (args[0]->StrictEquals(v8::String::NewFromUtf8(isolate, "%PDF"))) {  // PDF constructor.
       v8::String::Utf8Value filename(args[1]);
-      doc = SkDocument::CreatePDF(*filename);
+      SkDocument* doc = SkDocument::CreatePDF(*filename);
       if (!doc) return v8_utils::ThrowError(isolate, "Unable to create PDF document.");
       SkScalar width = args[2]->Int32Value(), height = args[3]->Int32Value();
       SkRect content = SkRect::MakeWH(args[4]->Int32Value(), args[5]->Int32Value());
       canvas = doc->beginPage(width, height, &content);
+      pdf = new PDFDocument;
+      pdf->doc = doc;
+      pdf->width = width;
+      pdf->height = height;
+      pdf->content_width = content.width();
+      pdf->content_height = content.height();
+      pdf->pages = 1;
       // Bit of a hack to get the width and height properties set.
       tbitmap.setInfo(SkImageInfo::Make(width, height, kUnknown_SkColorType, kUnknown_SkAlphaType));
     } else if (args[0]->StrictEquals(v8::String::NewFromUtf8(isolate, "^IMG"))) {
       // Load an image, either a path to a file on disk, or a TypedArray or
       // other external array data backed JS object.
       // TODO(deanm): This is all super inefficent, we copy / flip / etc.
+      PLASK_TRACE_EVENT("image", "decode");
 
       FIBITMAP* fbitmap = NULL;
 
@@ -5736,11 +9211,15 @@ class SkCanvasWrapper {
       if (!FreeImage_PreMultiplyWithAlpha(fbitmap))
         return v8_utils::ThrowError(isolate, "Couldn't premultiply image.");
 
-      tbitmap.allocPixels(SkImageInfo::Make(
+      block = AllocPooledPixels(&tbitmap, SkImageInfo::Make(
           FreeImage_GetWidth(fbitmap),
           FreeImage_GetHeight(fbitmap),
           kBGRA_8888_SkColorType,
-          kPremul_SkAlphaType), FreeImage_GetWidth(fbitmap) * 4);
+          kPremul_SkAlphaType));
+      if (!block) {
+        FreeImage_Unload(fbitmap);
+        return v8_utils::ThrowError(isolate, "Unable to allocate canvas pixels.");
+      }
 
       // Despite taking red/blue/green masks, FreeImage_CovertToRawBits doesn't
       // actually use them and swizzle the color ordering.  We just require
@@ -5752,14 +9231,54 @@ class SkCanvasWrapper {
                                  32, 0, 0, 0, TRUE);
       FreeImage_Unload(fbitmap);
 
+      canvas = new SkCanvas(tbitmap);
+    } else if (args[0]->StrictEquals(v8::String::NewFromUtf8(isolate, "^PAK"))) {
+      // An image from an asset pack, over the pack's mapped pixels.  Like a
+      // copy-on-write copy, it moves to pixels of its own when drawn to.
+      if (!PlaskAssetPackWrapper::HasInstance(isolate, args[1]))
+        return v8_utils::ThrowError(isolate, "Expected a PlaskAssetPack.");
+      AssetPack* pack = PlaskAssetPackWrapper::ExtractPointer(
+          v8::Handle<v8::Object>::Cast(args[1]));
+      v8::String::Utf8Value name(args[2]);
+      const AssetPackEntry* entry =
+          FindAssetPackEntry(pack, std::string(*name, name.length()));
+      if (!entry)
+        return v8_utils::ThrowError(isolate, "No such image in the asset pack.");
+      if (entry->format != kAssetPackFormatBGRA)
+        return v8_utils::ThrowError(isolate, "Asset pack entry isn't an image.");
+      block = MapPackPixels(&tbitmap, pack, *entry);
+      if (!block)
+        return v8_utils::ThrowError(isolate, "Unable to map asset pack image.");
+      mapped = true;
+      canvas = new SkCanvas(tbitmap);
+    } else if (args[0]->StrictEquals(v8::String::NewFromUtf8(isolate, "^COW"))) {
+      // Copy-on-write copy, shares the pixels of a bitmap canvas until either
+      // is drawn to, see UnsharePooledCanvas.
+      if (!SkCanvasWrapper::HasInstance(isolate, args[1]))
+        return v8_utils::ThrowError(isolate, "Expected an SkCanvas to copy.");
+      v8::Handle<v8::Object> source = v8::Handle<v8::Object>::Cast(args[1]);
+      SkCanvas* pcanvas = ExtractPointer(source);
+      PooledCanvas* source_pooled = ExtractPooledCanvas(source);
+      if (source_pooled && source_pooled->block) {
+        block = source_pooled->block;
+        if (!InstallPixelBlock(&tbitmap, pcanvas->imageInfo(), block))
+          return v8_utils::ThrowError(isolate, "Unable to share canvas pixels.");
+        shared = true;
+      } else {  // Not a bitmap canvas, make a plain copy.
+        block = CopyPixels(pcanvas, &tbitmap);
+        if (!block)
+          return;
+      }
       canvas = new SkCanvas(tbitmap);
     } else if (args.Length() == 2) {  // width / height offscreen constructor.
       unsigned int width = args[0]->Uint32Value();
       unsigned int height = args[1]->Uint32Value();
-      tbitmap.allocPixels(SkImageInfo::Make(
+      block = AllocPooledPixels(&tbitmap, SkImageInfo::Make(
           width, height,
           kBGRA_8888_SkColorType,
-          kPremul_SkAlphaType), width * 4);
+          kPremul_SkAlphaType));
+      if (!block)
+        return v8_utils::ThrowError(isolate, "Unable to allocate canvas pixels.");
       tbitmap.eraseARGB(0, 0, 0, 0);
       canvas = new SkCanvas(tbitmap);
 #if PLASK_GPUSKIA
@@ -5773,18 +9292,29 @@ class SkCanvasWrapper {
 #endif
     } else if (args.Length() == 1 && SkCanvasWrapper::HasInstance(isolate, args[0])) {
       SkCanvas* pcanvas = ExtractPointer(v8::Handle<v8::Object>::Cast(args[0]));
-      // Allocate a new block of pixels with a copy from pbitmap.
-      // NOTE(deanm): Don't think this version of readPixels allocates properly.
-      // if (!pcanvas->readPixels(&tbitmap, 0, 0))
-      if (!pcanvas->readPixels(pcanvas->imageInfo().bounds(), &tbitmap))
-        return v8_utils::ThrowError(isolate, "SkCanvas constructor unable to readPixels().");
+      block = CopyPixels(pcanvas, &tbitmap);
+      if (!block)
+        return;
       canvas = new SkCanvas(tbitmap);
     } else {
       return v8_utils::ThrowError(isolate, "Improper SkCanvas constructor arguments.");
     }
 
+    PooledCanvas* pooled = NULL;
+    if (block) {
+      pooled = new PooledCanvas;
+      pooled->block = block;
+      pooled->handle = NULL;
+      // A shared copy has no memory of its own until it's unshared, and
+      // mapped pixels can be dropped and read again from the file.
+      pooled->reported_bytes = shared || mapped ? 0 : bitmap->getSize();
+      pooled->pristine = shared || mapped;
+      block->sharers.push_back(pooled);
+    }
+
     args.This()->SetAlignedPointerInInternalField(0, canvas);
-    args.This()->SetAlignedPointerInInternalField(1, doc);
+    args.This()->SetAlignedPointerInInternalField(1, pdf);
+    args.This()->SetAlignedPointerInInternalField(2, pooled);
     // Direct pixel access via array[] indexing.
     args.This()->SetIndexedPropertiesToPixelData(
         reinterpret_cast<uint8_t*>(bitmap->getPixels()), bitmap->getSize());
@@ -5795,7 +9325,9 @@ class SkCanvasWrapper {
 
     // Notify the GC that we have a possibly large amount of data allocated
     // behind this object for bitmap backed canvases.
-    if (!doc) {
+    if (pooled) {
+      isolate->AdjustAmountOfExternalAllocatedMemory(pooled->reported_bytes);
+    } else if (!pdf) {
       int size_bytes = bitmap->width() * bitmap->height() * 4;
       isolate->AdjustAmountOfExternalAllocatedMemory(size_bytes);
     }
@@ -5803,25 +9335,167 @@ class SkCanvasWrapper {
     v8::Persistent<v8::Object>* persistent = new v8::Persistent<v8::Object>;
     persistent->Reset(isolate, args.This());
     persistent->SetWeak(persistent, &SkCanvasWrapper::WeakCallback);
+    if (pooled)
+      pooled->handle = persistent;
+  }
+
+  // Point |bitmap| at pooled pixels with a copy of |source|'s, returns NULL
+  // with an exception thrown on failure.
+  static PixelBlock* CopyPixels(SkCanvas* source, SkBitmap* bitmap) {
+    SkImageInfo info = SkImageInfo::Make(
+        source->imageInfo().width(), source->imageInfo().height(),
+        kBGRA_8888_SkColorType, kPremul_SkAlphaType);
+    PixelBlock* block = AllocPooledPixels(bitmap, info);
+    if (!block) {
+      v8_utils::ThrowError(isolate, "Unable to allocate canvas pixels.");
+      return NULL;
+    }
+    if (!source->readPixels(info, bitmap->getPixels(), bitmap->rowBytes(), 0, 0)) {
+      bitmap->reset();  // Returns the pixels.
+      v8_utils::ThrowError(isolate, "SkCanvas constructor unable to readPixels().");
+      return NULL;
+    }
+    return block;
   }
 
-  // void concatMatrix(a, b, c, d, e, f, g, h, i)
+  // void dispose()
   //
-  // Preconcat the current matrix with the specified matrix.
-  static void concatMatrix(const v8::FunctionCallbackInfo<v8::Value>& args) {
-    SkCanvas* canvas = ExtractPointer(args.Holder());
-    SkMatrix matrix;
-    matrix.setAll(SkDoubleToScalar(args[0]->NumberValue()),
-                  SkDoubleToScalar(args[1]->NumberValue()),
-                  SkDoubleToScalar(args[2]->NumberValue()),
-                  SkDoubleToScalar(args[3]->NumberValue()),
-                  SkDoubleToScalar(args[4]->NumberValue()),
-                  SkDoubleToScalar(args[5]->NumberValue()),
-                  SkDoubleToScalar(args[6]->NumberValue()),
-                  SkDoubleToScalar(args[7]->NumberValue()),
-                  SkDoubleToScalar(args[8]->NumberValue()));
-    canvas->concat(matrix);
-    return args.GetReturnValue().Set(true);
+  // Give the canvas' pixels back to the pool now, rather than when the canvas
+  // is garbage collected, so the next canvas of about the same size reuses
+  // them.  The canvas is left 0x0, and drawing to it does nothing.  Only for
+  // bitmap canvases.
+  static void dispose(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    PooledCanvas* pooled = ExtractPooledCanvas(args.Holder());
+    if (!pooled)
+      return v8_utils::ThrowError(isolate, "Only bitmap canvases can be disposed.");
+    if (!pooled->block)  // Already disposed.
+      return args.GetReturnValue().SetUndefined();
+
+    ReleasePooledCanvas(isolate, pooled, ExtractPointer(args.Holder()));
+    args.Holder()->SetAlignedPointerInInternalField(0, new SkCanvas(0, 0));
+    args.Holder()->SetIndexedPropertiesToPixelData(NULL, 0);
+    args.Holder()->Set(v8::String::NewFromUtf8(isolate, "width"),
+                       v8::Integer::New(isolate, 0));
+    args.Holder()->Set(v8::String::NewFromUtf8(isolate, "height"),
+                       v8::Integer::New(isolate, 0));
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // object poolStats()
+  //
+  // The pixel pool's counters: {liveBytes, pooledBytes, limitBytes, hits,
+  // misses, hitRate}.  liveBytes is held by canvases, pooledBytes is free for
+  // reuse, and hitRate is the share of canvases that reused pooled pixels.
+  static void class_poolStats(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    uv_once(&g_pixel_pool_once, &PixelPoolInitOnce);
+    uv_mutex_lock(&g_pixel_pool_lock);
+    double live = g_pixel_pool_live_bytes, pooled = g_pixel_pool_pooled_bytes;
+    double limit = g_pixel_pool_limit;
+    double hits = g_pixel_pool_hits, misses = g_pixel_pool_misses;
+    uv_mutex_unlock(&g_pixel_pool_lock);
+
+    v8::Local<v8::Object> res = v8::Object::New(isolate);
+    res->Set(v8::String::NewFromUtf8(isolate, "liveBytes"),
+             v8::Number::New(isolate, live));
+    res->Set(v8::String::NewFromUtf8(isolate, "pooledBytes"),
+             v8::Number::New(isolate, pooled));
+    res->Set(v8::String::NewFromUtf8(isolate, "limitBytes"),
+             v8::Number::New(isolate, limit));
+    res->Set(v8::String::NewFromUtf8(isolate, "hits"),
+             v8::Number::New(isolate, hits));
+    res->Set(v8::String::NewFromUtf8(isolate, "misses"),
+             v8::Number::New(isolate, misses));
+    res->Set(v8::String::NewFromUtf8(isolate, "hitRate"),
+             v8::Number::New(isolate, hits + misses > 0 ?
+                                      hits / (hits + misses) : 0));
+    return args.GetReturnValue().Set(res);
+  }
+
+  // void setPoolLimit(bytes)
+  //
+  // Keep at most `bytes` of free pixels in the pool (default 256MB), freeing
+  // any over the limit now.  0 turns pooling off.
+  static void class_setPoolLimit(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    double limit = args[0]->NumberValue();
+    if (!(limit >= 0))
+      return v8_utils::ThrowError(isolate, "Invalid pool limit.");
+    uv_once(&g_pixel_pool_once, &PixelPoolInitOnce);
+    uv_mutex_lock(&g_pixel_pool_lock);
+    g_pixel_pool_limit = static_cast<size_t>(limit);
+    PixelPoolTrimLocked(g_pixel_pool_limit);
+    uv_mutex_unlock(&g_pixel_pool_lock);
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // object pathCacheStats()
+  //
+  // The path mask cache's counters (see SkPath freeze): {hits, misses,
+  // bypassed, evictions, entries, bytes, budgetBytes, hitRate}.  bypassed
+  // counts the frozen path draws that couldn't be cached, ex. with a shader.
+  static void class_pathCacheStats(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    uv_once(&g_path_mask_once, &PathMaskInitOnce);
+    uv_mutex_lock(&g_path_mask_lock);
+    double hits = g_path_mask_hits, misses = g_path_mask_misses;
+    double bypassed = g_path_mask_bypassed, evictions = g_path_mask_evictions;
+    double entries = g_path_masks->size(), bytes = g_path_mask_bytes;
+    double budget = g_path_mask_budget;
+    uv_mutex_unlock(&g_path_mask_lock);
+
+    v8::Local<v8::Object> res = v8::Object::New(isolate);
+    res->Set(v8::String::NewFromUtf8(isolate, "hits"),
+             v8::Number::New(isolate, hits));
+    res->Set(v8::String::NewFromUtf8(isolate, "misses"),
+             v8::Number::New(isolate, misses));
+    res->Set(v8::String::NewFromUtf8(isolate, "bypassed"),
+             v8::Number::New(isolate, bypassed));
+    res->Set(v8::String::NewFromUtf8(isolate, "evictions"),
+             v8::Number::New(isolate, evictions));
+    res->Set(v8::String::NewFromUtf8(isolate, "entries"),
+             v8::Number::New(isolate, entries));
+    res->Set(v8::String::NewFromUtf8(isolate, "bytes"),
+             v8::Number::New(isolate, bytes));
+    res->Set(v8::String::NewFromUtf8(isolate, "budgetBytes"),
+             v8::Number::New(isolate, budget));
+    res->Set(v8::String::NewFromUtf8(isolate, "hitRate"),
+             v8::Number::New(isolate, hits + misses > 0 ?
+                                      hits / (hits + misses) : 0));
+    return args.GetReturnValue().Set(res);
+  }
+
+  // void setPathCacheBudget(bytes)
+  //
+  // Keep at most `bytes` of path masks (default 32MB), dropping the least
+  // recently used now if over.  A single mask can take up to a quarter of the
+  // budget, 0 turns the cache off.
+  static void class_setPathCacheBudget(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    double budget = args[0]->NumberValue();
+    if (!(budget >= 0))
+      return v8_utils::ThrowError(isolate, "Invalid path cache budget.");
+    uv_once(&g_path_mask_once, &PathMaskInitOnce);
+    uv_mutex_lock(&g_path_mask_lock);
+    g_path_mask_budget = static_cast<size_t>(budget);
+    PathMaskTrimLocked(g_path_mask_budget);
+    uv_mutex_unlock(&g_path_mask_lock);
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // void concatMatrix(a, b, c, d, e, f, g, h, i)
+  //
+  // Preconcat the current matrix with the specified matrix.
+  static void concatMatrix(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    SkCanvas* canvas = ExtractPointer(args.Holder());
+    SkMatrix matrix;
+    matrix.setAll(SkDoubleToScalar(args[0]->NumberValue()),
+                  SkDoubleToScalar(args[1]->NumberValue()),
+                  SkDoubleToScalar(args[2]->NumberValue()),
+                  SkDoubleToScalar(args[3]->NumberValue()),
+                  SkDoubleToScalar(args[4]->NumberValue()),
+                  SkDoubleToScalar(args[5]->NumberValue()),
+                  SkDoubleToScalar(args[6]->NumberValue()),
+                  SkDoubleToScalar(args[7]->NumberValue()),
+                  SkDoubleToScalar(args[8]->NumberValue()));
+    canvas->concat(matrix);
+    return args.GetReturnValue().Set(true);
   }
 
   // void setMatrix(a, b, c, d, e, f, g, h, i)
@@ -6000,7 +9674,86 @@ class SkCanvasWrapper {
     int srcy2 = v8_utils::ToInt32WithDefault(args[9], srcy1 + src_device->height());
     SkIRect src_rect = { srcx1, srcy1, srcx2, srcy2 };
 
-    canvas->drawBitmapRect(src_device->accessBitmap(false), src_rect, dst_rect, paint);
+    const SkBitmap& src_bitmap = src_device->accessBitmap(false);
+    PDFDocument* pdf = ExtractDocumentPointer(args.Holder());
+    canvas->drawBitmapRect(pdf ? CanonicalPDFImage(pdf, src_bitmap) : src_bitmap,
+                           src_rect, dst_rect, paint);
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // void drawAtlas(atlas, xforms, srcRects, colors, paint)
+  //
+  // Draw many sprites from the SkCanvas `atlas` in a single call, which is much
+  // faster than the same number of drawCanvas calls.  For sprite i:
+  //
+  //   - `xforms` (Float32Array) holds 4 floats [scos, ssin, tx, ty], the
+  //     sprite is scaled and rotated by the matrix [scos -ssin; ssin scos] and
+  //     then translated by (tx, ty).  For a scale `s` and rotation `r`,
+  //     scos = s * cos(r) and ssin = s * sin(r).
+  //   - `srcRects` (Float32Array) holds 4 floats [left, top, right, bottom],
+  //     the rectangle of the atlas to draw (see SkCanvas.packAtlas).
+  //   - `colors` (Uint32Array, optional, can be null) holds an ARGB color that
+  //     is multiplied with the sprite, ex. 0x80ffffff for half transparent.
+  //
+  // The optional `paint` supplies the filtering, alpha and blending.
+  static void drawAtlas(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (args.Length() < 3)
+      return v8_utils::ThrowError(isolate, "Wrong number of arguments.");
+
+    if (!SkCanvasWrapper::HasInstance(isolate, args[0]))
+      return v8_utils::ThrowError(isolate, "Atlas must be an SkCanvas.");
+    if (!args[1]->IsFloat32Array() || !args[2]->IsFloat32Array())
+      return v8_utils::ThrowError(isolate, "xforms and srcRects must be Float32Arrays.");
+
+    void* xforms_data = NULL; intptr_t xforms_size = 0;
+    void* rects_data = NULL; intptr_t rects_size = 0;
+    GetTypedArrayBytes(args[1], &xforms_data, &xforms_size);
+    GetTypedArrayBytes(args[2], &rects_data, &rects_size);
+
+    // SkRSXform and SkRect are both 4 SkScalars (floats), so the arrays can be
+    // used in place without any conversion.
+    int count = xforms_size / sizeof(SkRSXform);
+    if (rects_size < count * static_cast<intptr_t>(sizeof(SkRect)))
+      return v8_utils::ThrowError(isolate, "srcRects shorter than xforms.");
+
+    SkColor* colors = NULL;
+    if (args.Length() > 3 && !args[3]->IsNull() && !args[3]->IsUndefined()) {
+      if (!args[3]->IsUint32Array())
+        return v8_utils::ThrowError(isolate, "colors must be a Uint32Array.");
+      void* colors_data = NULL; intptr_t colors_size = 0;
+      GetTypedArrayBytes(args[3], &colors_data, &colors_size);
+      if (colors_size < count * static_cast<intptr_t>(sizeof(SkColor)))
+        return v8_utils::ThrowError(isolate, "colors shorter than xforms.");
+      colors = reinterpret_cast<SkColor*>(colors_data);
+    }
+
+    SkPaint* paint = NULL;
+    if (args.Length() > 4 && SkPaintWrapper::HasInstance(isolate, args[4])) {
+      paint = SkPaintWrapper::ExtractPointer(
+          v8::Handle<v8::Object>::Cast(args[4]));
+    }
+
+    if (count == 0)
+      return args.GetReturnValue().SetUndefined();
+
+    SkCanvas* canvas = ExtractPointer(args.Holder());
+    SkCanvas* atlas_canvas = SkCanvasWrapper::ExtractPointer(
+        v8::Handle<v8::Object>::Cast(args[0]));
+    const SkBitmap& atlas_bitmap =
+        atlas_canvas->getDevice()->accessBitmap(false);
+    SkAutoLockPixels lock(atlas_bitmap);
+
+    // Wrap the atlas pixels without copying, the image only lives for this
+    // call so it can't see later changes to the atlas.
+    SkAutoTUnref<SkImage> atlas(SkImage::NewFromRaster(
+        atlas_bitmap.info(), atlas_bitmap.getPixels(), atlas_bitmap.rowBytes(),
+        NULL, NULL));
+    if (!atlas)
+      return v8_utils::ThrowError(isolate, "Couldn't access atlas pixels.");
+
+    canvas->drawAtlas(atlas, reinterpret_cast<SkRSXform*>(xforms_data),
+                      reinterpret_cast<SkRect*>(rects_data), colors, count,
+                      SkXfermode::kModulate_Mode, NULL, paint);
     return args.GetReturnValue().SetUndefined();
   }
 
@@ -6054,8 +9807,14 @@ class SkCanvasWrapper {
     SkPaint* paint = SkPaintWrapper::ExtractPointer(
         v8::Handle<v8::Object>::Cast(args[0]));
 
-    SkPath* path = SkPathWrapper::ExtractPointer(
-        v8::Handle<v8::Object>::Cast(args[1]));
+    v8::Handle<v8::Object> path_obj = v8::Handle<v8::Object>::Cast(args[1]);
+    SkPath* path = SkPathWrapper::ExtractPointer(path_obj);
+
+    // Frozen paths on bitmap canvases go through the mask cache.
+    if (SkPathWrapper::IsFrozen(path_obj) && ExtractPooledCanvas(args.Holder()) &&
+        DrawPathWithMaskCache(canvas, *path, *paint)) {
+      return args.GetReturnValue().SetUndefined();
+    }
 
     canvas->drawPath(*path, *paint);
     return args.GetReturnValue().SetUndefined();
@@ -6292,17 +10051,72 @@ class SkCanvasWrapper {
   // The canvas is no longer usable after a call to writePDF.  A PDF can
   // only be written once and no further calls can be made on the canvas.
   DEFINE_METHOD(writePDF, 0)
-    SkDocument* doc = ExtractDocumentPointer(args.Holder());
+    PDFDocument* pdf = ExtractDocumentPointer(args.Holder());
 
-    if (!doc)
+    if (!pdf)
       return v8_utils::ThrowError(isolate, "Not a PDF canvas.");
 
     args.Holder()->SetAlignedPointerInInternalField(0, NULL);  // Clear SkCanvas*
-    doc->close();
+    pdf->doc->close();
+    pdf->images.clear();
+    pdf->image_hashes.clear();
 
     return args.GetReturnValue().SetUndefined();
   }
 
+  // int nextPage(page_width, page_height, content_width, content_height)
+  //
+  // End the current page of a vector-mode SkCanvas (created with createForPDF)
+  // and start a new page, the canvas then draws to the new page.  The sizes
+  // are as for createForPDF, the content size defaults to the page size, and
+  // with no arguments the new page is the same size as the last one.  The
+  // `width` and `height` properties are updated to the new page's size.
+  // Returns the number of pages in the document so far.
+  //
+  // Images drawn on more than one page, whether from the same SkCanvas or from
+  // canvases with the same pixels, are written to the PDF only once, and so
+  // are fonts.
+  //
+  //     var pdf = plask.SkCanvas.createForPDF('catalog.pdf', 612, 792);
+  //     for (var i = 0; i < items.length; ++i) {
+  //       if (i !== 0) pdf.nextPage();
+  //       drawItem(pdf, items[i]);
+  //     }
+  //     pdf.writePDF();
+  static void nextPage(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    PDFDocument* pdf = ExtractDocumentPointer(args.Holder());
+
+    if (!pdf)
+      return v8_utils::ThrowError(isolate, "Not a PDF canvas.");
+    if (!ExtractPointer(args.Holder()))
+      return v8_utils::ThrowError(isolate, "PDF has already been written.");
+
+    if (args.Length() > 0) {
+      pdf->width = args[0]->Int32Value();
+      pdf->height = args[1]->Int32Value();
+      pdf->content_width = v8_utils::ToInt32WithDefault(args[2], pdf->width);
+      pdf->content_height = v8_utils::ToInt32WithDefault(args[3], pdf->height);
+    }
+    if (pdf->width <= 0 || pdf->height <= 0)
+      return v8_utils::ThrowError(isolate, "Bad page size.");
+
+    // Ending the page deletes its SkCanvas.
+    args.Holder()->SetAlignedPointerInInternalField(0, NULL);
+    pdf->doc->endPage();
+    SkRect content = SkRect::MakeWH(pdf->content_width, pdf->content_height);
+    SkCanvas* canvas = pdf->doc->beginPage(pdf->width, pdf->height, &content);
+    if (!canvas)
+      return v8_utils::ThrowError(isolate, "Unable to begin PDF page.");
+    args.Holder()->SetAlignedPointerInInternalField(0, canvas);
+    ++pdf->pages;
+
+    args.Holder()->Set(v8::String::NewFromUtf8(isolate, "width"),
+                       v8::Integer::New(isolate, pdf->width));
+    args.Holder()->Set(v8::String::NewFromUtf8(isolate, "height"),
+                       v8::Integer::New(isolate, pdf->height));
+    return args.GetReturnValue().Set(pdf->pages);
+  }
+
   // void flush()
   //
   // Flushes any pending operations to the underlying surface, for example
@@ -6319,7 +10133,7 @@ class SkCanvasWrapper {
 class NSSoundWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -6327,6 +10141,7 @@ class NSSoundWrapper {
         v8::FunctionTemplate::New(isolate, &NSSoundWrapper::V8New);
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
     instance->SetInternalFieldCount(1);
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
@@ -6353,15 +10168,15 @@ class NSSoundWrapper {
     for (size_t i = 0; i < arraysize(constants); ++i) {
       ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
               v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -6461,6 +10276,8 @@ void NSOpenGLContextWrapper::texImage2DSkCanvasB(
   if (!args[2]->IsObject() && !SkCanvasWrapper::HasInstance(isolate, args[2]))
     return v8_utils::ThrowError(isolate, "Expected image to be an SkCanvas instance.");
 
+  PLASK_TRACE_EVENT("gl", "texImage2DSkCanvas");
+
 #if PLASK_OSX
   SkCanvas* canvas = SkCanvasWrapper::ExtractPointer(
       v8::Handle<v8::Object>::Cast(args[2]));
@@ -6488,6 +10305,8 @@ void NSOpenGLContextWrapper::drawSkCanvas(
   if (!args[0]->IsObject() && !SkCanvasWrapper::HasInstance(isolate, args[0]))
     return v8_utils::ThrowError(isolate, "Expected image to be an SkCanvas instance.");
 
+  PLASK_TRACE_EVENT("gl", "drawSkCanvas");
+
   SkCanvas* canvas = SkCanvasWrapper::ExtractPointer(
       v8::Handle<v8::Object>::Cast(args[0]));
   const SkBitmap& bitmap = canvas->getDevice()->accessBitmap(false);
@@ -6661,7 +10480,7 @@ static CFStringRef ConnectedEndpointName( MIDIEndpointRef endpoint )
 class CAMIDISourceWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -6669,6 +10488,7 @@ class CAMIDISourceWrapper {
         v8::FunctionTemplate::New(isolate, &CAMIDISourceWrapper::V8New);
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
     instance->SetInternalFieldCount(2);  // MIDIEndpointRef and MIDIPortRef.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
@@ -6686,15 +10506,15 @@ class CAMIDISourceWrapper {
     };
 
     for (size_t i = 0; i < arraysize(constants); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -6877,7 +10697,7 @@ class CAMIDIDestinationWrapper {
 
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -6902,6 +10722,8 @@ class CAMIDIDestinationWrapper {
       METHOD_ENTRY( close ),
     };
 
+    // Unlike the other classes these are set on the instance, since plask.js
+    // replaces the prototype to inherit from EventEmitter.
     for (size_t i = 0; i < arraysize(constants); ++i) {
       instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
                     v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
@@ -7079,7 +10901,7 @@ class CAMIDIDestinationWrapper {
 class SBApplicationWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -7087,6 +10909,7 @@ class SBApplicationWrapper {
         v8::FunctionTemplate::New(isolate, &SBApplicationWrapper::V8New);
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
     instance->SetInternalFieldCount(1);  // id.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
@@ -7102,15 +10925,15 @@ class SBApplicationWrapper {
     };
 
     for (size_t i = 0; i < arraysize(constants); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -7189,7 +11012,7 @@ class SBApplicationWrapper {
 class NSAppleScriptWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -7197,6 +11020,7 @@ class NSAppleScriptWrapper {
         v8::FunctionTemplate::New(isolate, &NSAppleScriptWrapper::V8New);
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
     instance->SetInternalFieldCount(1);  // NSAppleScript*.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
@@ -7210,15 +11034,15 @@ class NSAppleScriptWrapper {
     };
 
     for (size_t i = 0; i < arraysize(constants); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -7260,7 +11084,7 @@ class NSAppleScriptWrapper {
 class AVPlayerWrapper {
  public:
   static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
-    static v8::Persistent<v8::FunctionTemplate> ft_cache;
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
     if (!ft_cache.IsEmpty())
       return ft_cache;
 
@@ -7270,6 +11094,7 @@ class AVPlayerWrapper {
     ft->SetClassName(v8::String::NewFromUtf8(isolate, "AVPlayer"));
     v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
     instance->SetInternalFieldCount(1);  // Player
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
 
     v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
 
@@ -7302,15 +11127,15 @@ class AVPlayerWrapper {
     for (size_t i = 0; i < arraysize(constants); ++i) {
       ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
               v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
-      instance->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
-                    v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+      proto->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+                 v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
     }
 
     for (size_t i = 0; i < arraysize(methods); ++i) {
-      instance->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
-                    v8::FunctionTemplate::New(isolate, methods[i].func,
-                                              v8::Handle<v8::Value>(),
-                                              default_signature));
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
     }
 
     ft_cache.Reset(isolate, ft);
@@ -7574,16 +11399,2104 @@ class AVPlayerWrapper {
 
 #endif  // PLASK_OSX
 
-}  // namespace
+// Frame sequences.
+//
+// A FrameSequencePlayer plays a sequence of image files (ex. the PNG or TGA
+// frames of a render) with the frames decoded ahead of time on threads of its
+// own.  There is no clock, the playhead is moved by the caller (seek, step,
+// setFrame), so playback can follow any clock, ex. MIDI clock.  The frames in
+// a window from the playhead in the direction of play are kept decoded, the
+// decode threads work through the window nearest frame first, and frames
+// leaving it are dropped, so memory stays at the window size.  The current
+// frame is delivered by copying it to a raster SkCanvas or uploading it to a
+// GL texture.
+
+enum SequenceFrameState {
+  kSequenceFrameDecoding,
+  kSequenceFrameReady,
+  kSequenceFrameFailed,
+};
 
-#if PLASK_OSX
-@implementation WrappedNSWindow
+struct SequenceFrame {
+  SequenceFrameState state;
+  uint32_t ticket;  // Which decode is storing to this frame.
+  int width, height;
+  // Premultiplied BGRA, bottom row first (as FreeImage, and GL, have it).
+  uint8_t* pixels;
+};
 
--(void)setEventCallbackWithHandle:(v8::Handle<v8::Function>)func {
-  event_callback_.Reset(isolate, func);
+struct FrameSequence {
+  std::vector<std::string> filenames;
+  int window;  // Frames kept decoded, from the playhead on.
+  bool loop;
+  std::vector<uv_thread_t> threads;
+
+  uv_mutex_t lock;
+  uv_cond_t work;  // Signalled when |wanted| changes, or on |quit|.
+  uv_cond_t done;  // Signalled when a frame is decoded.
+  // Guarded by |lock|.
+  std::map<int, SequenceFrame> frames;  // Decoding or decoded, in the window.
+  std::vector<int> wanted;  // The window, nearest frame first.
+  uint32_t next_ticket;
+  bool quit;
+  uint64_t decoded, failed, decode_ns;
+
+  // The player's thread only.
+  int current;
+  int direction;  // 1 or -1.
+  bool delivered;  // The current frame has been copied or uploaded.
+  uint64_t hits, misses, dropped, deliveries;
+};
+
+// Decode |filename| to premultiplied BGRA, bottom row first, or NULL.
+static uint8_t* DecodeSequenceFrame(const std::string& filename,
+                                    int* width, int* height) {
+  const char* name = filename.c_str();
+  FREE_IMAGE_FORMAT format = FreeImage_GetFileType(name, 0);
+  if (format == FIF_UNKNOWN)
+    format = FreeImage_GetFIFFromFilename(name);
+  if (format == FIF_UNKNOWN || !FreeImage_FIFSupportsReading(format))
+    return NULL;
+
+  FIBITMAP* fbitmap = FreeImage_Load(format, name, 0);
+  if (!fbitmap)
+    return NULL;
+  if (FreeImage_GetBPP(fbitmap) != 32) {
+    FIBITMAP* old_bitmap = fbitmap;
+    fbitmap = FreeImage_ConvertTo32Bits(old_bitmap);
+    FreeImage_Unload(old_bitmap);
+    if (!fbitmap)
+      return NULL;
+  }
+
+  uint8_t* pixels = NULL;
+  if (FreeImage_PreMultiplyWithAlpha(fbitmap)) {
+    *width = FreeImage_GetWidth(fbitmap);
+    *height = FreeImage_GetHeight(fbitmap);
+    pixels = reinterpret_cast<uint8_t*>(
+        malloc(static_cast<size_t>(*width) * *height * 4));
+    if (pixels) {
+      FreeImage_ConvertToRawBits(pixels, fbitmap, *width * 4,
+                                 32, 0, 0, 0, FALSE);
+    }
+  }
+  FreeImage_Unload(fbitmap);
+  return pixels;
 }
 
--(void)processEvent:(NSEvent *)event {
+static void FrameSequenceThreadMain(void* arg) {
+  FrameSequence* seq = reinterpret_cast<FrameSequence*>(arg);
+  uv_mutex_lock(&seq->lock);
+  while (!seq->quit) {
+    int frame = -1;
+    for (size_t i = 0; i < seq->wanted.size(); ++i) {
+      if (seq->frames.find(seq->wanted[i]) == seq->frames.end()) {
+        frame = seq->wanted[i];
+        break;
+      }
+    }
+    if (frame == -1) {
+      uv_cond_wait(&seq->work, &seq->lock);
+      continue;
+    }
+
+    SequenceFrame& entry = seq->frames[frame];
+    entry.state = kSequenceFrameDecoding;
+    entry.ticket = seq->next_ticket++;
+    entry.width = entry.height = 0;
+    entry.pixels = NULL;
+    uint32_t ticket = entry.ticket;
+    const std::string filename = seq->filenames[frame];
+    uv_mutex_unlock(&seq->lock);
+
+    PLASK_TRACE_EVENT("image", "decodeFrame");
+    uint64_t start_ns = uv_hrtime();
+    int width = 0, height = 0;
+    uint8_t* pixels = DecodeSequenceFrame(filename, &width, &height);
+    uint64_t elapsed_ns = uv_hrtime() - start_ns;
+
+    uv_mutex_lock(&seq->lock);
+    seq->decode_ns += elapsed_ns;
+    if (pixels)
+      ++seq->decoded;
+    else
+      ++seq->failed;
+    std::map<int, SequenceFrame>::iterator it = seq->frames.find(frame);
+    if (it != seq->frames.end() && it->second.ticket == ticket) {
+      it->second.state = pixels ? kSequenceFrameReady : kSequenceFrameFailed;
+      it->second.width = width;
+      it->second.height = height;
+      it->second.pixels = pixels;
+    } else {
+      free(pixels);  // Left the window while it was decoded.
+    }
+    uv_cond_broadcast(&seq->done);
+  }
+  uv_mutex_unlock(&seq->lock);
+}
+
+// Wrap or clamp |frame| to the sequence, -1 when past the end without loop.
+static int FrameSequenceIndex(FrameSequence* seq, int frame) {
+  int count = seq->filenames.size();
+  if (seq->loop)
+    return ((frame % count) + count) % count;
+  return frame < 0 || frame >= count ? -1 : frame;
+}
+
+// Point the window at the current frame, dropping the frames that left it.
+static void UpdateFrameSequenceWindow(FrameSequence* seq) {
+  uv_mutex_lock(&seq->lock);
+  seq->wanted.clear();
+  for (int i = 0; i < seq->window; ++i) {
+    int frame = FrameSequenceIndex(seq, seq->current + i * seq->direction);
+    if (frame == -1 ||
+        std::find(seq->wanted.begin(), seq->wanted.end(), frame) !=
+            seq->wanted.end()) {
+      break;
+    }
+    seq->wanted.push_back(frame);
+  }
+  std::map<int, SequenceFrame>::iterator it = seq->frames.begin();
+  while (it != seq->frames.end()) {
+    if (std::find(seq->wanted.begin(), seq->wanted.end(), it->first) ==
+        seq->wanted.end()) {
+      free(it->second.pixels);  // NULL while decoding.
+      seq->frames.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  uv_cond_broadcast(&seq->work);
+  uv_mutex_unlock(&seq->lock);
+}
+
+static void DestroyFrameSequence(FrameSequence* seq) {
+  uv_mutex_lock(&seq->lock);
+  seq->quit = true;
+  uv_cond_broadcast(&seq->work);
+  uv_mutex_unlock(&seq->lock);
+  for (size_t i = 0; i < seq->threads.size(); ++i)
+    uv_thread_join(&seq->threads[i]);
+
+  for (std::map<int, SequenceFrame>::iterator it = seq->frames.begin();
+       it != seq->frames.end(); ++it) {
+    free(it->second.pixels);
+  }
+  uv_cond_destroy(&seq->done);
+  uv_cond_destroy(&seq->work);
+  uv_mutex_destroy(&seq->lock);
+  delete seq;
+}
+
+class PlaskFrameSequencePlayerWrapper {
+ public:
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft =
+        v8::FunctionTemplate::New(isolate, &PlaskFrameSequencePlayerWrapper::V8New);
+    v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
+    instance->SetInternalFieldCount(1);  // FrameSequence pointer.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
+
+    v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
+
+    static BatchedMethods methods[] = {
+      METHOD_ENTRY( frame ),
+      METHOD_ENTRY( seek ),
+      METHOD_ENTRY( step ),
+      METHOD_ENTRY( setFrame ),
+      METHOD_ENTRY( isReady ),
+      METHOD_ENTRY( frameSize ),
+      METHOD_ENTRY( copyToCanvas ),
+      METHOD_ENTRY( texImage2D ),
+      METHOD_ENTRY( stats ),
+      METHOD_ENTRY( resetStats ),
+      METHOD_ENTRY( close ),
+    };
+
+    for (size_t i = 0; i < arraysize(methods); ++i) {
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
+    }
+
+    ft_cache.Reset(isolate, ft);
+    return ft_cache;
+  }
+
+  static FrameSequence* ExtractPointer(v8::Handle<v8::Object> obj) {
+    return reinterpret_cast<FrameSequence*>(obj->GetAlignedPointerFromInternalField(0));
+  }
+
+ private:
+  static void WeakCallback(
+      const v8::WeakCallbackData<v8::Object, v8::Persistent<v8::Object> >& data) {
+    FrameSequence* seq = ExtractPointer(data.GetValue());
+
+    v8::Persistent<v8::Object>* persistent = data.GetParameter();
+    persistent->ClearWeak();
+    persistent->Reset();
+    delete persistent;
+
+    if (seq)  // Not closed.
+      DestroyFrameSequence(seq);
+  }
+
+  // The open sequence of |args|' holder, or NULL with an exception thrown.
+  static FrameSequence* OpenSequence(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    FrameSequence* seq = ExtractPointer(args.Holder());
+    if (!seq)
+      v8_utils::ThrowError(isolate, "FrameSequencePlayer is closed.");
+    return seq;
+  }
+
+  // Move the playhead to |frame|.  Moving on from a frame that was never
+  // delivered drops it, and the |skipped| frames passed over are dropped.
+  static void MoveTo(FrameSequence* seq, int frame, int skipped) {
+    if (frame == seq->current)
+      return;
+    if (!seq->delivered)
+      ++seq->dropped;
+    seq->dropped += std::max(0, skipped);
+    seq->current = frame;
+    seq->delivered = false;
+    UpdateFrameSequenceWindow(seq);
+  }
+
+  // Wait for the current frame unless |wait| is false, counting a hit or a
+  // miss for a |delivery|.  Returns the frame, NULL if it isn't decoded yet,
+  // or NULL with an exception thrown if it couldn't be.
+  static SequenceFrame* CurrentFrame(FrameSequence* seq, bool wait,
+                                     bool delivery) {
+    uv_mutex_lock(&seq->lock);
+    std::map<int, SequenceFrame>::iterator it = seq->frames.find(seq->current);
+    bool ready = it != seq->frames.end() &&
+                 it->second.state != kSequenceFrameDecoding;
+    if (delivery)
+      ++(ready ? seq->hits : seq->misses);
+    while (wait && !ready) {
+      uv_cond_wait(&seq->done, &seq->lock);
+      it = seq->frames.find(seq->current);
+      ready = it != seq->frames.end() &&
+              it->second.state != kSequenceFrameDecoding;
+    }
+    uv_mutex_unlock(&seq->lock);
+
+    if (!ready)
+      return NULL;
+    // Only this thread drops frames, so the entry stays put until the
+    // playhead moves.
+    if (it->second.state == kSequenceFrameFailed) {
+      char message[64];
+      snprintf(message, sizeof(message), "Couldn't load frame %d: ", seq->current);
+      v8_utils::ThrowError(
+          isolate, (message + seq->filenames[seq->current]).c_str());
+      return NULL;
+    }
+    return &it->second;
+  }
+
+  // new PlaskFrameSequencePlayer(filenames, window, threads, loop)
+  //
+  // See FrameSequencePlayer in plask.js.
+  static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (!args.IsConstructCall())
+      return v8_utils::ThrowTypeError(isolate, kMsgNonConstructCall);
+
+    if (!args[0]->IsArray())
+      return v8_utils::ThrowTypeError(isolate, "Expected an Array of filenames.");
+    v8::Local<v8::Array> filenames = v8::Local<v8::Array>::Cast(args[0]);
+    if (filenames->Length() == 0)
+      return v8_utils::ThrowError(isolate, "A frame sequence needs frames.");
+
+    FrameSequence* seq = new FrameSequence;
+    for (uint32_t i = 0; i < filenames->Length(); ++i) {
+      v8::String::Utf8Value filename(filenames->Get(i));
+      seq->filenames.push_back(std::string(*filename, filename.length()));
+    }
+    seq->window = std::max(1, v8_utils::ToInt32WithDefault(args[1], 8));
+    int threads = v8_utils::ToInt32WithDefault(args[2], 0);
+    if (threads <= 0)
+      threads = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN) - 1);
+    threads = std::min(threads, seq->window);
+    seq->loop = args[3]->BooleanValue();
+    uv_mutex_init(&seq->lock);
+    uv_cond_init(&seq->work);
+    uv_cond_init(&seq->done);
+    seq->next_ticket = 0;
+    seq->quit = false;
+    seq->decoded = seq->failed = seq->decode_ns = 0;
+    seq->current = 0;
+    seq->direction = 1;
+    seq->delivered = false;
+    seq->hits = seq->misses = seq->dropped = seq->deliveries = 0;
+    UpdateFrameSequenceWindow(seq);
+
+    for (int i = 0; i < threads; ++i) {
+      uv_thread_t thread;
+      if (uv_thread_create(&thread, &FrameSequenceThreadMain, seq) != 0)
+        break;
+      seq->threads.push_back(thread);
+    }
+    if (seq->threads.empty()) {
+      DestroyFrameSequence(seq);
+      return v8_utils::ThrowError(isolate, "Unable to start decode threads.");
+    }
+
+    args.This()->SetAlignedPointerInInternalField(0, seq);
+    args.This()->Set(v8::String::NewFromUtf8(isolate, "frameCount"),
+                     v8::Integer::New(isolate, seq->filenames.size()));
+
+    v8::Persistent<v8::Object>* persistent = new v8::Persistent<v8::Object>;
+    persistent->Reset(isolate, args.This());
+    persistent->SetWeak(persistent, &WeakCallback);
+  }
+
+  // int frame()
+  //
+  // The current frame.
+  DEFINE_METHOD(frame, 0)
+    FrameSequence* seq = OpenSequence(args);
+    if (!seq) return;
+    return args.GetReturnValue().Set(seq->current);
+  }
+
+  // void seek(frame)
+  //
+  // Jump to `frame`, and start decoding ahead from there.  Frames passed over
+  // aren't counted as dropped.
+  DEFINE_METHOD(seek, 1)
+    FrameSequence* seq = OpenSequence(args);
+    if (!seq) return;
+    int frame = FrameSequenceIndex(seq, args[0]->Int32Value());
+    if (frame == -1)
+      return v8_utils::ThrowError(isolate, "Frame out of range.");
+    MoveTo(seq, frame, 0);
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // int step(delta)
+  //
+  // Move `delta` frames on (back, if negative), the direction of play and so
+  // of decoding ahead follows.  Frames stepped over count as dropped.  Without
+  // loop the playhead stops at the first and last frames.  Returns the new
+  // current frame.
+  DEFINE_METHOD(step, 1)
+    FrameSequence* seq = OpenSequence(args);
+    if (!seq) return;
+    int delta = args[0]->Int32Value();
+    if (delta == 0)
+      return args.GetReturnValue().Set(seq->current);
+    int count = seq->filenames.size();
+    int target = seq->current + delta;
+    if (!seq->loop)
+      target = std::max(0, std::min(count - 1, target));
+    int distance = std::min(std::abs(target - seq->current), count);
+    seq->direction = delta > 0 ? 1 : -1;
+    MoveTo(seq, FrameSequenceIndex(seq, target), distance - 1);
+    return args.GetReturnValue().Set(seq->current);
+  }
+
+  // void setFrame(frame)
+  //
+  // Move to `frame`, as given by an external clock.  Moving forward (with
+  // loop, across the end too) counts the frames in between as dropped, moving
+  // back is a seek.
+  DEFINE_METHOD(setFrame, 1)
+    FrameSequence* seq = OpenSequence(args);
+    if (!seq) return;
+    int frame = FrameSequenceIndex(seq, args[0]->Int32Value());
+    if (frame == -1)
+      return v8_utils::ThrowError(isolate, "Frame out of range.");
+    int count = seq->filenames.size();
+    int forward = frame - seq->current;
+    if (seq->loop && forward < 0 && seq->direction > 0 && -forward > count / 2)
+      forward += count;  // Wrapped around the end.
+    if (forward > 0) {
+      seq->direction = 1;
+      MoveTo(seq, frame, forward - 1);
+    } else {
+      MoveTo(seq, frame, 0);
+    }
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // bool isReady()
+  //
+  // Whether the current frame is decoded, and can be delivered without
+  // waiting.
+  DEFINE_METHOD(isReady, 0)
+    FrameSequence* seq = OpenSequence(args);
+    if (!seq) return;
+    uv_mutex_lock(&seq->lock);
+    std::map<int, SequenceFrame>::iterator it = seq->frames.find(seq->current);
+    bool ready = it != seq->frames.end() &&
+                 it->second.state != kSequenceFrameDecoding;
+    uv_mutex_unlock(&seq->lock);
+    return args.GetReturnValue().Set(ready);
+  }
+
+  // object frameSize(wait)
+  //
+  // The current frame's size as {width, height}, waiting for it to decode if
+  // `wait` is true, otherwise null if it isn't decoded yet.
+  DEFINE_METHOD(frameSize, 1)
+    FrameSequence* seq = OpenSequence(args);
+    if (!seq) return;
+    SequenceFrame* frame = CurrentFrame(seq, args[0]->BooleanValue(), false);
+    if (!frame)
+      return args.GetReturnValue().SetNull();  // Or an exception.
+    v8::Local<v8::Object> res = v8::Object::New(isolate);
+    res->Set(v8::String::NewFromUtf8(isolate, "width"),
+             v8::Integer::New(isolate, frame->width));
+    res->Set(v8::String::NewFromUtf8(isolate, "height"),
+             v8::Integer::New(isolate, frame->height));
+    return args.GetReturnValue().Set(res);
+  }
+
+  // bool copyToCanvas(canvas, wait)
+  //
+  // Copy the current frame to the bitmap SkCanvas `canvas`, which must be the
+  // frame's size.  If the frame isn't decoded yet, waits for it if `wait` is
+  // true, otherwise returns false and leaves `canvas` as it was.
+  DEFINE_METHOD(copyToCanvas, 2)
+    FrameSequence* seq = OpenSequence(args);
+    if (!seq) return;
+    if (!SkCanvasWrapper::HasInstance(isolate, args[0]))
+      return v8_utils::ThrowTypeError(isolate, "Expected an SkCanvas.");
+    v8::Local<v8::Object> canvas_obj = v8::Local<v8::Object>::Cast(args[0]);
+    SkCanvas* canvas = SkCanvasWrapper::ExtractPointer(canvas_obj);
+    PooledCanvas* pooled = SkCanvasWrapper::ExtractPooledCanvas(canvas_obj);
+    if (!pooled || !pooled->block)
+      return v8_utils::ThrowError(isolate, "Expected a bitmap SkCanvas.");
+
+    SequenceFrame* frame = CurrentFrame(seq, args[1]->BooleanValue(), true);
+    if (!frame)
+      return args.GetReturnValue().Set(false);  // Or an exception.
+
+    const SkImageInfo& info = canvas->imageInfo();
+    if (info.width() != frame->width || info.height() != frame->height)
+      return v8_utils::ThrowError(isolate, "Canvas isn't the frame's size.");
+    if (!UnsharePooledCanvas(isolate, pooled))
+      return v8_utils::ThrowError(isolate, "Unable to allocate canvas pixels.");
+    // Unsharing a pristine canvas replaces its SkCanvas.
+    canvas = SkCanvasWrapper::ExtractPointer(canvas_obj);
+
+    PLASK_TRACE_EVENT("image", "copyFrame");
+    const SkBitmap& bitmap = canvas->getDevice()->accessBitmap(true);
+    size_t row_bytes = frame->width * 4;
+    for (int y = 0; y < frame->height; ++y) {
+      memcpy(bitmap.getAddr(0, y),
+             frame->pixels + (frame->height - 1 - y) * row_bytes, row_bytes);
+    }
+    seq->delivered = true;
+    ++seq->deliveries;
+    return args.GetReturnValue().Set(true);
+  }
+
+  // bool texImage2D(target, level, wait)
+  //
+  // Upload the current frame to the texture bound to `target` of the current
+  // GL context, like texImage2DSkCanvas (so flipped for GL).  If the frame
+  // isn't decoded yet, waits for it if `wait` is true, otherwise returns false
+  // and uploads nothing.
+  DEFINE_METHOD(texImage2D, 3)
+    FrameSequence* seq = OpenSequence(args);
+    if (!seq) return;
+#if PLASK_OSX
+    SequenceFrame* frame = CurrentFrame(seq, args[2]->BooleanValue(), true);
+    if (!frame)
+      return args.GetReturnValue().Set(false);  // Or an exception.
+
+    PLASK_TRACE_EVENT("gl", "texImage2DFrame");
+    glTexImage2D(args[0]->Uint32Value(),
+                 args[1]->Int32Value(),
+                 GL_RGBA8,
+                 frame->width,
+                 frame->height,
+                 0,
+                 GL_BGRA,  // We have to swizzle, so this technically isn't ES.
+                 GL_UNSIGNED_INT_8_8_8_8_REV,
+                 frame->pixels);
+    seq->delivered = true;
+    ++seq->deliveries;
+    return args.GetReturnValue().Set(true);
+#else
+    return v8_utils::ThrowError(isolate, "Unimplemented.");
+#endif
+  }
+
+  // object stats()
+  //
+  // Playback counts since the player was created or resetStats:
+  //   hits        The current frame was to be delivered (copyToCanvas,
+  //               texImage2D) and was already decoded,
+  //   misses      or was still decoding, whether it was waited for or not.
+  //   dropped     Frames the playhead moved on from without delivering them.
+  //   delivered   Frames copied to a canvas or uploaded.
+  //   decoded     Frames decoded, and `failed` to decode.
+  //   decodeMs    Average decode time, in milliseconds.
+  //   cached      Decoded frames held now, and `cachedBytes` their size.
+  DEFINE_METHOD(stats, 0)
+    FrameSequence* seq = OpenSequence(args);
+    if (!seq) return;
+    uv_mutex_lock(&seq->lock);
+    uint64_t decoded = seq->decoded, failed = seq->failed;
+    double decode_ms = decoded + failed == 0 ? 0 :
+        seq->decode_ns / 1e6 / (decoded + failed);
+    int cached = 0;
+    double cached_bytes = 0;
+    for (std::map<int, SequenceFrame>::iterator it = seq->frames.begin();
+         it != seq->frames.end(); ++it) {
+      if (it->second.state == kSequenceFrameReady) {
+        ++cached;
+        cached_bytes += static_cast<double>(it->second.width) * it->second.height * 4;
+      }
+    }
+    uv_mutex_unlock(&seq->lock);
+
+    v8::Local<v8::Object> res = v8::Object::New(isolate);
+    res->Set(v8::String::NewFromUtf8(isolate, "hits"),
+             v8::Number::New(isolate, seq->hits));
+    res->Set(v8::String::NewFromUtf8(isolate, "misses"),
+             v8::Number::New(isolate, seq->misses));
+    res->Set(v8::String::NewFromUtf8(isolate, "dropped"),
+             v8::Number::New(isolate, seq->dropped));
+    res->Set(v8::String::NewFromUtf8(isolate, "delivered"),
+             v8::Number::New(isolate, seq->deliveries));
+    res->Set(v8::String::NewFromUtf8(isolate, "decoded"),
+             v8::Number::New(isolate, decoded));
+    res->Set(v8::String::NewFromUtf8(isolate, "failed"),
+             v8::Number::New(isolate, failed));
+    res->Set(v8::String::NewFromUtf8(isolate, "decodeMs"),
+             v8::Number::New(isolate, decode_ms));
+    res->Set(v8::String::NewFromUtf8(isolate, "cached"),
+             v8::Integer::New(isolate, cached));
+    res->Set(v8::String::NewFromUtf8(isolate, "cachedBytes"),
+             v8::Number::New(isolate, cached_bytes));
+    return args.GetReturnValue().Set(res);
+  }
+
+  // void resetStats()
+  DEFINE_METHOD(resetStats, 0)
+    FrameSequence* seq = OpenSequence(args);
+    if (!seq) return;
+    seq->hits = seq->misses = seq->dropped = seq->deliveries = 0;
+    uv_mutex_lock(&seq->lock);
+    seq->decoded = seq->failed = seq->decode_ns = 0;
+    uv_mutex_unlock(&seq->lock);
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // void close()
+  //
+  // Stop the decode threads and free the decoded frames now, rather than
+  // when the player is garbage collected.  The player can't be used after.
+  DEFINE_METHOD(close, 0)
+    FrameSequence* seq = ExtractPointer(args.Holder());
+    if (seq) {
+      args.Holder()->SetAlignedPointerInInternalField(0, NULL);
+      DestroyFrameSequence(seq);
+    }
+    return args.GetReturnValue().SetUndefined();
+  }
+};
+
+class PlaskS3TCWrapper {
+ public:
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft =
+        v8::FunctionTemplate::New(isolate, &PlaskS3TCWrapper::V8New);
+
+    static BatchedConstants constants[] = {
+      { "FLIP_Y", kS3TCFlipY },
+      { "SOURCE_BGRA", kS3TCSourceBGRA },
+    };
+
+    static BatchedMethods class_methods[] = {
+      { "encode", &PlaskS3TCWrapper::class_encode },
+      { "decode", &PlaskS3TCWrapper::class_decode },
+      { "imageBytes", &PlaskS3TCWrapper::class_imageBytes },
+    };
+
+    for (size_t i = 0; i < arraysize(constants); ++i) {
+      ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+              v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+    }
+
+    for (size_t i = 0; i < arraysize(class_methods); ++i) {
+      ft->Set(v8::String::NewFromUtf8(isolate, class_methods[i].name),
+              v8::FunctionTemplate::New(isolate, class_methods[i].func,
+                                              v8::Handle<v8::Value>()));
+    }
+
+    ft_cache.Reset(isolate, ft);
+    return ft_cache;
+  }
+
+ private:
+  // PlaskS3TC only has class methods, there is nothing to construct.
+  static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return v8_utils::ThrowTypeError(isolate, "PlaskS3TC is not constructable.");
+  }
+
+  static v8::Local<v8::Uint8Array> NewBytes(size_t size, uint8_t** data) {
+    v8::Local<v8::ArrayBuffer> ab = v8::ArrayBuffer::New(isolate, size);
+    v8::Local<v8::Uint8Array> view = v8::Uint8Array::New(ab, 0, size);
+    void* bytes;
+    intptr_t length;
+    GetTypedArrayBytes(view, &bytes, &length);
+    *data = reinterpret_cast<uint8_t*>(bytes);
+    return view;
+  }
+
+  // object[ ] encode(source, width, height, format, flags, levels, threads)
+  //
+  // Encode `source`, an SkCanvas or a TypedArray of `width` x `height` RGBA
+  // pixels (the size of a canvas comes from the canvas), as S3TC `format`.
+  // `flags` are FLIP_Y and SOURCE_BGRA.  `levels` is the number of mip levels
+  // to make, each half the size of the one before, 0 for all of them down to
+  // 1x1.  `threads` is the number of threads to encode on, 0 for one per CPU.
+  // Returns the levels as [{width, height, data}], data a Uint8Array.
+  static void class_encode(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (args.Length() != 7)
+      return v8_utils::ThrowError(isolate, "Wrong number of arguments.");
+
+    GLenum format = args[3]->Uint32Value();
+    if (S3TCBlockBytes(format) == 0)
+      return v8_utils::ThrowError(isolate, "Not an S3TC format.");
+
+    const uint8_t* src = NULL;
+    int width, height;
+    size_t stride;
+    if (SkCanvasWrapper::HasInstance(isolate, args[0])) {
+      v8::Local<v8::Object> obj = v8::Local<v8::Object>::Cast(args[0]);
+      SkImageInfo info = SkCanvasWrapper::ExtractPointer(obj)->imageInfo();
+      src = reinterpret_cast<const uint8_t*>(obj->GetIndexedPropertiesPixelData());
+      width = info.width();
+      height = info.height();
+      stride = height > 0 ? obj->GetIndexedPropertiesPixelDataLength() / height : 0;
+      if (!src || info.colorType() != kBGRA_8888_SkColorType)
+        return v8_utils::ThrowError(isolate, "Only bitmap canvases can be encoded.");
+    } else {
+      void* data;
+      intptr_t size;
+      if (!GetTypedArrayBytes(args[0], &data, &size))
+        return v8_utils::ThrowTypeError(isolate, "Source must be an SkCanvas or a TypedArray.");
+      width = args[1]->Int32Value();
+      height = args[2]->Int32Value();
+      stride = static_cast<size_t>(width) * 4;
+      if (width <= 0 || height <= 0 || size < static_cast<intptr_t>(stride * height))
+        return v8_utils::ThrowError(isolate, "Source is smaller than width x height RGBA pixels.");
+      src = reinterpret_cast<const uint8_t*>(data);
+    }
+    if (width <= 0 || height <= 0)
+      return v8_utils::ThrowError(isolate, "Can't encode an empty image.");
+
+    int levels = args[5]->Int32Value();
+    int max_levels = 1;
+    for (int size = std::max(width, height); size > 1; size /= 2) ++max_levels;
+    if (levels <= 0 || levels > max_levels)
+      levels = max_levels;
+    int threads = args[6]->Int32Value();
+    if (threads <= 0)
+      threads = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+    PLASK_TRACE_EVENT("image", "encodeS3TC");
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    S3TCLoadSource(src, width, height, stride, args[4]->Int32Value(), &rgba[0]);
+
+    v8::Local<v8::Array> res = v8::Array::New(isolate, levels);
+    for (int level = 0; level < levels; ++level) {
+      if (level > 0) {
+        std::vector<uint8_t> next(static_cast<size_t>(std::max(1, width / 2)) *
+                                  std::max(1, height / 2) * 4);
+        S3TCHalve(&rgba[0], width, height, &next[0]);
+        rgba.swap(next);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+      }
+      uint8_t* out;
+      v8::Local<v8::Uint8Array> data =
+          NewBytes(S3TCImageBytes(format, width, height), &out);
+      S3TCEncode(&rgba[0], width, height, format, out, threads);
+
+      v8::Local<v8::Object> obj = v8::Object::New(isolate);
+      obj->Set(v8::String::NewFromUtf8(isolate, "width"),
+               v8::Integer::New(isolate, width));
+      obj->Set(v8::String::NewFromUtf8(isolate, "height"),
+               v8::Integer::New(isolate, height));
+      obj->Set(v8::String::NewFromUtf8(isolate, "data"), data);
+      res->Set(level, obj);
+    }
+    return args.GetReturnValue().Set(res);
+  }
+
+  // Uint8Array decode(data, width, height, format)
+  //
+  // Decode S3TC `data` to RGBA pixels, the way the GPU would.
+  static void class_decode(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (args.Length() != 4)
+      return v8_utils::ThrowError(isolate, "Wrong number of arguments.");
+
+    void* data;
+    intptr_t size;
+    if (!GetTypedArrayBytes(args[0], &data, &size))
+      return v8_utils::ThrowTypeError(isolate, "Data must be a TypedArray.");
+    int width = args[1]->Int32Value(), height = args[2]->Int32Value();
+    GLenum format = args[3]->Uint32Value();
+    if (S3TCBlockBytes(format) == 0)
+      return v8_utils::ThrowError(isolate, "Not an S3TC format.");
+    if (width <= 0 || height <= 0 ||
+        static_cast<size_t>(size) < S3TCImageBytes(format, width, height)) {
+      return v8_utils::ThrowError(isolate, "Data is too small for the image.");
+    }
+
+    uint8_t* pixels;
+    v8::Local<v8::Uint8Array> res =
+        NewBytes(static_cast<size_t>(width) * height * 4, &pixels);
+    S3TCDecode(reinterpret_cast<const uint8_t*>(data), width, height, format,
+               pixels);
+    return args.GetReturnValue().Set(res);
+  }
+
+  // number imageBytes(format, width, height)
+  //
+  // The size of S3TC `format` data for a `width` x `height` image, or 0 if
+  // `format` isn't S3TC.
+  static void class_imageBytes(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return args.GetReturnValue().Set(v8::Number::New(isolate,
+        S3TCImageBytes(args[0]->Uint32Value(), args[1]->Int32Value(),
+                       args[2]->Int32Value())));
+  }
+};
+
+class PlaskNoiseWrapper {
+ public:
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft =
+        v8::FunctionTemplate::New(isolate, &PlaskNoiseWrapper::V8New);
+    v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
+    instance->SetInternalFieldCount(1);  // NoiseGenerator pointer.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
+
+    v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
+
+    static BatchedConstants constants[] = {
+      { "SIMPLEX", kSimplexNoise },
+      { "PERLIN", kPerlinNoise },
+    };
+
+    static BatchedMethods methods[] = {
+      METHOD_ENTRY( noise ),
+      METHOD_ENTRY( fillGrid ),
+      METHOD_ENTRY( fillPoints ),
+      METHOD_ENTRY( drawGrid ),
+    };
+
+    for (size_t i = 0; i < arraysize(constants); ++i) {
+      ft->Set(v8::String::NewFromUtf8(isolate, constants[i].name),
+              v8::Uint32::New(isolate, constants[i].val), v8::ReadOnly);
+    }
+
+    for (size_t i = 0; i < arraysize(methods); ++i) {
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
+    }
+
+    ft_cache.Reset(isolate, ft);
+    return ft_cache;
+  }
+
+  static NoiseGenerator* ExtractPointer(v8::Handle<v8::Object> obj) {
+    return reinterpret_cast<NoiseGenerator*>(obj->GetAlignedPointerFromInternalField(0));
+  }
+
+ private:
+  static void WeakCallback(
+      const v8::WeakCallbackData<v8::Object, v8::Persistent<v8::Object> >& data) {
+    NoiseGenerator* noise = ExtractPointer(data.GetValue());
+
+    v8::Persistent<v8::Object>* persistent = data.GetParameter();
+    persistent->ClearWeak();
+    persistent->Reset();
+    delete persistent;
+
+    delete noise;
+  }
+
+  // The dimensions argument, or 0 with an exception thrown.
+  static int DimsArg(v8::Handle<v8::Value> value) {
+    int dims = value->Int32Value();
+    if (dims < 2 || dims > 4) {
+      v8_utils::ThrowError(isolate, "Noise dimensions must be 2, 3 or 4.");
+      return 0;
+    }
+    return dims;
+  }
+
+  // The threads argument, 1 when not given and 0 for one per CPU.
+  static int ThreadsArg(v8::Handle<v8::Value> value) {
+    int threads = v8_utils::ToInt32WithDefault(value, 1);
+    if (threads <= 0)
+      threads = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    return threads;
+  }
+
+  // The floats of the Float32Array |value|, or NULL with an exception thrown.
+  static float* Float32ArrayArg(v8::Handle<v8::Value> value, size_t* length) {
+    void* data;
+    intptr_t size;
+    if (!value->IsFloat32Array() || !GetTypedArrayBytes(value, &data, &size)) {
+      v8_utils::ThrowTypeError(isolate, "Expected a Float32Array.");
+      return NULL;
+    }
+    *length = size / sizeof(float);
+    return reinterpret_cast<float*>(data);
+  }
+
+  // new PlaskNoise(type, seed, octaves, lacunarity, gain, turbulence)
+  //
+  // See Noise in plask.js.
+  static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (!args.IsConstructCall())
+      return v8_utils::ThrowTypeError(isolate, kMsgNonConstructCall);
+
+    int kind = v8_utils::ToInt32WithDefault(args[0], kSimplexNoise);
+    if (kind != kSimplexNoise && kind != kPerlinNoise)
+      return v8_utils::ThrowError(isolate, "Unknown noise type.");
+    int octaves = v8_utils::ToInt32WithDefault(args[2], 1);
+    if (octaves < 1 || octaves > 32)
+      return v8_utils::ThrowError(isolate, "Octaves must be 1 to 32.");
+
+    NoiseGenerator* noise = new NoiseGenerator;
+    noise->kind = kind;
+    noise->octaves = octaves;
+    noise->lacunarity = v8_utils::ToNumberWithDefault(args[3], 2);
+    noise->gain = v8_utils::ToNumberWithDefault(args[4], 0.5);
+    noise->turbulence = args[5]->BooleanValue();
+    SeedNoise(noise, v8_utils::ToInt32WithDefault(args[1], 0));
+
+    args.This()->SetAlignedPointerInInternalField(0, noise);
+    args.This()->Set(v8::String::NewFromUtf8(isolate, "turbulence"),
+                     v8::Boolean::New(isolate, noise->turbulence));
+
+    v8::Persistent<v8::Object>* persistent = new v8::Persistent<v8::Object>;
+    persistent->Reset(isolate, args.This());
+    persistent->SetWeak(persistent, &WeakCallback);
+  }
+
+  // float noise(x, y, z, w)
+  //
+  // The noise at a single point, of 2 to 4 dimensions by the number of
+  // arguments.  Fill a grid or a list of points for more than a few.
+  static void noise(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    int dims = args.Length();
+    if (dims < 2 || dims > 4)
+      return v8_utils::ThrowError(isolate, "Wrong number of arguments.");
+    float p[4] = {0, 0, 0, 0};
+    for (int d = 0; d < dims; ++d)
+      p[d] = args[d]->NumberValue();
+    return args.GetReturnValue().Set(
+        NoiseAt(ExtractPointer(args.Holder()), dims, p));
+  }
+
+  // void fillGrid(out, dims, width, height, x, y, z, w, dx, dy, threads)
+  //
+  // Fill the Float32Array `out` with a `width` x `height` grid of `dims`
+  // dimensional noise, row by row.  The sample at column i, row j is at
+  // (x + i * dx, y + j * dy, z, w).  Split by rows over `threads` threads
+  // (default 1, 0 for one per CPU).
+  static void fillGrid(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (args.Length() < 10 || args.Length() > 11)
+      return v8_utils::ThrowError(isolate, "Wrong number of arguments.");
+    size_t length;
+    float* out = Float32ArrayArg(args[0], &length);
+    if (!out) return;
+    int dims = DimsArg(args[1]);
+    if (!dims) return;
+    NoiseGrid grid;
+    grid.width = args[2]->Int32Value();
+    grid.height = args[3]->Int32Value();
+    if (grid.width < 0 || grid.height < 0 ||
+        length < static_cast<size_t>(grid.width) * grid.height) {
+      return v8_utils::ThrowError(isolate, "Output is smaller than width x height.");
+    }
+    for (int i = 0; i < 4; ++i)
+      grid.origin[i] = args[4 + i]->NumberValue();
+    grid.dx = args[8]->NumberValue();
+    grid.dy = args[9]->NumberValue();
+
+    PLASK_TRACE_EVENT("noise", "fillGrid");
+    NoiseJob job = NoiseJob();
+    job.noise = ExtractPointer(args.Holder());
+    job.dims = dims;
+    job.grid = &grid;
+    job.output = kNoiseToFloats;
+    job.out = out;
+    RunNoiseJobs(job, grid.height, ThreadsArg(args[10]));
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // void fillPoints(out, points, dims, threads)
+  //
+  // Fill the Float32Array `out` with the noise at each of `points`, a
+  // Float32Array of `dims` (2 to 4) coordinates per point.  Split over
+  // `threads` threads (default 1, 0 for one per CPU).
+  static void fillPoints(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (args.Length() < 3 || args.Length() > 4)
+      return v8_utils::ThrowError(isolate, "Wrong number of arguments.");
+    size_t length, points_length;
+    float* out = Float32ArrayArg(args[0], &length);
+    if (!out) return;
+    const float* points = Float32ArrayArg(args[1], &points_length);
+    if (!points) return;
+    int dims = DimsArg(args[2]);
+    if (!dims) return;
+    size_t count = points_length / dims;
+    if (length < count)
+      return v8_utils::ThrowError(isolate, "Output is smaller than the number of points.");
+
+    PLASK_TRACE_EVENT("noise", "fillPoints");
+    NoiseJob job = NoiseJob();
+    job.noise = ExtractPointer(args.Holder());
+    job.dims = dims;
+    job.points = points;
+    job.output = kNoiseToFloats;
+    job.out = out;
+    RunNoiseJobs(job, static_cast<int>(count), ThreadsArg(args[3]));
+    return args.GetReturnValue().SetUndefined();
+  }
+
+  // void drawGrid(canvas, dims, x, y, z, w, dx, dy, lo, hi, threads)
+  //
+  // Like fillGrid, the size of the bitmap SkCanvas `canvas`, but written to
+  // its pixels as opaque gray, noise `lo` as black up to `hi` as white.
+  static void drawGrid(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (args.Length() < 10 || args.Length() > 11)
+      return v8_utils::ThrowError(isolate, "Wrong number of arguments.");
+    if (!SkCanvasWrapper::HasInstance(isolate, args[0]))
+      return v8_utils::ThrowTypeError(isolate, "Expected an SkCanvas.");
+    v8::Local<v8::Object> canvas_obj = v8::Local<v8::Object>::Cast(args[0]);
+    SkCanvas* canvas = SkCanvasWrapper::ExtractPointer(canvas_obj);
+    PooledCanvas* pooled = SkCanvasWrapper::ExtractPooledCanvas(canvas_obj);
+    if (!pooled || !pooled->block)
+      return v8_utils::ThrowError(isolate, "Expected a bitmap SkCanvas.");
+    int dims = DimsArg(args[1]);
+    if (!dims) return;
+    if (!UnsharePooledCanvas(isolate, pooled))
+      return v8_utils::ThrowError(isolate, "Unable to allocate canvas pixels.");
+    // Unsharing a pristine canvas replaces its SkCanvas.
+    canvas = SkCanvasWrapper::ExtractPointer(canvas_obj);
+
+    const SkBitmap& bitmap = canvas->getDevice()->accessBitmap(true);
+    NoiseGrid grid;
+    grid.width = bitmap.width();
+    grid.height = bitmap.height();
+    for (int i = 0; i < 4; ++i)
+      grid.origin[i] = args[2 + i]->NumberValue();
+    grid.dx = args[6]->NumberValue();
+    grid.dy = args[7]->NumberValue();
+
+    PLASK_TRACE_EVENT("noise", "drawGrid");
+    NoiseJob job = NoiseJob();
+    job.noise = ExtractPointer(args.Holder());
+    job.dims = dims;
+    job.grid = &grid;
+    job.output = kNoiseToPixels;
+    job.pixels = reinterpret_cast<uint8_t*>(bitmap.getAddr(0, 0));
+    job.stride = bitmap.rowBytes();
+    job.lo = args[8]->NumberValue();
+    job.hi = args[9]->NumberValue();
+    RunNoiseJobs(job, grid.height, ThreadsArg(args[10]));
+    return args.GetReturnValue().SetUndefined();
+  }
+};
+
+class PlaskStatsWrapper {
+ public:
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft =
+        v8::FunctionTemplate::New(isolate, &PlaskStatsWrapper::V8New);
+
+    static BatchedMethods class_methods[] = {
+      { "enable", &PlaskStatsWrapper::class_enable },
+      { "disable", &PlaskStatsWrapper::class_disable },
+      { "isEnabled", &PlaskStatsWrapper::class_isEnabled },
+      { "reset", &PlaskStatsWrapper::class_reset },
+      { "snapshot", &PlaskStatsWrapper::class_snapshot },
+    };
+
+    for (size_t i = 0; i < arraysize(class_methods); ++i) {
+      ft->Set(v8::String::NewFromUtf8(isolate, class_methods[i].name),
+              v8::FunctionTemplate::New(isolate, class_methods[i].func,
+                                              v8::Handle<v8::Value>()));
+    }
+
+    ft_cache.Reset(isolate, ft);
+    return ft_cache;
+  }
+
+ private:
+  // PlaskStats only has class methods, there is nothing to construct.
+  static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return v8_utils::ThrowTypeError(isolate, "PlaskStats is not constructable.");
+  }
+
+  // void enable()
+  static void class_enable(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    g_binding_stats_enabled = true;
+  }
+
+  // void disable()
+  static void class_disable(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    g_binding_stats_enabled = false;
+  }
+
+  // bool isEnabled()
+  static void class_isEnabled(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return args.GetReturnValue().Set(g_binding_stats_enabled);
+  }
+
+  // void reset()
+  static void class_reset(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    ResetBindingStats();
+  }
+
+  // Array snapshot()
+  //
+  // Return an entry for every instrumented method that has been called:
+  // {className, name, calls, totalNs, maxNs, histogram}, where histogram[i]
+  // is the number of calls that took from 2^i to 2^(i+1) nanoseconds.
+  static void class_snapshot(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::Local<v8::Array> res = v8::Array::New(isolate);
+    uint32_t num = 0;
+    for (size_t i = 0; i < g_binding_stats.size(); ++i) {
+      BindingStats* stats = g_binding_stats[i];
+      if (stats->calls == 0)
+        continue;
+
+      int num_buckets = kBindingStatsBuckets;
+      while (num_buckets > 0 && stats->histogram[num_buckets - 1] == 0)
+        --num_buckets;
+      v8::Local<v8::Array> histogram = v8::Array::New(isolate, num_buckets);
+      for (int j = 0; j < num_buckets; ++j) {
+        histogram->Set(j, v8::Number::New(
+            isolate, static_cast<double>(stats->histogram[j])));
+      }
+
+      v8::Local<v8::Object> entry = v8::Object::New(isolate);
+      entry->Set(v8::String::NewFromUtf8(isolate, "className"),
+                 v8::String::NewFromUtf8(isolate, stats->class_name));
+      entry->Set(v8::String::NewFromUtf8(isolate, "name"),
+                 v8::String::NewFromUtf8(isolate, stats->name));
+      entry->Set(v8::String::NewFromUtf8(isolate, "calls"),
+                 v8::Number::New(isolate, static_cast<double>(stats->calls)));
+      entry->Set(v8::String::NewFromUtf8(isolate, "totalNs"),
+                 v8::Number::New(isolate, static_cast<double>(stats->total_ns)));
+      entry->Set(v8::String::NewFromUtf8(isolate, "maxNs"),
+                 v8::Number::New(isolate, static_cast<double>(stats->max_ns)));
+      entry->Set(v8::String::NewFromUtf8(isolate, "histogram"), histogram);
+      res->Set(num++, entry);
+    }
+    return args.GetReturnValue().Set(res);
+  }
+};
+
+class PlaskTraceWrapper {
+ public:
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft =
+        v8::FunctionTemplate::New(isolate, &PlaskTraceWrapper::V8New);
+
+    static BatchedMethods class_methods[] = {
+      { "enable", &PlaskTraceWrapper::class_enable },
+      { "disable", &PlaskTraceWrapper::class_disable },
+      { "isEnabled", &PlaskTraceWrapper::class_isEnabled },
+      { "clear", &PlaskTraceWrapper::class_clear },
+      { "begin", &PlaskTraceWrapper::class_begin },
+      { "end", &PlaskTraceWrapper::class_end },
+      { "toJSON", &PlaskTraceWrapper::class_toJSON },
+      { "startupMark", &PlaskTraceWrapper::class_startupMark },
+      { "startupMarks", &PlaskTraceWrapper::class_startupMarks },
+    };
+
+    for (size_t i = 0; i < arraysize(class_methods); ++i) {
+      ft->Set(v8::String::NewFromUtf8(isolate, class_methods[i].name),
+              v8::FunctionTemplate::New(isolate, class_methods[i].func,
+                                              v8::Handle<v8::Value>()));
+    }
+
+    ft_cache.Reset(isolate, ft);
+    return ft_cache;
+  }
+
+ private:
+  // PlaskTrace only has class methods, there is nothing to construct.
+  static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return v8_utils::ThrowTypeError(isolate, "PlaskTrace is not constructable.");
+  }
+
+  // void enable()
+  //
+  // Start recording events.  Recording is cheap enough to leave enabled for
+  // the lifetime of a sketch, each thread keeps the last 65536 events.
+  static void class_enable(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    TraceEnable(isolate);
+  }
+
+  // void disable()
+  static void class_disable(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    TraceDisable(isolate);
+  }
+
+  // bool isEnabled()
+  static void class_isEnabled(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return args.GetReturnValue().Set(g_plask_trace_enabled);
+  }
+
+  // void clear()
+  //
+  // Discard all recorded events.
+  static void class_clear(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    TraceClear();
+  }
+
+  // void begin(string name)
+  //
+  // Open a JavaScript event, closed by the matching end().  Events nest, and
+  // are recorded under the category "js".
+  static void class_begin(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (args.Length() != 1)
+      return v8_utils::ThrowError(isolate, "Wrong number of arguments.");
+    if (t_trace_num_open >= kTraceMaxOpenEvents)
+      return v8_utils::ThrowError(isolate, "Trace events nested too deeply.");
+
+    v8::String::Utf8Value name(args[0]);
+    TraceOpenEvent* open = &t_trace_open[t_trace_num_open++];
+    open->name = TraceInternName(std::string(*name, name.length()));
+    open->start_ns = uv_hrtime();
+  }
+
+  // void end()
+  static void class_end(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    uint64_t end_ns = uv_hrtime();
+    if (t_trace_num_open == 0)
+      return v8_utils::ThrowError(isolate, "end() without a matching begin().");
+    TraceOpenEvent* open = &t_trace_open[--t_trace_num_open];
+    plask_trace_add_complete_event("js", open->name, open->start_ns, end_ns);
+  }
+
+  // string toJSON()
+  //
+  // Return the recorded events in the Trace Event Format, suitable for
+  // loading into chrome://tracing.
+  static void class_toJSON(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    std::string json = TraceExportJSON();
+    return args.GetReturnValue().Set(v8::String::NewFromUtf8(
+        isolate, json.data(), v8::String::kNormalString, json.size()));
+  }
+
+  // void startupMark(string name)
+  static void class_startupMark(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (t_is_worker)
+      return;  // Workers load plask.js too, but aren't the startup.
+    v8::String::Utf8Value name(args[0]);
+    plask_startup_mark(TraceInternName(std::string(*name, name.length())));
+  }
+
+  // object[ ] startupMarks()
+  //
+  // Returns [{name, ms}, ...], the startup marks in order, where `ms` is the
+  // time since the process was started.
+  static void class_startupMarks(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::Local<v8::Array> res = v8::Array::New(isolate, g_num_startup_marks);
+    for (int i = 0; i < g_num_startup_marks; ++i) {
+      v8::Local<v8::Object> mark = v8::Object::New(isolate);
+      mark->Set(v8::String::NewFromUtf8(isolate, "name"),
+                v8::String::NewFromUtf8(isolate, g_startup_marks[i].name));
+      mark->Set(v8::String::NewFromUtf8(isolate, "ms"),
+                v8::Number::New(isolate,
+                    (g_startup_marks[i].ns - g_process_start_ns) / 1e6));
+      res->Set(i, mark);
+    }
+    return args.GetReturnValue().Set(res);
+  }
+};
+
+// ArrayBuffer transfer.
+//
+// ArrayBuffers are passed between isolates by moving their backing store, the
+// sender's ArrayBuffer is neutered (left zero length) and the receiver gets a
+// new ArrayBuffer over the same memory, nothing is copied.  The memory comes
+// from node's ArrayBuffer::Allocator (new char[]), the receiving isolate frees
+// it when its ArrayBuffer is collected.
+
+struct TransferredBuffer {
+  void* data;
+  size_t length;
+};
+
+// A buffer received from another isolate.
+struct AdoptedBuffer {
+  v8::Persistent<v8::ArrayBuffer> handle;
+  void* data;
+  size_t length;
+};
+
+// The buffers adopted by this thread's isolate, by data pointer.
+__thread std::map<void*, AdoptedBuffer*>* t_adopted_buffers = NULL;
+
+void FreeTransferredData(void* data) {
+  delete[] reinterpret_cast<char*>(data);
+}
+
+AdoptedBuffer* FindAdoptedBuffer(v8::Local<v8::ArrayBuffer> ab) {
+  void* data;
+  intptr_t size;
+  if (!t_adopted_buffers || !GetTypedArrayBytes(ab, &data, &size))
+    return NULL;
+  std::map<void*, AdoptedBuffer*>::iterator it = t_adopted_buffers->find(data);
+  return it == t_adopted_buffers->end() ? NULL : it->second;
+}
+
+// Stop tracking |adopted|, without freeing the memory.
+void ReleaseAdoptedBuffer(AdoptedBuffer* adopted) {
+  t_adopted_buffers->erase(adopted->data);
+  isolate->AdjustAmountOfExternalAllocatedMemory(
+      -static_cast<int64_t>(adopted->length));
+  adopted->handle.ClearWeak();
+  adopted->handle.Reset();
+  delete adopted;
+}
+
+void AdoptedBufferWeakCallback(
+    const v8::WeakCallbackData<v8::ArrayBuffer, AdoptedBuffer>& data) {
+  AdoptedBuffer* adopted = data.GetParameter();
+  void* memory = adopted->data;
+  ReleaseAdoptedBuffer(adopted);
+  FreeTransferredData(memory);
+}
+
+v8::Local<v8::ArrayBuffer> AdoptTransferredBuffer(
+    v8::Isolate* isolate, const TransferredBuffer& buffer) {
+  if (!buffer.data)
+    return v8::ArrayBuffer::New(isolate, 0);
+
+  v8::Local<v8::ArrayBuffer> ab =
+      v8::ArrayBuffer::New(isolate, buffer.data, buffer.length);
+  AdoptedBuffer* adopted = new AdoptedBuffer;
+  adopted->data = buffer.data;
+  adopted->length = buffer.length;
+  adopted->handle.Reset(isolate, ab);
+  adopted->handle.SetWeak(adopted, &AdoptedBufferWeakCallback);
+  if (!t_adopted_buffers)
+    t_adopted_buffers = new std::map<void*, AdoptedBuffer*>;
+  (*t_adopted_buffers)[buffer.data] = adopted;
+  isolate->AdjustAmountOfExternalAllocatedMemory(buffer.length);
+  return ab;
+}
+
+v8::Local<v8::Array> AdoptTransferredBuffers(
+    v8::Isolate* isolate, const std::vector<TransferredBuffer>& buffers) {
+  v8::Local<v8::Array> res = v8::Array::New(isolate, buffers.size());
+  for (size_t i = 0; i < buffers.size(); ++i)
+    res->Set(i, AdoptTransferredBuffer(isolate, buffers[i]));
+  return res;
+}
+
+// Free the buffers still adopted by this thread's isolate, before it is
+// disposed (weak callbacks aren't called on dispose).
+void FreeAdoptedBuffers() {
+  if (!t_adopted_buffers)
+    return;
+  for (std::map<void*, AdoptedBuffer*>::iterator it = t_adopted_buffers->begin();
+       it != t_adopted_buffers->end(); ++it) {
+    it->second->handle.Reset();
+    FreeTransferredData(it->second->data);
+    delete it->second;
+  }
+  delete t_adopted_buffers;
+  t_adopted_buffers = NULL;
+}
+
+// Move the contents of the ArrayBuffers in |list| (an Array, or undefined for
+// none) to |out|, neutering them.  Either they are all moved, or none are and
+// false is returned with an exception thrown.
+bool TransferArrayBuffers(v8::Isolate* isolate, v8::Handle<v8::Value> list,
+                          std::vector<TransferredBuffer>* out) {
+  if (list->IsUndefined())
+    return true;
+  if (!list->IsArray()) {
+    v8_utils::ThrowTypeError(isolate, "Transfer list must be an Array.");
+    return false;
+  }
+
+  v8::Local<v8::Array> array = v8::Local<v8::Array>::Cast(list);
+  std::vector<v8::Local<v8::ArrayBuffer> > buffers;
+  for (uint32_t i = 0; i < array->Length(); ++i) {
+    v8::Local<v8::Value> value = array->Get(i);
+    if (!value->IsArrayBuffer()) {
+      v8_utils::ThrowTypeError(isolate, "Transfer list must only hold ArrayBuffers.");
+      return false;
+    }
+    v8::Local<v8::ArrayBuffer> ab = v8::Local<v8::ArrayBuffer>::Cast(value);
+    for (size_t j = 0; j < buffers.size(); ++j) {
+      if (buffers[j]->StrictEquals(ab)) {
+        v8_utils::ThrowError(isolate, "ArrayBuffer is in the transfer list twice.");
+        return false;
+      }
+    }
+    // An external buffer's memory belongs to someone else (ex. a mapped
+    // stream buffer), unless it was received from another isolate.
+    if (ab->IsExternal() && !FindAdoptedBuffer(ab)) {
+      v8_utils::ThrowError(isolate,
+          "ArrayBuffer is external or already transferred, it can't be transferred.");
+      return false;
+    }
+    buffers.push_back(ab);
+  }
+
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    v8::Local<v8::ArrayBuffer> ab = buffers[i];
+    TransferredBuffer buffer;
+    if (ab->IsExternal()) {
+      AdoptedBuffer* adopted = FindAdoptedBuffer(ab);
+      buffer.data = adopted->data;
+      buffer.length = adopted->length;
+      ReleaseAdoptedBuffer(adopted);
+    } else {
+      v8::ArrayBuffer::Contents contents = ab->Externalize();
+      buffer.data = contents.Data();
+      buffer.length = contents.ByteLength();
+    }
+    ab->Neuter();
+    out->push_back(buffer);
+  }
+  return true;
+}
+
+// Workers.
+//
+// A worker runs a script on a thread of its own, in a separate isolate with
+// its own uv loop.  It has the SkPath, SkPaint, raster SkCanvas and PlaskTrace
+// bindings, the rest (windows, GL, audio, MIDI) are main thread only.
+// Messages in both directions are a JSON string and a list of transferred
+// ArrayBuffers (see Worker in plask.js for the encoding), queued under a lock,
+// and the receiving loop is woken with a uv_async_t.
+
+enum WorkerMessageType {
+  kWorkerMessage,
+  kWorkerError,  // An uncaught exception in the worker, |json| is the text.
+};
+
+struct WorkerMessage {
+  WorkerMessageType type;
+  std::string json;
+  std::vector<TransferredBuffer> buffers;
+};
+
+void FreeWorkerMessage(WorkerMessage* message) {
+  for (size_t i = 0; i < message->buffers.size(); ++i)
+    FreeTransferredData(message->buffers[i].data);
+  delete message;
+}
+
+void FreeWorkerMessages(std::deque<WorkerMessage*>* messages) {
+  for (size_t i = 0; i < messages->size(); ++i)
+    FreeWorkerMessage((*messages)[i]);
+  messages->clear();
+}
+
+struct WorkerState {
+  std::string script_filename;
+  std::string plask_filename;
+  std::string bootstrap_filename;  // plask_worker.js.
+  uv_thread_t thread;
+
+  uv_mutex_t lock;
+  // Guarded by |lock|.
+  std::deque<WorkerMessage*> to_worker;
+  std::deque<WorkerMessage*> to_main;
+  v8::Isolate* worker_isolate;  // While the worker's isolate is alive.
+  uv_async_t* worker_async;  // While the worker's loop takes messages.
+  bool terminated;
+  bool exited;  // The worker thread is finished, and can be joined.
+
+  // Main thread.
+  uv_async_t main_async;
+  v8::Persistent<v8::Object> wrapper;
+  v8::Persistent<v8::Function> callback;
+};
+
+// The worker thread's side of a WorkerState.
+struct WorkerThread {
+  WorkerState* state;
+  uv_async_t async;
+  bool closed;
+  v8::Persistent<v8::Object> native;  // The object given to the bootstrap.
+};
+
+void CloseWorkerThread(WorkerThread* thread) {
+  if (thread->closed)
+    return;
+  thread->closed = true;
+  uv_mutex_lock(&thread->state->lock);
+  thread->state->worker_async = NULL;
+  uv_mutex_unlock(&thread->state->lock);
+  uv_close(reinterpret_cast<uv_handle_t*>(&thread->async), NULL);
+}
+
+void PostWorkerMessageToMain(WorkerState* state, WorkerMessage* message) {
+  uv_mutex_lock(&state->lock);
+  state->to_main.push_back(message);
+  uv_mutex_unlock(&state->lock);
+  uv_async_send(&state->main_async);
+}
+
+// The stack trace of a caught exception, or just the exception if it has none.
+std::string ExceptionText(const v8::TryCatch& try_catch) {
+  v8::Local<v8::Value> stack = try_catch.StackTrace();
+  v8::String::Utf8Value text(
+      !stack.IsEmpty() && stack->IsString() ? stack : try_catch.Exception());
+  return *text ? std::string(*text, text.length()) :
+                 std::string("Unknown exception.");
+}
+
+// Report an uncaught exception to the main thread.  A terminated worker
+// closes instead, without running any more JavaScript.
+void ReportWorkerException(WorkerThread* thread, const v8::TryCatch& try_catch) {
+  if (v8::V8::IsExecutionTerminating(isolate))
+    return CloseWorkerThread(thread);
+
+  WorkerMessage* message = new WorkerMessage;
+  message->type = kWorkerError;
+  message->json = ExceptionText(try_catch);
+  PostWorkerMessageToMain(thread->state, message);
+}
+
+// The whole of a file, false if it couldn't be read.
+static bool ReadFileToString(const char* filename, std::string* contents) {
+  FILE* f = fopen(filename, "rb");
+  if (!f)
+    return false;
+  char buf[16384];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) != 0)
+    contents->append(buf, n);
+  fclose(f);
+  return true;
+}
+
+// The worker side of the messaging, given to the bootstrap as `native`.
+class WorkerNativeWrapper {
+ public:
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft = v8::FunctionTemplate::New(isolate);
+    v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
+    instance->SetInternalFieldCount(1);  // WorkerThread pointer.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
+
+    static BatchedMethods methods[] = {
+      { "postMessage", &WorkerNativeWrapper::postMessage },
+      { "close", &WorkerNativeWrapper::close },
+      { "print", &WorkerNativeWrapper::print },
+      { "readFile", &WorkerNativeWrapper::readFile },
+      { "compile", &WorkerNativeWrapper::compile },
+      { "hrtime", &WorkerNativeWrapper::hrtime },
+    };
+
+    for (size_t i = 0; i < arraysize(methods); ++i) {
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func));
+    }
+
+    ft_cache.Reset(isolate, ft);
+    return ft_cache;
+  }
+
+  static WorkerThread* ExtractPointer(v8::Handle<v8::Object> obj) {
+    return reinterpret_cast<WorkerThread*>(
+        obj->GetAlignedPointerFromInternalField(0));
+  }
+
+ private:
+  // void postMessage(string json, Array buffers)
+  static void postMessage(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    WorkerThread* thread = ExtractPointer(args.Holder());
+
+    WorkerMessage* message = new WorkerMessage;
+    message->type = kWorkerMessage;
+    v8::String::Utf8Value json(args[0]);
+    message->json.assign(*json, json.length());
+    if (!TransferArrayBuffers(isolate, args[1], &message->buffers)) {
+      delete message;
+      return;
+    }
+    PostWorkerMessageToMain(thread->state, message);
+  }
+
+  // void close()
+  //
+  // Stop taking messages, the worker exits once the script returns.
+  static void close(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    CloseWorkerThread(ExtractPointer(args.Holder()));
+  }
+
+  // void print(string str, bool error)
+  static void print(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::String::Utf8Value str(args[0]);
+    FILE* out = args[1]->BooleanValue() ? stderr : stdout;
+    fwrite(*str, 1, str.length(), out);
+    fflush(out);
+  }
+
+  // string readFile(string filename)
+  static void readFile(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::String::Utf8Value filename(args[0]);
+    std::string contents;
+    if (!ReadFileToString(*filename, &contents)) {
+      std::string msg = std::string("Unable to open file: ") + *filename;
+      return v8_utils::ThrowError(isolate, msg.c_str());
+    }
+    return args.GetReturnValue().Set(v8::String::NewFromUtf8(
+        isolate, contents.data(), v8::String::kNormalString, contents.size()));
+  }
+
+  // any compile(string source, string filename)
+  //
+  // Compile and run `source`, returning the result.
+  static void compile(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::ScriptOrigin origin(args[1]->ToString());
+    v8::Local<v8::Script> script =
+        v8::Script::Compile(args[0]->ToString(), &origin);
+    if (script.IsEmpty())
+      return;  // Exception already thrown.
+    return args.GetReturnValue().Set(script->Run());
+  }
+
+  // number hrtime()
+  //
+  // A monotonic time in nanoseconds.
+  static void hrtime(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    return args.GetReturnValue().Set(
+        v8::Number::New(isolate, static_cast<double>(uv_hrtime())));
+  }
+};
+
+void SetupWorkerBindings(v8::Isolate* isolate,
+                         v8::Handle<v8::ObjectTemplate> obj) {
+  obj->Set(v8::String::NewFromUtf8(isolate, "SkPath"),
+           PersistentToLocal(isolate, SkPathWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "SkPaint"),
+           PersistentToLocal(isolate, SkPaintWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "SkCanvas"),
+           PersistentToLocal(isolate, SkCanvasWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskAssetPack"),
+           PersistentToLocal(isolate, PlaskAssetPackWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskS3TC"),
+           PersistentToLocal(isolate, PlaskS3TCWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskFrameSequencePlayer"),
+           PersistentToLocal(isolate, PlaskFrameSequencePlayerWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskNoise"),
+           PersistentToLocal(isolate, PlaskNoiseWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskTrace"),
+           PersistentToLocal(isolate, PlaskTraceWrapper::GetTemplate(isolate)));
+}
+
+class PlaskWorkerWrapper {
+ public:
+  static v8::Persistent<v8::FunctionTemplate>& GetTemplate(v8::Isolate* isolate) {
+    PER_ISOLATE_TEMPLATE_CACHE(ft_cache);
+    if (!ft_cache.IsEmpty())
+      return ft_cache;
+
+    v8::Local<v8::FunctionTemplate> ft =
+        v8::FunctionTemplate::New(isolate, &PlaskWorkerWrapper::V8New);
+    ft->SetClassName(v8::String::NewFromUtf8(isolate, "PlaskWorker"));
+    v8::Local<v8::ObjectTemplate> instance = ft->InstanceTemplate();
+    instance->SetInternalFieldCount(1);  // WorkerState pointer.
+    v8::Local<v8::ObjectTemplate> proto = ft->PrototypeTemplate();
+
+    v8::Local<v8::Signature> default_signature = v8::Signature::New(isolate, ft);
+
+    static BatchedMethods methods[] = {
+      { "postMessage", &PlaskWorkerWrapper::postMessage },
+      { "terminate", &PlaskWorkerWrapper::terminate },
+    };
+
+    for (size_t i = 0; i < arraysize(methods); ++i) {
+      proto->Set(v8::String::NewFromUtf8(isolate, methods[i].name),
+                 v8::FunctionTemplate::New(isolate, methods[i].func,
+                                           v8::Handle<v8::Value>(),
+                                           default_signature));
+    }
+
+    ft_cache.Reset(isolate, ft);
+    return ft_cache;
+  }
+
+  static WorkerState* ExtractPointer(v8::Handle<v8::Object> obj) {
+    return reinterpret_cast<WorkerState*>(
+        obj->GetAlignedPointerFromInternalField(0));
+  }
+
+ private:
+  // new PlaskWorker(string script_filename, string plask_filename,
+  //                 string bootstrap_filename,
+  //                 function callback(string type, string json, Array buffers))
+  //
+  // Start a worker running `script_filename`, loaded by the worker bootstrap
+  // `bootstrap_filename` (plask_worker.js).  `callback` is called on the
+  // main thread with type 'message' for each message, 'error' for each
+  // uncaught exception (`json` is then the stack trace), and finally 'exit'.
+  // The worker is kept alive, and keeps the process alive, until it exits.
+  static void V8New(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    if (!args.IsConstructCall())
+      return v8_utils::ThrowTypeError(isolate, kMsgNonConstructCall);
+    if (args.Length() != 4 || !args[3]->IsFunction())
+      return v8_utils::ThrowError(isolate, "Wrong arguments.");
+
+    v8::String::Utf8Value script_filename(args[0]);
+    v8::String::Utf8Value plask_filename(args[1]);
+    v8::String::Utf8Value bootstrap_filename(args[2]);
+
+    WorkerState* state = new WorkerState;
+    state->script_filename.assign(*script_filename, script_filename.length());
+    state->plask_filename.assign(*plask_filename, plask_filename.length());
+    state->bootstrap_filename.assign(*bootstrap_filename,
+                                     bootstrap_filename.length());
+    state->worker_isolate = NULL;
+    state->worker_async = NULL;
+    state->terminated = false;
+    state->exited = false;
+    uv_mutex_init(&state->lock);
+    uv_async_init(uv_default_loop(), &state->main_async, &MainAsyncCallback);
+    state->main_async.data = state;
+    state->callback.Reset(isolate, v8::Local<v8::Function>::Cast(args[3]));
+    state->wrapper.Reset(isolate, args.This());
+    args.This()->SetAlignedPointerInInternalField(0, state);
+
+    if (uv_thread_create(&state->thread, &WorkerThreadMain, state) != 0) {
+      args.This()->SetAlignedPointerInInternalField(0, NULL);
+      state->callback.Reset();
+      state->wrapper.Reset();
+      uv_close(reinterpret_cast<uv_handle_t*>(&state->main_async),
+               &MainAsyncClosed);
+      return v8_utils::ThrowError(isolate, "Unable to start worker thread.");
+    }
+  }
+
+  // void postMessage(string json, Array buffers)
+  //
+  // The ArrayBuffers in `buffers` are transferred, and neutered here.
+  static void postMessage(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    WorkerState* state = ExtractPointer(args.Holder());
+    if (!state)
+      return v8_utils::ThrowError(isolate, "Worker has exited.");
+
+    WorkerMessage* message = new WorkerMessage;
+    message->type = kWorkerMessage;
+    v8::String::Utf8Value json(args[0]);
+    message->json.assign(*json, json.length());
+    if (!TransferArrayBuffers(isolate, args[1], &message->buffers)) {
+      delete message;
+      return;
+    }
+
+    uv_mutex_lock(&state->lock);
+    if (state->terminated) {
+      FreeWorkerMessage(message);
+    } else {
+      state->to_worker.push_back(message);
+      if (state->worker_async)
+        uv_async_send(state->worker_async);
+    }
+    uv_mutex_unlock(&state->lock);
+  }
+
+  // void terminate()
+  //
+  // Stop the worker as soon as possible, even in the middle of running
+  // JavaScript.  Messages not yet delivered, in either direction, are dropped.
+  static void terminate(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    WorkerState* state = ExtractPointer(args.Holder());
+    if (!state)
+      return;
+
+    uv_mutex_lock(&state->lock);
+    state->terminated = true;
+    if (state->worker_isolate)
+      v8::V8::TerminateExecution(state->worker_isolate);
+    if (state->worker_async)
+      uv_async_send(state->worker_async);
+    uv_mutex_unlock(&state->lock);
+  }
+
+  static void CallCallback(WorkerState* state, const char* type,
+                           WorkerMessage* message) {
+    v8::Handle<v8::Value> argv[] = {
+      v8::String::NewFromUtf8(isolate, type),
+      v8::Undefined(isolate),
+      v8::Undefined(isolate),
+    };
+    if (message) {
+      argv[1] = v8::String::NewFromUtf8(isolate, message->json.data(),
+                                        v8::String::kNormalString,
+                                        message->json.size());
+      argv[2] = AdoptTransferredBuffers(isolate, message->buffers);
+    }
+    v8::TryCatch try_catch;
+    PersistentToLocal(isolate, state->callback)->Call(
+        PersistentToLocal(isolate, state->wrapper), 3, argv);
+    // Hopefully plask.js will have caught any exceptions already.
+    if (try_catch.HasCaught()) {
+      printf("Exception in worker callback: %s\n",
+             ExceptionText(try_catch).c_str());
+    }
+  }
+
+  static void MainAsyncCallback(uv_async_t* handle) {
+    WorkerState* state = reinterpret_cast<WorkerState*>(handle->data);
+
+    std::deque<WorkerMessage*> messages;
+    uv_mutex_lock(&state->lock);
+    messages.swap(state->to_main);
+    bool terminated = state->terminated;
+    bool exited = state->exited;
+    uv_mutex_unlock(&state->lock);
+
+    v8::HandleScope handle_scope(isolate);
+
+    for (size_t i = 0; i < messages.size(); ++i) {
+      WorkerMessage* message = messages[i];
+      if (terminated) {
+        FreeWorkerMessage(message);
+        continue;
+      }
+      CallCallback(state, message->type == kWorkerError ? "error" : "message",
+                   message);
+      delete message;  // The buffers were adopted.
+      // The callback could have called terminate().
+      uv_mutex_lock(&state->lock);
+      terminated = state->terminated;
+      uv_mutex_unlock(&state->lock);
+    }
+
+    if (exited) {
+      uv_thread_join(&state->thread);
+      PersistentToLocal(isolate, state->wrapper)->
+          SetAlignedPointerInInternalField(0, NULL);
+      CallCallback(state, "exit", NULL);
+      state->callback.Reset();
+      state->wrapper.Reset();
+      uv_close(reinterpret_cast<uv_handle_t*>(&state->main_async),
+               &MainAsyncClosed);
+    }
+  }
+
+  static void MainAsyncClosed(uv_handle_t* handle) {
+    WorkerState* state = reinterpret_cast<WorkerState*>(handle->data);
+    FreeWorkerMessages(&state->to_worker);
+    FreeWorkerMessages(&state->to_main);
+    uv_mutex_destroy(&state->lock);
+    delete state;
+  }
+
+  static void WorkerAsyncCallback(uv_async_t* handle) {
+    WorkerThread* thread = reinterpret_cast<WorkerThread*>(handle->data);
+    WorkerState* state = thread->state;
+
+    std::deque<WorkerMessage*> messages;
+    uv_mutex_lock(&state->lock);
+    messages.swap(state->to_worker);
+    bool terminated = state->terminated;
+    uv_mutex_unlock(&state->lock);
+
+    v8::HandleScope handle_scope(isolate);
+    v8::Local<v8::Object> native = PersistentToLocal(isolate, thread->native);
+
+    for (size_t i = 0; i < messages.size(); ++i) {
+      WorkerMessage* message = messages[i];
+      if (terminated || thread->closed) {
+        FreeWorkerMessage(message);
+        continue;
+      }
+      v8::Local<v8::Value> argv[] = {
+        v8::String::NewFromUtf8(isolate, message->json.data(),
+                                v8::String::kNormalString,
+                                message->json.size()),
+        AdoptTransferredBuffers(isolate, message->buffers),
+      };
+      delete message;
+
+      v8::Local<v8::Value> onmessage =
+          native->Get(v8::String::NewFromUtf8(isolate, "onmessage"));
+      if (!onmessage->IsFunction())
+        continue;
+      v8::TryCatch try_catch;
+      v8::Local<v8::Function>::Cast(onmessage)->Call(native, 2, argv);
+      if (try_catch.HasCaught())
+        ReportWorkerException(thread, try_catch);
+    }
+
+    if (terminated)
+      CloseWorkerThread(thread);
+  }
+
+  static void RunWorkerScript(WorkerThread* thread) {
+    WorkerState* state = thread->state;
+    v8::TryCatch try_catch;
+
+    // The bootstrap evaluates to function(native, script_filename,
+    // plask_filename), see plask_worker.js.
+    std::string contents;
+    v8::Local<v8::Value> bootstrap;
+    if (!ReadFileToString(state->bootstrap_filename.c_str(), &contents)) {
+      std::string msg = "Unable to open file: " + state->bootstrap_filename;
+      v8_utils::ThrowError(isolate, msg.c_str());
+    } else {
+      v8::Local<v8::String> source = v8::String::NewFromUtf8(
+          isolate, contents.data(), v8::String::kNormalString, contents.size());
+      v8::ScriptOrigin origin(v8::String::NewFromUtf8(
+          isolate, state->bootstrap_filename.data(), v8::String::kNormalString,
+          state->bootstrap_filename.size()));
+      v8::Local<v8::Script> script = v8::Script::Compile(source, &origin);
+      if (!script.IsEmpty())
+        bootstrap = script->Run();
+    }
+    if (!bootstrap.IsEmpty() && bootstrap->IsFunction()) {
+      v8::Local<v8::Value> argv[] = {
+        PersistentToLocal(isolate, thread->native),
+        v8::String::NewFromUtf8(isolate, state->script_filename.data(),
+                                v8::String::kNormalString,
+                                state->script_filename.size()),
+        v8::String::NewFromUtf8(isolate, state->plask_filename.data(),
+                                v8::String::kNormalString,
+                                state->plask_filename.size()),
+      };
+      v8::Local<v8::Function>::Cast(bootstrap)->Call(
+          isolate->GetCurrentContext()->Global(), 3, argv);
+    }
+
+    // A script that fails to load has nothing to handle messages with.
+    if (try_catch.HasCaught()) {
+      ReportWorkerException(thread, try_catch);
+      CloseWorkerThread(thread);
+    }
+  }
+
+  static void WorkerThreadMain(void* arg) {
+    WorkerState* state = reinterpret_cast<WorkerState*>(arg);
+    t_is_worker = true;
+    plask_trace_set_thread_name("Worker");
+
+    WorkerThread thread;
+    thread.state = state;
+    thread.closed = false;
+
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    uv_async_init(&loop, &thread.async, &WorkerAsyncCallback);
+    thread.async.data = &thread;
+
+    v8::Isolate* worker_isolate = v8::Isolate::New();
+    {
+      v8::Locker locker(worker_isolate);
+      v8::Isolate::Scope isolate_scope(worker_isolate);
+      SetInternalIsolate(worker_isolate);
+
+      {
+        v8::HandleScope handle_scope(worker_isolate);
+        v8::Local<v8::Context> context = v8::Context::New(worker_isolate);
+        v8::Context::Scope context_scope(context);
+
+        v8::Local<v8::ObjectTemplate> plask_raw = v8::ObjectTemplate::New();
+        SetupWorkerBindings(worker_isolate, plask_raw);
+        context->Global()->Set(
+            v8::String::NewFromUtf8(worker_isolate, "PlaskRawMac"),
+            plask_raw->NewInstance());
+
+        v8::Local<v8::Object> native = PersistentToLocal(
+            worker_isolate, WorkerNativeWrapper::GetTemplate(worker_isolate))->
+                InstanceTemplate()->NewInstance();
+        native->SetAlignedPointerInInternalField(0, &thread);
+        thread.native.Reset(worker_isolate, native);
+
+        uv_mutex_lock(&state->lock);
+        bool terminated = state->terminated;
+        if (!terminated) {
+          state->worker_isolate = worker_isolate;
+          state->worker_async = &thread.async;
+          if (!state->to_worker.empty())
+            uv_async_send(&thread.async);
+        }
+        uv_mutex_unlock(&state->lock);
+
+        if (terminated) {
+          CloseWorkerThread(&thread);
+        } else {
+          RunWorkerScript(&thread);
+        }
+
+        // Until close(), terminate(), or failing to load.
+        uv_run(&loop, UV_RUN_DEFAULT);
+
+        uv_mutex_lock(&state->lock);
+        state->worker_isolate = NULL;
+        uv_mutex_unlock(&state->lock);
+
+        thread.native.Reset();
+      }
+
+      // Collect what the script left behind, so the weak callbacks free the
+      // native objects (canvases, paths, ...) before the isolate goes.
+      v8::V8::LowMemoryNotification();
+      FreeAdoptedBuffers();
+      PerIsolateData::DisposeCurrent();
+    }
+    worker_isolate->Dispose();
+    SetInternalIsolate(NULL);
+    uv_loop_close(&loop);
+
+    uv_mutex_lock(&state->lock);
+    FreeWorkerMessages(&state->to_worker);
+    state->exited = true;
+    uv_mutex_unlock(&state->lock);
+    // The main thread joins, and then deletes |state|.
+    uv_async_send(&state->main_async);
+  }
+};
+
+}  // namespace
+
+#if PLASK_OSX
+@implementation WrappedNSWindow
+
+-(void)setEventCallbackWithHandle:(v8::Handle<v8::Function>)func {
+  event_callback_.Reset(isolate, func);
+}
+
+-(void)setEventQueueWithHandle:(v8::Handle<v8::Value>)queue {
+  if (queue->IsNull()) {
+    event_queue_handle_.Reset();
+    event_queue_ = NULL;
+  } else {
+    v8::Handle<v8::Object> obj = v8::Handle<v8::Object>::Cast(queue);
+    event_queue_handle_.Reset(isolate, obj);
+    event_queue_ = PlaskEventQueueWrapper::ExtractPointer(obj);
+  }
+}
+
+// Decode |event| into the event queue, returns NO for the types that aren't
+// queued.  The event callback is only called when the queue was empty, to get
+// it drained when nothing is draining it every frame.
+-(BOOL)queueEvent:(NSEvent *)event {
+  NSEventType type = [event type];
+  switch (type) {
+    case NSLeftMouseDown: case NSLeftMouseUp:
+    case NSRightMouseDown: case NSRightMouseUp:
+    case NSOtherMouseDown: case NSOtherMouseUp:
+    case NSLeftMouseDragged: case NSRightMouseDragged: case NSOtherMouseDragged:
+    case NSMouseMoved: case NSScrollWheel:
+    case NSTabletPoint: case NSTabletProximity:
+      break;
+    default:
+      return NO;
+  }
+
+  bool was_empty = event_queue_->empty();
+  double* record = event_queue_->Push();
+  record[kEventFieldType] = type;
+  record[kEventFieldTimestamp] = [event timestamp];
+  record[kEventFieldModifiers] = [event modifierFlags];
+  if (type == NSTabletProximity) {
+    if ([event isEnteringProximity])
+      record[kEventFieldFlags] = kEventFlagEnteringProximity;
+  } else {
+    NSPoint location = [event locationInWindow];
+    record[kEventFieldX] = location.x;
+    record[kEventFieldY] = location.y;
+  }
+
+  switch (type) {
+    case NSLeftMouseDown: case NSLeftMouseUp:
+    case NSRightMouseDown: case NSRightMouseUp:
+    case NSOtherMouseDown: case NSOtherMouseUp:
+      record[kEventFieldButton] = [event buttonNumber];
+      record[kEventFieldClickCount] = [event clickCount];
+      break;
+    case NSLeftMouseDragged: case NSRightMouseDragged: case NSOtherMouseDragged:
+      record[kEventFieldButton] = [event buttonNumber];
+      record[kEventFieldPressure] = [event pressure];
+      // Fall through for the deltas.
+    case NSMouseMoved:
+      record[kEventFieldDeltaX] = [event deltaX];
+      record[kEventFieldDeltaY] = [event deltaY];
+      record[kEventFieldDeltaZ] = [event deltaZ];
+      break;
+    case NSScrollWheel:
+      record[kEventFieldDeltaX] = [event deltaX];
+      record[kEventFieldDeltaY] = [event deltaY];
+      record[kEventFieldDeltaZ] = [event deltaZ];
+      record[kEventFieldScrollingDeltaX] = [event scrollingDeltaX];
+      record[kEventFieldScrollingDeltaY] = [event scrollingDeltaY];
+      if ([event hasPreciseScrollingDeltas])
+        record[kEventFieldFlags] = kEventFlagPreciseScrollingDeltas;
+      record[kEventFieldPhase] = [event phase];
+      record[kEventFieldMomentumPhase] = [event momentumPhase];
+      break;
+    case NSTabletPoint:
+      record[kEventFieldPressure] = [event pressure];
+      break;
+    default:
+      break;
+  }
+
+  if (was_empty && !event_callback_.IsEmpty()) {
+    v8::Local<v8::Value> argv[] = { v8::Number::New(isolate, 2),
+                                    v8::Undefined(isolate) };
+    v8::TryCatch try_catch;
+    PersistentToLocal(isolate, event_callback_)->Call(
+        isolate->GetCurrentContext()->Global(), 2, argv);
+    // Hopefully plask.js will have caught any exceptions already.
+    if (try_catch.HasCaught()) {
+      printf("Exception in event callback, TODO(deanm): print something.\n");
+    }
+  }
+  return YES;
+}
+
+-(void)processEvent:(NSEvent *)event {
+  PLASK_TRACE_EVENT("event", "processEvent");
+  if (event_queue_ != NULL && [self queueEvent:event])
+    return;
   if (!event_callback_.IsEmpty()) {
     [event retain];  // Released by NSEventWrapper.
     v8::Local<v8::FunctionTemplate> ft = v8::Local<v8::FunctionTemplate>::New(
@@ -7694,12 +13607,22 @@ void plask_setup_bindings(v8::Isolate* isolate,
            PersistentToLocal(isolate, NSWindowWrapper::GetTemplate(isolate)));
   obj->Set(v8::String::NewFromUtf8(isolate, "NSEvent"),
            PersistentToLocal(isolate, NSEventWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskEventQueue"),
+           PersistentToLocal(isolate, PlaskEventQueueWrapper::GetTemplate(isolate)));
   obj->Set(v8::String::NewFromUtf8(isolate, "SkPath"),
            PersistentToLocal(isolate, SkPathWrapper::GetTemplate(isolate)));
   obj->Set(v8::String::NewFromUtf8(isolate, "SkPaint"),
            PersistentToLocal(isolate, SkPaintWrapper::GetTemplate(isolate)));
   obj->Set(v8::String::NewFromUtf8(isolate, "SkCanvas"),
            PersistentToLocal(isolate, SkCanvasWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskAssetPack"),
+           PersistentToLocal(isolate, PlaskAssetPackWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskS3TC"),
+           PersistentToLocal(isolate, PlaskS3TCWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskFrameSequencePlayer"),
+           PersistentToLocal(isolate, PlaskFrameSequencePlayerWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskNoise"),
+           PersistentToLocal(isolate, PlaskNoiseWrapper::GetTemplate(isolate)));
   obj->Set(v8::String::NewFromUtf8(isolate, "NSOpenGLContext"),
            PersistentToLocal(isolate, NSOpenGLContextWrapper::GetTemplate(isolate)));
 #if PLASK_OSX
@@ -7720,6 +13643,12 @@ void plask_setup_bindings(v8::Isolate* isolate,
   obj->Set(v8::String::NewFromUtf8(isolate, "AVPlayer"),
            PersistentToLocal(isolate, AVPlayerWrapper::GetTemplate(isolate)));
 #endif
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskTrace"),
+           PersistentToLocal(isolate, PlaskTraceWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskStats"),
+           PersistentToLocal(isolate, PlaskStatsWrapper::GetTemplate(isolate)));
+  obj->Set(v8::String::NewFromUtf8(isolate, "PlaskWorker"),
+           PersistentToLocal(isolate, PlaskWorkerWrapper::GetTemplate(isolate)));
 
 }
 
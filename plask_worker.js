@@ -0,0 +1,186 @@
+// Plask worker bootstrap.
+//
+// Runs in a worker's context, evaluating to function(native, script_filename,
+// plask_filename).  Provides enough of node (console, require() of relative
+// .js files and plask.js, stubs of the builtin modules plask.js uses) to load
+// plask.js unmodified, wires up postMessage / onmessage, and runs the script.
+// `native` is the worker's side of the messaging, see WorkerNativeWrapper in
+// plask_bindings.mm.
+
+(function(native, script_filename, plask_filename) {
+  var global = this;
+  global.global = global.self = global;
+
+  // Windows, GL, audio and MIDI are main thread only.
+  ['NSWindow', 'NSEvent', 'NSOpenGLContext', 'NSSound', 'CAMIDISource',
+   'CAMIDIDestination', 'SBApplication', 'NSAppleScript', 'AVPlayer'
+  ].forEach(function(name) {
+    PlaskRawMac[name] = function() {
+      throw new Error(name + ' is not available in a worker.');
+    };
+  });
+
+  function format(args) {
+    return Array.prototype.map.call(args, function(arg) {
+      if (typeof arg !== 'object' || arg === null) return String(arg);
+      try { return JSON.stringify(arg); } catch (e) { return String(arg); }
+    }).join(' ');
+  }
+
+  global.console = {
+    log: function() { native.print(format(arguments) + '\n', false); },
+    error: function() { native.print(format(arguments) + '\n', true); },
+    trace: function() {
+      var stack = new Error().stack.split('\n').slice(2).join('\n');
+      native.print(format(arguments) + '\n' + stack + '\n', true);
+    }
+  };
+  console.info = console.log;
+  console.warn = console.error;
+
+  global.process = {
+    platform: 'darwin',
+    argv: [ ],
+    env: { },
+    hrtime: function(prev) {
+      var ns = native.hrtime();
+      var t = [Math.floor(ns / 1e9), ns % 1e9];
+      if (prev === undefined) return t;
+      var s = t[0] - prev[0], n = t[1] - prev[1];
+      return n < 0 ? [s - 1, n + 1e9] : [s, n];
+    }
+  };
+
+  function EventEmitter() { }
+  EventEmitter.prototype.on = EventEmitter.prototype.addListener =
+      function(type, listener) {
+    if (!this._events) this._events = { };
+    (this._events[type] || (this._events[type] = [ ])).push(listener);
+    return this;
+  };
+  EventEmitter.prototype.removeListener = function(type, listener) {
+    var list = this._events && this._events[type];
+    var i = list ? list.indexOf(listener) : -1;
+    if (i !== -1) list.splice(i, 1);
+    return this;
+  };
+  EventEmitter.prototype.listeners = function(type) {
+    return (this._events && this._events[type]) || [ ];
+  };
+  EventEmitter.prototype.emit = function(type) {
+    var list = this._events && this._events[type];
+    if (!list || list.length === 0) return false;
+    var args = Array.prototype.slice.call(arguments, 1);
+    list = list.slice();
+    for (var i = 0, il = list.length; i < il; ++i) list[i].apply(this, args);
+    return true;
+  };
+
+  function normalize(p) {
+    var abs = p.charAt(0) === '/', out = [ ];
+    p.split('/').forEach(function(s) {
+      if (s === '..') {
+        if (out.length !== 0 && out[out.length - 1] !== '..') out.pop();
+        else if (!abs) out.push(s);
+      } else if (s !== '' && s !== '.') {
+        out.push(s);
+      }
+    });
+    return ((abs ? '/' : '') + out.join('/')) || '.';
+  }
+
+  function dirname(p) {
+    var i = p.lastIndexOf('/');
+    return i === -1 ? '.' : i === 0 ? '/' : p.slice(0, i);
+  }
+
+  function basename(p, ext) {
+    var b = p.slice(p.lastIndexOf('/') + 1);
+    if (ext && b.slice(-ext.length) === ext) b = b.slice(0, -ext.length);
+    return b;
+  }
+
+  function extname(p) {
+    var b = basename(p), i = b.lastIndexOf('.');
+    return i <= 0 ? '' : b.slice(i);
+  }
+
+  // Just enough of node's builtin modules for plask.js.
+  var builtins = {
+    sys: {
+      inherits: function(ctor, super_ctor) {
+        ctor.super_ = super_ctor;
+        ctor.prototype = Object.create(super_ctor.prototype, {
+          constructor: {value: ctor, enumerable: false,
+                        writable: true, configurable: true}
+        });
+      },
+      puts: console.log,
+      print: function(s) { native.print(String(s), false); },
+      error: console.error
+    },
+    fs: {
+      readFileSync: function(filename) { return native.readFile(filename); }
+    },
+    path: {
+      normalize: normalize,
+      dirname: dirname,
+      basename: basename,
+      extname: extname,
+      join: function() {
+        return normalize(Array.prototype.join.call(arguments, '/'));
+      }
+    },
+    events: {EventEmitter: EventEmitter},
+    net: { }
+  };
+  builtins.util = builtins.sys;
+
+  var modules = { };
+
+  function load(filename) {
+    if (modules.hasOwnProperty(filename)) return modules[filename].exports;
+    var module = {id: filename, filename: filename, exports: { }};
+    modules[filename] = module;
+    var dir = dirname(filename);
+    var source = native.readFile(filename).replace(/^#!.*/, '');
+    var fn = native.compile(
+        '(function(exports, require, module, __filename, __dirname) {' +
+        source + '\n})', filename);
+    fn.call(module.exports, module.exports, makeRequire(dir), module,
+            filename, dir);
+    return module.exports;
+  }
+
+  function makeRequire(dir) {
+    return function require(name) {
+      if (name === 'plask') return load(plask_filename);
+      if (builtins.hasOwnProperty(name)) return builtins[name];
+      if (name.charAt(0) !== '/' && name.slice(0, 2) !== './' &&
+          name.slice(0, 3) !== '../') {
+        throw new Error('Cannot find module \'' + name + '\' in a worker.');
+      }
+      var filename = normalize(name.charAt(0) === '/' ? name : dir + '/' + name);
+      if (extname(filename) !== '.js') filename += '.js';
+      return load(filename);
+    };
+  }
+
+  var plask = load(plask_filename);
+
+  global.onmessage = null;
+
+  global.postMessage = function(data) {
+    var encoded = plask.Worker.encodeMessage(data);
+    native.postMessage(encoded.json, encoded.buffers);
+  };
+
+  global.close = function() { native.close(); };
+
+  native.onmessage = function(json, buffers) {
+    if (typeof global.onmessage === 'function')
+      global.onmessage({data: plask.Worker.decodeMessage(json, buffers)});
+  };
+
+  load(script_filename);
+})
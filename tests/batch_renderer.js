@@ -0,0 +1,124 @@
+// Test plask.gl.BatchRenderer: objects drawn through it land where their
+// instance values put them, with and without instancing, and the draws
+// issued are counted against the draws submitted.  Renders offscreen with
+// the software renderer.
+
+var plask = require('plask');
+var test_utils = require('./test_utils');
+var assert_eq = test_utils.assert_eq;
+
+var gl = new PlaskRawMac.NSOpenGLContext(0, true);  // Software renderer.
+gl.makeCurrentContext();
+
+var kSize = 64;
+var fbo = gl.createFramebuffer();
+var rbo = gl.createRenderbuffer();
+gl.bindRenderbuffer(gl.RENDERBUFFER, rbo);
+gl.renderbufferStorage(gl.RENDERBUFFER, gl.RGBA8, kSize, kSize);
+gl.bindFramebuffer(gl.FRAMEBUFFER, fbo);
+gl.framebufferRenderbuffer(gl.FRAMEBUFFER, gl.COLOR_ATTACHMENT0,
+                           gl.RENDERBUFFER, rbo);
+gl.viewport(0, 0, kSize, kSize);
+
+var mp = plask.gl.MagicProgram.createFromStrings(gl,
+    'uniform float u_scale;\n' +
+    'attribute vec2 a_pos;\n' +
+    'attribute mat4 i_model;\n' +
+    'attribute vec4 i_color;\n' +
+    'varying vec4 v_color;\n' +
+    'void main() {\n' +
+    '  v_color = i_color;\n' +
+    '  gl_Position = i_model * vec4(a_pos * u_scale, 0.0, 1.0);\n' +
+    '}\n',
+    'varying vec4 v_color;\n' +
+    'void main() { gl_FragColor = v_color; }\n');
+mp.use();
+mp.set_u_scale(0.25);
+
+// A quad covering (-1, -1) to (1, 1), a quarter of that with u_scale.
+var quad_buffer = gl.createBuffer();
+gl.bindBuffer(gl.ARRAY_BUFFER, quad_buffer);
+gl.bufferData(gl.ARRAY_BUFFER, new Float32Array([
+    -1, -1, 1, -1, 1, 1, -1, -1, 1, 1, -1, 1]), gl.STATIC_DRAW);
+var quad = {mode: gl.TRIANGLES, count: 6,
+            attribs: {a_pos: {buffer: quad_buffer, size: 2}}};
+
+var indices = gl.createBuffer();
+gl.bindBuffer(gl.ELEMENT_ARRAY_BUFFER, indices);
+gl.bufferData(gl.ELEMENT_ARRAY_BUFFER, new Uint16Array([0, 1, 2, 0, 2, 5]),
+              gl.STATIC_DRAW);
+var indexed_quad = {mode: gl.TRIANGLES, count: 6, indices: indices,
+                    attribs: {a_pos: {buffer: quad_buffer, size: 2}}};
+
+// A quad in each quarter of the target, each its own color.
+var quarters = [[-0.5, -0.5, [1, 0, 0, 1]], [0.5, -0.5, [0, 1, 0, 1]],
+                [-0.5, 0.5, [0, 0, 1, 1]], [0.5, 0.5, [1, 1, 0, 1]]];
+
+var pixels = new Uint8Array(kSize * kSize * 4);
+
+function check_quarters() {
+  gl.readPixels(0, 0, kSize, kSize, gl.RGBA, gl.UNSIGNED_BYTE, pixels);
+  quarters.forEach(function(q) {
+    var x = Math.floor((q[0] + 1) / 2 * kSize);
+    var y = Math.floor((q[1] + 1) / 2 * kSize);
+    var i = (y * kSize + x) * 4;
+    for (var c = 0; c < 4; ++c) assert_eq(q[2][c] * 255, pixels[i + c]);
+  });
+  // Between the quads is left clear.
+  assert_eq(0, pixels[(kSize / 2 * kSize + kSize / 2) * 4 + 3]);
+}
+
+function draw(batch) {
+  gl.clearColor(0, 0, 0, 0);
+  gl.clear(gl.COLOR_BUFFER_BIT);
+  quarters.forEach(function(q, i) {
+    var model = new plask.Mat4().translate(q[0], q[1], 0);
+    batch.submit(mp, i < 2 ? quad : indexed_quad,
+                 {i_model: model, i_color: q[2]});
+  });
+  batch.flush();
+  check_quarters();
+}
+
+var modes = [false];
+if (typeof gl.drawArraysInstanced === 'function') modes.push(true);
+
+modes.forEach(function(instanced) {
+  var batch = new plask.gl.BatchRenderer(gl, {instanced: instanced});
+  assert_eq(instanced, batch.instanced);
+  draw(batch);
+  draw(batch);  // Reusing the groups.
+  var stats = batch.stats();
+  assert_eq(8, stats.submitted);
+  assert_eq(instanced ? 4 : 8, stats.issued);  // One draw per geometry.
+  assert_eq(4, stats.groups);
+  assert_eq(2, stats.flushes);
+  // Groups without draws in a flush are dropped.
+  assert_eq(2, Object.keys(batch.groups_by_key).length);
+  batch.submit(mp, quad, {i_model: new plask.Mat4(), i_color: [1, 1, 1, 1]});
+  batch.flush();
+  assert_eq(1, Object.keys(batch.groups_by_key).length);
+  batch.flush();
+  assert_eq(0, Object.keys(batch.groups_by_key).length);
+  // A value of another size is another group, with its own layout.
+  batch.submit(mp, quad, {i_model: new plask.Mat4(), i_color: [1, 1, 1, 1]});
+  batch.submit(mp, quad, {i_model: new plask.Mat4(), i_color: [1, 1, 1]});
+  assert_eq(2, batch.groups.length);
+  assert_eq(20, batch.groups[0].stride);
+  assert_eq(19, batch.groups[1].stride);
+  batch.flush();
+  batch.resetStats();
+  assert_eq(0, batch.stats().submitted);
+  batch.destroy();
+});
+
+assert_eq(gl.NO_ERROR, gl.getError());
+
+// An instance value the program doesn't have.
+var batch = new plask.gl.BatchRenderer(gl);
+try {
+  batch.submit(mp, quad, {i_missing: 1});
+  throw 'Expected an exception.';
+} catch (e) {
+  assert_eq('BatchRenderer: no attribute i_missing in the program.', e);
+}
@@ -0,0 +1,100 @@
+// Asset pack vs PNG loading benchmark, cold and warm.
+//
+// Generates a set of PNG images and an asset pack of the same images, then
+// launches Plask on asset_pack_sketch.js to load all of them, either way, and
+// reports the time to load (and touch every page of) the set:
+//
+//   node tests/bench/asset_pack.js --plask Plask.app/Contents/MacOS/Plask
+//
+// Warm runs load from the file cache.  For cold runs (--cold) the file cache
+// is emptied before each launch with `sudo purge`, so run it as a user that
+// can sudo without a password.
+//
+// Options:
+//   --plask path      The Plask binary (default: this process, if it is Plask).
+//   --count n         Number of images (default 64).
+//   --size n          Width and height of the images (default 1024).
+//   --runs n          Launches per way of loading (default 5).
+//   --cold            Empty the file cache before each launch.
+//   --dir path        Where to put the images (default: a temporary directory).
+//   --out file        Write the results as JSON.
+
+var child_process = require('child_process');
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var bench = require('./bench');
+
+var kSketch = path.join(__dirname, 'asset_pack_sketch.js');
+
+function parseArgs(argv) {
+  var opts = {plask: process.execPath, count: 64, size: 1024, runs: 5,
+              cold: false, dir: path.join(os.tmpdir(), 'plask_asset_bench')};
+  for (var i = 0; i < argv.length; ++i) {
+    var arg = argv[i], val = argv[i + 1];
+    switch (arg) {
+      case '--plask': opts.plask = val; ++i; break;
+      case '--count': opts.count = parseInt(val); ++i; break;
+      case '--size': opts.size = parseInt(val); ++i; break;
+      case '--runs': opts.runs = parseInt(val); ++i; break;
+      case '--cold': opts.cold = true; break;
+      case '--dir': opts.dir = val; ++i; break;
+      case '--out': opts.out = val; ++i; break;
+      default: throw 'Unknown argument: ' + arg;
+    }
+  }
+  return opts;
+}
+
+// Run the sketch with `args`, returning what it reported.
+function launch(binary, args) {
+  var env = { };
+  for (var key in process.env) env[key] = process.env[key];
+  env.PLASK_DONT_ACTIVATE = '1';
+
+  var res = child_process.spawnSync(binary, [kSketch].concat(args), {env: env});
+  var match = /^PLASK_ASSETS (.*)$/m.exec(String(res.stdout));
+  if (res.status !== 0 || match === null)
+    throw 'Launch failed: ' + binary + '\n' + res.stdout + res.stderr;
+  return JSON.parse(match[1]);
+}
+
+function purge() {
+  var res = child_process.spawnSync('sudo', ['-n', 'purge']);
+  if (res.status !== 0) throw 'Unable to purge the file cache: ' + res.stderr;
+}
+
+var opts = parseArgs(process.argv.slice(2));
+var generated = launch(opts.plask, ['--generate', opts.dir, opts.count, opts.size]);
+console.log(generated.count + ' images of ' + opts.size + 'x' + opts.size +
+            ', PNG ' + (generated.pngBytes / (1 << 20)).toFixed(1) + ' MB, ' +
+            'pack ' + (generated.packBytes / (1 << 20)).toFixed(1) + ' MB');
+
+var ways = ['png', 'pack'];
+var times = {png: [ ], pack: [ ]};
+if (!opts.cold) ways.forEach(function(way) { launch(opts.plask, ['--' + way, opts.dir]); });
+for (var i = 0; i < opts.runs; ++i) {
+  ways.forEach(function(way) {
+    if (opts.cold) purge();
+    times[way].push(launch(opts.plask, ['--' + way, opts.dir]).ms);
+  });
+}
+
+var kind = opts.cold ? 'cold' : 'warm';
+var results = { };
+ways.forEach(function(way) {
+  var summary = bench.summarize(times[way]);
+  summary.unit = 'ms';
+  results['assets.' + way + '.' + kind] = summary;
+  console.log('  ' + way + ' ' + kind + ': ' + summary.median.toFixed(1) +
+              ' ms  (min ' + summary.min.toFixed(1) + ', max ' +
+              summary.max.toFixed(1) + ')');
+});
+console.log('  speedup: ' + (results['assets.png.' + kind].median /
+                             results['assets.pack.' + kind].median).toFixed(1) + 'x');
+
+if (opts.out !== undefined) {
+  fs.writeFileSync(opts.out, JSON.stringify(
+      {version: 1, date: new Date().toISOString(), count: opts.count,
+       size: opts.size, results: results}, null, 2) + '\n');
+}
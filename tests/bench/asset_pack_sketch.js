@@ -0,0 +1,68 @@
+// Launched by tests/bench/asset_pack.js.
+//
+//   --generate dir count size   Write count PNG images and assets.plaskpak.
+//   --png dir                   Load the PNG images.
+//   --pack dir                  Load the images from assets.plaskpak.
+//
+// Loading reads a byte of every page of every image, so both ways end up with
+// all of the pixels in memory, and prints the time taken.
+
+var fs = require('fs');
+var path = require('path');
+var plask = require('plask');
+
+var args = process.argv.slice(2);
+var dir = args[1];
+var pack_filename = path.join(dir, 'assets.plaskpak');
+
+function pngFilename(i) {
+  return path.join(dir, 'image' + i + '.png');
+}
+
+function report(res) {
+  console.log('PLASK_ASSETS ' + JSON.stringify(res));
+  process.exit(0);
+}
+
+function touch(canvas) {
+  var sum = 0;
+  for (var i = 0, il = canvas.width * canvas.height * 4; i < il; i += 4096)
+    sum += canvas[i];
+  return sum;
+}
+
+if (args[0] === '--generate') {
+  var count = parseInt(args[2]), size = parseInt(args[3]);
+  if (!fs.existsSync(dir)) fs.mkdirSync(dir);
+  var canvas = plask.SkCanvas.create(size, size);
+  var paint = new plask.SkPaint();
+  paint.setAntiAlias(true);
+  var assets = [ ], png_bytes = 0;
+  for (var i = 0; i < count; ++i) {
+    canvas.clear(230, 230, 230, 255);
+    for (var j = 0; j < 100; ++j) {  // Some detail so it doesn't compress away.
+      paint.setColor((i * 7 + j * 37) & 255, (j * 91) & 255, (i * 13) & 255, 255);
+      canvas.drawCircle(paint, (i * 31 + j * 37) % size, (j * 91) % size,
+                        5 + j % 40);
+    }
+    canvas.writeImage('png', pngFilename(i));
+    png_bytes += fs.statSync(pngFilename(i)).size;
+    assets.push({name: 'image' + i, canvas: new plask.SkCanvas(canvas)});
+  }
+  var res = plask.AssetPack.write(pack_filename, assets);
+  report({count: count, pngBytes: png_bytes, packBytes: res.byteLength});
+}
+
+var start = process.hrtime();
+var sum = 0;
+if (args[0] === '--png') {
+  for (var i = 0; fs.existsSync(pngFilename(i)); ++i)
+    sum += touch(plask.SkCanvas.createFromImage(pngFilename(i)));
+} else {
+  var pack = plask.AssetPack.open(pack_filename);
+  pack.names().forEach(function(name) {
+    sum += touch(plask.SkCanvas.createFromPack(pack, name));
+  });
+}
+var elapsed = process.hrtime(start);
+report({ms: elapsed[0] * 1e3 + elapsed[1] / 1e6, sum: sum});
@@ -0,0 +1,151 @@
+// Plask benchmark harness.
+//
+// A benchmark is a function `fn(n)` that performs `n` operations.  The harness
+// calibrates `n` so a single sample takes around `sampleMs`, runs a warmup
+// sample, then times `samples` samples and summarizes the time per operation
+// in nanoseconds.
+
+var kDefaultSampleMs = 25;
+var kDefaultSamples = 15;
+var kMaxIterations = 1 << 30;
+
+function nowNs() {
+  var t = process.hrtime();
+  return t[0] * 1e9 + t[1];
+}
+
+function timeNs(fn, n) {
+  var start = nowNs();
+  fn(n);
+  return nowNs() - start;
+}
+
+// object summarize(Array samples)
+//
+// Statistical summary of `samples`: mean, median, stddev (sample), min, max
+// and the 95th percentile (nearest rank).
+function summarize(samples) {
+  var sorted = samples.slice().sort(function(a, b) { return a - b; });
+  var n = sorted.length;
+  var sum = 0;
+  for (var i = 0; i < n; ++i) sum += sorted[i];
+  var mean = sum / n;
+  var sq = 0;
+  for (var i = 0; i < n; ++i) sq += (sorted[i] - mean) * (sorted[i] - mean);
+  var median = (n & 1) ? sorted[n >> 1] :
+                         (sorted[(n >> 1) - 1] + sorted[n >> 1]) / 2;
+  return {
+    mean: mean,
+    median: median,
+    stddev: n > 1 ? Math.sqrt(sq / (n - 1)) : 0,
+    min: sorted[0],
+    max: sorted[n - 1],
+    p95: sorted[Math.min(n - 1, Math.ceil(n * 0.95) - 1)],
+    samples: n
+  };
+}
+
+// new Bench(opts)
+//
+// Collects benchmarks registered with add() and runs them.  `opts.filter` is
+// an optional RegExp matched against 'suite.name', `opts.samples` and
+// `opts.sampleMs` control the measurement.
+function Bench(opts) {
+  this.opts = opts || { };
+  this.suite = null;
+  this.results = { };
+}
+
+Bench.prototype.setSuite = function(suite) {
+  this.suite = suite;
+};
+
+// void add(name, fn(n), opts)
+//
+// Measure `fn`.  `opts.ops` is the number of logical operations per call of
+// `fn(1)`, when it is not 1, ex. the number of points in a drawPoints call,
+// so that the results are per operation.
+Bench.prototype.add = function(name, fn, opts) {
+  var full_name = this.suite + '.' + name;
+  if (this.opts.filter && !this.opts.filter.test(full_name)) return;
+
+  var sample_ns = (this.opts.sampleMs || kDefaultSampleMs) * 1e6;
+  var num_samples = this.opts.samples || kDefaultSamples;
+  var ops = (opts && opts.ops) || 1;
+
+  // Calibrate, doubling until a sample is long enough to time reliably.
+  var n = 1;
+  while (n < kMaxIterations && timeNs(fn, n) < sample_ns) n *= 2;
+  timeNs(fn, n);  // Warmup at the calibrated size.
+
+  var samples = [ ];
+  for (var i = 0; i < num_samples; ++i)
+    samples.push(timeNs(fn, n) / (n * ops));
+
+  var summary = summarize(samples);
+  summary.unit = 'ns/op';
+  summary.iterations = n;
+  this.results[full_name] = summary;
+
+  console.log(pad(full_name, 36) + pad(summary.median.toFixed(1), 12, true) +
+              ' ns/op  ±' + (100 * summary.stddev / summary.mean).toFixed(1) +
+              '%');
+};
+
+function pad(str, width, left) {
+  str = String(str);
+  while (str.length < width) str = left === true ? ' ' + str : str + ' ';
+  return str;
+}
+
+// object compare(baseline, current, threshold)
+//
+// Compare the medians of two result sets.  A benchmark regressed when its
+// median is more than `threshold` (ex. 0.1 for 10%) slower than the baseline
+// and the difference is also larger than the noise, that is the fastest
+// current sample is still slower than the baseline median.
+function compare(baseline, current, threshold) {
+  var rows = [ ], regressions = [ ], improvements = [ ];
+  for (var name in current) {
+    var cur = current[name], base = baseline[name];
+    if (base === undefined) {
+      rows.push({name: name, status: 'new'});
+      continue;
+    }
+    var ratio = cur.median / base.median;
+    var status = 'ok';
+    if (ratio > 1 + threshold && cur.min > base.median) {
+      status = 'REGRESSION';
+      regressions.push(name);
+    } else if (ratio < 1 - threshold && cur.max < base.median) {
+      status = 'improved';
+      improvements.push(name);
+    }
+    rows.push({name: name, base: base.median, cur: cur.median,
+               ratio: ratio, status: status, unit: cur.unit || 'ns/op'});
+  }
+  for (var name in baseline) {
+    if (!(name in current)) rows.push({name: name, status: 'missing'});
+  }
+  return {rows: rows, regressions: regressions, improvements: improvements};
+}
+
+function printComparison(cmp) {
+  cmp.rows.forEach(function(r) {
+    if (r.ratio === undefined) {
+      console.log(pad(r.name, 36) + r.status);
+      return;
+    }
+    var pct = ((r.ratio - 1) * 100).toFixed(1);
+    console.log(pad(r.name, 36) +
+                pad(r.base.toFixed(1), 12, true) + ' ->' +
+                pad(r.cur.toFixed(1), 12, true) + ' ' + pad(r.unit, 5) + ' ' +
+                pad((r.ratio >= 1 ? '+' : '') + pct + '%', 9, true) + '  ' +
+                r.status);
+  });
+}
+
+exports.Bench = Bench;
+exports.summarize = summarize;
+exports.compare = compare;
+exports.printComparison = printComparison;
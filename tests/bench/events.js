@@ -0,0 +1,35 @@
+// Input event delivery through an EventQueue, with synthetic events so it
+// runs without a window.  Ops are events.
+
+module.exports = function(bench, plask) {
+  var num_events = 0;
+  var emitter = { emit: function(type, e) { ++num_events; } };
+  var NSEvent = PlaskRawMac.NSEvent;
+
+  var kBatch = 256;  // About a frame of 1 kHz tablet input, with room.
+  var queue = new plask.EventQueue({capacity: kBatch, height: 1000});
+  var coalescing = new plask.EventQueue({capacity: kBatch, height: 1000,
+                                         coalesce: true});
+  var drag = {type: NSEvent.NSLeftMouseDragged, x: 0, y: 0, dx: 1, dy: 1,
+              pressure: 0.5};
+
+  function pushAndDrain(q, n) {
+    for (var i = 0; i < n; i += kBatch) {
+      for (var j = 0; j < kBatch; ++j) {
+        drag.x = j; drag.y = j;
+        q.push(drag);
+      }
+      q.drain(emitter);
+    }
+  }
+
+  bench.add('dragDrain', function(n) {
+    pushAndDrain(queue, n * kBatch);
+  }, {ops: kBatch});
+
+  bench.add('dragDrainCoalesced', function(n) {
+    pushAndDrain(coalescing, n * kBatch);
+  }, {ops: kBatch});
+
+  if (num_events === 0) throw 'EventQueue emitted no events.';
+};
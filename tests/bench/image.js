@@ -0,0 +1,103 @@
+// Image decode and encode, through FreeImage.
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+
+module.exports = function(bench, plask) {
+  var kSize = 512;
+  var canvas = plask.SkCanvas.create(kSize, kSize);
+  var paint = new plask.SkPaint();
+  paint.setLinearGradientShader(0, 0, kSize, kSize,
+                                [0, 255, 0, 0, 255, 1, 0, 0, 255, 255]);
+  canvas.drawPaint(paint);
+  paint.clearShader();
+  paint.setAntiAlias(true);
+  for (var i = 0; i < 200; ++i) {  // Some detail so it doesn't compress away.
+    paint.setColor((i * 37) & 255, (i * 91) & 255, (i * 13) & 255, 255);
+    canvas.drawCircle(paint, (i * 37) % kSize, (i * 91) % kSize, 5 + i % 20);
+  }
+
+  var dir = os.tmpdir();
+  var png_filename = path.join(dir, 'plask_bench.png');
+  var tiff_filename = path.join(dir, 'plask_bench.tiff');
+  canvas.writeImage('png', png_filename);
+  canvas.writeImage('tiff', tiff_filename);
+  var png_data = fs.readFileSync(png_filename);
+
+  // Sizes are per pixel, so the results are comparable across image sizes.
+  var kPixels = kSize * kSize;
+
+  bench.add('encodePNG', function(n) {
+    for (var i = 0; i < n; ++i) canvas.writeImage('png', png_filename);
+  }, {ops: kPixels});
+
+  bench.add('encodeTIFF', function(n) {
+    for (var i = 0; i < n; ++i) canvas.writeImage('tiff', tiff_filename);
+  }, {ops: kPixels});
+
+  bench.add('decodePNGFile', function(n) {
+    for (var i = 0; i < n; ++i) plask.SkCanvas.createFromImage(png_filename);
+  }, {ops: kPixels});
+
+  bench.add('decodePNGData', function(n) {
+    for (var i = 0; i < n; ++i) plask.SkCanvas.createFromImageData(png_data);
+  }, {ops: kPixels});
+
+  bench.add('decodeTIFFFile', function(n) {
+    for (var i = 0; i < n; ++i) plask.SkCanvas.createFromImage(tiff_filename);
+  }, {ops: kPixels});
+
+  // S3TC encoding of the canvas, on one thread and on all of them.
+  var CT = plask.CompressedTexture;
+
+  bench.add('encodeDXT1', function(n) {
+    for (var i = 0; i < n; ++i)
+      CT.encode(canvas, CT.COMPRESSED_RGB_S3TC_DXT1_EXT, {threads: 1});
+  }, {ops: kPixels});
+
+  bench.add('encodeDXT5', function(n) {
+    for (var i = 0; i < n; ++i)
+      CT.encode(canvas, CT.COMPRESSED_RGBA_S3TC_DXT5_EXT, {threads: 1});
+  }, {ops: kPixels});
+
+  bench.add('encodeDXT5Threaded', function(n) {
+    for (var i = 0; i < n; ++i)
+      CT.encode(canvas, CT.COMPRESSED_RGBA_S3TC_DXT5_EXT);
+  }, {ops: kPixels});
+
+  // The same image from an asset pack, warm (its pages are in memory after
+  // the first load).  loadPack only maps the pixels, loadPackTouch also reads
+  // a byte of every page, so all of the image is read like with a decode.
+  var pack_filename = path.join(dir, 'plask_bench.plaskpak');
+  plask.AssetPack.write(pack_filename, [{name: 'image', canvas: canvas}]);
+  var pack = plask.AssetPack.open(pack_filename);
+
+  bench.add('loadPack', function(n) {
+    for (var i = 0; i < n; ++i) plask.SkCanvas.createFromPack(pack, 'image');
+  }, {ops: kPixels});
+
+  bench.add('loadPackTouch', function(n) {
+    var sum = 0;
+    for (var i = 0; i < n; ++i) {
+      var image = plask.SkCanvas.createFromPack(pack, 'image');
+      for (var j = 0, jl = kPixels * 4; j < jl; j += 4096) sum += image[j];
+    }
+    return sum;
+  }, {ops: kPixels});
+
+  // Playing the PNG as a frame sequence, decoded ahead on background threads,
+  // against decodePNGFile's decode per frame.  Waits for frames the decoders
+  // haven't caught up with, so it's bound by decode throughput on all threads.
+  var frame_filenames = [ ];
+  for (var i = 0; i < 16; ++i) frame_filenames.push(png_filename);
+  var player = plask.FrameSequencePlayer.create(frame_filenames, {loop: true});
+  var frame = plask.SkCanvas.create(kSize, kSize);
+
+  bench.add('frameSequence', function(n) {
+    for (var i = 0; i < n; ++i) {
+      player.step(1);
+      player.copyToCanvas(frame, true);
+    }
+  }, {ops: kPixels});
+};
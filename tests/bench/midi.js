@@ -0,0 +1,30 @@
+// MIDI message parsing, the path every incoming MIDI packet takes.  Runs the
+// parser directly without a device.
+
+module.exports = function(bench, plask) {
+  var num_events = 0;
+  var emitter = { emit: function(type, e) { ++num_events; } };
+
+  var note_on = new Buffer([0x90, 60, 100]);
+  bench.add('parseNoteOn', function(n) {
+    for (var i = 0; i < n; ++i) plask.parseMidiMessage(note_on, emitter);
+  });
+
+  // A controller snapshot, 32 controller messages back to back in a packet.
+  var snapshot_bytes = [ ];
+  for (var i = 0; i < 32; ++i) snapshot_bytes.push(0xb0 | (i & 15), i, i * 3);
+  var snapshot = new Buffer(snapshot_bytes);
+  bench.add('parseControllerSnapshot', function(n) {
+    for (var i = 0; i < n; ++i) plask.parseMidiMessage(snapshot, emitter);
+  }, {ops: 32});
+
+  var sysex_bytes = [0xf0];
+  for (var i = 0; i < 256; ++i) sysex_bytes.push(i & 0x7f);
+  sysex_bytes.push(0xf7);
+  var sysex = new Buffer(sysex_bytes);
+  bench.add('parseSysex256', function(n) {
+    for (var i = 0; i < n; ++i) plask.parseMidiMessage(sysex, emitter);
+  });
+
+  if (num_events === 0) throw 'MIDI parser emitted no events.';
+};
@@ -0,0 +1,102 @@
+// plask.Noise, per sample, against simplex noise written in JavaScript the way
+// a sketch would.
+
+// 2D simplex noise in JavaScript (after Stefan Gustavson), the baseline.
+function jsSimplex2(perm, x, y) {
+  var F2 = 0.5 * (Math.sqrt(3) - 1), G2 = (3 - Math.sqrt(3)) / 6;
+  var s = (x + y) * F2;
+  var i = Math.floor(x + s), j = Math.floor(y + s);
+  var t = (i + j) * G2;
+  var x0 = x - (i - t), y0 = y - (j - t);
+  var i1 = x0 > y0 ? 1 : 0, j1 = 1 - i1;
+  var x1 = x0 - i1 + G2, y1 = y0 - j1 + G2;
+  var x2 = x0 - 1 + 2 * G2, y2 = y0 - 1 + 2 * G2;
+  var ii = i & 255, jj = j & 255;
+  return 70 * (jsCorner(perm[ii + perm[jj]] % 12, x0, y0) +
+               jsCorner(perm[ii + i1 + perm[jj + j1]] % 12, x1, y1) +
+               jsCorner(perm[ii + 1 + perm[jj + 1]] % 12, x2, y2));
+}
+
+function jsCorner(g, x, y) {
+  var t = 0.5 - x * x - y * y;
+  if (t <= 0) return 0;
+  var gx = (g & 1) ? -1 : 1, gy = (g & 2) ? -1 : 1;
+  if (g >= 8) { gy = gx; gx = 0; } else if (g >= 4) { gy = 0; }
+  t *= t;
+  return t * t * (gx * x + gy * y);
+}
+
+module.exports = function(bench, plask) {
+  var Noise = plask.Noise;
+  var kSize = 256, kSamples = kSize * kSize;
+  var out = new Float32Array(kSamples);
+  var simplex = Noise.create(), perlin = Noise.create({type: 'perlin'});
+  var fbm = Noise.create({octaves: 4});
+  var kScale = 4 / kSize;
+
+  var perm = new Uint8Array(512);
+  for (var i = 0; i < 512; ++i) perm[i] = (i * 167 + 13) & 255;
+
+  bench.add('jsSimplex2', function(n) {
+    for (var k = 0; k < n; ++k) {
+      for (var y = 0; y < kSize; ++y) {
+        for (var x = 0; x < kSize; ++x)
+          out[y * kSize + x] = jsSimplex2(perm, x * 4 / kSize, y * 4 / kSize + k);
+      }
+    }
+  }, {ops: kSamples});
+
+  // A binding call per sample.
+  bench.add('noiseCall2', function(n) {
+    for (var k = 0; k < n; ++k) {
+      for (var y = 0; y < kSize; ++y) {
+        for (var x = 0; x < kSize; ++x)
+          out[y * kSize + x] = simplex.noise(x * 4 / kSize, y * 4 / kSize + k);
+      }
+    }
+  }, {ops: kSamples});
+
+  [2, 3, 4].forEach(function(dims) {
+    bench.add('simplex' + dims, function(n) {
+      for (var k = 0; k < n; ++k)
+        simplex.fill(out, kSize, kSize, {dims: dims, scale: kScale, z: k, w: k});
+    }, {ops: kSamples});
+    bench.add('perlin' + dims, function(n) {
+      for (var k = 0; k < n; ++k)
+        perlin.fill(out, kSize, kSize, {dims: dims, scale: kScale, z: k, w: k});
+    }, {ops: kSamples});
+  });
+
+  bench.add('fbm3Octaves4', function(n) {
+    for (var k = 0; k < n; ++k)
+      fbm.fill(out, kSize, kSize, {dims: 3, scale: kScale, z: k});
+  }, {ops: kSamples});
+
+  bench.add('fbm3Octaves4Threads', function(n) {
+    for (var k = 0; k < n; ++k)
+      fbm.fill(out, kSize, kSize, {dims: 3, scale: kScale, z: k, threads: 0});
+  }, {ops: kSamples});
+
+  // A flow field, the noise at each particle.
+  var kParticles = 100000;
+  var points = new Float32Array(kParticles * 3);
+  for (var i = 0; i < kParticles; ++i) {
+    points[i * 3] = (i % 317) * 0.013;
+    points[i * 3 + 1] = Math.floor(i / 317) * 0.013;
+  }
+  var angles = new Float32Array(kParticles);
+
+  bench.add('fillPoints3', function(n) {
+    for (var k = 0; k < n; ++k) {
+      for (var i = 0; i < kParticles; ++i) points[i * 3 + 2] = k * 0.01;
+      simplex.fillPoints(angles, points, 3);
+    }
+  }, {ops: kParticles});
+
+  var canvas = plask.SkCanvas.create(kSize, kSize);
+
+  bench.add('drawCanvas3', function(n) {
+    for (var k = 0; k < n; ++k)
+      simplex.draw(canvas, {dims: 3, scale: kScale, z: k * 0.01});
+  }, {ops: kSamples});
+};
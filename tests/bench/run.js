@@ -0,0 +1,90 @@
+// Plask benchmark suite.
+//
+// Run all (or some) of the suites and print a summary, optionally writing the
+// results as JSON and comparing them against a previous run:
+//
+//   Plask tests/bench/run.js --out baseline.json
+//   ... change things ...
+//   Plask tests/bench/run.js --compare baseline.json --threshold 0.05
+//
+// The suites don't open a window, and the webgl suite renders offscreen with
+// the software renderer, so they can run on a machine without a display or a
+// GPU.  Exits with status 1 if any benchmark regressed.
+//
+// Options:
+//   --suite a,b        Only run the named suites.
+//   --filter regexp    Only run benchmarks whose 'suite.name' matches.
+//   --samples n        Number of timed samples per benchmark (default 15).
+//   --sample-ms n      Target duration of a sample (default 25).
+//   --out file         Write the results as JSON.
+//   --compare file     Compare against the results in a previous JSON file.
+//   --threshold f      Slowdown that counts as a regression (default 0.1).
+//   --input file       Don't run anything, compare the results in `file`.
+//                      This needs no Plask, it also runs under plain node.
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var bench = require('./bench');
+
+var kSuites = ['skcanvas', 'skpath', 'image', 'webgl', 'midi', 'vecmath',
+               'events', 'noise'];
+
+function parseArgs(argv) {
+  var opts = {threshold: 0.1};
+  for (var i = 0; i < argv.length; ++i) {
+    var arg = argv[i], val = argv[i + 1];
+    switch (arg) {
+      case '--suite': opts.suites = val.split(','); ++i; break;
+      case '--filter': opts.filter = new RegExp(val); ++i; break;
+      case '--samples': opts.samples = parseInt(val); ++i; break;
+      case '--sample-ms': opts.sampleMs = parseFloat(val); ++i; break;
+      case '--out': opts.out = val; ++i; break;
+      case '--compare': opts.compare = val; ++i; break;
+      case '--threshold': opts.threshold = parseFloat(val); ++i; break;
+      case '--input': opts.input = val; ++i; break;
+      default: throw 'Unknown argument: ' + arg;
+    }
+  }
+  return opts;
+}
+
+function runSuites(opts) {
+  var plask = require('plask');
+  var b = new bench.Bench(opts);
+  var suites = opts.suites || kSuites;
+  suites.forEach(function(name) {
+    if (kSuites.indexOf(name) === -1) throw 'Unknown suite: ' + name;
+    b.setSuite(name);
+    require('./' + name)(b, plask);
+  });
+  return {
+    version: 1,
+    date: new Date().toISOString(),
+    platform: process.platform,
+    arch: process.arch,
+    cpu: os.cpus()[0].model,
+    node: process.version,
+    results: b.results
+  };
+}
+
+var opts = parseArgs(process.argv.slice(2));
+var run = opts.input !== undefined ?
+    JSON.parse(fs.readFileSync(opts.input, 'utf8')) : runSuites(opts);
+
+if (opts.out !== undefined)
+  fs.writeFileSync(opts.out, JSON.stringify(run, null, 2) + '\n');
+
+if (opts.compare !== undefined) {
+  var baseline = JSON.parse(fs.readFileSync(opts.compare, 'utf8'));
+  console.log('\nCompared to ' + path.basename(opts.compare) +
+              ' (' + baseline.date + '), threshold ' +
+              (opts.threshold * 100) + '%:');
+  var cmp = bench.compare(baseline.results, run.results, opts.threshold);
+  bench.printComparison(cmp);
+  if (cmp.regressions.length !== 0) {
+    console.log(cmp.regressions.length + ' regression(s).');
+    process.exit(1);
+  }
+}
@@ -0,0 +1,194 @@
+// SkCanvas primitive throughput, into a bitmap canvas.
+
+module.exports = function(bench, plask) {
+  var canvas = plask.SkCanvas.create(1024, 1024);
+  var paint = new plask.SkPaint();
+  paint.setAntiAlias(true);
+  paint.setColor(200, 40, 80, 255);
+
+  bench.add('clear', function(n) {
+    for (var i = 0; i < n; ++i) canvas.clear(230, 230, 230, 255);
+  });
+
+  bench.add('drawRect', function(n) {
+    for (var i = 0; i < n; ++i) {
+      var x = (i * 37) & 1023, y = (i * 91) & 1023;
+      canvas.drawRect(paint, x, y, x + 20, y + 20);
+    }
+  });
+
+  var stroke = new plask.SkPaint();
+  stroke.setAntiAlias(true);
+  stroke.setStroke();
+  stroke.setStrokeWidth(3);
+  stroke.setColor(20, 40, 200, 255);
+
+  bench.add('drawRectStroke', function(n) {
+    for (var i = 0; i < n; ++i) {
+      var x = (i * 37) & 1023, y = (i * 91) & 1023;
+      canvas.drawRect(stroke, x, y, x + 20, y + 20);
+    }
+  });
+
+  // A 16 point star, so the path is concave and antialiased.
+  var star = new plask.SkPath();
+  for (var i = 0; i < 16; ++i) {
+    var r = (i & 1) ? 20 : 50, t = i * Math.PI / 8;
+    if (i === 0) star.moveTo(r, 0); else star.lineTo(r * Math.cos(t), r * Math.sin(t));
+  }
+  star.close();
+
+  bench.add('drawPath', function(n) {
+    for (var i = 0; i < n; ++i) {
+      canvas.save();
+      canvas.translate((i * 37) & 1023, (i * 91) & 1023);
+      canvas.drawPath(paint, star);
+      canvas.restore();
+    }
+  });
+
+  bench.add('drawPathStroke', function(n) {
+    for (var i = 0; i < n; ++i) {
+      canvas.save();
+      canvas.translate((i * 37) & 1023, (i * 91) & 1023);
+      canvas.drawPath(stroke, star);
+      canvas.restore();
+    }
+  });
+
+  // The same star frozen, so after the first draw it's a cached mask blit.
+  var frozen = new plask.SkPath(star);
+  frozen.freeze();
+
+  bench.add('drawPathFrozen', function(n) {
+    for (var i = 0; i < n; ++i) {
+      canvas.save();
+      canvas.translate((i * 37) & 1023, (i * 91) & 1023);
+      canvas.drawPath(paint, frozen);
+      canvas.restore();
+    }
+  });
+
+  // An animated scene of 64 gradient filled circles, a frame per op.  Each
+  // gradient is set in the circle's own coordinates so it's the same from
+  // frame to frame, and comes from the shader cache after the first.
+  var kNumGradients = 64;
+  var grad = new plask.SkPaint();
+  grad.setAntiAlias(true);
+  var stop_arrays = [ ], stop_floats = [ ];
+  for (var i = 0; i < kNumGradients; ++i) {
+    var stops = [0, (i * 37) & 255, (i * 91) & 255, 200, 255,
+                 0.6, 255, 255, 255, 128, 1, 0, 0, 0, 0];
+    stop_arrays.push(stops);
+    stop_floats.push(new Float32Array(stops));
+  }
+
+  function drawGradientScene(n, stops) {
+    for (var i = 0; i < n; ++i) {
+      for (var j = 0; j < kNumGradients; ++j) {
+        canvas.save();
+        canvas.translate((j * 131 + i * 3) & 1023, (j * 71 + i * 5) & 1023);
+        if ((j & 3) === 0) {
+          grad.setSweepGradientShader(0, 0, stops[j]);
+        } else {
+          grad.setRadialGradientShader(0, 0, 20 + (j & 15), stops[j],
+                                       (j & 1) ? grad.kMirrorTileMode :
+                                                 grad.kClampTileMode);
+        }
+        canvas.drawCircle(grad, 0, 0, 40);
+        canvas.restore();
+      }
+    }
+  }
+
+  bench.add('gradientScene', function(n) {
+    drawGradientScene(n, stop_arrays);
+  });
+
+  bench.add('gradientSceneFloat32', function(n) {
+    drawGradientScene(n, stop_floats);
+  });
+
+  bench.add('gradientSceneUncached', function(n) {
+    var size = plask.SkPaint.shaderCacheStats().maxEntries;
+    plask.SkPaint.setShaderCacheSize(0);
+    drawGradientScene(n, stop_floats);
+    plask.SkPaint.setShaderCacheSize(size);
+  });
+
+  var text = new plask.SkPaint();
+  text.setAntiAlias(true);
+  text.setTextSize(18);
+  text.setColor(0, 0, 0, 255);
+
+  bench.add('drawText', function(n) {
+    for (var i = 0; i < n; ++i)
+      canvas.drawText(text, 'The quick brown fox', (i * 37) & 1023, (i * 91) & 1023);
+  });
+
+  // drawPoints marshals a JS array of coordinates, report per point.
+  var kNumPoints = 1000;
+  var points = [ ];
+  for (var i = 0; i < kNumPoints; ++i)
+    points.push((i * 37) & 1023, (i * 91) & 1023);
+  var dots = new plask.SkPaint();
+  dots.setStrokeWidth(2);
+  dots.setColor(0, 120, 0, 255);
+
+  bench.add('drawPoints', function(n) {
+    for (var i = 0; i < n; ++i)
+      canvas.drawPoints(dots, canvas.kPointsPointMode, points);
+  }, {ops: kNumPoints});
+
+  bench.add('drawPointsLines', function(n) {
+    for (var i = 0; i < n; ++i)
+      canvas.drawPoints(stroke, canvas.kLinesPointMode, points);
+  }, {ops: kNumPoints / 2});
+
+  // 50k sprites per frame, from 16 small images packed into an atlas.  The
+  // drawCanvas version is the same frame with a call per sprite.
+  var kNumSprites = 50000;
+  var images = [ ];
+  for (var i = 0; i < 16; ++i) {
+    var img = plask.SkCanvas.create(8 + i, 8 + i);
+    img.clear(0, 0, 0, 0);
+    paint.setColor((i * 37) & 255, (i * 91) & 255, 128, 255);
+    img.drawCircle(paint, (8 + i) / 2, (8 + i) / 2, (8 + i) / 2);
+    images.push(img);
+  }
+  paint.setColor(200, 40, 80, 255);
+  var packed = plask.SkCanvas.packAtlas(images);
+
+  var xforms = new Float32Array(kNumSprites * 4);
+  var rects = new Float32Array(kNumSprites * 4);
+  var colors = new Uint32Array(kNumSprites);
+  for (var i = 0; i < kNumSprites; ++i) {
+    var k = i & 15, angle = i * 0.01, scale = 0.5 + (i % 10) / 10;
+    xforms[i * 4 + 0] = scale * Math.cos(angle);
+    xforms[i * 4 + 1] = scale * Math.sin(angle);
+    xforms[i * 4 + 2] = (i * 37) & 1023;
+    xforms[i * 4 + 3] = (i * 91) & 1023;
+    for (var j = 0; j < 4; ++j) rects[i * 4 + j] = packed.rects[k * 4 + j];
+    colors[i] = ((128 + (i & 127)) << 24 | 0xffffff) >>> 0;
+  }
+
+  bench.add('drawAtlas50k', function(n) {
+    for (var i = 0; i < n; ++i)
+      canvas.drawAtlas(packed.canvas, xforms, rects, null, null);
+  }, {ops: kNumSprites});
+
+  bench.add('drawAtlas50kColors', function(n) {
+    for (var i = 0; i < n; ++i)
+      canvas.drawAtlas(packed.canvas, xforms, rects, colors, null);
+  }, {ops: kNumSprites});
+
+  bench.add('drawCanvas50k', function(n) {
+    for (var i = 0; i < n; ++i) {
+      for (var j = 0; j < kNumSprites; ++j) {
+        var img = images[j & 15];
+        var x = xforms[j * 4 + 2], y = xforms[j * 4 + 3];
+        canvas.drawCanvas(null, img, x, y, x + img.width, y + img.height);
+      }
+    }
+  }, {ops: kNumSprites});
+};
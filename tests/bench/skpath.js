@@ -0,0 +1,58 @@
+// SkPath construction, path ops and serialization.
+
+module.exports = function(bench, plask) {
+  var path = new plask.SkPath();
+
+  // Build a 100 segment polyline from scratch.
+  bench.add('buildPolyline100', function(n) {
+    for (var i = 0; i < n; ++i) {
+      path.rewind();
+      path.moveTo(0, 0);
+      for (var j = 1; j < 100; ++j) path.lineTo(j, (j * 37) % 100);
+      path.close();
+    }
+  });
+
+  bench.add('buildCubics', function(n) {
+    for (var i = 0; i < n; ++i) {
+      path.rewind();
+      path.moveTo(0, 0);
+      for (var j = 0; j < 20; ++j)
+        path.cubicTo(j, 10, j + 5, -10, j + 10, 0);
+    }
+  });
+
+  bench.add('addCircle', function(n) {
+    for (var i = 0; i < n; ++i) {
+      path.rewind();
+      path.addCircle(50, 50, 40);
+    }
+  });
+
+  var a = new plask.SkPath(), b = new plask.SkPath();
+  a.addCircle(50, 50, 40);
+  b.addRect(30, 30, 120, 90);
+  var result = new plask.SkPath();
+
+  bench.add('opUnion', function(n) {
+    for (var i = 0; i < n; ++i) result.op(a, b, result.kUnionPathOp);
+  });
+
+  bench.add('opIntersect', function(n) {
+    for (var i = 0; i < n; ++i) result.op(a, b, result.kIntersectPathOp);
+  });
+
+  var svg = a.toSVGString();
+
+  bench.add('toSVGString', function(n) {
+    for (var i = 0; i < n; ++i) a.toSVGString();
+  });
+
+  bench.add('fromSVGString', function(n) {
+    for (var i = 0; i < n; ++i) path.fromSVGString(svg);
+  });
+
+  bench.add('getBounds', function(n) {
+    for (var i = 0; i < n; ++i) a.getBounds();
+  });
+};
@@ -0,0 +1,122 @@
+// Startup time benchmark.
+//
+// Launches Plask on startup_sketch.js a number of times and reports the time
+// from process start to each startup phase (see plask.startupTimings()),
+// ending with the first frame.  Pass a second binary to compare two builds,
+// ex. before and after a change:
+//
+//   node tests/bench/startup.js --plask new/Plask.app/Contents/MacOS/Plask \
+//       --baseline old/Plask.app/Contents/MacOS/Plask
+//
+// Options:
+//   --plask path      The Plask binary to measure (default: this process, if
+//                     it is Plask).
+//   --baseline path   Another Plask binary to compare against.  Launches of
+//                     the two alternate, to spread out system noise.
+//   --runs n          Launches per binary (default 15).
+//   --offscreen       Draw the first frame to a bitmap instead of a window,
+//                     like a batch render.
+//   --out file        Write the results as JSON.
+//   --threshold f     Slowdown that counts as a regression (default 0.1), the
+//                     exit status is 1 if any phase regressed.
+
+var child_process = require('child_process');
+var fs = require('fs');
+var path = require('path');
+var bench = require('./bench');
+
+var kSketch = path.join(__dirname, 'startup_sketch.js');
+
+function parseArgs(argv) {
+  var opts = {plask: process.execPath, runs: 15, threshold: 0.1,
+              offscreen: false};
+  for (var i = 0; i < argv.length; ++i) {
+    var arg = argv[i], val = argv[i + 1];
+    switch (arg) {
+      case '--plask': opts.plask = val; ++i; break;
+      case '--baseline': opts.baseline = val; ++i; break;
+      case '--runs': opts.runs = parseInt(val); ++i; break;
+      case '--offscreen': opts.offscreen = true; break;
+      case '--out': opts.out = val; ++i; break;
+      case '--threshold': opts.threshold = parseFloat(val); ++i; break;
+      default: throw 'Unknown argument: ' + arg;
+    }
+  }
+  return opts;
+}
+
+// Launch `binary` once, returning its startup timings plus 'exit', the time
+// until the process had exited as seen from here.
+function launch(binary, offscreen) {
+  var args = offscreen ? [kSketch, '--offscreen'] : [kSketch];
+  var env = { };
+  for (var key in process.env) env[key] = process.env[key];
+  env.PLASK_DONT_ACTIVATE = '1';
+
+  var start = process.hrtime();
+  var res = child_process.spawnSync(binary, args, {env: env});
+  var elapsed = process.hrtime(start);
+
+  var match = /^PLASK_STARTUP (.*)$/m.exec(String(res.stdout));
+  if (res.status !== 0 || match === null)
+    throw 'Launch failed: ' + binary + '\n' + res.stdout + res.stderr;
+  var timings = JSON.parse(match[1]);
+  timings.exit = elapsed[0] * 1e3 + elapsed[1] / 1e6;
+  return timings;
+}
+
+function summarizeRuns(runs) {
+  var results = { };
+  Object.keys(runs[0]).forEach(function(phase) {
+    var summary = bench.summarize(runs.map(function(r) { return r[phase]; }));
+    summary.unit = 'ms';
+    results['startup.' + phase] = summary;
+  });
+  return results;
+}
+
+function printResults(title, results) {
+  console.log(title);
+  for (var name in results) {
+    var r = results[name];
+    console.log('  ' + name + new Array(Math.max(1, 28 - name.length)).join(' ') +
+                r.median.toFixed(1) + ' ms  (min ' + r.min.toFixed(1) +
+                ', max ' + r.max.toFixed(1) + ')');
+  }
+}
+
+var opts = parseArgs(process.argv.slice(2));
+var binaries = opts.baseline !== undefined ? [opts.plask, opts.baseline] :
+                                             [opts.plask];
+var runs = binaries.map(function() { return [ ]; });
+
+launch(binaries[0], opts.offscreen);  // Warm the file cache.
+for (var i = 0; i < opts.runs; ++i) {
+  for (var j = 0; j < binaries.length; ++j)
+    runs[j].push(launch(binaries[j], opts.offscreen));
+}
+
+var current = summarizeRuns(runs[0]);
+printResults(opts.plask, current);
+
+var out = {version: 1, date: new Date().toISOString(), offscreen: opts.offscreen,
+           plask: opts.plask, results: current};
+
+if (opts.baseline !== undefined) {
+  var baseline = summarizeRuns(runs[1]);
+  printResults(opts.baseline, baseline);
+  out.baseline = {plask: opts.baseline, results: baseline};
+
+  console.log('\nCompared to ' + opts.baseline + ', threshold ' +
+              (opts.threshold * 100) + '%:');
+  var cmp = bench.compare(baseline, current, opts.threshold);
+  bench.printComparison(cmp);
+}
+
+if (opts.out !== undefined)
+  fs.writeFileSync(opts.out, JSON.stringify(out, null, 2) + '\n');
+
+if (cmp !== undefined && cmp.regressions.length !== 0) {
+  console.log(cmp.regressions.length + ' regression(s).');
+  process.exit(1);
+}
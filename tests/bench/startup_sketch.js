@@ -0,0 +1,39 @@
+// Launched by tests/bench/startup.js.  Draws one frame, prints the startup
+// timings and exits.  With --offscreen the frame is drawn to a bitmap canvas
+// without opening a window, like a batch render.
+
+var plask = require('plask');
+
+function draw(canvas, paint) {
+  canvas.clear(230, 230, 230, 255);
+  canvas.drawCircle(paint, 200, 150, 100);
+}
+
+// Called from a timer, so after the main script has returned and main() has
+// marked the 'script' phase.
+function report() {
+  console.log('PLASK_STARTUP ' + JSON.stringify(plask.startupTimings()));
+  process.exit(0);
+}
+
+if (process.argv.indexOf('--offscreen') !== -1) {
+  var paint = new plask.SkPaint();
+  paint.setAntiAlias(true);
+  paint.setColor(80, 0, 0, 255);
+  draw(plask.SkCanvas.create(400, 300), paint);
+  PlaskRawMac.PlaskTrace.startupMark('firstFrame');
+  setTimeout(report, 0);
+} else {
+  plask.simpleWindow({
+    init: function() {
+      this.paint.setAntiAlias(true);
+      this.paint.setColor(80, 0, 0, 255);
+    },
+
+    draw: function() {
+      draw(this.canvas, this.paint);
+    }
+  });
+  // simpleWindow draws the first frame before returning.
+  setTimeout(report, 0);
+}
@@ -0,0 +1,47 @@
+// plask.js vector and matrix math.
+
+module.exports = function(bench, plask) {
+  var Vec3 = plask.Vec3, Mat4 = plask.Mat4;
+
+  var a = new Vec3(1, 2, 3), b = new Vec3(-4, 5, 0.5);
+
+  bench.add('vec3AddDup', function(n) {
+    for (var i = 0; i < n; ++i) a.dup().add(b);
+  });
+
+  bench.add('vec3CrossNormalize', function(n) {
+    var v = new Vec3(0, 0, 0);
+    for (var i = 0; i < n; ++i) { v.set(a.x, a.y, a.z); v.cross(b).normalize(); }
+  });
+
+  bench.add('vec3Lerp', function(n) {
+    var v = new Vec3(0, 0, 0);
+    for (var i = 0; i < n; ++i) { v.set(a.x, a.y, a.z); v.lerp(b, 0.25); }
+  });
+
+  var m = new Mat4(), r = new Mat4();
+  r.rotate(0.3, 0, 1, 0).translate(1, 2, 3);
+
+  bench.add('mat4Mul', function(n) {
+    for (var i = 0; i < n; ++i) m.mul(r);
+  });
+
+  bench.add('mat4RotateTranslateScale', function(n) {
+    for (var i = 0; i < n; ++i) {
+      m.reset();
+      m.rotate(i * 0.001, 0, 1, 0).translate(1, 2, 3).scale(2, 2, 2);
+    }
+  });
+
+  bench.add('mat4Invert', function(n) {
+    for (var i = 0; i < n; ++i) { m.set4x4r(1, 0, 0, 1, 0, 2, 0, 2, 0, 0, 3, 3, 0, 0, 0, 1); m.invert(); }
+  });
+
+  bench.add('mat4MulVec3', function(n) {
+    for (var i = 0; i < n; ++i) r.mulVec3(a);
+  });
+
+  bench.add('mat4Perspective', function(n) {
+    for (var i = 0; i < n; ++i) { m.reset(); m.perspective(60, 1.5, 0.1, 100); }
+  });
+};
@@ -0,0 +1,189 @@
+// Marshalling typed arrays and arguments into GL calls.  Renders offscreen
+// into a framebuffer with the software renderer, so it doesn't need a window
+// or a GPU, and measures the binding overhead more than the driver.
+
+module.exports = function(bench, plask) {
+  var gl = new PlaskRawMac.NSOpenGLContext(0, true);  // Software renderer.
+  gl.makeCurrentContext();
+
+  var kSize = 256;
+  var fbo = gl.createFramebuffer();
+  var rbo = gl.createRenderbuffer();
+  gl.bindRenderbuffer(gl.RENDERBUFFER, rbo);
+  gl.renderbufferStorage(gl.RENDERBUFFER, gl.RGBA8, kSize, kSize);
+  gl.bindFramebuffer(gl.FRAMEBUFFER, fbo);
+  gl.framebufferRenderbuffer(gl.FRAMEBUFFER, gl.COLOR_ATTACHMENT0,
+                             gl.RENDERBUFFER, rbo);
+  if (gl.checkFramebufferStatus(gl.FRAMEBUFFER) !== gl.FRAMEBUFFER_COMPLETE)
+    throw 'Incomplete framebuffer.';
+  gl.viewport(0, 0, kSize, kSize);
+
+  var mprogram = plask.gl.MagicProgram.createFromStrings(gl,
+      'uniform mat4 u_mvp;\n' +
+      'attribute vec2 a_pos;\n' +
+      'void main() { gl_Position = u_mvp * vec4(a_pos, 0.0, 1.0); }\n',
+      'uniform vec4 u_color;\n' +
+      'void main() { gl_FragColor = u_color; }\n');
+  mprogram.use();
+
+  var buffer = gl.createBuffer();
+  gl.bindBuffer(gl.ARRAY_BUFFER, buffer);
+
+  var big = new Float32Array(16384);  // 64kB.
+  var small = new Float32Array(64);
+  for (var i = 0; i < big.length; ++i) big[i] = (i % 7) / 7 - 0.5;
+
+  bench.add('bufferData64k', function(n) {
+    for (var i = 0; i < n; ++i) gl.bufferData(gl.ARRAY_BUFFER, big, gl.STREAM_DRAW);
+  });
+
+  bench.add('bufferSubData256', function(n) {
+    for (var i = 0; i < n; ++i) gl.bufferSubData(gl.ARRAY_BUFFER, (i & 63) * 256, small);
+  });
+
+  var loc_color = mprogram.location_u_color;
+  var loc_mvp = mprogram.location_u_mvp;
+  var color_f32 = new Float32Array([1, 0.5, 0.25, 1]);
+  var color_array = [1, 0.5, 0.25, 1];
+
+  bench.add('uniform4f', function(n) {
+    for (var i = 0; i < n; ++i) gl.uniform4f(loc_color, 1, 0.5, 0.25, 1);
+  });
+
+  bench.add('uniform4fvFloat32Array', function(n) {
+    for (var i = 0; i < n; ++i) gl.uniform4fv(loc_color, color_f32);
+  });
+
+  bench.add('uniform4fvArray', function(n) {
+    for (var i = 0; i < n; ++i) gl.uniform4fv(loc_color, color_array);
+  });
+
+  var mvp = new plask.Mat4();
+
+  bench.add('uniformMatrix4fvMat4', function(n) {
+    for (var i = 0; i < n; ++i) mprogram.set_u_mvp(mvp);
+  });
+
+  var mvp_f32 = mvp.toFloat32Array();
+
+  bench.add('uniformMatrix4fvFloat32Array', function(n) {
+    for (var i = 0; i < n; ++i) gl.uniformMatrix4fv(loc_mvp, false, mvp_f32);
+  });
+
+  gl.bufferData(gl.ARRAY_BUFFER, big, gl.STATIC_DRAW);
+  var loc_pos = mprogram.location_a_pos;
+  gl.enableVertexAttribArray(loc_pos);
+  gl.vertexAttribPointer(loc_pos, 2, gl.FLOAT, false, 0, 0);
+
+  bench.add('drawArraysTriangle', function(n) {
+    for (var i = 0; i < n; ++i) gl.drawArrays(gl.TRIANGLES, (i % 100) * 3, 3);
+  });
+
+  // Streaming dynamic vertices, 1MB per frame, reported per MB so the target
+  // of 100MB/s is 10ms (1e7 ns) per op.  Each frame writes the data, draws
+  // from it and finishes the frame, compared with uploading the same data
+  // with bufferSubData into a buffer the previous frame drew from.
+  var kStreamBytes = 1 << 20;
+  var stream = gl.createStreamBuffer(gl.ARRAY_BUFFER, kStreamBytes, 3);
+  var src = new Float32Array(kStreamBytes / 4);
+  for (var i = 0; i < src.length; ++i) src[i] = (i % 11) / 11 - 0.5;
+
+  bench.add('streamBufferMB', function(n) {
+    for (var i = 0; i < n; ++i) {
+      var f32 = stream.map();
+      f32.set(src);
+      var offset = stream.unmap(kStreamBytes);
+      gl.vertexAttribPointer(loc_pos, 2, gl.FLOAT, false, 0, offset);
+      gl.drawArrays(gl.TRIANGLES, 0, 3);
+      stream.endFrame();
+    }
+  });
+
+  var sub_buffer = gl.createBuffer();
+  gl.bindBuffer(gl.ARRAY_BUFFER, sub_buffer);
+  gl.bufferData(gl.ARRAY_BUFFER, kStreamBytes, gl.STREAM_DRAW);
+
+  bench.add('bufferSubDataMB', function(n) {
+    for (var i = 0; i < n; ++i) {
+      gl.bindBuffer(gl.ARRAY_BUFFER, sub_buffer);
+      gl.bufferSubData(gl.ARRAY_BUFFER, 0, src);
+      gl.vertexAttribPointer(loc_pos, 2, gl.FLOAT, false, 0, 0);
+      gl.drawArrays(gl.TRIANGLES, 0, 3);
+    }
+  });
+
+  var readback = new Float32Array(64);
+
+  bench.add('getBufferSubData256', function(n) {
+    for (var i = 0; i < n; ++i)
+      gl.getBufferSubData(gl.ARRAY_BUFFER, (i & 1023) * 256, readback);
+  });
+
+  stream.destroy();
+
+  var pixels = new Uint8Array(kSize * kSize * 4);
+
+  bench.add('readPixels', function(n) {
+    for (var i = 0; i < n; ++i)
+      gl.readPixels(0, 0, kSize, kSize, gl.RGBA, gl.UNSIGNED_BYTE, pixels);
+  }, {ops: kSize * kSize});
+
+  // 10k small triangles, each with its own matrix and color, drawn one by one
+  // with uniforms, against submitted to a BatchRenderer (instanced where
+  // available).  Reported per object.
+  var kObjects = 10000;
+  var models = [ ], colors = [ ];
+  for (var i = 0; i < kObjects; ++i) {
+    models.push(new plask.Mat4().translate((i % 100) / 50 - 1,
+                                           Math.floor(i / 100) / 50 - 1, 0)
+                                .scale(0.01, 0.01, 1));
+    colors.push(new plask.Vec4((i % 7) / 7, (i % 11) / 11, (i % 13) / 13, 1));
+  }
+  gl.bindBuffer(gl.ARRAY_BUFFER, buffer);
+  gl.bufferData(gl.ARRAY_BUFFER, big, gl.STATIC_DRAW);
+
+  bench.add('drawObjectsUniforms', function(n) {
+    for (var i = 0; i < n; ++i) {
+      mprogram.use();
+      gl.enableVertexAttribArray(loc_pos);
+      gl.vertexAttribPointer(loc_pos, 2, gl.FLOAT, false, 0, 0);
+      mprogram.set_u_mvp(models[i % kObjects]);
+      mprogram.set_u_color(colors[i % kObjects]);
+      gl.drawArrays(gl.TRIANGLES, 0, 3);
+    }
+  });
+
+  var instanced_program = plask.gl.MagicProgram.createFromStrings(gl,
+      'attribute vec2 a_pos;\n' +
+      'attribute mat4 i_mvp;\n' +
+      'attribute vec4 i_color;\n' +
+      'varying vec4 v_color;\n' +
+      'void main() {\n' +
+      '  v_color = i_color;\n' +
+      '  gl_Position = i_mvp * vec4(a_pos, 0.0, 1.0);\n' +
+      '}\n',
+      'varying vec4 v_color;\n' +
+      'void main() { gl_FragColor = v_color; }\n');
+  var triangle = {mode: gl.TRIANGLES, count: 3,
+                  attribs: {a_pos: {buffer: buffer, size: 2}}};
+  var batch = new plask.gl.BatchRenderer(gl);
+
+  bench.add('drawObjectsBatched', function(n) {
+    for (var i = 0; i < n; ++i) {
+      var o = i % kObjects;
+      batch.submit(instanced_program, triangle,
+                   {i_mvp: models[o], i_color: colors[o]});
+      if (o === kObjects - 1) batch.flush();
+    }
+    batch.flush();
+  });
+
+  batch.resetStats();
+  for (var i = 0; i < kObjects; ++i)
+    batch.submit(instanced_program, triangle, {i_mvp: models[i], i_color: colors[i]});
+  batch.flush();
+  var stats = batch.stats();
+  console.log('BatchRenderer draws: ' + stats.submitted + ' submitted, ' +
+              stats.issued + ' issued');
+  batch.destroy();
+};
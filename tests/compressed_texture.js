@@ -0,0 +1,184 @@
+// Test plask.CompressedTexture on the CPU: S3TC encoder quality (as PSNR of
+// the decoded pixels), mip chains, threading, and DDS / KTX parsing.
+
+var plask = require('plask');
+var test_utils = require('./test_utils');
+var assert_eq = test_utils.assert_eq, assert_throws = test_utils.assert_throws;
+var CT = plask.CompressedTexture;
+
+function assert_true(cond, msg) {
+  if (!cond) { console.trace(msg); throw msg; }
+}
+
+function assert_bytes_eq(a, b) {
+  assert_eq(a.length, b.length);
+  for (var i = 0; i < a.length; ++i) assert_eq(a[i], b[i]);
+}
+
+// PSNR over channels [first, last) of two RGBA images.
+function psnr(a, b, first, last) {
+  var se = 0, n = 0;
+  for (var i = 0; i < a.length; i += 4) {
+    for (var c = first; c < last; ++c) {
+      var d = a[i + c] - b[i + c];
+      se += d * d; ++n;
+    }
+  }
+  return se === 0 ? Infinity : 10 * Math.log(255 * 255 * n / se) / Math.LN10;
+}
+
+// A test image: smooth gradients with an alpha ramp, and some noisy blocks.
+function makeImage(width, height) {
+  var data = new Uint8Array(width * height * 4), seed = 1;
+  for (var y = 0; y < height; ++y) {
+    for (var x = 0; x < width; ++x) {
+      var i = (y * width + x) * 4;
+      data[i] = x * 255 / width;
+      data[i + 1] = y * 255 / height;
+      data[i + 2] = 128 + 100 * Math.sin(x * 0.05) * Math.cos(y * 0.07);
+      data[i + 3] = (x + y) * 255 / (width + height);
+      if (((x >> 5) + (y >> 5)) % 7 === 0) {
+        seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+        data[i] = seed >> 16;
+      }
+    }
+  }
+  return {data: data, width: width, height: height};
+}
+
+var kWidth = 250, kHeight = 130;  // Not a multiple of 4 on purpose.
+var image = makeImage(kWidth, kHeight);
+
+// Quality.  The thresholds are a few dB under what the encoder gets, to
+// catch regressions.
+var dxt1 = CT.encode(image, CT.COMPRESSED_RGB_S3TC_DXT1_EXT);
+assert_eq(1, dxt1.levels.length);
+assert_eq(63 * 33 * 8, dxt1.levels[0].data.length);
+var decoded = CT.decode(dxt1.levels[0].data, kWidth, kHeight, dxt1.format);
+assert_true(psnr(image.data, decoded, 0, 3) > 32, 'DXT1 color PSNR');
+
+var dxt5 = CT.encode(image, CT.COMPRESSED_RGBA_S3TC_DXT5_EXT);
+assert_eq(63 * 33 * 16, dxt5.levels[0].data.length);
+decoded = CT.decode(dxt5.levels[0].data, kWidth, kHeight, dxt5.format);
+assert_true(psnr(image.data, decoded, 0, 3) > 32, 'DXT5 color PSNR');
+assert_true(psnr(image.data, decoded, 3, 4) > 45, 'DXT5 alpha PSNR');
+
+var dxt3 = CT.encode(image, CT.COMPRESSED_RGBA_S3TC_DXT3_EXT);
+decoded = CT.decode(dxt3.levels[0].data, kWidth, kHeight, dxt3.format);
+assert_true(psnr(image.data, decoded, 3, 4) > 30, 'DXT3 alpha PSNR');
+
+// A block of one color that 565 can hold exactly comes back exactly.
+var solid = {data: new Uint8Array(64), width: 4, height: 4};
+for (var i = 0; i < 64; i += 4) {
+  solid.data[i] = 255; solid.data[i + 1] = 130; solid.data[i + 2] = 0;
+  solid.data[i + 3] = i < 32 ? 0 : 255;
+}
+var block = CT.encode(solid, CT.COMPRESSED_RGB_S3TC_DXT1_EXT).levels[0].data;
+decoded = CT.decode(block, 4, 4, CT.COMPRESSED_RGB_S3TC_DXT1_EXT);
+assert_eq('255,130,0,255', Array.prototype.slice.call(decoded, 0, 4).join());
+
+// DXT1 with alpha makes the transparent half transparent.
+block = CT.encode(solid, CT.COMPRESSED_RGBA_S3TC_DXT1_EXT).levels[0].data;
+decoded = CT.decode(block, 4, 4, CT.COMPRESSED_RGBA_S3TC_DXT1_EXT);
+assert_eq(0, decoded[3]);
+assert_eq('255,130,0,255', Array.prototype.slice.call(decoded, 60, 64).join());
+
+// The same result on any number of threads.
+var one = CT.encode(makeImage(256, 256), CT.COMPRESSED_RGBA_S3TC_DXT5_EXT,
+                    {threads: 1});
+var many = CT.encode(makeImage(256, 256), CT.COMPRESSED_RGBA_S3TC_DXT5_EXT,
+                     {threads: 8});
+assert_bytes_eq(one.levels[0].data, many.levels[0].data);
+
+// Mip chains go down to 1x1.
+var mips = CT.encode(image, CT.COMPRESSED_RGB_S3TC_DXT1_EXT, {mipmaps: true});
+assert_eq(8, mips.levels.length);
+assert_eq('250x130,125x65,62x32,31x16,15x8,7x4,3x2,1x1', mips.levels.map(
+    function(l) { return l.width + 'x' + l.height; }).join());
+assert_eq(8, mips.levels[7].data.length);
+
+// From a canvas, flipped like texImage2DSkCanvas by default.
+var canvas = plask.SkCanvas.create(8, 8);
+canvas.clear(255, 0, 0, 255);
+var paint = new plask.SkPaint();
+paint.setColor(0, 0, 255, 255);
+canvas.drawRect(paint, 0, 0, 8, 4);  // Top half blue.
+var flipped = CT.encode(canvas, CT.COMPRESSED_RGB_S3TC_DXT1_EXT);
+decoded = CT.decode(flipped.levels[0].data, 8, 8, flipped.format);
+assert_eq('255,0,0', Array.prototype.slice.call(decoded, 0, 3).join());
+var unflipped = CT.encode(canvas, CT.COMPRESSED_RGB_S3TC_DXT1_EXT, {flipY: false});
+decoded = CT.decode(unflipped.levels[0].data, 8, 8, unflipped.format);
+assert_eq('0,0,255', Array.prototype.slice.call(decoded, 0, 3).join());
+
+assert_throws('Error: Not an S3TC format.', function() {
+  CT.encode(image, 0x1908);
+});
+assert_throws('Error: Source is smaller than width x height RGBA pixels.',
+              function() {
+                CT.encode({data: new Uint8Array(10), width: 4, height: 4},
+                          0x83f0);
+              });
+
+// Containers, built around the mip chain from above.
+function concatLevels(header, levels, ktx) {
+  var size = header.length;
+  levels.forEach(function(l) { size += (ktx ? 4 : 0) + l.data.length; });
+  var out = new Uint8Array(size), pos = header.length;
+  out.set(header, 0);
+  levels.forEach(function(l) {
+    if (ktx) {
+      new DataView(out.buffer).setUint32(pos, l.data.length, true);
+      pos += 4;
+    }
+    out.set(l.data, pos);
+    pos += l.data.length;
+  });
+  return out;
+}
+
+function checkParsed(parsed, format) {
+  assert_eq(format, parsed.format);
+  assert_eq(kWidth, parsed.width);
+  assert_eq(kHeight, parsed.height);
+  assert_eq(mips.levels.length, parsed.levels.length);
+  for (var i = 0; i < mips.levels.length; ++i) {
+    assert_eq(mips.levels[i].width, parsed.levels[i].width);
+    assert_eq(mips.levels[i].height, parsed.levels[i].height);
+    assert_bytes_eq(mips.levels[i].data, parsed.levels[i].data);
+  }
+}
+
+var dds = new Uint8Array(128), ddv = new DataView(dds.buffer);
+ddv.setUint32(0, 0x20534444, true);  // 'DDS '
+ddv.setUint32(4, 124, true);
+ddv.setUint32(8, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000, true);
+ddv.setUint32(12, kHeight, true);
+ddv.setUint32(16, kWidth, true);
+ddv.setUint32(28, mips.levels.length, true);
+ddv.setUint32(76, 32, true);
+ddv.setUint32(80, 0x4, true);  // DDPF_FOURCC
+ddv.setUint32(84, 0x31545844, true);  // 'DXT1'
+var dds_file = concatLevels(dds, mips.levels, false);
+checkParsed(CT.parseDDS(dds_file), CT.COMPRESSED_RGB_S3TC_DXT1_EXT);
+assert_throws('Error: Compressed texture data is truncated.', function() {
+  CT.parseDDS(dds_file.subarray(0, dds_file.length - 1));
+});
+ddv.setUint32(84, 0x31545846, true);  // 'FXT1'
+assert_throws('Error: Unsupported DDS format: FXT1', function() {
+  CT.parseDDS(dds);
+});
+
+var ktx = new Uint8Array(64), kdv = new DataView(ktx.buffer);
+ktx.set([0xab, 0x4b, 0x54, 0x58, 0x20, 0x31, 0x31, 0xbb, 0x0d, 0x0a, 0x1a, 0x0a]);
+kdv.setUint32(12, 0x04030201, true);
+kdv.setUint32(16 + 3 * 4, CT.COMPRESSED_RGB_S3TC_DXT1_EXT, true);
+kdv.setUint32(16 + 4 * 4, 0x1907, true);  // GL_RGB
+kdv.setUint32(16 + 5 * 4, kWidth, true);
+kdv.setUint32(16 + 6 * 4, kHeight, true);
+kdv.setUint32(16 + 9 * 4, 1, true);  // Faces.
+kdv.setUint32(16 + 10 * 4, mips.levels.length, true);
+checkParsed(CT.parseKTX(concatLevels(ktx, mips.levels, true)),
+            CT.COMPRESSED_RGB_S3TC_DXT1_EXT);
+assert_throws('Error: Not a KTX file.', function() { CT.parseKTX(dds_file); });
+
+console.log('ok');
@@ -0,0 +1,136 @@
+// Test plask.EventQueue without a window: synthetic events through the native
+// ring, decoding, coalescing with history, object reuse, and overflow.
+
+var plask = require('plask');
+var events = require('events');
+var test_utils = require('./test_utils');
+var assert_eq = test_utils.assert_eq, assert_throws = test_utils.assert_throws;
+
+var NSEvent = PlaskRawMac.NSEvent;  // For the event types and masks.
+var kHeight = 300;
+
+// Log the events emitted, with a copy of each event as it was emitted, since
+// the event objects are reused.
+function record(emitter, names) {
+  var log = [ ];
+  names.forEach(function(name) {
+    emitter.on(name, function(e) {
+      var copy = { };
+      for (var key in e) copy[key] = e[key];
+      log.push({name: name, obj: e, e: copy});
+    });
+  });
+  return log;
+}
+
+var kNames = ['leftMouseDown', 'leftMouseUp', 'middleMouseDown', 'mouseDown',
+              'mouseUp', 'leftMouseDragged', 'mouseDragged', 'mouseMoved',
+              'scrollWheel', 'tabletProximity'];
+
+// Decoding, without coalescing.
+(function() {
+  var q = new plask.EventQueue({capacity: 64, height: kHeight, dpiScale: 2});
+  var em = new events.EventEmitter();
+  var log = record(em, kNames);
+
+  q.push({type: NSEvent.NSLeftMouseDown, x: 10, y: 100, button: 0,
+          clickCount: 2, modifiers: NSEvent.NSShiftKeyMask, timestamp: 5});
+  q.push({type: NSEvent.NSOtherMouseDown, x: 1, y: 1, button: 2});
+  q.push({type: NSEvent.NSLeftMouseDown, x: 1, y: 200});  // Title bar.
+  q.push({type: NSEvent.NSScrollWheel, x: 1, y: 1, dy: 3, precise: true,
+          scrollingDeltaY: 30, phase: 4});
+  q.push({type: NSEvent.NSTabletProximity, entering: true});
+  assert_eq(5, q.size());
+  assert_eq(5, q.drain(em));
+  assert_eq(0, q.size());
+
+  assert_eq('leftMouseDown,mouseDown,middleMouseDown,mouseDown,' +
+            'scrollWheel,tabletProximity',
+            log.map(function(l) { return l.name; }).join(','));
+  var down = log[0].e, down_obj = log[0].obj;
+  assert_eq(20, log[0].e.x);
+  assert_eq(kHeight - 200, log[0].e.y);
+  assert_eq(1, down.buttonNumber);
+  assert_eq('left', down.buttonName);
+  assert_eq(2, down.clickCount);
+  assert_eq(true, down.shift);
+  assert_eq(false, down.cmd);
+  assert_eq(5, down.timestamp);
+  assert_eq('middle', log[2].e.buttonName);
+  var scroll = log[4].e;
+  assert_eq(6, scroll.dy);
+  assert_eq(true, scroll.hasPreciseScrollingDeltas);
+  assert_eq(30, scroll.scrollingDeltaY);
+  assert_eq(4, scroll.phase);
+  assert_eq(true, log[5].e.entering);
+
+  // The event objects are reused.
+  log.length = 0;
+  q.push({type: NSEvent.NSLeftMouseDown, x: 50, y: 50});
+  q.drain(em);
+  assert_eq(log[0].obj, down_obj);
+  assert_eq(100, down_obj.x);
+  assert_eq(0, down_obj.clickCount);
+})();
+
+// Coalescing keeps the last event of a run, sums the deltas, and has the run
+// at full resolution as history.
+(function() {
+  var q = new plask.EventQueue({capacity: 64, height: kHeight, coalesce: true});
+  var em = new events.EventEmitter();
+  var log = record(em, kNames);
+
+  for (var i = 0; i < 5; ++i)
+    q.push({type: NSEvent.NSMouseMoved, x: i, y: 10, dx: 1});
+  q.push({type: NSEvent.NSLeftMouseDown, x: 4, y: 10});
+  for (var i = 0; i < 3; ++i) {
+    q.push({type: NSEvent.NSLeftMouseDragged, x: 4 + i, y: 10 + i, dx: 1,
+            pressure: i / 2});
+  }
+  q.push({type: NSEvent.NSLeftMouseUp, x: 6, y: 12});
+  assert_eq(10, q.drain(em));
+
+  assert_eq('mouseMoved,leftMouseDown,mouseDown,leftMouseDragged,' +
+            'mouseDragged,leftMouseUp,mouseUp',
+            log.map(function(l) { return l.name; }).join(','));
+  assert_eq(4, log[0].e.x);
+  assert_eq(5, log[0].e.dx);
+  assert_eq(0, log[0].e.historyIndex);
+  assert_eq(5, log[0].e.historyCount);
+  for (var i = 0; i < 5; ++i) {
+    assert_eq(i, q.recordX(log[0].e.historyIndex + i));
+    assert_eq(kHeight - 10, q.recordY(log[0].e.historyIndex + i));
+  }
+
+  var drag = log[3].e;
+  assert_eq(6, drag.historyIndex);
+  assert_eq(3, drag.historyCount);
+  assert_eq(3, drag.dx);
+  assert_eq(6, drag.x);
+  assert_eq(kHeight - 12, drag.y);
+  assert_eq(0.5, q.recordPressure(drag.historyIndex + 1));
+  assert_eq(1, drag.pressure);
+})();
+
+// A full queue drops the oldest records.
+(function() {
+  var q = new plask.EventQueue({capacity: 4, height: kHeight});
+  var em = new events.EventEmitter();
+  var log = record(em, kNames);
+  for (var i = 0; i < 6; ++i)
+    q.push({type: NSEvent.NSMouseMoved, x: i, y: 0});
+  assert_eq(4, q.size());
+  assert_eq(2, q.dropped());
+  assert_eq(4, q.drain(em));
+  assert_eq('2,3,4,5', log.map(function(l) { return l.e.x; }).join(','));
+  assert_eq(0, q.drain(em));
+})();
+
+assert_throws('Error: Invalid event queue capacity.', function() {
+  new plask.EventQueue({capacity: 0});
+});
+assert_throws('TypeError: drain expects a Float64Array.', function() {
+  new PlaskRawMac.PlaskEventQueue(4).drain(new Float32Array(64));
+});
+
+console.log('ok');
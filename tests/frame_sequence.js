@@ -0,0 +1,174 @@
+// Test plask.FrameSequencePlayer: delivery of the right frame to a canvas,
+// seeking and stepping with and without loop, the dropped frame and cache
+// counts, and errors.
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var plask = require('plask');
+var test_utils = require('./test_utils');
+var assert_eq = test_utils.assert_eq, assert_throws = test_utils.assert_throws;
+
+var kFrames = 30;
+var kWidth = 64, kHeight = 48;
+var dir = path.join(os.tmpdir(), 'plask_frame_sequence');
+if (!fs.existsSync(dir)) fs.mkdirSync(dir);
+
+// Frame i is filled with red i * 8, and has a white top row (to check the
+// orientation).
+function frame_filename(i) {
+  return path.join(dir, 'frame_' + ('000' + i).slice(-4) + '.png');
+}
+for (var i = 0; i < kFrames; ++i) {
+  var c = plask.SkCanvas.create(kWidth, kHeight);
+  c.clear(i * 8, 0, 0, 255);
+  var paint = new plask.SkPaint();
+  paint.setColor(255, 255, 255, 255);
+  c.drawRect(paint, 0, 0, kWidth, 1);
+  c.writeImage('png', frame_filename(i));
+}
+
+var canvas = plask.SkCanvas.create(kWidth, kHeight);
+
+function check_frame(player, i) {
+  assert_eq(i, player.frame());
+  assert_eq(true, player.copyToCanvas(canvas, true));
+  assert_eq(255, canvas[2]);  // White top row (BGRA).
+  assert_eq(i * 8, canvas[(kHeight - 1) * kWidth * 4 + 2]);
+}
+
+// A pattern, up to the first missing file.
+var player = plask.FrameSequencePlayer.create(
+    path.join(dir, 'frame_%04d.png'), {window: 4, threads: 2});
+assert_eq(kFrames, player.frameCount);
+check_frame(player, 0);
+for (var i = 1; i < 10; ++i) {
+  assert_eq(i, player.step(1));
+  check_frame(player, i);
+}
+assert_eq(0, player.stats().dropped);
+
+// Frames stepped over are dropped.
+assert_eq(12, player.step(3));
+check_frame(player, 12);
+assert_eq(2, player.stats().dropped);
+
+// Moving on from a frame that wasn't delivered drops it too.
+player.step(1);
+player.step(1);
+check_frame(player, 14);
+assert_eq(3, player.stats().dropped);
+
+// A clock driven setFrame forward drops the frames between, a seek doesn't.
+player.setFrame(20);
+check_frame(player, 20);
+assert_eq(8, player.stats().dropped);
+player.seek(2);
+check_frame(player, 2);
+player.seek(25);
+check_frame(player, 25);
+assert_eq(8, player.stats().dropped);
+
+// Without loop the playhead stops at the ends.
+assert_eq(kFrames - 1, player.step(100));
+check_frame(player, kFrames - 1);
+assert_eq(0, player.step(-100));
+check_frame(player, 0);
+assert_throws('Error: Frame out of range.', function() {
+  player.seek(kFrames);
+});
+
+// Decoding ahead: after waiting for the window to decode, the next frames are
+// hits.
+player.step(1);
+check_frame(player, 1);
+var start = Date.now();
+while (player.stats().cached < 4 && Date.now() - start < 5000) { }
+player.resetStats();
+for (var i = 2; i < 5; ++i) {
+  player.step(1);
+  assert_eq(true, player.isReady());
+  check_frame(player, i);
+}
+var stats = player.stats();
+assert_eq(3, stats.hits);
+assert_eq(0, stats.misses);
+assert_eq(3, stats.delivered);
+if (stats.cached > 4) throw 'Expected at most the window to be cached.';
+if (stats.cachedBytes !== stats.cached * kWidth * kHeight * 4)
+  throw 'Expected cachedBytes to be the cached frames.';
+console.log('decode: ' + stats.decodeMs.toFixed(2) + ' ms/frame');
+
+// Frame delivery checks.
+assert_throws('Error: Canvas isn\'t the frame\'s size.', function() {
+  player.copyToCanvas(plask.SkCanvas.create(8, 8), true);
+});
+var size = player.frameSize(true);
+assert_eq(kWidth, size.width);
+assert_eq(kHeight, size.height);
+var copy = player.toCanvas(true);
+assert_eq(kWidth, copy.width);
+assert_eq(4 * 8, copy[(kHeight - 1) * kWidth * 4 + 2]);
+
+player.close();
+assert_throws('Error: FrameSequencePlayer is closed.', function() {
+  player.step(1);
+});
+player.close();  // Twice is fine.
+
+// Looping, backwards too.
+player = plask.FrameSequencePlayer.create(
+    path.join(dir, 'frame_%04d.png'), {first: 5, count: 10, loop: true});
+assert_eq(10, player.frameCount);
+assert_eq(9, player.step(-1));
+assert_eq(true, player.copyToCanvas(canvas, true));
+assert_eq(14 * 8, canvas[(kHeight - 1) * kWidth * 4 + 2]);
+assert_eq(1, player.step(2));  // Over frame 0.
+assert_eq(true, player.copyToCanvas(canvas, true));
+assert_eq(1, player.stats().dropped);
+player.setFrame(8);
+assert_eq(true, player.copyToCanvas(canvas, true));
+assert_eq(7, player.stats().dropped);
+// Forward across the end.
+player.setFrame(1);
+assert_eq(9, player.stats().dropped);
+player.close();
+
+// A frame that can't be decoded throws when delivered.
+player = plask.FrameSequencePlayer.create(
+    [frame_filename(0), path.join(dir, 'missing.png')]);
+check_frame(player, 0);
+player.step(1);
+assert_throws('Error: Couldn\'t load frame 1: ' + path.join(dir, 'missing.png'),
+              function() { player.copyToCanvas(canvas, true); });
+assert_eq(1, player.stats().failed);
+player.close();
+
+// Onto a copy on write canvas, and a canvas still mapped from a pack, both of
+// which move to their own pixels first.
+player = plask.FrameSequencePlayer.create([frame_filename(5)]);
+var source = plask.SkCanvas.create(kWidth, kHeight);
+source.clear(0, 0, 255, 255);
+var copy = plask.SkCanvas.createCopyOnWrite(source);
+assert_eq(true, player.copyToCanvas(copy, true));
+assert_eq(255, copy[2]);
+assert_eq(5 * 8, copy[(kHeight - 1) * kWidth * 4 + 2]);
+assert_eq(255, source[0]);  // The source is still blue.
+assert_eq(0, source[2]);
+var pack_filename = path.join(dir, 'frames.pack');
+plask.AssetPack.write(pack_filename, [{name: 'f', canvas: source}]);
+var pack = plask.AssetPack.open(pack_filename);
+var packed = plask.SkCanvas.createFromPack(pack, 'f');
+assert_eq(true, player.copyToCanvas(packed, true));
+assert_eq(255, packed[2]);
+assert_eq(5 * 8, packed[(kHeight - 1) * kWidth * 4 + 2]);
+assert_eq(0, plask.SkCanvas.createFromPack(pack, 'f')[2]);
+player.close();
+fs.unlinkSync(pack_filename);
+
+assert_throws('TypeError: Expected an Array of filenames.', function() {
+  new plask.FrameSequencePlayer('frame.png');
+});
+
+for (var i = 0; i < kFrames; ++i) fs.unlinkSync(frame_filename(i));
+fs.rmdirSync(dir);
@@ -0,0 +1,149 @@
+// Test plask.Noise: golden values for each type and dimension, fBm and
+// turbulence, that grids, point lists and threads agree with single samples,
+// drawing into a canvas, and errors.
+
+var plask = require('plask');
+var test_utils = require('./test_utils');
+var assert_eq = test_utils.assert_eq, assert_throws = test_utils.assert_throws;
+var Noise = plask.Noise;
+
+function assert_near(a, b) {
+  if (!(Math.abs(a - b) < 1e-5)) {
+    var m = 'assert_near: ' + a + ' !== ' + b;
+    console.trace(m); throw m;
+  }
+}
+
+var kPoints = [[0.3, 1.7, 2.9, 4.1], [-12.25, 7.5, -3.75, 100.125]];
+
+function sample(noise, dims, p) {
+  return noise.noise.apply(noise, p.slice(0, dims));
+}
+
+// [type, seed, dims, noise at kPoints[0], noise at kPoints[1]].
+var kGolden = [
+  ['simplex', 0, 2, 0.6652715, 0.1885561],
+  ['simplex', 0, 3, 0.2513009, 0.2096298],
+  ['simplex', 0, 4, -0.4146399, 0.0023709],
+  ['perlin', 0, 2, -0.1474183, -0.4698662],
+  ['perlin', 0, 3, 0.1970563, -0.0154467],
+  ['perlin', 0, 4, 0.4428335, 0.2738850],
+  ['simplex', 7, 2, -0.2336993, -0.7782226],
+  ['simplex', 7, 3, 0.0138909, -0.1040956],
+  ['simplex', 7, 4, -0.2058278, -0.0411187],
+  ['perlin', 7, 2, 0.3290473, -0.4895471],
+  ['perlin', 7, 3, -0.4324577, 0.0079244],
+  ['perlin', 7, 4, 0.0849209, 0.1029454],
+];
+
+kGolden.forEach(function(g) {
+  var noise = Noise.create({type: g[0], seed: g[1]});
+  assert_near(g[3], sample(noise, g[2], kPoints[0]));
+  assert_near(g[4], sample(noise, g[2], kPoints[1]));
+});
+
+var fbm = Noise.create({octaves: 5});
+assert_near(0.1504292, sample(fbm, 3, kPoints[0]));
+assert_near(0.2012680, sample(fbm, 3, kPoints[1]));
+var turbulence = Noise.create({octaves: 5, turbulence: true});
+assert_eq(true, turbulence.turbulence);
+assert_near(0.2683630, sample(turbulence, 3, kPoints[0]));
+assert_near(0.3063071, sample(turbulence, 3, kPoints[1]));
+var perlin_fbm = Noise.create({type: 'perlin', seed: 3, octaves: 3,
+                               lacunarity: 1.5, gain: 0.7});
+assert_near(-0.0391081, sample(perlin_fbm, 2, kPoints[0]));
+assert_near(-0.1385618, sample(perlin_fbm, 4, kPoints[1]));
+
+// Perlin noise is 0 on the integer lattice.
+var perlin = Noise.create({type: 'perlin'});
+assert_eq(0, perlin.noise(3, -7));
+assert_eq(0, perlin.noise(3, -7, 12, 1));
+
+// A grid matches sampling each point (the coordinates are exact in floats),
+// whichever of the SSE2 and scalar paths each takes, and on any threads.
+[Noise.create(), perlin, fbm, turbulence].forEach(function(noise) {
+  for (var dims = 2; dims <= 4; ++dims) {
+    var width = 37, height = 21;  // Not a multiple of the chunk or of 4.
+    var opts = {dims: dims, x: 0.5, y: -1.25, z: 2, w: -3, dx: 0.25, dy: 0.5};
+    var grid = noise.fill(null, width, height, opts);
+    for (var j = 0; j < height; ++j) {
+      for (var i = 0; i < width; ++i) {
+        var p = [0.5 + i * 0.25, -1.25 + j * 0.5, 2, -3];
+        assert_eq(sample(noise, dims, p), grid[j * width + i]);
+      }
+    }
+
+    opts.threads = 4;
+    var threaded = noise.fill(new Float32Array(width * height), width, height, opts);
+    for (var k = 0; k < grid.length; ++k) assert_eq(grid[k], threaded[k]);
+
+    var points = new Float32Array(width * height * dims);
+    for (var k = 0; k < width * height; ++k) {
+      points[k * dims] = 0.5 + (k % width) * 0.25;
+      points[k * dims + 1] = -1.25 + Math.floor(k / width) * 0.5;
+      if (dims > 2) points[k * dims + 2] = 2;
+      if (dims > 3) points[k * dims + 3] = -3;
+    }
+    var out = new Float32Array(width * height);
+    noise.fillPoints(out, points, dims, 0);
+    for (var k = 0; k < grid.length; ++k) assert_eq(grid[k], out[k]);
+  }
+});
+
+// Default scale spans one unit across the grid.
+var simplex = Noise.create();
+var grid = simplex.fill(null, 64, 64);
+assert_eq(simplex.noise(0.5, 0.25), grid[16 * 64 + 32]);
+
+// Drawing is the grid as gray, -1 to 1 by default.
+var canvas = plask.SkCanvas.create(64, 64);
+simplex.draw(canvas);
+for (var k = 0; k < 64 * 64; k += 7) {
+  var f = Math.fround;  // Scaled in floats.
+  var gray = Math.max(0, Math.min(255, Math.floor(f(f(f(grid[k] + 1) * 127.5) + 0.5))));
+  assert_eq(gray, canvas[k * 4]);
+  assert_eq(gray, canvas[k * 4 + 1]);
+  assert_eq(gray, canvas[k * 4 + 2]);
+  assert_eq(255, canvas[k * 4 + 3]);
+}
+simplex.draw(canvas, {min: 0, max: 0.001, threads: 2});
+for (var k = 0; k < 64 * 64; k += 7) {
+  if (grid[k] >= 0.001) assert_eq(255, canvas[k * 4]);
+  if (grid[k] <= 0) assert_eq(0, canvas[k * 4]);
+}
+
+// Drawing into a copy on write copy leaves the source as it was.
+var copy = plask.SkCanvas.createCopyOnWrite(canvas);
+simplex.draw(copy);
+for (var k = 0; k < 64 * 64; k += 7) {
+  var f = Math.fround;
+  var gray = Math.max(0, Math.min(255, Math.floor(f(f(f(grid[k] + 1) * 127.5) + 0.5))));
+  assert_eq(gray, copy[k * 4]);
+  if (grid[k] >= 0.001) assert_eq(255, canvas[k * 4]);
+  if (grid[k] <= 0) assert_eq(0, canvas[k * 4]);
+}
+copy.dispose();
+canvas.dispose();
+
+assert_throws('Error: Unknown noise type: value', function() {
+  Noise.create({type: 'value'});
+});
+assert_throws('Error: Octaves must be 1 to 32.', function() {
+  Noise.create({octaves: 0});
+});
+assert_throws('Error: Wrong number of arguments.', function() {
+  simplex.noise(1);
+});
+assert_throws('Error: Noise dimensions must be 2, 3 or 4.', function() {
+  simplex.fill(null, 4, 4, {dims: 5});
+});
+assert_throws('Error: Output is smaller than width x height.', function() {
+  simplex.fill(new Float32Array(15), 4, 4);
+});
+assert_throws('TypeError: Expected a Float32Array.', function() {
+  simplex.fill([ ], 4, 4);
+});
+assert_throws('Error: Output is smaller than the number of points.',
+              function() {
+                simplex.fillPoints(new Float32Array(1), new Float32Array(6), 3);
+              });
@@ -0,0 +1,84 @@
+// Write a 1000 page PDF with SkCanvas nextPage, the way a catalog would be,
+// every page drawing text, a logo from the same canvas, and a product image
+// decoded again for the page.  Reports pages per second and peak RSS, and
+// checks that the repeated images are only written to the PDF once.
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var plask = require('plask');
+var test_utils = require('./test_utils');
+var assert_eq = test_utils.assert_eq, assert_throws = test_utils.assert_throws;
+
+var kPages = 1000;
+var kFilename = path.join(os.tmpdir(), 'plask_pdf_pages.pdf');
+var kImageFilename = path.join(os.tmpdir(), 'plask_pdf_pages.png');
+
+function count(str, re) {
+  var m = str.match(re);
+  return m === null ? 0 : m.length;
+}
+
+var paint = new plask.SkPaint();
+paint.setAntiAlias(true);
+
+var logo = plask.SkCanvas.create(128, 64);
+paint.setLinearGradientShader(0, 0, 128, 64, [0, 255, 80, 0, 255, 1, 0, 80, 255, 255]);
+logo.drawPaint(paint);
+
+var product = plask.SkCanvas.create(400, 300);
+paint.setRadialGradientShader(200, 150, 200, [0, 255, 255, 255, 255, 1, 40, 40, 40, 255]);
+product.drawPaint(paint);
+product.writeImage('png', kImageFilename);
+paint.clearShader();
+
+var pdf = plask.SkCanvas.createForPDF(kFilename, 612, 792);
+assert_throws('Error: Not a PDF canvas.', function() { logo.nextPage(); });
+
+var peak_rss = process.memoryUsage().rss;
+var start = process.hrtime();
+
+for (var i = 0; i < kPages; ++i) {
+  if (i !== 0) assert_eq(i + 1, pdf.nextPage());
+  pdf.drawCanvas(null, logo, 36, 36);
+  pdf.drawCanvas(null, plask.SkCanvas.createFromImage(kImageFilename),
+                 106, 150, 506, 450);
+  paint.setTextSize(24);
+  pdf.drawText(paint, 'Item ' + (i + 1), 106, 500);
+  paint.setTextSize(12);
+  for (var line = 0; line < 10; ++line) {
+    pdf.drawText(paint, 'Line ' + line + ' of the description of item ' +
+                 (i + 1) + '.', 106, 530 + line * 16);
+  }
+  if (i % 50 === 0) peak_rss = Math.max(peak_rss, process.memoryUsage().rss);
+}
+
+// A page of another size.
+assert_eq(kPages + 1, pdf.nextPage(842, 595));
+assert_eq(842, pdf.width);
+assert_eq(595, pdf.height);
+pdf.drawText(paint, 'Index', 36, 36);
+
+pdf.writePDF();
+var diff = process.hrtime(start);
+peak_rss = Math.max(peak_rss, process.memoryUsage().rss);
+
+assert_throws('Error: PDF has already been written.', function() {
+  pdf.nextPage();
+});
+
+var seconds = diff[0] + diff[1] / 1e9;
+console.log('pages: ' + (kPages + 1) + ' in ' + seconds.toFixed(2) + ' s, ' +
+            ((kPages + 1) / seconds).toFixed(1) + ' pages/s');
+console.log('peak rss: ' + (peak_rss / (1024 * 1024)).toFixed(1) + ' MB');
+
+var data = fs.readFileSync(kFilename);
+console.log('file: ' + (data.length / 1024).toFixed(1) + ' KB');
+var text = data.toString('binary');
+assert_eq(kPages + 1, count(text, /\/Type\s*\/Page\b/g));
+// The logo and the product image, each written once (with its soft mask).
+if (count(text, /\/Subtype\s*\/Image\b/g) > 4) throw 'Expected the images to be shared.';
+if (count(text, /\/Type\s*\/Font\b/g) > 4) throw 'Expected the font to be shared.';
+
+fs.unlinkSync(kFilename);
+fs.unlinkSync(kImageFilename);
@@ -0,0 +1,84 @@
+// Test WebGLStreamBuffer and getBufferSubData against the software renderer,
+// offscreen, so no window or GPU is needed.
+
+var plask = require('plask');
+var test_utils = require('./test_utils');
+var assert_eq = test_utils.assert_eq, assert_throws = test_utils.assert_throws;
+
+var gl = new PlaskRawMac.NSOpenGLContext(0, true);  // Software renderer.
+gl.makeCurrentContext();
+
+var kSize = 16;
+var fbo = gl.createFramebuffer();
+var rbo = gl.createRenderbuffer();
+gl.bindRenderbuffer(gl.RENDERBUFFER, rbo);
+gl.renderbufferStorage(gl.RENDERBUFFER, gl.RGBA8, kSize, kSize);
+gl.bindFramebuffer(gl.FRAMEBUFFER, fbo);
+gl.framebufferRenderbuffer(gl.FRAMEBUFFER, gl.COLOR_ATTACHMENT0,
+                           gl.RENDERBUFFER, rbo);
+assert_eq(gl.FRAMEBUFFER_COMPLETE, gl.checkFramebufferStatus(gl.FRAMEBUFFER));
+gl.viewport(0, 0, kSize, kSize);
+
+var mprogram = plask.gl.MagicProgram.createFromStrings(gl,
+    'attribute vec2 a_pos;\n' +
+    'void main() { gl_Position = vec4(a_pos, 0.0, 1.0); }\n',
+    'void main() { gl_FragColor = vec4(1.0, 0.0, 0.0, 1.0); }\n');
+mprogram.use();
+var loc = mprogram.location_a_pos;
+gl.enableVertexAttribArray(loc);
+
+var pixels = new Uint8Array(kSize * kSize * 4);
+function pixel(x, y) {
+  var i = (y * kSize + x) * 4;
+  return [pixels[i], pixels[i+1], pixels[i+2]].join(',');
+}
+
+// A quad covering the left (x < 0) or right half of the viewport.
+function writeHalfQuad(f32, left) {
+  var x0 = left ? -1 : 0, x1 = left ? 0 : 1;
+  f32.set([x0, -1, x1, -1, x0, 1, x0, 1, x1, -1, x1, 1]);
+}
+
+[3, 1].forEach(function(num_segments) {  // Ring, and orphaning.
+  var stream = gl.createStreamBuffer(gl.ARRAY_BUFFER, 48, num_segments);
+  assert_eq(256, stream.segmentSize);  // Rounded up for alignment.
+
+  for (var frame = 0; frame < 8; ++frame) {
+    var left = (frame & 1) === 0;
+    var f32 = stream.map();
+    assert_eq(64, f32.length);
+    writeHalfQuad(f32, left);
+    var offset = stream.unmap(48);
+    assert_eq(0, f32.length);  // Detached after unmap.
+    assert_eq(num_segments === 1 ? 0 : (frame % num_segments) * 256, offset);
+
+    gl.clearColor(0, 0, 0, 1);
+    gl.clear(gl.COLOR_BUFFER_BIT);
+    gl.vertexAttribPointer(loc, 2, gl.FLOAT, false, 0, offset);
+    gl.drawArrays(gl.TRIANGLES, 0, 6);
+    stream.endFrame();
+
+    gl.readPixels(0, 0, kSize, kSize, gl.RGBA, gl.UNSIGNED_BYTE, pixels);
+    assert_eq(left ? '255,0,0' : '0,0,0', pixel(2, 8));
+    assert_eq(left ? '0,0,0' : '255,0,0', pixel(13, 8));
+  }
+
+  var stats = stream.stats();
+  assert_eq(8 * 48, stats.bytesFlushed);
+  stream.destroy();
+});
+
+// getBufferSubData reads back just a sub-range.
+var buffer = gl.createBuffer();
+gl.bindBuffer(gl.ARRAY_BUFFER, buffer);
+var data = new Float32Array(1024);
+for (var i = 0; i < data.length; ++i) data[i] = i;
+gl.bufferData(gl.ARRAY_BUFFER, data, gl.STATIC_DRAW);
+var sub = new Float32Array(4);
+gl.getBufferSubData(gl.ARRAY_BUFFER, 100 * 4, sub);
+assert_eq('100,101,102,103', Array.prototype.join.call(sub, ','));
+
+// A range past the end of the buffer throws rather than reading past the map.
+assert_throws('Error: Read outside of the buffer.', function() {
+  gl.getBufferSubData(gl.ARRAY_BUFFER, 1022 * 4, sub);
+});
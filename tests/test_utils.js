@@ -0,0 +1,22 @@
+// Asserts shared by the tests.  Exceptions are compared by toString(), so
+// with their type, ex. 'Error: Expected an SkCanvas.'
+
+function assert_eq(a, b) {
+  if (a !== b) {
+    var m = 'assert_eq: ' + JSON.stringify(a) + ' !== ' + JSON.stringify(b);
+    console.trace(m); throw m;
+  }
+}
+
+function assert_throws(estr, cb) {
+  try {
+    cb();
+  } catch(e) {
+    assert_eq(estr, e.toString());
+    return;
+  }
+  throw 'Expected an exception.';
+}
+
+exports.assert_eq = assert_eq;
+exports.assert_throws = assert_throws;
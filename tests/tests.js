@@ -41,5 +41,281 @@ function test_fracts() {
   assert_eq(-0.25, plask.fract3(-1.25));
 }
 
+function test_stats() {
+  plask.stats.reset();
+  plask.stats.setEnabled(true);
+  var path = new plask.SkPath();
+  for (var i = 0; i < 100; ++i) path.lineTo(i, i);
+  plask.stats.setEnabled(false);
+  path.lineTo(0, 0);  // Not counted.
+  var stats = plask.stats();
+  assert_eq(100, stats['SkPath.lineTo'].calls);
+  assert_eq(100, stats['SkPath.lineTo'].histogram.reduce(function(a, b) {
+    return a + b;
+  }, 0));
+  assert_eq(undefined, stats['SkPath.moveTo']);
+  plask.stats.reset();
+  assert_eq(undefined, plask.stats()['SkPath.lineTo']);
+}
+
+function test_atlas() {
+  var red = plask.SkCanvas.create(4, 4), blue = plask.SkCanvas.create(2, 6);
+  red.clear(255, 0, 0, 255);
+  blue.clear(0, 0, 255, 255);
+  var packed = plask.SkCanvas.packAtlas([red, blue], {padding: 1});
+  assert_eq(4, packed.rects[2] - packed.rects[0]);
+  assert_eq(6, packed.rects[7] - packed.rects[5]);
+
+  // Draw blue unscaled at (10, 20), and red at 2x at (0, 0).
+  var canvas = plask.SkCanvas.create(32, 32);
+  canvas.clear(0, 0, 0, 255);
+  var xforms = new Float32Array([1, 0, 10, 20, 2, 0, 0, 0]);
+  var rects = new Float32Array([packed.rects[4], packed.rects[5],
+                                packed.rects[6], packed.rects[7],
+                                packed.rects[0], packed.rects[1],
+                                packed.rects[2], packed.rects[3]]);
+  canvas.drawAtlas(packed.canvas, xforms, rects, null, null);
+  function pixel(x, y) {  // BGRA.
+    var i = (y * 32 + x) * 4;
+    return [canvas[i], canvas[i+1], canvas[i+2]].join(',');
+  }
+  assert_eq('255,0,0', pixel(11, 25));
+  assert_eq('0,0,0', pixel(12, 25));
+  assert_eq('0,0,255', pixel(7, 7));
+  assert_eq('0,0,0', pixel(8, 8));
+  assert_throws('Error: xforms and srcRects must be Float32Arrays.', function() {
+    canvas.drawAtlas(packed.canvas, [1, 0, 0, 0], rects);
+  });
+}
+
+function test_canvas_pool() {
+  var SkCanvas = plask.SkCanvas;
+  // A size no other test uses, so it starts out with nothing pooled.
+  var a = SkCanvas.create(123, 77);
+  var before = SkCanvas.poolStats();
+  a.dispose();
+  assert_eq(0, a.width);
+  assert_eq(undefined, a[0]);
+  a.drawColor(255, 0, 0, 255);  // Does nothing.
+  a.dispose();  // Twice is fine.
+  var after = SkCanvas.poolStats();
+  assert_eq(true, after.pooledBytes > before.pooledBytes);
+  assert_eq(true, after.liveBytes < before.liveBytes);
+
+  var b = SkCanvas.create(123, 77);  // Reuses a's pixels.
+  assert_eq(after.hits + 1, SkCanvas.poolStats().hits);
+  assert_eq(0, b[0]);  // Cleared.
+
+  // Copy-on-write copies see the pixels as they were when copied.
+  b.clear(255, 0, 0, 255);  // Red, the pixels are BGRA.
+  var c = SkCanvas.createCopyOnWrite(b), d = SkCanvas.createCopyOnWrite(b);
+  assert_eq(255, c[2]);
+  b.clear(0, 255, 0, 255);  // Green, unshares c and d.
+  assert_eq(0, c[1]);
+  assert_eq(255, c[2]);
+  assert_eq(255, b[1]);
+  c.clear(0, 0, 255, 255);
+  assert_eq(255, c[0]);
+  assert_eq(0, d[0]);
+  assert_eq(255, d[2]);
+
+  // A pristine copy drawn to first moves, leaving the original alone.
+  var e = SkCanvas.createCopyOnWrite(d);
+  e.translate(10, 10);
+  e.clear(0, 0, 0, 0);
+  assert_eq(0, e[2]);
+  assert_eq(255, d[2]);
+
+  // Pixel writes don't unshare, on either side, until the canvas is drawn to.
+  var f = SkCanvas.createCopyOnWrite(d);
+  d[2] = 7;
+  assert_eq(7, f[2]);
+  d.save(); d.restore();  // Moves f off.
+  d[2] = 9;
+  assert_eq(7, f[2]);
+  f.dispose();
+
+  assert_throws('Error: Only bitmap canvases can be disposed.', function() {
+    SkCanvas.createForPDF('/dev/null', 10, 10, 10, 10).dispose();
+  });
+  b.dispose(); c.dispose(); d.dispose(); e.dispose();
+}
+
+function test_path_cache() {
+  var SkCanvas = plask.SkCanvas;
+  var path = new plask.SkPath();
+  path.addCircle(20, 20, 10);
+  path.freeze();
+  assert_eq(true, path.isFrozen());
+  assert_throws('Error: SkPath is frozen.', function() { path.lineTo(1, 1); });
+  assert_throws('Error: SkPath is frozen.', function() {
+    new plask.SkPaint().getFillPath(new plask.SkPath(), path);
+  });
+  var copy = new plask.SkPath(path);
+  assert_eq(false, copy.isFrozen());
+  copy.lineTo(1, 1);
+
+  var paint = new plask.SkPaint();
+  paint.setColor(255, 0, 0, 255);
+  var canvas = SkCanvas.create(64, 64);
+  var before = SkCanvas.pathCacheStats();
+  canvas.drawPath(paint, path);
+  var stats = SkCanvas.pathCacheStats();
+  assert_eq(before.misses + 1, stats.misses);
+  assert_eq(255, canvas[(20 * 64 + 20) * 4 + 2]);
+
+  // Same scale at an integer translation, with a different color, is a hit.
+  paint.setColor(0, 255, 0, 255);
+  canvas.translate(30, 30);
+  canvas.drawPath(paint, path);
+  assert_eq(stats.hits + 1, SkCanvas.pathCacheStats().hits);
+  assert_eq(255, canvas[(50 * 64 + 50) * 4 + 1]);
+  assert_eq(0, canvas[(50 * 64 + 50) * 4 + 2]);
+
+  // A different scale is a miss, and a shader isn't cacheable.
+  canvas.scale(0.5, 0.5);
+  canvas.drawPath(paint, path);
+  assert_eq(stats.misses + 1, SkCanvas.pathCacheStats().misses);
+  paint.setLinearGradientShader(0, 0, 10, 10, [0, 0, 0, 0, 255, 1, 255, 255, 255, 255]);
+  canvas.drawPath(paint, path);
+  assert_eq(stats.bypassed + 1, SkCanvas.pathCacheStats().bypassed);
+
+  SkCanvas.setPathCacheBudget(0);
+  assert_eq(0, SkCanvas.pathCacheStats().entries);
+  assert_eq(0, SkCanvas.pathCacheStats().bytes);
+  SkCanvas.setPathCacheBudget(before.budgetBytes);
+  canvas.dispose();
+}
+
+function test_asset_pack() {
+  var SkCanvas = plask.SkCanvas, AssetPack = plask.AssetPack;
+  var a = SkCanvas.create(3, 2), b = SkCanvas.create(40, 30);
+  a.clear(255, 0, 0, 255);
+  b.clear(0, 0, 255, 128);
+  var filename = require('os').tmpdir() + '/plask_test.plaskpak';
+  var res = AssetPack.write(filename, [
+    {name: 'a', canvas: a},
+    {name: 'images/b', canvas: b},
+    {name: 'tex', data: new Uint8Array([1, 2, 3, 4]), format: 0x83f0,
+     width: 4, height: 4}]);
+  assert_eq(3, res.count);
+
+  var pack = AssetPack.open(filename);
+  assert_eq(true, pack !== AssetPack.open(filename));  // Not cached.
+  assert_eq('a,images/b,tex', pack.names().join());
+  assert_eq(40, pack.entry('images/b').width);
+  assert_eq(0x83f0, pack.entry('tex').format);
+  assert_eq(null, pack.entry('nope'));
+  assert_eq('1,2,3,4', Array.prototype.join.call(pack.data('tex')));
+  pack.prefetch('images/b');
+
+  var c = SkCanvas.createFromPack(pack, 'a');
+  assert_eq(3, c.width);
+  assert_eq(255, c[2]);
+  var d = SkCanvas.createFromPack(filename, 'images/b');
+  for (var i = 0; i < b.width * b.height * 4; ++i) assert_eq(b[i], d[i]);
+
+  // Drawing moves the canvas off the pack, later loads see the original.
+  c.clear(0, 255, 0, 255);
+  assert_eq(255, c[1]);
+  assert_eq(255, SkCanvas.createFromPack(pack, 'a')[2]);
+
+  assert_throws('Error: No such image in the asset pack.', function() {
+    SkCanvas.createFromPack(pack, 'nope');
+  });
+  assert_throws('Error: Asset pack entry isn\'t an image.', function() {
+    SkCanvas.createFromPack(pack, 'tex');
+  });
+  assert_throws('Error: Not an asset pack, or a corrupt one.', function() {
+    new AssetPack(__filename);
+  });
+
+  // An alignment that isn't a multiple of the page size, and a name length
+  // that would wrap around when padded.
+  var fs = require('fs');
+  var bytes = fs.readFileSync(filename);
+  var index_offset = bytes.readUInt32LE(24);
+  [[16, 100], [index_offset, 0xfffffffe]].forEach(function(patch) {
+    var corrupt = new Buffer(bytes);
+    corrupt.writeUInt32LE(patch[1], patch[0]);
+    fs.writeFileSync(filename + '.corrupt', corrupt);
+    assert_throws('Error: Not an asset pack, or a corrupt one.', function() {
+      new AssetPack(filename + '.corrupt');
+    });
+  });
+  fs.unlinkSync(filename + '.corrupt');
+}
+
+function test_gradients() {
+  var SkCanvas = plask.SkCanvas, SkPaint = plask.SkPaint;
+  var stops = [0, 255, 0, 0, 255, 0.5, 0, 255, 0, 255, 1, 0, 0, 255, 255];
+  var a = SkCanvas.create(64, 64), b = SkCanvas.create(64, 64);
+  var paint = new SkPaint();
+
+  // The same gradient from an Array and a Float32Array, the second a hit.
+  var before = SkPaint.shaderCacheStats();
+  paint.setLinearGradientShader(0, 0, 64, 0, stops);
+  a.drawPaint(paint);
+  paint.setLinearGradientShader(0, 0, 64, 0, new Float32Array(stops));
+  b.drawPaint(paint);
+  var stats = SkPaint.shaderCacheStats();
+  assert_eq(before.misses + 1, stats.misses);
+  assert_eq(before.hits + 1, stats.hits);
+  for (var i = 0; i < 64 * 64 * 4; ++i) assert_eq(a[i], b[i]);
+  assert_eq(true, a[(10 * 64 + 0) * 4 + 2] > 240);
+  assert_eq(true, a[(10 * 64 + 63) * 4 + 0] > 240);
+
+  // Tile modes, past the end of a half width gradient.
+  var px = (10 * 64 + 34) * 4;
+  paint.setLinearGradientShader(0, 0, 32, 0, stops, paint.kClampTileMode);
+  a.drawPaint(paint);
+  assert_eq(255, a[px + 0]);
+  paint.setLinearGradientShader(0, 0, 32, 0, stops, paint.kRepeatTileMode);
+  a.drawPaint(paint);
+  assert_eq(true, a[px + 2] > 128);
+  paint.setLinearGradientShader(0, 0, 32, 0, stops, paint.kMirrorTileMode);
+  a.drawPaint(paint);
+  assert_eq(true, a[px + 0] > 128);
+  assert_throws('Error: Invalid tile mode.', function() {
+    paint.setRadialGradientShader(32, 32, 10, stops, 7);
+  });
+  assert_throws('Error: Wrong number of arguments.', function() {
+    paint.setSweepGradientShader(32, 32);
+  });
+
+  // Sweep starts red along the positive x axis, conical is red at the center
+  // of its start circle.
+  paint.setSweepGradientShader(32, 32, stops);
+  a.drawPaint(paint);
+  assert_eq(true, a[(32 * 64 + 60) * 4 + 2] > 200);
+  paint.setTwoPointConicalGradientShader(32, 32, 0, 32, 32, 30, stops);
+  a.drawPaint(paint);
+  assert_eq(true, a[(32 * 64 + 32) * 4 + 2] > 200);
+
+  // A new gradient every frame of an animation is a miss, the same ones on
+  // the next loop are hits, and a size of 0 turns the cache off.
+  stats = SkPaint.shaderCacheStats();
+  for (var loop = 0; loop < 2; ++loop) {
+    for (var f = 0; f < 10; ++f)
+      paint.setRadialGradientShader(32, 32, 10 + f, stops, paint.kMirrorTileMode);
+  }
+  assert_eq(stats.misses + 10, SkPaint.shaderCacheStats().misses);
+  assert_eq(stats.hits + 10, SkPaint.shaderCacheStats().hits);
+  SkPaint.setShaderCacheSize(0);
+  assert_eq(0, SkPaint.shaderCacheStats().entries);
+  paint.setRadialGradientShader(32, 32, 10, stops);
+  a.drawPaint(paint);
+  assert_eq(true, a[(32 * 64 + 32) * 4 + 2] > 200);
+  assert_eq(0, SkPaint.shaderCacheStats().entries);
+  SkPaint.setShaderCacheSize(stats.maxEntries);
+  a.dispose(); b.dispose();
+}
+
 test_path();
 test_fracts();
+test_stats();
+test_atlas();
+test_canvas_pool();
+test_path_cache();
+test_asset_pack();
+test_gradients();
@@ -0,0 +1,82 @@
+// Measure the cost of plask.trace, both stopped (which should be about free,
+// since begin() / end() are left in simpleWindow redraw) and recording.  Also
+// check that the exported trace is valid JSON containing what was recorded.
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var plask = require('plask');
+
+var kIterations = 1000000;
+
+function time_ns(cb) {
+  var start = process.hrtime();
+  cb();
+  var diff = process.hrtime(start);
+  return diff[0] * 1e9 + diff[1];
+}
+
+function report(name, total_ns, iterations) {
+  console.log(name + ': ' + (total_ns / iterations).toFixed(1) + ' ns/iter');
+}
+
+var trace = plask.trace;
+var sink = 0;
+
+var baseline = time_ns(function() {
+  for (var i = 0; i < kIterations; ++i) sink += i;
+});
+report('baseline loop', baseline, kIterations);
+
+var stopped = time_ns(function() {
+  for (var i = 0; i < kIterations; ++i) {
+    trace.begin('iter'); sink += i; trace.end();
+  }
+});
+report('begin/end stopped', stopped, kIterations);
+
+trace.clear();
+trace.start();
+var recording = time_ns(function() {
+  for (var i = 0; i < kIterations; ++i) {
+    trace.begin('iter'); sink += i; trace.end();
+  }
+});
+trace.stop();
+report('begin/end recording', recording, kIterations);
+
+// Native scopes, an image decode is traced under the "image" category.
+var canvas = plask.SkCanvas.create(512, 512);
+var paint = new plask.SkPaint();
+paint.setLinearGradientShader(0, 0, 512, 512, [0, 255, 0, 0, 255, 1, 0, 0, 255, 255]);
+canvas.drawPaint(paint);
+var png_filename = path.join(os.tmpdir(), 'plask_trace_overhead.png');
+canvas.writeImage('png', png_filename);
+
+var kDecodes = 50;
+function decode_all() {
+  for (var i = 0; i < kDecodes; ++i)
+    plask.SkCanvas.createFromImage(png_filename);
+}
+report('decode stopped', time_ns(decode_all), kDecodes);
+trace.start();
+report('decode recording', time_ns(decode_all), kDecodes);
+trace.stop();
+fs.unlinkSync(png_filename);
+
+var json = JSON.parse(trace.toJSON());
+var num_js = 0, num_decode = 0, num_thread_names = 0;
+json.traceEvents.forEach(function(e) {
+  if (e.ph === 'M' && e.name === 'thread_name') ++num_thread_names;
+  if (e.ph === 'X' && e.cat === 'js' && e.name === 'iter') ++num_js;
+  if (e.ph === 'X' && e.cat === 'image' && e.name === 'decode') ++num_decode;
+});
+// The per thread ring keeps the last 65536 events.
+console.log('events: ' + json.traceEvents.length);
+if (num_js === 0) throw 'Expected recorded js events.';
+if (num_decode !== kDecodes) throw 'Expected ' + kDecodes + ' decode events.';
+if (num_thread_names === 0) throw 'Expected a thread_name metadata event.';
+trace.clear();
+if (JSON.parse(trace.toJSON()).traceEvents.some(function(e) {
+  return e.ph === 'X';
+})) throw 'Expected clear() to discard events.';
@@ -0,0 +1,50 @@
+// Test plask.Worker: transferring typed arrays both ways without copies, Skia
+// in the worker, uncaught exceptions, and exit.
+
+var plask = require('plask');
+var test_utils = require('./test_utils');
+var assert_eq = test_utils.assert_eq, assert_throws = test_utils.assert_throws;
+
+var kN = 1 << 20;
+var values = new Float32Array(kN);
+for (var i = 0; i < kN; ++i) values[i] = i & 0xff;
+
+var worker = new plask.Worker(__dirname + '/worker/worker.js');
+var received = [ ], num_errors = 0;
+
+worker.on('message', function(data) {
+  received.push(data.op);
+  if (data.op === 'double' && data.values.length === kN) {
+    assert_eq(254, data.values[127]);
+    assert_eq(kN / 256 * (255 * 256 / 2), data.sum);
+    // A received buffer can be transferred on again.
+    worker.postMessage({op: 'double', values: data.values.subarray(0, 4)});
+    assert_eq(0, data.values.length);
+  } else if (data.op === 'double') {
+    assert_eq('0,4,8,12', Array.prototype.join.call(data.values, ','));
+    assert_eq(12, data.sum);
+  } else if (data.op === 'path') {
+    assert_eq('10,20,30,60', data.bounds.join(','));
+    assert_eq('255,0', data.pixel.join(','));
+    worker.postMessage({op: 'throw'});
+    worker.postMessage({op: 'close'});
+  }
+});
+
+worker.on('error', function(err) {
+  ++num_errors;
+  if (!/from worker/.test(err.message)) throw err;
+});
+
+worker.on('exit', function() {
+  assert_eq('double,path,double', received.join(','));
+  assert_eq(1, num_errors);
+  assert_throws('Error: Worker has exited.', function() {
+    worker.postMessage({op: 'close'});
+  });
+  console.log('ok');
+});
+
+worker.postMessage({op: 'double', values: values});
+assert_eq(0, values.length);  // Transferred, no longer ours.
+worker.postMessage({op: 'path'});
@@ -0,0 +1,33 @@
+// The worker side of tests/worker.js.
+
+var plask = require('plask');
+
+onmessage = function(e) {
+  var data = e.data;
+  switch (data.op) {
+    case 'double':  // Double in place and send the same memory back.
+      var sum = 0;
+      for (var i = 0; i < data.values.length; ++i) {
+        sum += data.values[i];
+        data.values[i] *= 2;
+      }
+      postMessage({op: 'double', sum: sum, values: data.values});
+      break;
+    case 'path':  // Skia is available off the main thread.
+      var path = new plask.SkPath();
+      path.addRect(10, 20, 30, 60);
+      var canvas = plask.SkCanvas.create(64, 64);
+      var paint = new plask.SkPaint();
+      paint.setColor(255, 0, 0, 255);
+      canvas.drawPath(paint, path);
+      postMessage({op: 'path', bounds: path.getBounds(),
+                   pixel: [canvas[(40 * 64 + 20) * 4 + 2],
+                           canvas[(0 * 64 + 0) * 4 + 2]]});
+      break;
+    case 'throw':
+      throw new Error('from worker');
+    case 'close':
+      close();
+      break;
+  }
+};
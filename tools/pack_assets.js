@@ -0,0 +1,48 @@
+// Build a Plask asset pack from image files.
+//
+//   Plask tools/pack_assets.js out.plaskpak images/ logo.png ...
+//
+// Directories are walked recursively for image files.  Each image is named by
+// its path relative to the directory given on the command line (or just its
+// filename for a file given directly), so images/ui/button.png is loaded with
+// SkCanvas.createFromPack('out.plaskpak', 'ui/button.png').
+
+var fs = require('fs');
+var path = require('path');
+var plask = require('plask');
+
+var kImageExtensions = ['.png', '.jpg', '.jpeg', '.gif', '.tif', '.tiff',
+                        '.bmp', '.tga', '.psd', '.exr', '.hdr', '.webp'];
+
+function collect(dir, prefix, out) {
+  fs.readdirSync(dir).sort().forEach(function(entry) {
+    if (entry.charAt(0) === '.') return;
+    var filename = path.join(dir, entry);
+    if (fs.statSync(filename).isDirectory()) {
+      collect(filename, prefix + entry + '/', out);
+    } else if (kImageExtensions.indexOf(path.extname(entry).toLowerCase()) !== -1) {
+      out.push({name: prefix + entry, path: filename});
+    }
+  });
+}
+
+var args = process.argv.slice(2);
+if (args.length < 2) {
+  console.log('Usage: pack_assets.js out.plaskpak (image or directory)...');
+  process.exit(1);
+}
+
+var assets = [ ];
+args.slice(1).forEach(function(arg) {
+  if (fs.statSync(arg).isDirectory()) {
+    collect(arg, '', assets);
+  } else {
+    assets.push({name: path.basename(arg), path: arg});
+  }
+});
+
+var start = Date.now();
+var res = plask.AssetPack.write(args[0], assets);
+console.log('Wrote ' + res.count + ' images, ' +
+            (res.byteLength / (1 << 20)).toFixed(1) + ' MB, to ' + args[0] +
+            ' in ' + ((Date.now() - start) / 1000).toFixed(1) + 's.');